@@ -36,7 +36,7 @@ extern void nds_update_input(void);
 
 // Timer code stolen from SDL (LGPL)
 
-#define timers2ms(tlow,thigh)(tlow | (thigh<<16)) >> 5
+#define timers2ms(tlow,thigh)((Uint32)(tlow) | ((Uint32)(thigh)<<16)) >> 5
 
 void delay(Uint32 ms)
 {
@@ -51,6 +51,33 @@ Uint32 get_ticks(void)
   return timers2ms(TIMER0_DATA, TIMER1_DATA);
 }
 
+// The cascaded timers are a 32-bit count at about 32.7kHz that wraps every
+// 36 hours or so. Count the wraps so this clock keeps going up; it only
+// needs to be called once per wrap, which the main loop easily does.
+
+Uint64 get_ticks_us(void)
+{
+  static Uint32 last_ticks;
+  static Uint32 wraps;
+  Uint32 high, low;
+  Uint32 ticks;
+
+  // TIMER1 may go up between the two reads
+  do
+  {
+    high = TIMER1_DATA;
+    low = TIMER0_DATA;
+  }
+  while(high != TIMER1_DATA);
+
+  ticks = (Uint32)(low | (high << 16));
+  if(ticks < last_ticks)
+    wraps++;
+
+  last_ticks = ticks;
+  return ((((Uint64)wraps << 32) | ticks) * 1000) >> 5;
+}
+
 static void timer_init(void)
 {
   // TIMER0, TIMER1: Tick timer
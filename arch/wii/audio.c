@@ -60,7 +60,7 @@ static void voice_callback(s32 voice)
   LWP_ThreadSignal(audio_queue);
 }
 
-void init_audio_platform(struct config_info *conf)
+bool init_audio_platform(struct config_info *conf)
 {
   int i;
 
@@ -87,7 +87,10 @@ void init_audio_platform(struct config_info *conf)
     ASND_SetVoice(0, VOICE_STEREO_16BIT, audio.output_frequency, 0,
      audio_buffer[0], buffer_size, 255, 255, voice_callback);
     ASND_Pause(0);
+    return true;
   }
+
+  return false;
 }
 
 void quit_audio_platform(void)
@@ -26,9 +26,19 @@ __M_BEGIN_DECLS
 
 #define BOOL _BOOL
 #include <ogc/mutex.h>
+#include <ogc/cond.h>
+#include <ogc/lwp.h>
 #undef BOOL
 
 typedef mutex_t platform_mutex;
+typedef cond_t platform_cond;
+typedef lwp_t platform_thread;
+
+#define THREAD_RES void *
+#define THREAD_RETURN do { return NULL; } while(0)
+
+#define THREAD_STACKSIZE 65536
+#define THREAD_PRIORITY 64
 
 static inline void platform_mutex_init(platform_mutex *mutex)
 {
@@ -36,6 +46,11 @@ static inline void platform_mutex_init(platform_mutex *mutex)
   LWP_MutexInit(mutex, false);
 }
 
+static inline void platform_mutex_destroy(platform_mutex *mutex)
+{
+  LWP_MutexDestroy(*mutex);
+}
+
 static inline bool platform_mutex_lock(platform_mutex *mutex)
 {
   if(LWP_MutexLock(*mutex))
@@ -50,6 +65,42 @@ static inline bool platform_mutex_unlock(platform_mutex *mutex)
   return true;
 }
 
+static inline void platform_cond_init(platform_cond *cond)
+{
+  LWP_CondInit(cond);
+}
+
+static inline bool platform_cond_wait(platform_cond *cond,
+ platform_mutex *mutex)
+{
+  if(LWP_CondWait(*cond, *mutex))
+    return false;
+  return true;
+}
+
+static inline bool platform_cond_broadcast(platform_cond *cond)
+{
+  if(LWP_CondBroadcast(*cond))
+    return false;
+  return true;
+}
+
+static inline bool platform_thread_create(platform_thread *thread,
+ THREAD_RES (*start_function)(void *), void *data)
+{
+  // libogc allocates the stack when it isn't given one
+  if(LWP_CreateThread(thread, start_function, data, NULL,
+   THREAD_STACKSIZE, THREAD_PRIORITY) < 0)
+    return false;
+  return true;
+}
+
+static inline void platform_thread_join(platform_thread *thread)
+{
+  void *dud;
+  LWP_JoinThread(*thread, &dud);
+}
+
 __M_END_DECLS
 
 #endif // __MUTEX_WII_H
@@ -77,6 +77,11 @@ Uint32 get_ticks(void)
   return ticks_to_millisecs(gettime() - timebase_offset);
 }
 
+Uint64 get_ticks_us(void)
+{
+  return ticks_to_microsecs(gettime() - timebase_offset);
+}
+
 bool platform_init(void)
 {
   timebase_offset = gettime();
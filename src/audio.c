@@ -35,6 +35,7 @@
 #include "configure.h"
 #include "fsafeopen.h"
 #include "util.h"
+#include "trace.h"
 
 // For WAV loader fallback
 #ifdef CONFIG_SDL
@@ -74,9 +75,26 @@ struct wav_info
   Uint32 loop_end;
 };
 
+// Decoded WAV data, keyed by file name and modification time. Entries are
+// shared by all of the streams playing them and only evicted once none are.
+// The list is in least recently used order and protected by the audio lock.
+
+struct sample_cache_entry
+{
+  struct sample_cache_entry *next;
+  struct wav_info info;
+  Uint8 *wav_data;
+  Uint32 data_length;
+  Uint32 refcount;
+  bool cached;
+  time_t mtime;
+  char filename[MAX_PATH];
+};
+
 struct wav_stream
 {
   struct sampled_stream s;
+  struct sample_cache_entry *sample;
   Uint8 *wav_data;
   Uint32 data_offset;
   Uint32 data_length;
@@ -102,6 +120,9 @@ static const int default_period = 428;
 // May be used by audio plugins
 struct audio audio;
 
+// The audio lock is only taken by the threads that send commands to the
+// mixer (the game thread and the module loader), never by audio_callback.
+
 #define __lock()      platform_mutex_lock(&audio.audio_mutex)
 #define __unlock()    platform_mutex_unlock(&audio.audio_mutex)
 
@@ -145,6 +166,67 @@ static void unlock(const char *file, int line)
 
 #endif // DEBUG
 
+// Loads and stores of values shared between the mixer and the other
+// threads without a lock. MSVC gives volatile accesses these semantics.
+
+#if defined(__GNUC__)
+#define load_acquire(ptr)       __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define store_release(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#else
+#define load_acquire(ptr)       (*(volatile Uint32 *)(ptr))
+#define store_release(ptr, val) (*(volatile Uint32 *)(ptr) = (val))
+#endif
+
+// Modules are loaded by a background thread so board changes don't stall
+// the game while big modules are read, converted and parsed. The old
+// module keeps playing until the new one replaces it. Modules for the
+// boards next to the current one are loaded ahead of time too.
+
+#define MAX_PREFETCH_MODULES 4
+
+struct prefetched_module
+{
+  char filename[MAX_PATH];
+  struct audio_stream *stream;
+  bool tried;
+};
+
+struct module_loader
+{
+  platform_thread thread;
+  platform_mutex mutex;
+  platform_cond cond;
+  bool running;
+  bool quit;
+
+  // The plugins aren't safe to load more than one module at a time with
+  platform_mutex plugin_mutex;
+
+  // The module load_module asked for last. request_id changes on every
+  // load_module/end_module, so a module that was superseded while it was
+  // loading can be thrown away.
+  char request[MAX_PATH];
+  Uint32 request_volume;
+  Uint32 request_id;
+  bool request_pending;
+  bool busy;
+
+  struct prefetched_module prefetch[MAX_PREFETCH_MODULES];
+  int num_prefetch;
+};
+
+static struct module_loader loader;
+
+enum audio_output_type
+{
+  AUDIO_OUTPUT_DEVICE,
+  AUDIO_OUTPUT_WAV,
+  AUDIO_OUTPUT_NULL
+};
+
+// Where mixed audio goes (the audio_output config option)
+static enum audio_output_type audio_output;
+
 static const int freq_conversion = 3579364;
 
 // Macros are used to generate functions to help reduce redundancy and
@@ -197,12 +279,14 @@ static const int freq_conversion = 3579364;
    frac_index) >> FP_SHIFT) + c) * frac_index) >> FP_SHIFT) + s1) >>    \
    FP_SHIFT)                                                            \
 
+// The loops pick up wherever the vectorized mixers (below) left off.
+
 #define RESAMPLE_LOOP_HEADER                                            \
-  for(i = 0; i < write_len; i += 2, s_index += d)                       \
+  for(; i < write_len; i += 2, s_index += d)                            \
   {                                                                     \
 
 #define FLAT_LOOP_HEADER(channels)                                      \
-  for(i = 0, i2 = 0; i < write_len; i += 2, i2 += channels)             \
+  for(i2 = i / 2 * channels; i < write_len; i += 2, i2 += channels)     \
   {                                                                     \
 
 #define NEAREST_LOOP_HEADER(dummy)                                      \
@@ -264,6 +348,7 @@ static const int freq_conversion = 3579364;
 case num:                                                               \
 {                                                                       \
   type##_HEADER                                                         \
+  type##_SIMD(2)                                                        \
   type##_LOOP_HEADER(2)                                                 \
   type##_SETUP_INDEX(2)                                                 \
   type##_MIX_SAMPLE(dest_buffer[i] +=, 2, 0) mod;                       \
@@ -277,6 +362,7 @@ case num:                                                               \
 {                                                                       \
   Sint32 current_sample;                                                \
   type##_HEADER                                                         \
+  type##_SIMD(1)                                                        \
   type##_LOOP_HEADER(1)                                                 \
   type##_SETUP_INDEX(1)                                                 \
   type##_MIX_SAMPLE(current_sample =, 1, 0) mod;                        \
@@ -292,6 +378,658 @@ case num:                                                               \
   SETUP_MIXER(type, (num * 4) + 2, VOL)                                 \
   SETUP_MIXER_MONO(type, (num * 4) + 3, VOL)                            \
 
+// Vectorized versions of the mixers above, for as much of the buffer as
+// fits in whole vectors (the rest is left to the mixers above). They work
+// on four Sint32 lanes and give exactly the same results, including the
+// rounding of the fixed point math; cubic only needs 32 bits per lane
+// because a, b and c are always multiples of 1 << 12 and the products
+// with frac_index are split in two. SSE2 and NEON are part of the base
+// x86-64 and ARMv8 instruction sets, so they're chosen at compile time;
+// the AVX2 versions further down are chosen at runtime.
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+ (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+
+#include <emmintrin.h>
+
+#define MIX_SIMD
+
+typedef __m128i mix_vec;
+
+#define mix_set1(a)         _mm_set1_epi32(a)
+#define mix_set(a, b, c, d) _mm_set_epi32(d, c, b, a)
+#define mix_add(a, b)       _mm_add_epi32(a, b)
+#define mix_sub(a, b)       _mm_sub_epi32(a, b)
+#define mix_and(a, b)       _mm_and_si128(a, b)
+#define mix_sra(a, n)       _mm_srai_epi32(a, n)
+#define mix_sll(a, n)       _mm_slli_epi32(a, n)
+
+// SSE2 only multiplies the even lanes, so do it twice
+static inline mix_vec mix_mul(mix_vec a, mix_vec b)
+{
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+   _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline mix_vec mix_load_s16(Sint16 *src)
+{
+  __m128i v = _mm_loadl_epi64((__m128i *)src);
+  return _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+}
+
+// Two samples from a, then two samples from b
+static inline mix_vec mix_load_pairs(Sint16 *a, Sint16 *b)
+{
+  Sint32 a_pair, b_pair;
+  __m128i v;
+
+  memcpy(&a_pair, a, sizeof(Sint32));
+  memcpy(&b_pair, b, sizeof(Sint32));
+  v = _mm_unpacklo_epi32(_mm_cvtsi32_si128(a_pair),
+   _mm_cvtsi32_si128(b_pair));
+  return _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+}
+
+// Add to four Sint32s of the mix buffer
+static inline void mix_accumulate(Sint32 *dest, mix_vec v)
+{
+  _mm_storeu_si128((__m128i *)dest,
+   _mm_add_epi32(_mm_loadu_si128((__m128i *)dest), v));
+}
+
+// Add mono samples to both channels of eight Sint32s of the mix buffer
+static inline void mix_accumulate_mono(Sint32 *dest, mix_vec v)
+{
+  mix_accumulate(dest, _mm_unpacklo_epi32(v, v));
+  mix_accumulate(dest + 4, _mm_unpackhi_epi32(v, v));
+}
+
+static inline void clip_samples(Sint16 *dest, Sint32 *src)
+{
+  _mm_storeu_si128((__m128i *)dest,
+   _mm_packs_epi32(_mm_loadu_si128((__m128i *)src),
+   _mm_loadu_si128((__m128i *)(src + 4))));
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+#define MIX_SIMD
+
+typedef int32x4_t mix_vec;
+
+#define mix_set1(a)       vdupq_n_s32(a)
+#define mix_add(a, b)     vaddq_s32(a, b)
+#define mix_sub(a, b)     vsubq_s32(a, b)
+#define mix_and(a, b)     vandq_s32(a, b)
+#define mix_mul(a, b)     vmulq_s32(a, b)
+#define mix_sra(a, n)     vshrq_n_s32(a, n)
+#define mix_sll(a, n)     vshlq_n_s32(a, n)
+
+static inline mix_vec mix_set(Sint32 a, Sint32 b, Sint32 c, Sint32 d)
+{
+  Sint32 lanes[4] = { a, b, c, d };
+  return vld1q_s32(lanes);
+}
+
+static inline mix_vec mix_load_s16(Sint16 *src)
+{
+  return vmovl_s16(vld1_s16(src));
+}
+
+static inline mix_vec mix_load_pairs(Sint16 *a, Sint16 *b)
+{
+  return mix_set(a[0], a[1], b[0], b[1]);
+}
+
+static inline void mix_accumulate(Sint32 *dest, mix_vec v)
+{
+  vst1q_s32(dest, vaddq_s32(vld1q_s32(dest), v));
+}
+
+static inline void mix_accumulate_mono(Sint32 *dest, mix_vec v)
+{
+  int32x4x2_t both = vzipq_s32(v, v);
+  mix_accumulate(dest, both.val[0]);
+  mix_accumulate(dest + 4, both.val[1]);
+}
+
+static inline void clip_samples(Sint16 *dest, Sint32 *src)
+{
+  vst1q_s16(dest, vcombine_s16(vqmovn_s32(vld1q_s32(src)),
+   vqmovn_s32(vld1q_s32(src + 4))));
+}
+
+#endif
+
+#ifdef MIX_SIMD
+
+// VOL, where dividing rounds towards zero
+static inline mix_vec mix_volume(mix_vec v, mix_vec volume)
+{
+  v = mix_mul(v, volume);
+  return mix_sra(mix_add(v, mix_and(mix_sra(v, 31), mix_set1(255))), 8);
+}
+
+static inline mix_vec mix_linear(mix_vec s1, mix_vec s2, mix_vec frac)
+{
+  return mix_add(s1, mix_sra(mix_mul(frac, mix_sub(s2, s1)), FP_SHIFT));
+}
+
+// (v * frac) >> FP_SHIFT without the 64-bit product
+static inline mix_vec mix_mul_frac(mix_vec v, mix_vec frac)
+{
+  return mix_add(mix_mul(mix_sra(v, FP_SHIFT), frac),
+   mix_sra(mix_mul(mix_and(v, mix_set1(FP_AND)), frac), FP_SHIFT));
+}
+
+static inline mix_vec mix_cubic(mix_vec s0, mix_vec s1, mix_vec s2,
+ mix_vec s3, mix_vec frac)
+{
+  // a, b and c from CUBIC_MIX_SAMPLE, shifted right by 12
+  mix_vec d12 = mix_sub(s1, s2);
+  mix_vec a = mix_add(mix_sub(mix_add(d12, mix_sll(d12, 1)), s0), s3);
+  mix_vec b = mix_sub(mix_add(mix_sll(s2, 2), mix_sll(s0, 1)),
+   mix_add(mix_add(mix_sll(s1, 2), s1), s3));
+  mix_vec c = mix_sub(s2, s0);
+  mix_vec v;
+
+  // (a * frac) >> FP_SHIFT fits in 32 bits, the other two products don't
+  v = mix_sra(mix_mul(a, frac), 1);
+  v = mix_mul_frac(mix_add(v, mix_sll(b, 12)), frac);
+  v = mix_mul_frac(mix_add(v, mix_sll(c, 12)), frac);
+  return mix_add(s1, mix_sra(v, FP_SHIFT));
+}
+
+static Uint32 flat_mix_simd(Sint32 *dest, Sint16 *src, Uint32 write_len,
+ Uint32 channels, Sint32 volume)
+{
+  mix_vec vol = mix_set1(volume);
+  mix_vec v;
+  Uint32 i;
+
+  if(channels == 2)
+  {
+    for(i = 0; i + 4 <= write_len; i += 4)
+    {
+      v = mix_load_s16(src + i);
+      if(volume != 256)
+        v = mix_volume(v, vol);
+      mix_accumulate(dest + i, v);
+    }
+  }
+  else
+  {
+    for(i = 0; i + 8 <= write_len; i += 8)
+    {
+      v = mix_load_s16(src + i / 2);
+      if(volume != 256)
+        v = mix_volume(v, vol);
+      mix_accumulate_mono(dest + i, v);
+    }
+  }
+
+  return i;
+}
+
+// The next source frame's index in the buffer (and its fraction)
+
+#define NEXT_INDEX(index, channels)                                     \
+  index = (Sint32)(*s_index >> FP_SHIFT) * channels;                    \
+  *s_index += d;                                                        \
+
+#define NEXT_FRAME(index, frac, channels)                               \
+  frac = (Sint32)(*s_index & FP_AND);                                   \
+  NEXT_INDEX(index, channels)                                           \
+
+static Uint32 nearest_mix_simd(Sint32 *dest, Sint16 *src, Uint32 write_len,
+ Uint32 channels, Sint64 *s_index, Sint64 d, Sint32 volume)
+{
+  mix_vec vol = mix_set1(volume);
+  Sint32 ia, ib, ic, id;
+  mix_vec v;
+  Uint32 i;
+
+  if(channels == 2)
+  {
+    for(i = 0; i + 4 <= write_len; i += 4)
+    {
+      NEXT_INDEX(ia, 2)
+      NEXT_INDEX(ib, 2)
+      v = mix_load_pairs(src + ia, src + ib);
+      if(volume != 256)
+        v = mix_volume(v, vol);
+      mix_accumulate(dest + i, v);
+    }
+  }
+  else
+  {
+    for(i = 0; i + 8 <= write_len; i += 8)
+    {
+      NEXT_INDEX(ia, 1)
+      NEXT_INDEX(ib, 1)
+      NEXT_INDEX(ic, 1)
+      NEXT_INDEX(id, 1)
+      v = mix_set(src[ia], src[ib], src[ic], src[id]);
+      if(volume != 256)
+        v = mix_volume(v, vol);
+      mix_accumulate_mono(dest + i, v);
+    }
+  }
+
+  return i;
+}
+
+static Uint32 linear_mix_simd(Sint32 *dest, Sint16 *src, Uint32 write_len,
+ Uint32 channels, Sint64 *s_index, Sint64 d, Sint32 volume)
+{
+  mix_vec vol = mix_set1(volume);
+  Sint32 ia, ib, ic, id, fa, fb, fc, fd;
+  mix_vec v;
+  Uint32 i;
+
+  if(channels == 2)
+  {
+    for(i = 0; i + 4 <= write_len; i += 4)
+    {
+      NEXT_FRAME(ia, fa, 2)
+      NEXT_FRAME(ib, fb, 2)
+      v = mix_linear(mix_load_pairs(src + ia, src + ib),
+       mix_load_pairs(src + ia + 2, src + ib + 2),
+       mix_set(fa, fa, fb, fb));
+      if(volume != 256)
+        v = mix_volume(v, vol);
+      mix_accumulate(dest + i, v);
+    }
+  }
+  else
+  {
+    for(i = 0; i + 8 <= write_len; i += 8)
+    {
+      NEXT_FRAME(ia, fa, 1)
+      NEXT_FRAME(ib, fb, 1)
+      NEXT_FRAME(ic, fc, 1)
+      NEXT_FRAME(id, fd, 1)
+      v = mix_linear(
+       mix_set(src[ia], src[ib], src[ic], src[id]),
+       mix_set(src[ia + 1], src[ib + 1], src[ic + 1], src[id + 1]),
+       mix_set(fa, fb, fc, fd));
+      if(volume != 256)
+        v = mix_volume(v, vol);
+      mix_accumulate_mono(dest + i, v);
+    }
+  }
+
+  return i;
+}
+
+static Uint32 cubic_mix_simd(Sint32 *dest, Sint16 *src, Uint32 write_len,
+ Uint32 channels, Sint64 *s_index, Sint64 d, Sint32 volume)
+{
+  mix_vec vol = mix_set1(volume);
+  Sint32 ia, ib, ic, id, fa, fb, fc, fd;
+  mix_vec v;
+  Uint32 i;
+
+  if(channels == 2)
+  {
+    for(i = 0; i + 4 <= write_len; i += 4)
+    {
+      NEXT_FRAME(ia, fa, 2)
+      NEXT_FRAME(ib, fb, 2)
+      v = mix_cubic(mix_load_pairs(src + ia - 2, src + ib - 2),
+       mix_load_pairs(src + ia, src + ib),
+       mix_load_pairs(src + ia + 2, src + ib + 2),
+       mix_load_pairs(src + ia + 4, src + ib + 4),
+       mix_set(fa, fa, fb, fb));
+      if(volume != 256)
+        v = mix_volume(v, vol);
+      mix_accumulate(dest + i, v);
+    }
+  }
+  else
+  {
+    for(i = 0; i + 8 <= write_len; i += 8)
+    {
+      NEXT_FRAME(ia, fa, 1)
+      NEXT_FRAME(ib, fb, 1)
+      NEXT_FRAME(ic, fc, 1)
+      NEXT_FRAME(id, fd, 1)
+      v = mix_cubic(
+       mix_set(src[ia - 1], src[ib - 1], src[ic - 1], src[id - 1]),
+       mix_set(src[ia], src[ib], src[ic], src[id]),
+       mix_set(src[ia + 1], src[ib + 1], src[ic + 1], src[id + 1]),
+       mix_set(src[ia + 2], src[ib + 2], src[ic + 2], src[id + 2]),
+       mix_set(fa, fb, fc, fd));
+      if(volume != 256)
+        v = mix_volume(v, vol);
+      mix_accumulate_mono(dest + i, v);
+    }
+  }
+
+  return i;
+}
+
+/* AVX2 doubles the number of lanes, but unlike SSE2 it isn't part of the
+ * base instruction set, so these versions are only used if the CPU has it.
+ * Source samples are fetched with gathers: a 32-bit load at a sample index
+ * is a whole stereo frame, or a mono sample and the one after it.
+ */
+
+#ifdef X86_TARGETS
+
+#include <immintrin.h>
+
+#define MIX_AVX2
+#define MIX_AVX2_TARGET __attribute__((target("avx2")))
+
+typedef __m256i mix_vec8;
+
+static bool mix_use_avx2;
+
+static inline MIX_AVX2_TARGET mix_vec8 mix8_volume(mix_vec8 v,
+ mix_vec8 volume)
+{
+  v = _mm256_mullo_epi32(v, volume);
+  return _mm256_srai_epi32(_mm256_add_epi32(v, _mm256_and_si256(
+   _mm256_srai_epi32(v, 31), _mm256_set1_epi32(255))), 8);
+}
+
+static inline MIX_AVX2_TARGET mix_vec8 mix8_linear(mix_vec8 s1, mix_vec8 s2,
+ mix_vec8 frac)
+{
+  return _mm256_add_epi32(s1, _mm256_srai_epi32(
+   _mm256_mullo_epi32(frac, _mm256_sub_epi32(s2, s1)), FP_SHIFT));
+}
+
+static inline MIX_AVX2_TARGET mix_vec8 mix8_mul_frac(mix_vec8 v,
+ mix_vec8 frac)
+{
+  return _mm256_add_epi32(
+   _mm256_mullo_epi32(_mm256_srai_epi32(v, FP_SHIFT), frac),
+   _mm256_srai_epi32(_mm256_mullo_epi32(
+    _mm256_and_si256(v, _mm256_set1_epi32(FP_AND)), frac), FP_SHIFT));
+}
+
+// Same as mix_cubic
+static inline MIX_AVX2_TARGET mix_vec8 mix8_cubic(mix_vec8 s0, mix_vec8 s1,
+ mix_vec8 s2, mix_vec8 s3, mix_vec8 frac)
+{
+  mix_vec8 d12 = _mm256_sub_epi32(s1, s2);
+  mix_vec8 a = _mm256_add_epi32(_mm256_sub_epi32(
+   _mm256_add_epi32(d12, _mm256_slli_epi32(d12, 1)), s0), s3);
+  mix_vec8 b = _mm256_sub_epi32(
+   _mm256_add_epi32(_mm256_slli_epi32(s2, 2), _mm256_slli_epi32(s0, 1)),
+   _mm256_add_epi32(_mm256_add_epi32(_mm256_slli_epi32(s1, 2), s1), s3));
+  mix_vec8 c = _mm256_sub_epi32(s2, s0);
+  mix_vec8 v;
+
+  v = _mm256_srai_epi32(_mm256_mullo_epi32(a, frac), 1);
+  v = mix8_mul_frac(_mm256_add_epi32(v, _mm256_slli_epi32(b, 12)), frac);
+  v = mix8_mul_frac(_mm256_add_epi32(v, _mm256_slli_epi32(c, 12)), frac);
+  return _mm256_add_epi32(s1, _mm256_srai_epi32(v, FP_SHIFT));
+}
+
+// Four stereo frames starting at the given sample indices
+static inline MIX_AVX2_TARGET mix_vec8 mix8_gather_frames(Sint16 *src,
+ __m128i index)
+{
+  return _mm256_cvtepi16_epi32(_mm_i32gather_epi32((const int *)src,
+   index, 2));
+}
+
+// Eight pairs of mono samples starting at the given sample indices; the
+// first sample of each pair is in the low half
+static inline MIX_AVX2_TARGET mix_vec8 mix8_gather_pairs(Sint16 *src,
+ mix_vec8 index)
+{
+  return _mm256_i32gather_epi32((const int *)src, index, 2);
+}
+
+#define mix8_first(pairs)   _mm256_srai_epi32(_mm256_slli_epi32(pairs, 16), 16)
+#define mix8_second(pairs)  _mm256_srai_epi32(pairs, 16)
+
+static inline MIX_AVX2_TARGET void mix8_accumulate(Sint32 *dest, mix_vec8 v)
+{
+  _mm256_storeu_si256((__m256i *)dest,
+   _mm256_add_epi32(_mm256_loadu_si256((__m256i *)dest), v));
+}
+
+static inline MIX_AVX2_TARGET void mix8_accumulate_mono(Sint32 *dest,
+ mix_vec8 v)
+{
+  mix8_accumulate(dest, _mm256_permutevar8x32_epi32(v,
+   _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3)));
+  mix8_accumulate(dest + 8, _mm256_permutevar8x32_epi32(v,
+   _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7)));
+}
+
+// Sixteen samples; packing works within each half, so put them back in order
+static inline MIX_AVX2_TARGET void clip_samples_avx2(Sint16 *dest,
+ Sint32 *src)
+{
+  _mm256_storeu_si256((__m256i *)dest, _mm256_permute4x64_epi64(
+   _mm256_packs_epi32(_mm256_loadu_si256((__m256i *)src),
+   _mm256_loadu_si256((__m256i *)(src + 8))), _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+MIX_AVX2_TARGET
+static Uint32 flat_mix_avx2(Sint32 *dest, Sint16 *src, Uint32 write_len,
+ Uint32 channels, Sint32 volume)
+{
+  mix_vec8 vol = _mm256_set1_epi32(volume);
+  mix_vec8 v;
+  Uint32 i;
+
+  if(channels == 2)
+  {
+    for(i = 0; i + 8 <= write_len; i += 8)
+    {
+      v = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i *)(src + i)));
+      if(volume != 256)
+        v = mix8_volume(v, vol);
+      mix8_accumulate(dest + i, v);
+    }
+  }
+  else
+  {
+    for(i = 0; i + 16 <= write_len; i += 16)
+    {
+      v = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i *)(src + i / 2)));
+      if(volume != 256)
+        v = mix8_volume(v, vol);
+      mix8_accumulate_mono(dest + i, v);
+    }
+  }
+
+  return i;
+}
+
+MIX_AVX2_TARGET
+static Uint32 nearest_mix_avx2(Sint32 *dest, Sint16 *src, Uint32 write_len,
+ Uint32 channels, Sint64 *s_index, Sint64 d, Sint32 volume)
+{
+  mix_vec8 vol = _mm256_set1_epi32(volume);
+  Sint32 ia, ib, ic, id, index[8];
+  mix_vec8 v;
+  Uint32 i;
+  int i2;
+
+  if(channels == 2)
+  {
+    for(i = 0; i + 8 <= write_len; i += 8)
+    {
+      NEXT_INDEX(ia, 2)
+      NEXT_INDEX(ib, 2)
+      NEXT_INDEX(ic, 2)
+      NEXT_INDEX(id, 2)
+      v = mix8_gather_frames(src, _mm_setr_epi32(ia, ib, ic, id));
+      if(volume != 256)
+        v = mix8_volume(v, vol);
+      mix8_accumulate(dest + i, v);
+    }
+  }
+  else
+  {
+    for(i = 0; i + 16 <= write_len; i += 16)
+    {
+      for(i2 = 0; i2 < 8; i2++)
+      {
+        NEXT_INDEX(index[i2], 1)
+      }
+      v = mix8_gather_pairs(src, _mm256_loadu_si256((__m256i *)index));
+      v = mix8_first(v);
+      if(volume != 256)
+        v = mix8_volume(v, vol);
+      mix8_accumulate_mono(dest + i, v);
+    }
+  }
+
+  return i;
+}
+
+MIX_AVX2_TARGET
+static Uint32 linear_mix_avx2(Sint32 *dest, Sint16 *src, Uint32 write_len,
+ Uint32 channels, Sint64 *s_index, Sint64 d, Sint32 volume)
+{
+  mix_vec8 vol = _mm256_set1_epi32(volume);
+  Sint32 ia, ib, ic, id, fa, fb, fc, fd, index[8], frac[8];
+  __m128i index4;
+  mix_vec8 v;
+  Uint32 i;
+  int i2;
+
+  if(channels == 2)
+  {
+    for(i = 0; i + 8 <= write_len; i += 8)
+    {
+      NEXT_FRAME(ia, fa, 2)
+      NEXT_FRAME(ib, fb, 2)
+      NEXT_FRAME(ic, fc, 2)
+      NEXT_FRAME(id, fd, 2)
+      index4 = _mm_setr_epi32(ia, ib, ic, id);
+      v = mix8_linear(mix8_gather_frames(src, index4),
+       mix8_gather_frames(src, _mm_add_epi32(index4, _mm_set1_epi32(2))),
+       _mm256_setr_epi32(fa, fa, fb, fb, fc, fc, fd, fd));
+      if(volume != 256)
+        v = mix8_volume(v, vol);
+      mix8_accumulate(dest + i, v);
+    }
+  }
+  else
+  {
+    for(i = 0; i + 16 <= write_len; i += 16)
+    {
+      for(i2 = 0; i2 < 8; i2++)
+      {
+        NEXT_FRAME(index[i2], frac[i2], 1)
+      }
+      v = mix8_gather_pairs(src, _mm256_loadu_si256((__m256i *)index));
+      v = mix8_linear(mix8_first(v), mix8_second(v),
+       _mm256_loadu_si256((__m256i *)frac));
+      if(volume != 256)
+        v = mix8_volume(v, vol);
+      mix8_accumulate_mono(dest + i, v);
+    }
+  }
+
+  return i;
+}
+
+MIX_AVX2_TARGET
+static Uint32 cubic_mix_avx2(Sint32 *dest, Sint16 *src, Uint32 write_len,
+ Uint32 channels, Sint64 *s_index, Sint64 d, Sint32 volume)
+{
+  mix_vec8 vol = _mm256_set1_epi32(volume);
+  Sint32 ia, ib, ic, id, fa, fb, fc, fd, index[8], frac[8];
+  __m128i index4;
+  mix_vec8 v, v2, index8;
+  Uint32 i;
+  int i2;
+
+  if(channels == 2)
+  {
+    for(i = 0; i + 8 <= write_len; i += 8)
+    {
+      NEXT_FRAME(ia, fa, 2)
+      NEXT_FRAME(ib, fb, 2)
+      NEXT_FRAME(ic, fc, 2)
+      NEXT_FRAME(id, fd, 2)
+      index4 = _mm_setr_epi32(ia, ib, ic, id);
+      v = mix8_cubic(
+       mix8_gather_frames(src, _mm_sub_epi32(index4, _mm_set1_epi32(2))),
+       mix8_gather_frames(src, index4),
+       mix8_gather_frames(src, _mm_add_epi32(index4, _mm_set1_epi32(2))),
+       mix8_gather_frames(src, _mm_add_epi32(index4, _mm_set1_epi32(4))),
+       _mm256_setr_epi32(fa, fa, fb, fb, fc, fc, fd, fd));
+      if(volume != 256)
+        v = mix8_volume(v, vol);
+      mix8_accumulate(dest + i, v);
+    }
+  }
+  else
+  {
+    for(i = 0; i + 16 <= write_len; i += 16)
+    {
+      for(i2 = 0; i2 < 8; i2++)
+      {
+        NEXT_FRAME(index[i2], frac[i2], 1)
+      }
+      index8 = _mm256_loadu_si256((__m256i *)index);
+      v = mix8_gather_pairs(src,
+       _mm256_sub_epi32(index8, _mm256_set1_epi32(1)));
+      v2 = mix8_gather_pairs(src,
+       _mm256_add_epi32(index8, _mm256_set1_epi32(1)));
+      v = mix8_cubic(mix8_first(v), mix8_second(v),
+       mix8_first(v2), mix8_second(v2), _mm256_loadu_si256((__m256i *)frac));
+      if(volume != 256)
+        v = mix8_volume(v, vol);
+      mix8_accumulate_mono(dest + i, v);
+    }
+  }
+
+  return i;
+}
+
+#define MIX_KERNEL(name) (mix_use_avx2 ? name##_avx2 : name##_simd)
+
+#else // !MIX_AVX2
+
+#define MIX_KERNEL(name) name##_simd
+
+#endif // MIX_AVX2
+
+// Mixing at full volume is the same as not using it
+#define SIMD_VOLUME (volume_mode ? volume : 256)
+
+#define FLAT_SIMD(channels)                                             \
+  i = MIX_KERNEL(flat_mix)(dest_buffer, src_buffer, write_len,          \
+   channels, SIMD_VOLUME);                                              \
+
+#define NEAREST_SIMD(channels)                                          \
+  i = MIX_KERNEL(nearest_mix)(dest_buffer, src_buffer, write_len,       \
+   channels, &s_index, d, SIMD_VOLUME);                                 \
+
+#define LINEAR_SIMD(channels)                                           \
+  i = MIX_KERNEL(linear_mix)(dest_buffer, src_buffer, write_len,        \
+   channels, &s_index, d, SIMD_VOLUME);                                 \
+
+#define CUBIC_SIMD(channels)                                            \
+  i = MIX_KERNEL(cubic_mix)(dest_buffer, src_buffer, write_len,         \
+   channels, &s_index, d, SIMD_VOLUME);                                 \
+
+#else // !MIX_SIMD
+
+#define FLAT_SIMD(channels)     i = 0;
+#define NEAREST_SIMD(channels)  i = 0;
+#define LINEAR_SIMD(channels)   i = 0;
+#define CUBIC_SIMD(channels)    i = 0;
+
+#endif // MIX_SIMD
 
 // WAV sample types
 
@@ -786,20 +1524,11 @@ static void pcs_set_volume(struct audio_stream *a_src, Uint32 volume)
   ((struct pc_speaker_stream *)a_src)->volume = volume;
 }
 
+// Streams are only ever destroyed once the mixer is done with them (see
+// collect_audio_garbage), so they aren't in the stream list anymore.
+
 static void destruct_audio_stream(struct audio_stream *a_src)
 {
-  if(a_src == audio.stream_list_base)
-    audio.stream_list_base = a_src->next;
-
-  if(a_src == audio.stream_list_end)
-    audio.stream_list_end = a_src->previous;
-
-  if(a_src->next)
-    a_src->next->previous = a_src->previous;
-
-  if(a_src->previous)
-    a_src->previous->next = a_src->next;
-
   free(a_src);
 }
 
@@ -817,10 +1546,138 @@ static void vorbis_destruct(struct audio_stream *a_src)
   sampled_destruct(a_src);
 }
 
+static void free_sample_cache_entry(struct sample_cache_entry *entry)
+{
+  free(entry->wav_data);
+  free(entry);
+}
+
+static void unlink_sample_cache_entry(struct sample_cache_entry *entry)
+{
+  struct sample_cache_entry **prev = &(audio.sample_cache);
+
+  while(*prev != entry)
+    prev = &((*prev)->next);
+
+  *prev = entry->next;
+  entry->next = NULL;
+  entry->cached = false;
+  audio.sample_cache_size -= entry->data_length;
+}
+
+// Evict the least recently used samples nothing is playing until the
+// cache fits in its limit again.
+
+static void trim_sample_cache(void)
+{
+  struct sample_cache_entry *current, *oldest;
+
+  while(audio.sample_cache_size > audio.sample_cache_limit)
+  {
+    oldest = NULL;
+
+    for(current = audio.sample_cache; current; current = current->next)
+      if(!current->refcount)
+        oldest = current;
+
+    if(!oldest)
+      break;
+
+    unlink_sample_cache_entry(oldest);
+    free_sample_cache_entry(oldest);
+  }
+}
+
+static struct sample_cache_entry *get_sample_cache_entry(
+ const char *filename, time_t mtime)
+{
+  struct sample_cache_entry **prev = &(audio.sample_cache);
+  struct sample_cache_entry *current;
+
+  while(*prev)
+  {
+    current = *prev;
+
+    if(!strcmp(current->filename, filename))
+    {
+      // The file changed since it was loaded, so it needs loading again
+      if(current->mtime != mtime)
+      {
+        unlink_sample_cache_entry(current);
+        if(!current->refcount)
+          free_sample_cache_entry(current);
+
+        break;
+      }
+
+      // Move it to the front of the list
+      *prev = current->next;
+      current->next = audio.sample_cache;
+      audio.sample_cache = current;
+
+      current->refcount++;
+      audio.sample_cache_hits++;
+      return current;
+    }
+
+    prev = &(current->next);
+  }
+
+  audio.sample_cache_misses++;
+  return NULL;
+}
+
+static void put_sample_cache_entry(struct sample_cache_entry *entry)
+{
+  if(entry->data_length > audio.sample_cache_limit)
+    return;
+
+  entry->next = audio.sample_cache;
+  entry->cached = true;
+  audio.sample_cache = entry;
+  audio.sample_cache_size += entry->data_length;
+
+  trim_sample_cache();
+}
+
+static void release_sample_cache_entry(struct sample_cache_entry *entry)
+{
+  entry->refcount--;
+
+  if(!entry->cached)
+  {
+    if(!entry->refcount)
+      free_sample_cache_entry(entry);
+  }
+  else
+    trim_sample_cache();
+}
+
+static void clear_sample_cache(void)
+{
+  struct sample_cache_entry *current = audio.sample_cache;
+  struct sample_cache_entry *next;
+
+  while(current)
+  {
+    next = current->next;
+    current->next = NULL;
+    current->cached = false;
+
+    if(!current->refcount)
+      free_sample_cache_entry(current);
+
+    current = next;
+  }
+
+  audio.sample_cache = NULL;
+  audio.sample_cache_size = 0;
+}
+
 static void wav_destruct(struct audio_stream *a_src)
 {
   struct wav_stream *w_stream = (struct wav_stream *)a_src;
-  free(w_stream->wav_data);
+  release_sample_cache_entry(w_stream->sample);
   sampled_destruct(a_src);
 }
 
@@ -841,38 +1698,349 @@ __audio_c_maybe_static void construct_audio_stream(
  void (* destruct)(struct audio_stream *a_src),
  Uint32 volume, Uint32 repeat)
 {
-  a_src->mix_data = mix_data;
-  a_src->set_volume = set_volume;
-  a_src->set_repeat = set_repeat;
-  a_src->set_order = set_order;
-  a_src->set_position = set_position;
-  a_src->get_order = get_order;
-  a_src->get_position = get_position;
-  a_src->destruct = destruct;
+  a_src->mix_data = mix_data;
+  a_src->set_volume = set_volume;
+  a_src->set_repeat = set_repeat;
+  a_src->set_order = set_order;
+  a_src->set_position = set_position;
+  a_src->get_order = get_order;
+  a_src->get_position = get_position;
+  a_src->destruct = destruct;
+
+  if(set_volume)
+    set_volume(a_src, volume);
+
+  if(set_repeat)
+    set_repeat(a_src, repeat);
+
+  // Streams don't play until they're added to the stream list
+  a_src->next = NULL;
+  a_src->previous = NULL;
+}
+
+// The stream list belongs to the mixer. Other threads change what it plays
+// by sending it commands through a single producer/single consumer ring that
+// audio_callback runs before mixing, so neither side ever waits for the
+// other. Streams the mixer is done with go back through a second ring and
+// are destroyed by the sending side, so audio_callback never frees memory.
+
+#define AUDIO_QUEUE_SIZE 1024
+
+enum audio_command_type
+{
+  AUDIO_ADD_STREAM,
+  AUDIO_SET_PRIMARY,
+  AUDIO_END_SAMPLES,
+  AUDIO_SET_ORDER,
+  AUDIO_SET_POSITION,
+  AUDIO_SET_FREQUENCY,
+  AUDIO_SET_MUSIC_VOLUME,
+  AUDIO_SET_SOUND_VOLUME,
+  AUDIO_SET_SFX_VOLUME
+};
+
+struct audio_command
+{
+  enum audio_command_type type;
+  struct audio_stream *stream;
+  Uint32 value;
+};
+
+// What the mixer last reported about the primary stream, along with
+// what was last asked of it that the mixer hasn't seen yet.
+
+struct primary_state
+{
+  Uint32 value;
+  Uint32 requested;
+  Uint32 requested_at;
+};
+
+struct audio_queue
+{
+  struct audio_command commands[AUDIO_QUEUE_SIZE];
+  Uint32 command_write;
+  Uint32 command_read;
+
+  // The command count the reported primary stream state is current for
+  Uint32 commands_done;
+  struct primary_state order;
+  struct primary_state position;
+  struct primary_state frequency;
+
+  struct audio_stream *garbage[AUDIO_QUEUE_SIZE];
+  Uint32 garbage_write;
+  Uint32 garbage_read;
+
+  // Finished streams that didn't fit in the garbage ring (mixer only)
+  struct audio_stream *garbage_overflow;
+
+  // Whether the sending side has given the mixer a primary stream
+  bool has_primary;
+
+  // When the mixer isn't running commands are run as they're sent
+  bool mixer_running;
+};
+
+static struct audio_queue queue;
+
+static void add_audio_stream(struct audio_stream *a_src)
+{
+  if(audio.stream_list_base == NULL)
+  {
+    audio.stream_list_base = a_src;
+  }
+  else
+  {
+    audio.stream_list_end->next = a_src;
+  }
+
+  a_src->previous = audio.stream_list_end;
+  audio.stream_list_end = a_src;
+}
+
+static void flush_audio_garbage(void)
+{
+  Uint32 write = queue.garbage_write;
+  Uint32 read = load_acquire(&(queue.garbage_read));
+  struct audio_stream *a_src;
+
+  while(queue.garbage_overflow && (write - read < AUDIO_QUEUE_SIZE))
+  {
+    a_src = queue.garbage_overflow;
+    queue.garbage_overflow = a_src->next;
+    a_src->next = NULL;
+
+    queue.garbage[write % AUDIO_QUEUE_SIZE] = a_src;
+    write++;
+  }
+
+  store_release(&(queue.garbage_write), write);
+}
+
+// Take a stream out of the stream list and hand it back to be destroyed.
+
+static void retire_audio_stream(struct audio_stream *a_src)
+{
+  if(a_src == audio.stream_list_base)
+    audio.stream_list_base = a_src->next;
+
+  if(a_src == audio.stream_list_end)
+    audio.stream_list_end = a_src->previous;
+
+  if(a_src->next)
+    a_src->next->previous = a_src->previous;
+
+  if(a_src->previous)
+    a_src->previous->next = a_src->next;
+
+  if(a_src == audio.primary_stream)
+    audio.primary_stream = NULL;
+
+  a_src->previous = NULL;
+  a_src->next = queue.garbage_overflow;
+  queue.garbage_overflow = a_src;
+}
+
+static void run_audio_command(struct audio_command *cmd)
+{
+  struct audio_stream *primary = audio.primary_stream;
+  struct audio_stream *current_astream = audio.stream_list_base;
+  struct audio_stream *next_astream;
+
+  switch(cmd->type)
+  {
+    case AUDIO_ADD_STREAM:
+      add_audio_stream(cmd->stream);
+      break;
+
+    case AUDIO_SET_PRIMARY:
+      if(primary)
+        retire_audio_stream(primary);
+
+      if(cmd->stream)
+        add_audio_stream(cmd->stream);
+
+      audio.primary_stream = cmd->stream;
+      break;
+
+    case AUDIO_END_SAMPLES:
+      // Something is a sample if it's not a primary or PC speaker stream.
+      // This is a bit of a dirty way to do it though (might want to keep
+      // multiple lists instead)
+      while(current_astream)
+      {
+        next_astream = current_astream->next;
+
+        if((current_astream != primary) &&
+         (current_astream != (struct audio_stream *)(audio.pcs_stream)))
+          retire_audio_stream(current_astream);
+
+        current_astream = next_astream;
+      }
+      break;
+
+    case AUDIO_SET_ORDER:
+      if(primary && primary->set_order)
+        primary->set_order(primary, cmd->value);
+      break;
+
+    case AUDIO_SET_POSITION:
+      if(primary && primary->set_position)
+        primary->set_position(primary, cmd->value);
+      break;
+
+    case AUDIO_SET_FREQUENCY:
+      // Primary had better be a sampled stream (in reality I can't imagine
+      // ever letting it be anything but, but if it comes up a type
+      // enumeration could weed this out)
+      if(primary)
+      {
+        ((struct sampled_stream *)primary)->set_frequency(
+         (struct sampled_stream *)primary, cmd->value);
+      }
+      break;
+
+    case AUDIO_SET_MUSIC_VOLUME:
+      if(primary)
+        primary->set_volume(primary, cmd->value);
+      break;
+
+    case AUDIO_SET_SOUND_VOLUME:
+      while(current_astream)
+      {
+        if((current_astream != primary) &&
+         (current_astream != (struct audio_stream *)(audio.pcs_stream)))
+          current_astream->set_volume(current_astream, cmd->value);
+
+        current_astream = current_astream->next;
+      }
+      break;
+
+    case AUDIO_SET_SFX_VOLUME:
+      if(audio.pcs_stream)
+      {
+        audio.pcs_stream->a.set_volume(
+         (struct audio_stream *)audio.pcs_stream, cmd->value);
+      }
+      break;
+  }
+}
+
+// Run every command sent since the last call. Only the mixer calls this
+// (or the sending side, while the mixer isn't running).
+
+static void run_audio_commands(void)
+{
+  Uint32 write = load_acquire(&(queue.command_write));
+  Uint32 read = queue.command_read;
+
+  while(read != write)
+  {
+    run_audio_command(queue.commands + (read % AUDIO_QUEUE_SIZE));
+    read++;
+  }
+
+  store_release(&(queue.command_read), read);
+}
+
+// Let the sending side know where the primary stream is. This is done after
+// mixing, so it's current as of the last command that was run.
+
+static void report_primary_state(void)
+{
+  struct audio_stream *primary = audio.primary_stream;
+  Uint32 order = 0;
+  Uint32 position = 0;
+  Uint32 frequency = 0;
+
+  if(primary)
+  {
+    if(primary->get_order)
+      order = primary->get_order(primary);
+
+    if(primary->get_position)
+      position = primary->get_position(primary);
+
+    frequency = ((struct sampled_stream *)primary)->get_frequency(
+     (struct sampled_stream *)primary);
+  }
+
+  store_release(&(queue.order.value), order);
+  store_release(&(queue.position.value), position);
+  store_release(&(queue.frequency.value), frequency);
+  store_release(&(queue.commands_done), queue.command_read);
+}
+
+// Destroy the streams the mixer is done with. The audio lock must be held.
+
+static void collect_audio_garbage(void)
+{
+  Uint32 write = load_acquire(&(queue.garbage_write));
+  Uint32 read = queue.garbage_read;
+  struct audio_stream *a_src;
 
-  if(set_volume)
-    set_volume(a_src, volume);
+  while(read != write)
+  {
+    a_src = queue.garbage[read % AUDIO_QUEUE_SIZE];
+    a_src->destruct(a_src);
+    read++;
+  }
 
-  if(set_repeat)
-    set_repeat(a_src, repeat);
+  store_release(&(queue.garbage_read), read);
+}
 
-  a_src->next = NULL;
+// Send a command to the mixer. The audio lock must be held.
 
-  LOCK();
+static void send_audio_command(enum audio_command_type type,
+ struct audio_stream *a_src, Uint32 value)
+{
+  Uint32 write = queue.command_write;
+  struct audio_command *cmd;
 
-  if(audio.stream_list_base == NULL)
+  collect_audio_garbage();
+
+  // The ring only fills up if the mixer stalls; wait for it to catch up
+  while(write - load_acquire(&(queue.command_read)) >= AUDIO_QUEUE_SIZE)
   {
-    audio.stream_list_base = a_src;
+    if(!queue.mixer_running)
+      break;
+
+    delay(1);
   }
-  else
+
+  cmd = queue.commands + (write % AUDIO_QUEUE_SIZE);
+  cmd->type = type;
+  cmd->stream = a_src;
+  cmd->value = value;
+  store_release(&(queue.command_write), write + 1);
+
+  if(!queue.mixer_running)
   {
-    audio.stream_list_end->next = a_src;
+    run_audio_commands();
+    report_primary_state();
+    flush_audio_garbage();
+    collect_audio_garbage();
   }
+}
 
-  a_src->previous = audio.stream_list_end;
-  audio.stream_list_end = a_src;
+// Remember a value the primary stream was just asked to change to, since
+// the mixer may not have gotten to it yet.
 
-  UNLOCK();
+static void request_primary_state(struct primary_state *state, Uint32 value)
+{
+  state->requested = value;
+  state->requested_at = queue.command_write;
+}
+
+static Uint32 get_primary_state(struct primary_state *state)
+{
+  Uint32 done = load_acquire(&(queue.commands_done));
+
+  if((Sint32)(done - state->requested_at) < 0)
+    return state->requested;
+
+  return load_acquire(&(state->value));
 }
 
 __audio_c_maybe_static void initialize_sampled_stream(
@@ -1374,164 +2542,451 @@ int check_ext_for_gdm_and_convert(const char *filename, char *new_file)
       FILE *f = fopen_unsafe(translated_filename_dest, "r");
       long file_len = ftell_and_rewind(f);
 
-      fclose(f);
-      if(file_len > 0)
-        return 1;
+      fclose(f);
+      if(file_len > 0)
+        return 1;
+    }
+
+    /* In the case we need to convert the GDM, we need to find
+     * the real source path for it. Translate accordingly.
+     */
+    if(!fsafetranslate(filename, translated_filename_dest))
+      convert_gdm_s3m(translated_filename_dest, new_file);
+    return 1;
+  }
+
+  return 0;
+}
+
+#endif // CONFIG_MODPLUG
+
+static struct sample_cache_entry *load_sample(char *filename)
+{
+  struct sample_cache_entry *entry;
+  struct wav_info w_info = {0,0,0,0,0};
+  char new_file[MAX_PATH];
+  Uint32 data_length = 0;
+  Uint8 *wav_data = NULL;
+  struct stat file_info;
+  bool use_cache = false;
+
+  // Samples played before don't need to be converted or loaded again,
+  // unless they were modified since.
+  if(audio.sample_cache_limit && (strlen(filename) < MAX_PATH) &&
+   !stat(filename, &file_info))
+  {
+    LOCK();
+    entry = get_sample_cache_entry(filename, file_info.st_mtime);
+    UNLOCK();
+
+    if(entry)
+      return entry;
+
+    use_cache = true;
+  }
+
+  check_ext_for_sam_and_convert(filename, new_file);
+
+  if(!load_wav_file(new_file, &w_info, &wav_data, &data_length))
+    return NULL;
+
+  // Surround WAVs not supported yet..
+  if(w_info.channels > 2)
+  {
+    free(wav_data);
+    return NULL;
+  }
+
+  entry = cmalloc(sizeof(struct sample_cache_entry));
+  entry->next = NULL;
+  entry->info = w_info;
+  entry->wav_data = wav_data;
+  entry->data_length = data_length;
+  entry->refcount = 1;
+  entry->cached = false;
+
+  if(use_cache)
+  {
+    strcpy(entry->filename, filename);
+    entry->mtime = file_info.st_mtime;
+
+    LOCK();
+    put_sample_cache_entry(entry);
+    UNLOCK();
+  }
+
+  return entry;
+}
+
+// The stream takes over the reference to the sample
+
+static struct audio_stream *construct_sample_stream(
+ struct sample_cache_entry *sample, Uint32 frequency, Uint32 volume,
+ Uint32 repeat)
+{
+  struct wav_info *w_info = &(sample->info);
+  struct wav_stream *w_stream;
+
+  w_stream = cmalloc(sizeof(struct wav_stream));
+
+  w_stream->sample = sample;
+  w_stream->wav_data = sample->wav_data;
+  w_stream->data_length = sample->data_length;
+  w_stream->channels = w_info->channels;
+  w_stream->data_offset = 0;
+  w_stream->format = w_info->format;
+  w_stream->natural_frequency = w_info->freq;
+  w_stream->bytes_per_sample = w_info->channels;
+  w_stream->loop_start = w_info->loop_start;
+  w_stream->loop_end = w_info->loop_end;
+
+  if((w_info->format != SAMPLE_U8) && (w_info->format != SAMPLE_S8))
+    w_stream->bytes_per_sample *= 2;
+
+  initialize_sampled_stream((struct sampled_stream *)w_stream,
+   wav_set_frequency, wav_get_frequency, frequency,
+   w_info->channels, 1);
+
+  construct_audio_stream((struct audio_stream *)w_stream,
+   wav_mix_data, wav_set_volume, wav_set_repeat,
+   NULL, wav_set_position, NULL, wav_get_position, wav_destruct,
+   volume, repeat);
+
+  return (struct audio_stream *)w_stream;
+}
+
+static struct audio_stream *construct_wav_stream(char *filename,
+ Uint32 frequency, Uint32 volume, Uint32 repeat)
+{
+  struct sample_cache_entry *sample = load_sample(filename);
+
+  if(!sample)
+    return NULL;
+
+  return construct_sample_stream(sample, frequency, volume, repeat);
+}
+
+static struct audio_stream *construct_pc_speaker_stream(void)
+{
+  struct pc_speaker_stream *pcs_stream;
+
+  if(!audio.sfx_on)
+    return NULL;
+
+  pcs_stream = ccalloc(1, sizeof(struct pc_speaker_stream));
+
+  construct_audio_stream((struct audio_stream *)pcs_stream, pcs_mix_data,
+   pcs_set_volume, NULL, NULL, NULL, NULL, NULL, pcs_destruct,
+   audio.sfx_volume * 255 / 8, 0);
+
+  LOCK();
+  send_audio_command(AUDIO_ADD_STREAM, (struct audio_stream *)pcs_stream, 0);
+  UNLOCK();
+
+  return (struct audio_stream *)pcs_stream;
+}
+
+static struct audio_stream *construct_stream_audio_file(char *filename,
+ Uint32 frequency, Uint32 volume, Uint32 repeat)
+{
+  const char *const *exts = mod_gdm_ext;
+  struct audio_stream *a_return = NULL;
+  size_t ext_pos, len = strlen(filename);
+
+  if(!audio.music_on)
+    return NULL;
+
+  // check string contains a valid extension (no ext isn't valid)
+  if(len >= 4 && filename[len - 4] == '.')
+    ext_pos = len - 4;
+  else if(len >= 3 && filename[len - 3] == '.')
+    ext_pos = len - 3;
+  else
+    return NULL;
+
+  // ogg music is special cased
+  if(!strcasecmp(filename + ext_pos, ".ogg"))
+  {
+    a_return = construct_vorbis_stream(filename, frequency,
+      volume, repeat);
+  }
+
+  // samples can be played as MODs
+  if(!strcasecmp(filename + ext_pos, ".wav") ||
+    !strcasecmp(filename + ext_pos, ".sam"))
+  {
+    a_return = construct_wav_stream(filename, frequency,
+      volume, repeat);
+  }
+
+  // no need to check module formats; found a loader for SAM/WAV/OGG
+  if(a_return)
+    return a_return;
+
+  // enforce support only for editor selectable module extensions
+  while(*exts)
+  {
+    if(!strcasecmp(filename + ext_pos, *exts))
+      break;
+    exts++;
+  }
+
+  // wasn't a recognized extension
+  if(!*exts)
+    return NULL;
+
+  // The module loader thread and play_sample may both get here
+  platform_mutex_lock(&(loader.plugin_mutex));
+
+#ifdef CONFIG_MODPLUG
+  // The native WAV support does work now, however SDL's wav loading
+  // code doesn't work very well with a majority of the SAMs converted
+  // by the previous versions (probably because they're not really
+  // correctly done :x). If you erase those WAVs and let them be made
+  // anew they should work OK; otherwise the same old modplug code will
+  // be used instead, with modplug's resampling settings. modplug applies
+  // some volume filtering as well (some kind of ADSR?) so they won't
+  // sound the same. The native code produces a more "pure" and sharp
+  // sound.
+  a_return = construct_modplug_stream(filename, frequency, volume, repeat);
+#endif
+
+#ifdef CONFIG_MIKMOD
+  // Mikmod will handle all editor formats except WAV. Therefore loading
+  // bad WAV files as MODs may be more likely to fail with MikMod.
+  a_return = construct_mikmod_stream(filename, frequency, volume, repeat);
+#endif
+
+  platform_mutex_unlock(&(loader.plugin_mutex));
+
+  return a_return;
+}
+
+// Replace the primary stream with a new one (or nothing). The old one stops
+// as the new one starts. The audio lock must be held.
+
+static void swap_primary_stream(struct audio_stream *a_src)
+{
+  Uint32 frequency = 0;
+
+  if(a_src)
+  {
+    frequency = ((struct sampled_stream *)a_src)->get_frequency(
+     (struct sampled_stream *)a_src);
+  }
+
+  send_audio_command(AUDIO_SET_PRIMARY, a_src, 0);
+  request_primary_state(&(queue.order), 0);
+  request_primary_state(&(queue.position), 0);
+  request_primary_state(&(queue.frequency), frequency);
+
+  queue.has_primary = (a_src != NULL);
+}
+
+static void destruct_unused_stream(struct audio_stream *a_src)
+{
+  LOCK();
+  a_src->destruct(a_src);
+  UNLOCK();
+}
+
+// Take a stream from the prefetched modules. The loader mutex must be held.
+
+static struct audio_stream *take_prefetched_module(const char *filename)
+{
+  struct audio_stream *a_src;
+  int i;
+
+  for(i = 0; i < loader.num_prefetch; i++)
+  {
+    if(loader.prefetch[i].stream &&
+     !strcasecmp(loader.prefetch[i].filename, filename))
+    {
+      a_src = loader.prefetch[i].stream;
+      loader.prefetch[i].stream = NULL;
+      loader.prefetch[i].tried = false;
+      return a_src;
+    }
+  }
+
+  return NULL;
+}
+
+static void load_requested_module(void)
+{
+  char filename[MAX_PATH];
+  Uint32 volume = loader.request_volume;
+  Uint32 id = loader.request_id;
+  struct audio_stream *a_src;
+
+  strcpy(filename, loader.request);
+  loader.request_pending = false;
+  loader.busy = true;
+
+  a_src = take_prefetched_module(filename);
+  platform_mutex_unlock(&(loader.mutex));
+
+  if(a_src)
+  {
+    a_src->set_volume(a_src, volume);
+  }
+  else
+  {
+    a_src = construct_stream_audio_file(filename, 0, volume, 1);
+  }
+
+  platform_mutex_lock(&(loader.mutex));
+
+  if(id == loader.request_id)
+  {
+    LOCK();
+    swap_primary_stream(a_src);
+    UNLOCK();
+  }
+  else
+
+  if(a_src)
+    destruct_unused_stream(a_src);
+
+  loader.busy = false;
+  platform_cond_broadcast(&(loader.cond));
+}
+
+// Load the next module on the prefetch list that hasn't been tried yet.
+// Returns false if there's nothing left to load.
+
+static bool load_prefetch_module(void)
+{
+  char filename[MAX_PATH];
+  struct audio_stream *a_src;
+  int i;
+
+  for(i = 0; i < loader.num_prefetch; i++)
+    if(!loader.prefetch[i].tried)
+      break;
+
+  if(i == loader.num_prefetch)
+    return false;
+
+  strcpy(filename, loader.prefetch[i].filename);
+  loader.prefetch[i].tried = true;
+  platform_mutex_unlock(&(loader.mutex));
+
+  a_src = construct_stream_audio_file(filename, 0,
+   255 * audio.music_volume / 8, 1);
+
+  platform_mutex_lock(&(loader.mutex));
+
+  if(a_src)
+  {
+    // The prefetch list may have changed while this was loading
+    for(i = 0; i < loader.num_prefetch; i++)
+    {
+      if(loader.prefetch[i].tried && !loader.prefetch[i].stream &&
+       !strcmp(loader.prefetch[i].filename, filename))
+      {
+        loader.prefetch[i].stream = a_src;
+        break;
+      }
     }
 
-    /* In the case we need to convert the GDM, we need to find
-     * the real source path for it. Translate accordingly.
-     */
-    if(!fsafetranslate(filename, translated_filename_dest))
-      convert_gdm_s3m(translated_filename_dest, new_file);
-    return 1;
+    if(i == loader.num_prefetch)
+      destruct_unused_stream(a_src);
   }
 
-  return 0;
+  return true;
 }
 
-#endif // CONFIG_MODPLUG
-
-static struct audio_stream *construct_wav_stream(char *filename,
- Uint32 frequency, Uint32 volume, Uint32 repeat)
+static THREAD_RES module_loader_thread(void *data)
 {
-  struct wav_info w_info = {0,0,0,0,0};
-  struct audio_stream *ret_val = NULL;
-  char new_file[MAX_PATH];
-  Uint32 data_length = 0;
-  Uint8 *wav_data = NULL;
-
-  check_ext_for_sam_and_convert(filename, new_file);
+  platform_mutex_lock(&(loader.mutex));
 
-  if(load_wav_file(new_file, &w_info, &wav_data, &data_length))
+  while(!loader.quit)
   {
-    // Surround WAVs not supported yet..
-    if(w_info.channels <= 2)
+    if(loader.request_pending)
     {
-      struct wav_stream *w_stream = cmalloc(sizeof(struct wav_stream));
-
-      w_stream->wav_data = wav_data;
-      w_stream->data_length = data_length;
-      w_stream->channels = w_info.channels;
-      w_stream->data_offset = 0;
-      w_stream->format = w_info.format;
-      w_stream->natural_frequency = w_info.freq;
-      w_stream->bytes_per_sample = w_info.channels;
-      w_stream->loop_start = w_info.loop_start;
-      w_stream->loop_end = w_info.loop_end;
-
-      if((w_info.format != SAMPLE_U8) && (w_info.format != SAMPLE_S8))
-        w_stream->bytes_per_sample *= 2;
-
-      initialize_sampled_stream((struct sampled_stream *)w_stream,
-       wav_set_frequency, wav_get_frequency, frequency,
-       w_info.channels, 1);
-
-      ret_val = (struct audio_stream *)w_stream;
-
-      construct_audio_stream((struct audio_stream *)w_stream,
-       wav_mix_data, wav_set_volume, wav_set_repeat,
-       NULL, wav_set_position, NULL, wav_get_position, wav_destruct,
-       volume, repeat);
+      load_requested_module();
+      continue;
     }
+
+    if(load_prefetch_module())
+      continue;
+
+    platform_cond_wait(&(loader.cond), &(loader.mutex));
   }
 
-  return ret_val;
+  platform_mutex_unlock(&(loader.mutex));
+  THREAD_RETURN;
 }
 
-static struct audio_stream *construct_pc_speaker_stream(void)
-{
-  struct pc_speaker_stream *pcs_stream;
+// Wait for the module load_module asked for to start playing, so the
+// primary stream can be used.
 
-  if(!audio.sfx_on)
-    return NULL;
+static void wait_for_module(void)
+{
+  if(!loader.running)
+    return;
 
-  pcs_stream = ccalloc(1, sizeof(struct pc_speaker_stream));
+  platform_mutex_lock(&(loader.mutex));
 
-  construct_audio_stream((struct audio_stream *)pcs_stream, pcs_mix_data,
-   pcs_set_volume, NULL, NULL, NULL, NULL, NULL, pcs_destruct,
-   audio.sfx_volume * 255 / 8, 0);
+  while(loader.request_pending || loader.busy)
+    platform_cond_wait(&(loader.cond), &(loader.mutex));
 
-  return (struct audio_stream *)pcs_stream;
+  platform_mutex_unlock(&(loader.mutex));
 }
 
-static struct audio_stream *construct_stream_audio_file(char *filename,
- Uint32 frequency, Uint32 volume, Uint32 repeat)
+static void init_module_loader(void)
 {
-  const char *const *exts = mod_gdm_ext;
-  struct audio_stream *a_return = NULL;
-  size_t ext_pos, len = strlen(filename);
+  platform_mutex_init(&(loader.mutex));
+  platform_mutex_init(&(loader.plugin_mutex));
+  platform_cond_init(&(loader.cond));
 
-  if(!audio.music_on)
-    return NULL;
+  loader.running =
+   platform_thread_create(&(loader.thread), module_loader_thread, NULL);
 
-  // check string contains a valid extension (no ext isn't valid)
-  if(len >= 4 && filename[len - 4] == '.')
-    ext_pos = len - 4;
-  else if(len >= 3 && filename[len - 3] == '.')
-    ext_pos = len - 3;
-  else
-    return NULL;
+  if(!loader.running)
+    warn("Failed to start the module loader; loading modules directly\n");
+}
 
-  // ogg music is special cased
-  if(!strcasecmp(filename + ext_pos, ".ogg"))
-  {
-    a_return = construct_vorbis_stream(filename, frequency,
-      volume, repeat);
-  }
+static void quit_module_loader(void)
+{
+  int i;
 
-  // samples can be played as MODs
-  if(!strcasecmp(filename + ext_pos, ".wav") ||
-    !strcasecmp(filename + ext_pos, ".sam"))
+  if(loader.running)
   {
-    a_return = construct_wav_stream(filename, frequency,
-      volume, repeat);
-  }
-
-  // no need to check module formats; found a loader for SAM/WAV/OGG
-  if(a_return)
-    return a_return;
+    platform_mutex_lock(&(loader.mutex));
+    loader.quit = true;
+    platform_cond_broadcast(&(loader.cond));
+    platform_mutex_unlock(&(loader.mutex));
 
-  // enforce support only for editor selectable module extensions
-  while(*exts)
-  {
-    if(!strcasecmp(filename + ext_pos, *exts))
-      break;
-    exts++;
+    platform_thread_join(&(loader.thread));
+    loader.running = false;
   }
 
-  // wasn't a recognized extension
-  if(!*exts)
-    return NULL;
-
-#ifdef CONFIG_MODPLUG
-  // The native WAV support does work now, however SDL's wav loading
-  // code doesn't work very well with a majority of the SAMs converted
-  // by the previous versions (probably because they're not really
-  // correctly done :x). If you erase those WAVs and let them be made
-  // anew they should work OK; otherwise the same old modplug code will
-  // be used instead, with modplug's resampling settings. modplug applies
-  // some volume filtering as well (some kind of ADSR?) so they won't
-  // sound the same. The native code produces a more "pure" and sharp
-  // sound.
-  a_return = construct_modplug_stream(filename, frequency, volume, repeat);
-#endif
-
-#ifdef CONFIG_MIKMOD
-  // Mikmod will handle all editor formats except WAV. Therefore loading
-  // bad WAV files as MODs may be more likely to fail with MikMod.
-  a_return = construct_mikmod_stream(filename, frequency, volume, repeat);
-#endif
+  for(i = 0; i < loader.num_prefetch; i++)
+    if(loader.prefetch[i].stream)
+      destruct_unused_stream(loader.prefetch[i].stream);
 
-  return a_return;
+  loader.num_prefetch = 0;
 }
 
 static void clip_buffer(Sint16 *dest, Sint32 *src, int len)
 {
   Sint32 cur_sample;
-  int i;
+  int i = 0;
+
+#ifdef MIX_AVX2
+  if(mix_use_avx2)
+    for(; i + 16 <= len; i += 16)
+      clip_samples_avx2(dest + i, src + i);
+#endif
+
+#ifdef MIX_SIMD
+  for(; i + 8 <= len; i += 8)
+    clip_samples(dest + i, src + i);
+#endif
 
-  for(i = 0; i < len; i++)
+  for(; i < len; i++)
   {
     cur_sample = src[i];
     if(cur_sample > 32767)
@@ -1548,8 +3003,10 @@ void audio_callback(Sint16 *stream, int len)
 {
   Uint32 destroy_flag;
   struct audio_stream *current_astream;
+  Uint32 start_ticks = get_ticks();
+  Uint64 trace_start_ticks = trace_time();
 
-  LOCK();
+  run_audio_commands();
 
   current_astream = audio.stream_list_base;
 
@@ -1564,15 +3021,10 @@ void audio_callback(Sint16 *stream, int len)
       destroy_flag = current_astream->mix_data(current_astream,
        audio.mix_buffer, len);
 
+      // if the destroyed stream was our music, this also makes sure
+      // end_mod doesn't try to destroy it again.
       if(destroy_flag)
-      {
-        current_astream->destruct(current_astream);
-
-        // if the destroyed stream was our music, we shouldn't
-        // let end_mod try to destroy it again.
-        if(current_astream == audio.primary_stream)
-          audio.primary_stream = NULL;
-      }
+        retire_audio_stream(current_astream);
 
       current_astream = next_astream;
     }
@@ -1580,9 +3032,107 @@ void audio_callback(Sint16 *stream, int len)
     clip_buffer(stream, audio.mix_buffer, len / 2);
   }
 
+  report_primary_state();
+  flush_audio_garbage();
+
+  // Count the buffers that took longer to mix than they take to play
+  if((get_ticks() - start_ticks) * audio.output_frequency >
+   (Uint32)(len / 4) * 1000)
+    audio.underruns++;
+
+  trace_audio("mix", trace_start_ticks);
+}
+
+// Outputs without a device are mixed on the game's thread (see
+// audio_wav.c), which has to hold the lock like any other sender.
+
+void mix_audio_locked(Sint16 *stream, int len)
+{
+  LOCK();
+  audio_callback(stream, len);
   UNLOCK();
 }
 
+// Mix looping streams of a generated stereo sample into a scratch buffer,
+// the way the audio callback would, for num_frames output frames. Streams
+// are resampled with resample_mode (as master_resample_mode), or, if it's
+// -1, play at the output frequency so no resampling is needed. Returns
+// the number of frames mixed. Used by the benchmark suite.
+
+Uint32 benchmark_mixer(int resample_mode, int num_streams, Uint32 num_frames)
+{
+  Uint32 master_resample_mode = audio.master_resample_mode;
+  Uint32 buffer_samples = audio.buffer_samples;
+  Uint32 frequency = audio.output_frequency;
+  struct sample_cache_entry *sample;
+  struct audio_stream **streams;
+  Sint32 *mix_buffer;
+  Sint16 *output;
+  Sint16 *data;
+  Uint32 frames = 0;
+  Uint32 len;
+  Uint32 i;
+  int i2;
+
+  // Without a running output nothing set the buffer size
+  if(!audio.buffer_samples)
+    audio.buffer_samples = 4096;
+
+  len = audio.buffer_samples * 4;
+
+  // A second of a 440Hz sawtooth, louder on the left
+  data = cmalloc(frequency * 4);
+  for(i = 0; i < frequency; i++)
+  {
+    data[i * 2] = (Sint16)((Uint64)i * 440 * 16384 / frequency % 16384) - 8192;
+    data[i * 2 + 1] = data[i * 2] / 2;
+  }
+
+  sample = ccalloc(1, sizeof(struct sample_cache_entry));
+  sample->info.channels = 2;
+  sample->info.freq = frequency;
+  sample->info.format = SAMPLE_S16LSB;
+  sample->wav_data = (Uint8 *)data;
+  sample->data_length = frequency * 4;
+  sample->refcount = num_streams;
+
+  if(resample_mode >= 0)
+  {
+    audio.master_resample_mode = resample_mode;
+    frequency /= 2;
+  }
+
+  streams = cmalloc(num_streams * sizeof(struct audio_stream *));
+  for(i2 = 0; i2 < num_streams; i2++)
+    streams[i2] = construct_sample_stream(sample, frequency, 192, true);
+
+  mix_buffer = cmalloc(len * 2);
+  output = cmalloc(len);
+
+  while(frames < num_frames)
+  {
+    memset(mix_buffer, 0, len * 2);
+
+    for(i2 = 0; i2 < num_streams; i2++)
+      streams[i2]->mix_data(streams[i2], mix_buffer, len);
+
+    clip_buffer(output, mix_buffer, len / 2);
+    frames += audio.buffer_samples;
+  }
+
+  // The last one frees the sample
+  for(i2 = 0; i2 < num_streams; i2++)
+    streams[i2]->destruct(streams[i2]);
+
+  audio.master_resample_mode = master_resample_mode;
+  audio.buffer_samples = buffer_samples;
+
+  free(streams);
+  free(mix_buffer);
+  free(output);
+  return frames;
+}
+
 static void init_pc_speaker(struct config_info *conf)
 {
   audio.pcs_stream = (struct pc_speaker_stream *)construct_pc_speaker_stream();
@@ -1590,11 +3140,19 @@ static void init_pc_speaker(struct config_info *conf)
 
 void init_audio(struct config_info *conf)
 {
+  bool mixer_started;
+
   platform_mutex_init(&audio.audio_mutex);
+  queue.mixer_running = false;
+  init_module_loader();
 
   audio.output_frequency = conf->output_frequency;
   audio.master_resample_mode = conf->resample_mode;
 
+#ifdef MIX_AVX2
+  mix_use_avx2 = cpu_has_avx2();
+#endif
+
 #ifdef CONFIG_MODPLUG
   init_modplug(conf);
 #endif
@@ -1612,13 +3170,64 @@ void init_audio(struct config_info *conf)
 
   set_sfx_volume(conf->pc_speaker_volume);
 
-  init_audio_platform(conf);
+  audio.sample_cache_limit = conf->sample_cache_size * 1024;
+
+  // WAV and null output mix on the game's thread as it runs, so commands
+  // are run as they're sent rather than queued for a mixer thread
+  if(!strcmp(conf->audio_output, "wav"))
+  {
+    audio_output = AUDIO_OUTPUT_WAV;
+    init_audio_wav(conf, true);
+    return;
+  }
+
+  if(!strcmp(conf->audio_output, "null"))
+  {
+    audio_output = AUDIO_OUTPUT_NULL;
+    init_audio_wav(conf, false);
+    return;
+  }
+
+  // The output may start mixing as soon as it's initialized
+  LOCK();
+  queue.mixer_running = true;
+  UNLOCK();
+
+  audio_output = AUDIO_OUTPUT_DEVICE;
+  mixer_started = init_audio_platform(conf);
+
+  // Otherwise nothing would ever run the commands sent to it
+  if(!mixer_started)
+  {
+    LOCK();
+    queue.mixer_running = false;
+    UNLOCK();
+  }
 }
 
 void quit_audio(void)
 {
-  quit_audio_platform();
+  if(audio_output == AUDIO_OUTPUT_DEVICE)
+    quit_audio_platform();
+  else
+    quit_audio_wav();
+
+  // Anything sent after the last callback still has to be run
+  LOCK();
+  queue.mixer_running = false;
+  run_audio_commands();
+  flush_audio_garbage();
+  collect_audio_garbage();
+  UNLOCK();
+
+  quit_module_loader();
   free(audio.pcs_stream);
+
+  debug("Sample cache: %u hits, %u misses\n",
+   audio.sample_cache_hits, audio.sample_cache_misses);
+  debug("Audio underruns: %u\n", audio.underruns);
+
+  clear_sample_cache();
 }
 
 __editor_maybe_static void load_module(char *filename, bool safely,
@@ -1652,14 +3261,27 @@ __editor_maybe_static void load_module(char *filename, bool safely,
     filename = translated_filename;
   }
 
+  volume = volume * audio.music_volume / 8;
+
+  if(loader.running)
+  {
+    platform_mutex_lock(&(loader.mutex));
+    strcpy(loader.request, filename);
+    loader.request_volume = volume;
+    loader.request_id++;
+    loader.request_pending = true;
+    platform_cond_broadcast(&(loader.cond));
+    platform_mutex_unlock(&(loader.mutex));
+    return;
+  }
+
   end_module();
 
-  a_src = construct_stream_audio_file(filename, 0,
-   volume * audio.music_volume / 8, 1);
+  a_src = construct_stream_audio_file(filename, 0, volume, 1);
 
   LOCK();
 
-  audio.primary_stream = a_src;
+  swap_primary_stream(a_src);
 
   UNLOCK();
 }
@@ -1671,20 +3293,90 @@ void load_board_module(struct board *src_board)
 
 void end_module(void)
 {
-  if(audio.primary_stream)
+  if(loader.running)
   {
-    LOCK();
-    audio.primary_stream->destruct(audio.primary_stream);
-    UNLOCK();
+    // Forget about any module that's still loading
+    platform_mutex_lock(&(loader.mutex));
+    loader.request_id++;
+    loader.request_pending = false;
+    platform_mutex_unlock(&(loader.mutex));
+  }
+
+  LOCK();
+  swap_primary_stream(NULL);
+  UNLOCK();
+}
+
+// Load the modules for the given boards in the background so they can
+// start playing right away when one of them is entered. Modules that were
+// prefetched before and aren't in the new list are freed.
+
+void prefetch_modules(char *filenames[], int count)
+{
+  struct prefetched_module old_prefetch[MAX_PREFETCH_MODULES];
+  char translated_filename[MAX_PATH];
+  int old_num_prefetch;
+  int i, i2;
+
+  if(!loader.running)
+    return;
+
+  platform_mutex_lock(&(loader.mutex));
+
+  memcpy(old_prefetch, loader.prefetch, sizeof(loader.prefetch));
+  old_num_prefetch = loader.num_prefetch;
+  loader.num_prefetch = 0;
+
+  for(i = 0; (i < count) && (loader.num_prefetch < MAX_PREFETCH_MODULES); i++)
+  {
+    struct prefetched_module *prefetch =
+     loader.prefetch + loader.num_prefetch;
+
+    if(!filenames[i][0] || !strcmp(filenames[i], "*"))
+      continue;
+
+    if(fsafetranslate(filenames[i], translated_filename) != FSAFE_SUCCESS)
+      continue;
+
+    for(i2 = 0; i2 < loader.num_prefetch; i2++)
+      if(!strcasecmp(loader.prefetch[i2].filename, translated_filename))
+        break;
+
+    if(i2 < loader.num_prefetch)
+      continue;
+
+    strcpy(prefetch->filename, translated_filename);
+    prefetch->stream = NULL;
+    prefetch->tried = false;
+
+    // Keep what was already loaded for this module
+    for(i2 = 0; i2 < old_num_prefetch; i2++)
+    {
+      if(!strcasecmp(old_prefetch[i2].filename, translated_filename))
+      {
+        prefetch->stream = old_prefetch[i2].stream;
+        prefetch->tried = old_prefetch[i2].tried;
+        old_prefetch[i2].stream = NULL;
+        break;
+      }
+    }
+
+    loader.num_prefetch++;
   }
 
-  audio.primary_stream = NULL;
+  platform_cond_broadcast(&(loader.cond));
+  platform_mutex_unlock(&(loader.mutex));
+
+  for(i = 0; i < old_num_prefetch; i++)
+    if(old_prefetch[i].stream)
+      destruct_unused_stream(old_prefetch[i].stream);
 }
 
 void play_sample(int freq, char *filename, bool safely)
 {
   Uint32 vol = 255 * audio.sound_volume / 8;
   char translated_filename[MAX_PATH];
+  struct audio_stream *a_src;
 
   if(safely)
   {
@@ -1699,80 +3391,65 @@ void play_sample(int freq, char *filename, bool safely)
 
   if(freq == 0)
   {
-    construct_stream_audio_file(filename, 0, vol, 0);
+    a_src = construct_stream_audio_file(filename, 0, vol, 0);
   }
   else
   {
-    construct_stream_audio_file(filename,
+    a_src = construct_stream_audio_file(filename,
      (freq_conversion / freq) / 2, vol, 0);
   }
+
+  if(a_src)
+  {
+    LOCK();
+    send_audio_command(AUDIO_ADD_STREAM, a_src, 0);
+    UNLOCK();
+  }
 }
 
 void end_sample(void)
 {
-  // Destroy all samples - something is a sample if it's not a
-  // primary or PC speaker stream. This is a bit of a dirty way
-  // to do it though (might want to keep multiple lists instead)
-
-  struct audio_stream *current_astream = audio.stream_list_base;
-  struct audio_stream *next_astream;
-
+  // Destroy all samples
   LOCK();
-
-  while(current_astream)
-  {
-    next_astream = current_astream->next;
-
-    if((current_astream != audio.primary_stream) &&
-     (current_astream != (struct audio_stream *)(audio.pcs_stream)))
-    {
-      current_astream->destruct(current_astream);
-    }
-
-    current_astream = next_astream;
-  }
-
+  send_audio_command(AUDIO_END_SAMPLES, NULL, 0);
   UNLOCK();
 }
 
 void jump_module(int order)
 {
+  wait_for_module();
+
   // This is really just for modules, I can't imagine what an "order"
   // might be for non-sequenced formats. It's also mostly here for
   // legacy reasons; set_position rather supercedes it.
 
-  if(audio.primary_stream && audio.primary_stream->set_order)
+  if(queue.has_primary)
   {
     LOCK();
-    audio.primary_stream->set_order(audio.primary_stream, order);
+    send_audio_command(AUDIO_SET_ORDER, NULL, order);
+    request_primary_state(&(queue.order), order);
     UNLOCK();
   }
 }
 
 int get_order(void)
 {
-  if(audio.primary_stream && audio.primary_stream->get_order)
-  {
-    int order;
+  wait_for_module();
 
-    LOCK();
-    order = audio.primary_stream->get_order(audio.primary_stream);
-    UNLOCK();
+  if(queue.has_primary)
+    return get_primary_state(&(queue.order));
 
-    return order;
-  }
-  else
-  {
-    return 0;
-  }
+  return 0;
 }
 
 void volume_module(int vol)
 {
-  if(audio.primary_stream)
+  wait_for_module();
+
+  if(queue.has_primary)
   {
     LOCK();
-    audio.primary_stream->set_volume(audio.primary_stream,
+    send_audio_command(AUDIO_SET_MUSIC_VOLUME, NULL,
      vol * audio.music_volume / 8);
     UNLOCK();
   }
@@ -1805,42 +3482,30 @@ void spot_sample(int freq, int sample)
 
 void shift_frequency(int freq)
 {
-  // Primary had better be a sampled stream (in reality I can't imagine
-  // ever letting it be anything but, but if it comes up a type
-  // enumeration could weed this out)
-
   // Note that shifting the frequency dynamically messes up the phase
   // counters somewhat producing an audible pop. I've tried to reduce
   // this without too much success... This might be less noticeable
   // when interpolation isn't used (but the tradeoff is hardly worth it)
 
-  if(audio.primary_stream && freq >= 16)
+  wait_for_module();
+
+  if(queue.has_primary && freq >= 16)
   {
     LOCK();
-    ((struct sampled_stream *)audio.primary_stream)->
-     set_frequency((struct sampled_stream *)audio.primary_stream,
-     freq);
+    send_audio_command(AUDIO_SET_FREQUENCY, NULL, freq);
+    request_primary_state(&(queue.frequency), freq);
     UNLOCK();
   }
 }
 
 int get_frequency(void)
 {
-  if(audio.primary_stream)
-  {
-    int freq;
+  wait_for_module();
 
-    LOCK();
-    freq = ((struct sampled_stream *)audio.primary_stream)->
-     get_frequency((struct sampled_stream *)audio.primary_stream);
-    UNLOCK();
+  if(queue.has_primary)
+    return get_primary_state(&(queue.frequency));
 
-    return freq;
-  }
-  else
-  {
-    return 0;
-  }
+  return 0;
 }
 
 void set_position(int pos)
@@ -1848,26 +3513,23 @@ void set_position(int pos)
   // Position isn't a universal thing and instead depends on the
   // medium and what it supports.
 
-  if(audio.primary_stream && audio.primary_stream->set_position)
+  wait_for_module();
+
+  if(queue.has_primary)
   {
     LOCK();
-    audio.primary_stream->set_position(audio.primary_stream, pos);
+    send_audio_command(AUDIO_SET_POSITION, NULL, pos);
+    request_primary_state(&(queue.position), pos);
     UNLOCK();
   }
 }
 
 int get_position(void)
 {
-  if(audio.primary_stream && audio.primary_stream->get_position)
-  {
-    int pos;
+  wait_for_module();
 
-    LOCK();
-    pos = audio.primary_stream->get_position(audio.primary_stream);
-    UNLOCK();
-
-    return pos;
-  }
+  if(queue.has_primary)
+    return get_primary_state(&(queue.position));
 
   return 0;
 }
@@ -1946,23 +3608,11 @@ void set_music_volume(int volume)
 
 void set_sound_volume(int volume)
 {
-  struct audio_stream *current_astream = audio.stream_list_base;
-
   LOCK();
 
   audio.sound_volume = volume;
-
-  while(current_astream)
-  {
-    if((current_astream != audio.primary_stream) &&
-     (current_astream != (struct audio_stream *)(audio.pcs_stream)))
-    {
-      current_astream->set_volume(current_astream,
-       audio.sound_volume * 255 / 8);
-    }
-
-    current_astream = current_astream->next;
-  }
+  send_audio_command(AUDIO_SET_SOUND_VOLUME, NULL,
+   audio.sound_volume * 255 / 8);
 
   UNLOCK();
 }
@@ -1975,8 +3625,7 @@ void set_sfx_volume(int volume)
   LOCK();
 
   audio.sfx_volume = volume;
-  audio.pcs_stream->a.set_volume((struct audio_stream *)audio.pcs_stream,
-   volume * 255 / 8);
+  send_audio_command(AUDIO_SET_SFX_VOLUME, NULL, volume * 255 / 8);
 
   UNLOCK();
 }
@@ -106,8 +106,19 @@ struct audio
   struct audio_stream *stream_list_base;
   struct audio_stream *stream_list_end;
 
+  // Only held by threads sending commands to the mixer (see audio.c)
   platform_mutex audio_mutex;
 
+  // Buffers that took longer to mix than to play
+  Uint32 underruns;
+
+  // Decoded WAV/SAM files shared between sample streams (see audio.c)
+  struct sample_cache_entry *sample_cache;
+  Uint32 sample_cache_size;
+  Uint32 sample_cache_limit;
+  Uint32 sample_cache_hits;
+  Uint32 sample_cache_misses;
+
   Uint32 music_on;
   Uint32 sfx_on;
   Uint32 music_volume;
@@ -124,6 +135,7 @@ CORE_LIBSPEC void load_board_module(struct board *src_board);
 CORE_LIBSPEC void play_sample(int freq, char *filename, bool safely);
 
 void end_sample(void);
+void prefetch_modules(char *filenames[], int count);
 void jump_module(int order);
 int get_order(void);
 void volume_module(int vol);
@@ -150,8 +162,13 @@ void set_sound_volume(int volume);
 void set_sfx_volume(int volume);
 
 void audio_callback(Sint16 *stream, int len);
-void init_audio_platform(struct config_info *conf);
+void mix_audio_locked(Sint16 *stream, int len);
+Uint32 benchmark_mixer(int resample_mode, int num_streams, Uint32 num_frames);
+bool init_audio_platform(struct config_info *conf);
 void quit_audio_platform(void);
+bool init_audio_wav(struct config_info *conf, bool write_file);
+void quit_audio_wav(void);
+void advance_audio_clock(Uint32 ms);
 
 #ifdef CONFIG_EDITOR
 CORE_LIBSPEC void load_module(char *filename, bool safely, int volume);
@@ -205,6 +222,7 @@ static inline void end_sample(void) {}
 static inline void end_module(void) {}
 static inline void load_module(char *filename, bool safely, int volume) {}
 static inline void load_board_module(struct board *src_board) {}
+static inline void prefetch_modules(char *filenames[], int count) {}
 static inline void volume_module(int vol) {}
 static inline void set_position(int pos) {}
 static inline void jump_module(int order) {}
@@ -219,6 +237,7 @@ static inline int get_sfx_volume(void) { return 0; }
 static inline int get_position(void) { return 0; }
 static inline int get_order(void) { return 0; }
 static inline int get_frequency(void) { return 0; }
+static inline void advance_audio_clock(Uint32 ms) {}
 
 #endif // CONFIG_AUDIO
 
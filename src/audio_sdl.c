@@ -18,6 +18,7 @@
  */
 
 #include "audio.h"
+#include "util.h"
 #include "SDL.h"
 
 #include <stdlib.h>
@@ -29,7 +30,7 @@ static void sdl_audio_callback(void *userdata, Uint8 *stream, int len)
   audio_callback((Sint16 *)stream, len);
 }
 
-void init_audio_platform(struct config_info *conf)
+bool init_audio_platform(struct config_info *conf)
 {
   SDL_AudioSpec desired_spec =
   {
@@ -46,12 +47,18 @@ void init_audio_platform(struct config_info *conf)
 
   desired_spec.freq = audio.output_frequency;
 
-  SDL_OpenAudio(&desired_spec, &audio_settings);
+  if(SDL_OpenAudio(&desired_spec, &audio_settings) < 0)
+  {
+    warn("Failed to open audio device: %s\n", SDL_GetError());
+    return false;
+  }
+
   audio.mix_buffer = cmalloc(audio_settings.size * 2);
   audio.buffer_samples = audio_settings.samples;
 
   // now set the audio going
   SDL_PauseAudio(0);
+  return true;
 }
 
 void quit_audio_platform(void)
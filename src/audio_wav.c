@@ -0,0 +1,175 @@
+/* MegaZeux
+ *
+ * Copyright (C) 2026 MegaZeux contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// Audio output for machines without (or without wanting) an audio device.
+// Nothing asks for audio at the rate it plays, so the game clocks it
+// instead: each cycle advances a virtual clock and the audio that's due by
+// then is mixed right away, on the game's thread. The output only depends
+// on the cycles played, so it's the same on every run and is made as fast
+// as the game runs. The mixed audio is written to a WAV file or thrown
+// away, and the time spent mixing it is logged on exit.
+
+#include "audio.h"
+#include "benchmark.h"
+#include "platform.h"
+#include "world.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WAV_HEADER_SIZE 44
+
+static struct
+{
+  bool active;
+
+  FILE *wav_file;
+  Uint32 data_length;
+
+  Sint16 *buffer;
+  Uint32 buffer_len;
+
+  Uint64 clock_ms;
+  Uint64 frames_mixed;
+  Uint64 mix_time;
+} wav_output;
+
+static void write_wav_header(FILE *fp, Uint32 data_length)
+{
+  fwrite("RIFF", 4, 1, fp);
+  fputd(data_length + WAV_HEADER_SIZE - 8, fp);
+  fwrite("WAVEfmt ", 8, 1, fp);
+  fputd(16, fp);                              // fmt chunk length
+  fputw(1, fp);                               // PCM
+  fputw(2, fp);                               // channels
+  fputd(audio.output_frequency, fp);
+  fputd(audio.output_frequency * 4, fp);      // bytes per second
+  fputw(4, fp);                               // bytes per frame
+  fputw(16, fp);                              // bits per sample
+  fwrite("data", 4, 1, fp);
+  fputd(data_length, fp);
+}
+
+static void write_wav_data(Sint16 *buffer, Uint32 len)
+{
+#if PLATFORM_BYTE_ORDER == PLATFORM_BIG_ENDIAN
+  Uint32 i;
+
+  for(i = 0; i < len / 2; i++)
+    fputw(buffer[i], wav_output.wav_file);
+#else
+  fwrite(buffer, len, 1, wav_output.wav_file);
+#endif
+
+  wav_output.data_length += len;
+}
+
+static void mix_wav_output(void)
+{
+  Uint64 start_time = get_ticks_us();
+
+  mix_audio_locked(wav_output.buffer, wav_output.buffer_len);
+
+  wav_output.mix_time += get_ticks_us() - start_time;
+  wav_output.frames_mixed += audio.buffer_samples;
+
+  if(wav_output.wav_file)
+    write_wav_data(wav_output.buffer, wav_output.buffer_len);
+}
+
+// Move the clock on by the length of a game cycle and mix every whole
+// buffer that's due by then.
+
+void advance_audio_clock(Uint32 ms)
+{
+  Uint64 frames_due;
+
+  if(!wav_output.active)
+    return;
+
+  wav_output.clock_ms += ms;
+  frames_due = wav_output.clock_ms * audio.output_frequency / 1000;
+
+  if(wav_output.frames_mixed + audio.buffer_samples > frames_due)
+    return;
+
+  cycle_scope_begin(BENCHMARK_AUDIO, "mix_audio");
+
+  while(wav_output.frames_mixed + audio.buffer_samples <= frames_due)
+    mix_wav_output();
+
+  cycle_scope_end();
+}
+
+bool init_audio_wav(struct config_info *conf, bool write_file)
+{
+  audio.buffer_samples = conf->buffer_size;
+  if(!audio.buffer_samples)
+    audio.buffer_samples = 4096;
+
+  wav_output.buffer_len = audio.buffer_samples * 4;
+  wav_output.buffer = cmalloc(wav_output.buffer_len);
+  audio.mix_buffer = cmalloc(wav_output.buffer_len * 2);
+
+  wav_output.wav_file = NULL;
+  wav_output.data_length = 0;
+
+  if(write_file)
+  {
+    wav_output.wav_file = fopen_unsafe(conf->audio_wav_file, "wb");
+
+    if(wav_output.wav_file)
+    {
+      write_wav_header(wav_output.wav_file, 0);
+    }
+    else
+    {
+      warn("Failed to open '%s' for audio output\n", conf->audio_wav_file);
+    }
+  }
+
+  wav_output.clock_ms = 0;
+  wav_output.frames_mixed = 0;
+  wav_output.mix_time = 0;
+  wav_output.active = true;
+  return true;
+}
+
+void quit_audio_wav(void)
+{
+  wav_output.active = false;
+
+  if(wav_output.wav_file)
+  {
+    fseek(wav_output.wav_file, 0, SEEK_SET);
+    write_wav_header(wav_output.wav_file, wav_output.data_length);
+    fclose(wav_output.wav_file);
+    wav_output.wav_file = NULL;
+  }
+
+  info("Mixed %llu frames (%llu ms of audio) in %llu us\n",
+   (unsigned long long)wav_output.frames_mixed,
+   (unsigned long long)(wav_output.frames_mixed * 1000 /
+   audio.output_frequency),
+   (unsigned long long)wav_output.mix_time);
+
+  free(wav_output.buffer);
+  free(audio.mix_buffer);
+}
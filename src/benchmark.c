@@ -0,0 +1,734 @@
+/* MegaZeux
+ *
+ * Copyright (C) 2026 MegaZeux contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// The input script has one key event per line:
+//
+//   <cycle> press <keycode>
+//   <cycle> release <keycode>
+//
+// Keycodes are the internal ones, as for the joystick options in
+// config.txt. Events happen after the given cycle has been updated, where
+// a key pressed in the game would be noticed. Lines starting with # are
+// ignored.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio.h"
+#include "benchmark.h"
+#include "counter.h"
+#include "data.h"
+#include "event.h"
+#include "graphics.h"
+#include "idput.h"
+#include "render.h"
+#include "util.h"
+#include "world.h"
+
+#include "board_struct.h"
+#include "counter_struct.h"
+#include "robot_struct.h"
+
+struct benchmark_event
+{
+  int cycle;
+  bool press;
+  enum keycode key;
+};
+
+struct benchmark_status benchmark;
+
+static struct benchmark_event *events;
+static int num_events;
+static int next_event;
+
+static Uint64 start_time;
+
+static const char *const phase_names[NUM_BENCHMARK_PHASES] =
+{
+  "other",
+  "robots",
+  "board",
+  "sprites",
+  "draw",
+  "audio",
+};
+
+static bool load_input_script(const char *name)
+{
+  FILE *fp = fopen_unsafe(name, "rb");
+  int num_events_allocated = 0;
+  char line[256];
+  char action[16];
+  unsigned int key;
+  int cycle;
+  int line_number = 0;
+
+  if(!fp)
+  {
+    warn("Failed to open benchmark input '%s'\n", name);
+    return false;
+  }
+
+  while(fgets(line, 256, fp))
+  {
+    line_number++;
+
+    if((line[0] == '#') || (line[strspn(line, " \t\r\n")] == 0))
+      continue;
+
+    if((sscanf(line, "%d %15s %u", &cycle, action, &key) != 3) ||
+     (key >= 512) || (strcasecmp(action, "press") &&
+     strcasecmp(action, "release")))
+    {
+      warn("%s:%d: expected '<cycle> press|release <keycode>'\n",
+       name, line_number);
+      continue;
+    }
+
+    if(num_events && (cycle < events[num_events - 1].cycle))
+    {
+      warn("%s:%d: cycle %d is out of order, ignoring\n",
+       name, line_number, cycle);
+      continue;
+    }
+
+    if(num_events == num_events_allocated)
+    {
+      num_events_allocated = MAX(num_events_allocated * 2, 32);
+      events = crealloc(events,
+       num_events_allocated * sizeof(struct benchmark_event));
+    }
+
+    events[num_events].cycle = cycle;
+    events[num_events].press = !strcasecmp(action, "press");
+    events[num_events].key = (enum keycode)key;
+    num_events++;
+  }
+
+  fclose(fp);
+  return true;
+}
+
+bool benchmark_init(struct config_info *conf)
+{
+  memset(&benchmark, 0, sizeof(struct benchmark_status));
+  events = NULL;
+  num_events = 0;
+  next_event = 0;
+
+  if(conf->benchmark_input[0] && !load_input_script(conf->benchmark_input))
+    return false;
+
+  benchmark.dismiss_dialogs = true;
+
+  set_random_seed(conf->benchmark_seed);
+  return true;
+}
+
+void benchmark_start(void)
+{
+  benchmark.active = true;
+  benchmark.depth = 0;
+  benchmark.stack[0] = BENCHMARK_OTHER;
+
+  start_time = get_ticks_us();
+  benchmark.phase_start = start_time;
+}
+
+// Scripted keys go in like the platform's own events would
+
+void benchmark_input(int cycle)
+{
+  struct buffered_status *status = store_status();
+  enum keycode key;
+
+  while((next_event < num_events) && (events[next_event].cycle <= cycle))
+  {
+    key = events[next_event].key;
+
+    if(events[next_event].press)
+    {
+      key_press(status, key, ((key >= 32) && (key < 127)) ? key : 0);
+
+      // Repeats would depend on how fast the cycles are going
+      status->key_repeat = IKEY_UNKNOWN;
+    }
+    else
+    {
+      key_release(status, key);
+    }
+
+    next_event++;
+  }
+
+  if(benchmark.dismiss_held)
+  {
+    key_release(status, IKEY_ESCAPE);
+    benchmark.dismiss_held = false;
+  }
+
+  benchmark.dismiss_tries = 0;
+}
+
+#define BENCHMARK_MAX_DISMISS 100000
+
+// Scrolls, robot messages, prompts and dialogs wait for a key with
+// update_event_status_delay or wait_event, which the cycles never call.
+// There's nobody to press one, so they get escape. Dialogs check that it's
+// held down, so it's let go on the next call or the next cycle. A dialog
+// that won't close would hang the run, so that aborts it instead.
+
+void benchmark_dismiss(void)
+{
+  struct buffered_status *status = store_status();
+
+  if(benchmark.dismiss_tries >= BENCHMARK_MAX_DISMISS)
+  {
+    warn("Benchmark aborted: a dialog didn't close on escape\n");
+    platform_quit();
+    exit(1);
+  }
+
+  if(benchmark.dismiss_held)
+    key_release(status, IKEY_ESCAPE);
+
+  key_press(status, IKEY_ESCAPE, 0);
+
+  // Repeats would depend on how fast the dialog loops
+  status->key_repeat = IKEY_UNKNOWN;
+
+  benchmark.dismiss_held = true;
+  benchmark.dismiss_tries++;
+  benchmark.dismiss_keys++;
+}
+
+static void benchmark_charge(void)
+{
+  Uint64 now = get_ticks_us();
+  int depth = MIN(benchmark.depth, BENCHMARK_MAX_DEPTH - 1);
+
+  benchmark.phase_time[benchmark.stack[depth]] += now - benchmark.phase_start;
+  benchmark.phase_start = now;
+}
+
+void __benchmark_enter(enum benchmark_phase phase)
+{
+  benchmark_charge();
+  benchmark.depth++;
+
+  // Anything nested deeper just counts towards the deepest phase kept
+  if(benchmark.depth < BENCHMARK_MAX_DEPTH)
+    benchmark.stack[benchmark.depth] = phase;
+}
+
+void __benchmark_leave(void)
+{
+  benchmark_charge();
+  benchmark.depth--;
+}
+
+// The final state is hashed with 64-bit FNV-1a, a byte at a time and
+// with everything wider than a byte in little endian order, so the same
+// run gives the same hash on any machine.
+
+#define FNV_OFFSET_BASIS 0xCBF29CE484222325ULL
+#define FNV_PRIME        0x100000001B3ULL
+
+static Uint64 hash_bytes(Uint64 hash, const void *src, size_t len)
+{
+  const Uint8 *pos = src;
+  size_t i;
+
+  for(i = 0; i < len; i++)
+    hash = (hash ^ pos[i]) * FNV_PRIME;
+
+  return hash;
+}
+
+static Uint64 hash_int(Uint64 hash, int value)
+{
+  Uint8 bytes[4];
+
+  bytes[0] = value & 0xFF;
+  bytes[1] = (value >> 8) & 0xFF;
+  bytes[2] = (value >> 16) & 0xFF;
+  bytes[3] = (value >> 24) & 0xFF;
+
+  return hash_bytes(hash, bytes, 4);
+}
+
+static Uint64 hash_robot(Uint64 hash, struct robot *cur_robot)
+{
+  hash = hash_bytes(hash, cur_robot->robot_name, strlen(cur_robot->robot_name));
+  hash = hash_int(hash, cur_robot->xpos);
+  hash = hash_int(hash, cur_robot->ypos);
+  hash = hash_int(hash, cur_robot->cur_prog_line);
+  hash = hash_int(hash, cur_robot->pos_within_line);
+  hash = hash_int(hash, cur_robot->status);
+  return hash;
+}
+
+static Uint64 hash_board(Uint64 hash, struct board *cur_board)
+{
+  int size = cur_board->board_width * cur_board->board_height;
+  int i;
+
+  hash = hash_int(hash, cur_board->board_width);
+  hash = hash_int(hash, cur_board->board_height);
+  hash = hash_bytes(hash, cur_board->level_id, size);
+  hash = hash_bytes(hash, cur_board->level_color, size);
+  hash = hash_bytes(hash, cur_board->level_param, size);
+  hash = hash_bytes(hash, cur_board->level_under_id, size);
+  hash = hash_bytes(hash, cur_board->level_under_color, size);
+  hash = hash_bytes(hash, cur_board->level_under_param, size);
+
+  if(cur_board->overlay_mode && cur_board->overlay)
+  {
+    hash = hash_bytes(hash, cur_board->overlay, size);
+    hash = hash_bytes(hash, cur_board->overlay_color, size);
+  }
+
+  for(i = 1; i <= cur_board->num_robots; i++)
+    if(cur_board->robot_list[i])
+      hash = hash_robot(hash, cur_board->robot_list[i]);
+
+  return hash;
+}
+
+static Uint64 hash_world(struct world *mzx_world)
+{
+  struct char_element screen[SCREEN_W * SCREEN_H];
+  Uint64 hash = FNV_OFFSET_BASIS;
+  struct board *cur_board;
+  struct counter *cur_counter;
+  struct string *cur_string;
+  int i;
+
+  hash = hash_int(hash, mzx_world->current_board_id);
+  hash = hash_int(hash, mzx_world->player_x);
+  hash = hash_int(hash, mzx_world->player_y);
+
+  // Boards that were never loaded are still as they are in the file
+  for(i = 0; i < mzx_world->num_boards; i++)
+  {
+    cur_board = mzx_world->board_list[i];
+    if(cur_board && cur_board->loaded)
+      hash = hash_board(hash, cur_board);
+  }
+
+  hash = hash_robot(hash, &(mzx_world->global_robot));
+
+  for(i = 0; i < mzx_world->num_counters; i++)
+  {
+    cur_counter = mzx_world->counter_list[i];
+    hash = hash_bytes(hash, cur_counter->name, strlen(cur_counter->name));
+    hash = hash_int(hash, cur_counter->value);
+  }
+
+  for(i = 0; i < mzx_world->num_strings; i++)
+  {
+    cur_string = mzx_world->string_list[i];
+    hash = hash_bytes(hash, cur_string->name, strlen(cur_string->name));
+    hash = hash_bytes(hash, cur_string->value, cur_string->length);
+  }
+
+  get_screen(screen);
+  for(i = 0; i < SCREEN_W * SCREEN_H; i++)
+  {
+    hash = hash_int(hash, screen[i].char_value);
+    hash = hash_int(hash, (screen[i].bg_color << 8) | screen[i].fg_color);
+  }
+
+  return hash;
+}
+
+static void print_time(const char *name, Uint64 time, Uint64 total)
+{
+  info("  %-8s %8u.%03u ms  %5.1f%%\n", name, (Uint32)(time / 1000),
+   (Uint32)(time % 1000), total ? (double)time * 100.0 / total : 0.0);
+}
+
+void benchmark_finish(struct world *mzx_world, int cycles)
+{
+  Uint64 total = get_ticks_us() - start_time;
+  Uint64 hash;
+  int i;
+
+  benchmark_charge();
+  benchmark.active = false;
+  benchmark.dismiss_dialogs = false;
+
+  info("Benchmark: %d cycles in %u.%03u ms (%.1f cycles/sec)\n", cycles,
+   (Uint32)(total / 1000), (Uint32)(total % 1000),
+   total ? (double)cycles * 1000000.0 / total : 0.0);
+
+  for(i = 1; i < NUM_BENCHMARK_PHASES; i++)
+    print_time(phase_names[i], benchmark.phase_time[i], total);
+
+  print_time(phase_names[BENCHMARK_OTHER],
+   benchmark.phase_time[BENCHMARK_OTHER], total);
+
+  info("Sprites drawn: %llu (%llu chars), %.1f per cycle\n",
+   (unsigned long long)benchmark.sprites_drawn,
+   (unsigned long long)benchmark.sprite_chars_drawn,
+   cycles ? (double)benchmark.sprites_drawn / cycles : 0.0);
+
+  if(benchmark.dismiss_keys)
+    info("Escapes pressed to close dialogs: %d\n", benchmark.dismiss_keys);
+
+  if(mzx_world->active)
+  {
+    hash = hash_world(mzx_world);
+    info("Final state hash: %08x%08x\n", (Uint32)(hash >> 32), (Uint32)hash);
+  }
+
+  free(events);
+  events = NULL;
+  num_events = 0;
+}
+
+// Each test in the suite runs on a freshly loaded copy of the startup
+// world and logs how long one operation took on average.
+
+struct benchmark_test
+{
+  const char *name;
+  void (*run)(struct world *mzx_world);
+};
+
+static void print_rate(const char *test, const char *what, int count,
+ Uint64 time)
+{
+  info("  %-12s %-16s %9d in %6u.%03u ms  %10.1f ns each\n", test, what,
+   count, (Uint32)(time / 1000), (Uint32)(time % 1000),
+   count ? (double)time * 1000.0 / count : 0.0);
+}
+
+#define COUNTERS_SIDE 64
+#define COUNTERS_NUM  (COUNTERS_SIDE * COUNTERS_SIDE)
+#define COUNTERS_OPS  1000000
+#define COUNTERS_STEP 2503
+
+// Robots that keep a grid in counters name them after the coordinates,
+// so these are looked up in a scattered order like those would be.
+
+static void test_counters(struct world *mzx_world)
+{
+  char (*names)[16] = cmalloc(COUNTERS_NUM * 16);
+  Uint64 start;
+  int pos;
+  int i;
+
+  for(i = 0; i < COUNTERS_NUM; i++)
+    sprintf(names[i], "bx%dy%d", i % COUNTERS_SIDE, i / COUNTERS_SIDE);
+
+  start = get_ticks_us();
+  for(i = 0; i < COUNTERS_NUM; i++)
+    set_counter(mzx_world, names[i], i, 0);
+  print_rate("counters", "create", COUNTERS_NUM, get_ticks_us() - start);
+
+  start = get_ticks_us();
+  for(i = 0, pos = 0; i < COUNTERS_OPS; i++)
+  {
+    get_counter(mzx_world, names[pos], 0);
+    pos = (pos + COUNTERS_STEP) % COUNTERS_NUM;
+  }
+  print_rate("counters", "get", COUNTERS_OPS, get_ticks_us() - start);
+
+  start = get_ticks_us();
+  for(i = 0, pos = 0; i < COUNTERS_OPS; i++)
+  {
+    set_counter(mzx_world, names[pos], i, 0);
+    pos = (pos + COUNTERS_STEP) % COUNTERS_NUM;
+  }
+  print_rate("counters", "set", COUNTERS_OPS, get_ticks_us() - start);
+
+  start = get_ticks_us();
+  for(i = 0, pos = 0; i < COUNTERS_OPS; i++)
+  {
+    inc_counter(mzx_world, names[pos], 1, 0);
+    pos = (pos + COUNTERS_STEP) % COUNTERS_NUM;
+  }
+  print_rate("counters", "inc", COUNTERS_OPS, get_ticks_us() - start);
+
+  free(names);
+}
+
+#define BUILTINS_OPS  1000000
+
+// Names like the ones robots use most, to compare looking up builtin
+// counters with looking up the user counters beside them
+
+static const char *const builtin_names[] =
+{
+  "playerx", "playery", "loopcount", "spr3_x", "spr12_cy", "board_w",
+  "scrolledx", "mzx_speed", "local2", "abs-5", "vch3,4", "key_code",
+};
+
+static const char *const user_names[] =
+{
+  "health", "ammo", "gems", "x", "y", "dir", "frame", "hp2",
+  "enemy_count", "timer", "bx12y7", "spr_index",
+};
+
+static void test_builtins(struct world *mzx_world)
+{
+  int num_builtins = sizeof(builtin_names) / sizeof(char *);
+  int num_users = sizeof(user_names) / sizeof(char *);
+  Uint64 start;
+  int i;
+
+  for(i = 0; i < num_users; i++)
+    set_counter(mzx_world, user_names[i], i, 0);
+
+  start = get_ticks_us();
+  for(i = 0; i < BUILTINS_OPS; i++)
+    get_counter(mzx_world, builtin_names[i % num_builtins], 0);
+  print_rate("builtins", "builtin get", BUILTINS_OPS, get_ticks_us() - start);
+
+  start = get_ticks_us();
+  for(i = 0; i < BUILTINS_OPS; i++)
+    get_counter(mzx_world, user_names[i % num_users], 0);
+  print_rate("builtins", "user get", BUILTINS_OPS, get_ticks_us() - start);
+}
+
+#define GAME_WINDOW_FRAMES 20000
+
+// Draw the current board's game window over and over, first as it is and
+// then with an eighth of its cells recoloured before each frame
+
+static void test_game_window(struct world *mzx_world)
+{
+  struct board *src_board = mzx_world->current_board;
+  int board_size = src_board->board_width * src_board->board_height;
+  Uint64 start;
+  int pos = 0;
+  int i, i2;
+
+  start = get_ticks_us();
+  for(i = 0; i < GAME_WINDOW_FRAMES; i++)
+    draw_game_window(src_board, 0, 0);
+  print_rate("game_window", "static frame", GAME_WINDOW_FRAMES,
+   get_ticks_us() - start);
+
+  start = get_ticks_us();
+  for(i = 0; i < GAME_WINDOW_FRAMES; i++)
+  {
+    for(i2 = 0; i2 < board_size / 8; i2++)
+    {
+      src_board->level_color[pos]++;
+      pos = (pos + 8) % board_size;
+    }
+    mark_board_changed(src_board);
+
+    draw_game_window(src_board, 0, 0);
+  }
+  print_rate("game_window", "changed frame", GAME_WINDOW_FRAMES,
+   get_ticks_us() - start);
+}
+
+#define RENDER_FRAMES 2000
+#define RENDER_WIDTH  640
+#define RENDER_HEIGHT 350
+
+// Render a screen of random chars and colors to memory in each screen mode,
+// drawing every cell each frame
+
+static void test_render(struct world *mzx_world)
+{
+  Uint32 pitch = RENDER_WIDTH * sizeof(Uint32);
+  Uint32 *pixels = cmalloc(pitch * RENDER_HEIGHT);
+  Uint32 screen_mode = graphics.screen_mode;
+  struct char_element *src;
+  const char *name;
+  Uint64 start;
+  Uint32 mode;
+  int i;
+
+  for(i = 0; i < SCREEN_W * SCREEN_H; i++)
+  {
+    src = graphics.text_video + i;
+    src->char_value = Random(256);
+    src->bg_color = Random(16);
+    src->fg_color = Random(16);
+  }
+
+  for(mode = 0; mode < 4; mode++)
+  {
+    graphics.screen_mode = mode;
+
+    start = get_ticks_us();
+    for(i = 0; i < RENDER_FRAMES; i++)
+    {
+      graphics.redraw_all = true;
+
+      if(!mode)
+        render_graph32(pixels, pitch, &graphics, set_colors32[mode]);
+      else
+        render_graph32s(pixels, pitch, &graphics, set_colors32[mode]);
+    }
+
+    switch(mode)
+    {
+      case 0: name = "mzx frame"; break;
+      case 1: name = "smzx 1 frame"; break;
+      case 2: name = "smzx 2 frame"; break;
+      default: name = "smzx 3 frame"; break;
+    }
+
+    print_rate("render", name, RENDER_FRAMES, get_ticks_us() - start);
+  }
+
+  graphics.screen_mode = screen_mode;
+  graphics.redraw_all = true;
+  free(pixels);
+}
+
+#define WORLD_IO_ROUNDS 10
+#define WORLD_IO_FILE   "mzxbench.tmp"
+
+// Save the world to a scratch file and load it back again, as saving a
+// game and loading it would
+
+static void test_world_io(struct world *mzx_world)
+{
+  Uint64 start;
+  int fade = 0;
+  int i;
+
+  start = get_ticks_us();
+  for(i = 0; i < WORLD_IO_ROUNDS; i++)
+    save_world(mzx_world, WORLD_IO_FILE, 0);
+  print_rate("world_io", "save", WORLD_IO_ROUNDS, get_ticks_us() - start);
+
+  // Read every board in even with lazy_board_loading on, which also
+  // closes the scratch file again
+  start = get_ticks_us();
+  for(i = 0; i < WORLD_IO_ROUNDS; i++)
+  {
+    if(!reload_world(mzx_world, WORLD_IO_FILE, &fade))
+      break;
+
+    load_all_boards(mzx_world);
+  }
+  print_rate("world_io", "load", i, get_ticks_us() - start);
+
+  remove(WORLD_IO_FILE);
+}
+
+#ifdef CONFIG_AUDIO
+
+#define MIXER_STREAMS 16
+#define MIXER_SECONDS 10
+
+// Mix several sample streams at once with each way of resampling them
+
+static void test_mixer(struct world *mzx_world)
+{
+  static const char *const mode_names[] =
+  {
+    "flat", "nearest", "linear", "cubic",
+  };
+  Uint32 frames;
+  Uint64 time;
+  int mode;
+
+  for(mode = -1; mode < 3; mode++)
+  {
+    time = get_ticks_us();
+    frames = benchmark_mixer(mode, MIXER_STREAMS,
+     audio.output_frequency * MIXER_SECONDS);
+    time = get_ticks_us() - time;
+
+    info("  %-12s %-16s %9u in %6u.%03u ms  %10.0f frames/sec\n", "mixer",
+     mode_names[mode + 1], frames, (Uint32)(time / 1000),
+     (Uint32)(time % 1000), time ? (double)frames * 1000000.0 / time : 0.0);
+  }
+}
+
+#endif // CONFIG_AUDIO
+
+static const struct benchmark_test benchmark_tests[] =
+{
+  { "counters", test_counters },
+  { "builtins", test_builtins },
+  { "game_window", test_game_window },
+  { "render", test_render },
+  { "world_io", test_world_io },
+#ifdef CONFIG_AUDIO
+  { "mixer", test_mixer },
+#endif
+};
+
+static bool run_test(const char *list, const char *name)
+{
+  size_t len = strlen(name);
+  const char *pos;
+
+  if(!strcasecmp(list, "all"))
+    return true;
+
+  for(pos = list; pos; pos = strchr(pos, ','))
+  {
+    if(*pos == ',')
+      pos++;
+
+    if(!strncasecmp(pos, name, len) && ((pos[len] == ',') || !pos[len]))
+      return true;
+  }
+
+  return false;
+}
+
+// Run the tests named in benchmark_suite (separated by commas, or "all")
+
+void benchmark_suite(struct world *mzx_world)
+{
+  const char *list = mzx_world->conf.benchmark_suite;
+  const struct benchmark_test *test;
+  int num_tests =
+   sizeof(benchmark_tests) / sizeof(struct benchmark_test);
+  int fade = 0;
+  int i;
+
+  memset(&benchmark, 0, sizeof(struct benchmark_status));
+  benchmark.dismiss_dialogs = true;
+
+  set_random_seed(mzx_world->conf.benchmark_seed);
+  info("Benchmark suite on '%s':\n", curr_file);
+
+  for(i = 0; i < num_tests; i++)
+  {
+    test = &(benchmark_tests[i]);
+    if(!run_test(list, test->name))
+      continue;
+
+    if(!reload_world(mzx_world, curr_file, &fade))
+    {
+      warn("Failed to load '%s' for the benchmark\n", curr_file);
+      break;
+    }
+
+    test->run(mzx_world);
+  }
+
+  benchmark.dismiss_dialogs = false;
+}
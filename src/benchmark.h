@@ -0,0 +1,117 @@
+/* MegaZeux
+ *
+ * Copyright (C) 2026 MegaZeux contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// Benchmark runs play a world for a set number of cycles as fast as they
+// can, with a fixed random seed and keys from a script, then report how
+// long each part of a cycle took and a hash of where the world ended up.
+// The benchmark suite instead times parts of the engine one at a time.
+
+#ifndef __BENCHMARK_H
+#define __BENCHMARK_H
+
+#include "compat.h"
+
+__M_BEGIN_DECLS
+
+#include "configure.h"
+#include "platform.h"
+#include "trace.h"
+#include "world_struct.h"
+
+enum benchmark_phase
+{
+  BENCHMARK_OTHER,
+  BENCHMARK_ROBOTS,
+  BENCHMARK_BOARD,
+  BENCHMARK_SPRITES,
+  BENCHMARK_DRAW,
+  BENCHMARK_AUDIO,
+  NUM_BENCHMARK_PHASES
+};
+
+#define BENCHMARK_MAX_DEPTH 8
+
+struct benchmark_status
+{
+  bool active;
+
+  // Time is charged to the phase on top of the stack, so robots run by
+  // update_board don't count towards the board update
+  enum benchmark_phase stack[BENCHMARK_MAX_DEPTH];
+  int depth;
+  Uint64 phase_start;
+  Uint64 phase_time[NUM_BENCHMARK_PHASES];
+
+  // Totals of draw_sprites' counts, to tell how busy the sprites phase was
+  Uint64 sprites_drawn;
+  Uint64 sprite_chars_drawn;
+
+  // Set for the whole run, loading included, to close dialogs nobody is
+  // there to answer (see benchmark_dismiss). Counts the escapes that took
+  // in all and since the last cycle.
+  bool dismiss_dialogs;
+  bool dismiss_held;
+  int dismiss_keys;
+  int dismiss_tries;
+};
+
+extern struct benchmark_status benchmark;
+
+bool benchmark_init(struct config_info *conf);
+void benchmark_start(void);
+void benchmark_input(int cycle);
+void benchmark_dismiss(void);
+void benchmark_finish(struct world *mzx_world, int cycles);
+
+CORE_LIBSPEC void benchmark_suite(struct world *mzx_world);
+
+void __benchmark_enter(enum benchmark_phase phase);
+void __benchmark_leave(void);
+
+static inline void benchmark_enter(enum benchmark_phase phase)
+{
+  if(benchmark.active)
+    __benchmark_enter(phase);
+}
+
+static inline void benchmark_leave(void)
+{
+  if(benchmark.active)
+    __benchmark_leave();
+}
+
+// The parts of a game cycle are timed for benchmarks and marked in traces,
+// so both are entered and left together here. Scopes must nest.
+
+static inline void cycle_scope_begin(enum benchmark_phase phase,
+ const char *name)
+{
+  benchmark_enter(phase);
+  trace_begin(name);
+}
+
+static inline void cycle_scope_end(void)
+{
+  trace_end();
+  benchmark_leave();
+}
+
+__M_END_DECLS
+
+#endif // __BENCHMARK_H
@@ -25,7 +25,9 @@
 #include "world.h"
 #include "const.h"
 #include "extmem.h"
+#include "memfile.h"
 #include "error.h"
+#include "platform.h"
 #include "util.h"
 #include "validation.h"
 
@@ -38,6 +40,8 @@
 /* 80 (w/o saved NULL terminator) */
 #define LEGACY_INPUT_STRING_MAX 80
 
+unsigned int board_change_clock;
+
 static int cmp_robots(const void *dest, const void *src)
 {
   struct robot *rsrc = *((struct robot **)src);
@@ -45,39 +49,114 @@ static int cmp_robots(const void *dest, const void *src)
   return strcasecmp(rdest->robot_name, rsrc->robot_name);
 }
 
-static int load_RLE2_plane(char *plane, FILE *fp, int size)
+// RLE2 planes are handled right in the memfile's buffer. Stretches of
+// plain characters and of repeats are measured eight bytes at a time.
+
+#define RLE2_HIGH_BITS 0x8080808080808080ULL
+#define RLE2_REPEAT    0x0101010101010101ULL
+
+// The number of characters from src that can be stored as they are
+static inline int rle2_plain_length(const unsigned char *src, int max)
+{
+  Uint64 word;
+  int i;
+
+  for(i = 0; i + 8 <= max; i += 8)
+  {
+    memcpy(&word, src + i, 8);
+    if(word & RLE2_HIGH_BITS)
+      break;
+  }
+
+  while((i < max) && !(src[i] & 0x80))
+    i++;
+
+  return i;
+}
+
+// The number of characters from src that aren't the start of a run and
+// can be saved as they are
+static inline int rle2_single_length(const unsigned char *src, int max)
 {
-  int i, runsize;
+  Uint64 word, next, diff;
+  int i;
+
+  for(i = 0; i + 9 <= max; i += 8)
+  {
+    memcpy(&word, src + i, 8);
+    memcpy(&next, src + i + 1, 8);
+    diff = word ^ next;
+
+    // Stop at a high bit or at a zero byte in diff (a repeat)
+    if((word & RLE2_HIGH_BITS) ||
+     ((diff - RLE2_REPEAT) & ~diff & RLE2_HIGH_BITS))
+      break;
+  }
+
+  while((i < max) && !(src[i] & 0x80) &&
+   ((i + 1 == max) || (src[i] != src[i + 1])))
+    i++;
+
+  return i;
+}
+
+// The number of times the first character of src repeats
+static inline int rle2_run_length(const unsigned char *src, int max)
+{
+  Uint64 run = src[0] * RLE2_REPEAT;
+  Uint64 word;
+  int i;
+
+  for(i = 0; i + 8 <= max; i += 8)
+  {
+    memcpy(&word, src + i, 8);
+    if(word != run)
+      break;
+  }
+
+  while((i < max) && (src[i] == src[0]))
+    i++;
+
+  return i;
+}
+
+static int load_RLE2_plane(char *plane, struct memfile *mf, int size)
+{
+  int i, runsize, len;
   int current_char;
 
   if(size < 0)
     return -3;
 
-  for(i = 0; i < size; i++)
+  for(i = 0; i < size; i += len)
   {
-    current_char = fgetc(fp);
-    if(current_char == EOF)
-    {
+    if((mf->current >= mf->end) && !mffill(mf))
       return -1;
-    }
-    else if(!(current_char & 0x80))
+
+    if(!(mf->current[0] & 0x80))
     {
-      // Regular character
-      plane[i] = current_char;
+      // Regular characters
+      len = rle2_plain_length(mf->current,
+       MIN(size - i, (int)(mf->end - mf->current)));
+
+      memcpy(plane + i, mf->current, len);
+      mf->current += len;
     }
     else
     {
       // A run
-      runsize = current_char & 0x7F;
+      runsize = mf->current[0] & 0x7F;
+      mf->current++;
+
       if((i + runsize) > size)
         return -2;
 
-      current_char = fgetc(fp);
+      current_char = mfgetc(mf);
       if(current_char == EOF)
         return -1;
 
       memset(plane + i, current_char, runsize);
-      i += (runsize - 1);
+      len = runsize;
     }
   }
 
@@ -87,6 +166,10 @@ static int load_RLE2_plane(char *plane, FILE *fp, int size)
 static void create_blank_board(struct board *cur_board)
 {
   int size = 2000;
+  cur_board->loaded = true;
+  cur_board->clean = false;
+  cur_board->last_used = 0;
+  mark_board_changed(cur_board);
   cur_board->overlay_mode = 0;
   cur_board->board_width = 80;
   cur_board->board_height = 25;
@@ -154,8 +237,8 @@ static void create_blank_board(struct board *cur_board)
   cur_board->sensor_list = ccalloc(1, sizeof(struct sensor *));
 }
 
-__editor_maybe_static int load_board_direct(struct board *cur_board,
- FILE *fp, int data_size, int savegame, int version)
+int load_board_direct(struct board *cur_board,
+ struct memfile *mf, int data_size, int savegame, int version)
 {
   int num_robots, num_scrolls, num_sensors, num_robots_active;
   int overlay_mode, size, board_width, board_height, i;
@@ -168,8 +251,13 @@ __editor_maybe_static int load_board_direct(struct board *cur_board,
 
   char *test_buffer;
 
-  int board_location = ftell(fp);
+  int board_location = mftell(mf);
 
+  cur_board->loaded = true;
+  cur_board->clean = false;
+  cur_board->last_used = 0;
+  cur_board->update_chunks = NULL;
+  mark_board_changed(cur_board);
   cur_board->num_robots = 0;
   cur_board->num_robots_allocated = 0;
   cur_board->num_robots_active = 0;
@@ -204,22 +292,22 @@ __editor_maybe_static int load_board_direct(struct board *cur_board,
   cur_board->volume_target = 255;
 
   // board_mode, unused
-  if(fgetc(fp) == EOF)
+  if(mfgetc(mf) == EOF)
   {
     val_error(WORLD_BOARD_MISSING, board_location);
     return VAL_MISSING;
   }
 
-  overlay_mode = fgetc(fp);
+  overlay_mode = mfgetc(mf);
 
   if(!overlay_mode)
   {
     int overlay_width;
     int overlay_height;
 
-    overlay_mode = fgetc(fp);
-    overlay_width = fgetw(fp);
-    overlay_height = fgetw(fp);
+    overlay_mode = mfgetc(mf);
+    overlay_width = mfgetw(mf);
+    overlay_height = mfgetw(mf);
 
     size = overlay_width * overlay_height;
 
@@ -229,15 +317,15 @@ __editor_maybe_static int load_board_direct(struct board *cur_board,
     cur_board->overlay = cmalloc(size);
     cur_board->overlay_color = cmalloc(size);
 
-    if(load_RLE2_plane(cur_board->overlay, fp, size))
+    if(load_RLE2_plane(cur_board->overlay, mf, size))
       goto err_freeoverlay;
 
     test_buffer = cmalloc(1024);
     free(test_buffer);
 
     // Skip sizes
-    if(fseek(fp, 4, SEEK_CUR) ||
-     load_RLE2_plane(cur_board->overlay_color, fp, size))
+    if(mfseek(mf, 4, SEEK_CUR) ||
+     load_RLE2_plane(cur_board->overlay_color, mf, size))
       goto err_freeoverlay;
 
     test_buffer = cmalloc(1024);
@@ -247,13 +335,13 @@ __editor_maybe_static int load_board_direct(struct board *cur_board,
   {
     overlay_mode = 0;
     // Undo that last get
-    fseek(fp, -1, SEEK_CUR);
+    mfseek(mf, -1, SEEK_CUR);
   }
 
   cur_board->overlay_mode = overlay_mode;
 
-  board_width = fgetw(fp);
-  board_height = fgetw(fp);
+  board_width = mfgetw(mf);
+  board_height = mfgetw(mf);
   cur_board->board_width = board_width;
   cur_board->board_height = board_height;
 
@@ -269,50 +357,50 @@ __editor_maybe_static int load_board_direct(struct board *cur_board,
   cur_board->level_under_color = cmalloc(size);
   cur_board->level_under_param = cmalloc(size);
 
-  if(load_RLE2_plane(cur_board->level_id, fp, size))
+  if(load_RLE2_plane(cur_board->level_id, mf, size))
     goto err_freeboard;
 
-  if(fseek(fp, 4, SEEK_CUR) ||
-   load_RLE2_plane(cur_board->level_color, fp, size))
+  if(mfseek(mf, 4, SEEK_CUR) ||
+   load_RLE2_plane(cur_board->level_color, mf, size))
     goto err_freeboard;
 
-  if(fseek(fp, 4, SEEK_CUR) ||
-   load_RLE2_plane(cur_board->level_param, fp, size))
+  if(mfseek(mf, 4, SEEK_CUR) ||
+   load_RLE2_plane(cur_board->level_param, mf, size))
     goto err_freeboard;
 
-  if(fseek(fp, 4, SEEK_CUR) ||
-   load_RLE2_plane(cur_board->level_under_id, fp, size))
+  if(mfseek(mf, 4, SEEK_CUR) ||
+   load_RLE2_plane(cur_board->level_under_id, mf, size))
     goto err_freeboard;
 
-  if(fseek(fp, 4, SEEK_CUR) ||
-   load_RLE2_plane(cur_board->level_under_color, fp, size))
+  if(mfseek(mf, 4, SEEK_CUR) ||
+   load_RLE2_plane(cur_board->level_under_color, mf, size))
     goto err_freeboard;
 
-  if(fseek(fp, 4, SEEK_CUR) ||
-   load_RLE2_plane(cur_board->level_under_param, fp, size))
+  if(mfseek(mf, 4, SEEK_CUR) ||
+   load_RLE2_plane(cur_board->level_under_param, mf, size))
     goto err_freeboard;
 
   // Load board parameters
 
   if(version < 0x0253)
   {
-    fread(cur_board->mod_playing, LEGACY_MOD_FILENAME_MAX, 1, fp);
+    mfread(cur_board->mod_playing, LEGACY_MOD_FILENAME_MAX, 1, mf);
     cur_board->mod_playing[LEGACY_MOD_FILENAME_MAX] = 0;
   }
   else
   {
-    size_t len = fgetw(fp);
+    size_t len = mfgetw(mf);
     if(len >= MAX_PATH)
       len = MAX_PATH - 1;
 
-    fread(cur_board->mod_playing, len, 1, fp);
+    mfread(cur_board->mod_playing, len, 1, mf);
     cur_board->mod_playing[len] = 0;
   }
 
-  viewport_x = fgetc(fp);
-  viewport_y = fgetc(fp);
-  viewport_width = fgetc(fp);
-  viewport_height = fgetc(fp);
+  viewport_x = mfgetc(mf);
+  viewport_y = mfgetc(mf);
+  viewport_width = mfgetc(mf);
+  viewport_height = mfgetc(mf);
 
   if(
    (viewport_x < 0) || (viewport_x > 79) ||
@@ -325,99 +413,99 @@ __editor_maybe_static int load_board_direct(struct board *cur_board,
   cur_board->viewport_y = viewport_y;
   cur_board->viewport_width = viewport_width;
   cur_board->viewport_height = viewport_height;
-  cur_board->can_shoot = fgetc(fp);
-  cur_board->can_bomb = fgetc(fp);
-  cur_board->fire_burn_brown = fgetc(fp);
-  cur_board->fire_burn_space = fgetc(fp);
-  cur_board->fire_burn_fakes = fgetc(fp);
-  cur_board->fire_burn_trees = fgetc(fp);
-  cur_board->explosions_leave = fgetc(fp);
-  cur_board->save_mode = fgetc(fp);
-  cur_board->forest_becomes = fgetc(fp);
-  cur_board->collect_bombs = fgetc(fp);
-  cur_board->fire_burns = fgetc(fp);
+  cur_board->can_shoot = mfgetc(mf);
+  cur_board->can_bomb = mfgetc(mf);
+  cur_board->fire_burn_brown = mfgetc(mf);
+  cur_board->fire_burn_space = mfgetc(mf);
+  cur_board->fire_burn_fakes = mfgetc(mf);
+  cur_board->fire_burn_trees = mfgetc(mf);
+  cur_board->explosions_leave = mfgetc(mf);
+  cur_board->save_mode = mfgetc(mf);
+  cur_board->forest_becomes = mfgetc(mf);
+  cur_board->collect_bombs = mfgetc(mf);
+  cur_board->fire_burns = mfgetc(mf);
 
   for(i = 0; i < 4; i++)
   {
-    cur_board->board_dir[i] = fgetc(fp);
+    cur_board->board_dir[i] = mfgetc(mf);
   }
 
-  cur_board->restart_if_zapped = fgetc(fp);
-  cur_board->time_limit = fgetw(fp);
+  cur_board->restart_if_zapped = mfgetc(mf);
+  cur_board->time_limit = mfgetw(mf);
 
   if(version < 0x0253)
   {
-    cur_board->last_key = fgetc(fp);
-    cur_board->num_input = fgetw(fp);
-    cur_board->input_size = fgetc(fp);
+    cur_board->last_key = mfgetc(mf);
+    cur_board->num_input = mfgetw(mf);
+    cur_board->input_size = mfgetc(mf);
 
-    fread(cur_board->input_string, LEGACY_INPUT_STRING_MAX + 1, 1, fp);
+    mfread(cur_board->input_string, LEGACY_INPUT_STRING_MAX + 1, 1, mf);
     cur_board->input_string[LEGACY_INPUT_STRING_MAX] = 0;
 
-    cur_board->player_last_dir = fgetc(fp);
+    cur_board->player_last_dir = mfgetc(mf);
 
-    fread(cur_board->bottom_mesg, LEGACY_BOTTOM_MESG_MAX + 1, 1, fp);
+    mfread(cur_board->bottom_mesg, LEGACY_BOTTOM_MESG_MAX + 1, 1, mf);
     cur_board->bottom_mesg[LEGACY_BOTTOM_MESG_MAX] = 0;
 
-    cur_board->b_mesg_timer = fgetc(fp);
-    cur_board->lazwall_start = fgetc(fp);
-    cur_board->b_mesg_row = fgetc(fp);
-    cur_board->b_mesg_col = (signed char)fgetc(fp);
-    cur_board->scroll_x = (signed short)fgetw(fp);
-    cur_board->scroll_y = (signed short)fgetw(fp);
-    cur_board->locked_x = (signed short)fgetw(fp);
-    cur_board->locked_y = (signed short)fgetw(fp);
+    cur_board->b_mesg_timer = mfgetc(mf);
+    cur_board->lazwall_start = mfgetc(mf);
+    cur_board->b_mesg_row = mfgetc(mf);
+    cur_board->b_mesg_col = (signed char)mfgetc(mf);
+    cur_board->scroll_x = (signed short)mfgetw(mf);
+    cur_board->scroll_y = (signed short)mfgetw(mf);
+    cur_board->locked_x = (signed short)mfgetw(mf);
+    cur_board->locked_y = (signed short)mfgetw(mf);
   }
   else if(savegame)
   {
     size_t len;
 
-    cur_board->last_key = fgetc(fp);
-    cur_board->num_input = fgetw(fp);
-    cur_board->input_size = fgetw(fp);
+    cur_board->last_key = mfgetc(mf);
+    cur_board->num_input = mfgetw(mf);
+    cur_board->input_size = mfgetw(mf);
 
-    len = fgetw(fp);
+    len = mfgetw(mf);
     if(len >= ROBOT_MAX_TR)
       len = ROBOT_MAX_TR - 1;
 
-    fread(cur_board->input_string, len, 1, fp);
+    mfread(cur_board->input_string, len, 1, mf);
     cur_board->input_string[len] = 0;
 
-    cur_board->player_last_dir = fgetc(fp);
+    cur_board->player_last_dir = mfgetc(mf);
 
-    len = fgetw(fp);
+    len = mfgetw(mf);
     if(len >= ROBOT_MAX_TR)
       len = ROBOT_MAX_TR - 1;
 
-    fread(cur_board->bottom_mesg, len, 1, fp);
+    mfread(cur_board->bottom_mesg, len, 1, mf);
     cur_board->bottom_mesg[len] = 0;
 
-    cur_board->b_mesg_timer = fgetc(fp);
-    cur_board->lazwall_start = fgetc(fp);
-    cur_board->b_mesg_row = fgetc(fp);
-    cur_board->b_mesg_col = (signed char)fgetc(fp);
-    cur_board->scroll_x = (signed short)fgetw(fp);
-    cur_board->scroll_y = (signed short)fgetw(fp);
-    cur_board->locked_x = (signed short)fgetw(fp);
-    cur_board->locked_y = (signed short)fgetw(fp);
+    cur_board->b_mesg_timer = mfgetc(mf);
+    cur_board->lazwall_start = mfgetc(mf);
+    cur_board->b_mesg_row = mfgetc(mf);
+    cur_board->b_mesg_col = (signed char)mfgetc(mf);
+    cur_board->scroll_x = (signed short)mfgetw(mf);
+    cur_board->scroll_y = (signed short)mfgetw(mf);
+    cur_board->locked_x = (signed short)mfgetw(mf);
+    cur_board->locked_y = (signed short)mfgetw(mf);
   }
 
-  cur_board->player_ns_locked = fgetc(fp);
-  cur_board->player_ew_locked = fgetc(fp);
-  cur_board->player_attack_locked = fgetc(fp);
+  cur_board->player_ns_locked = mfgetc(mf);
+  cur_board->player_ew_locked = mfgetc(mf);
+  cur_board->player_attack_locked = mfgetc(mf);
 
   if(version < 0x0253 || savegame)
   {
-    cur_board->volume = fgetc(fp);
-    cur_board->volume_inc = fgetc(fp);
-    cur_board->volume_target = fgetc(fp);
+    cur_board->volume = mfgetc(mf);
+    cur_board->volume_inc = mfgetc(mf);
+    cur_board->volume_target = mfgetc(mf);
   }
 
 
   /***************/
   /* Load robots */
   /***************/
-  num_robots = fgetc(fp);
+  num_robots = mfgetc(mf);
   num_robots_active = 0;
 
   if(num_robots == EOF)
@@ -439,17 +527,17 @@ __editor_maybe_static int load_board_direct(struct board *cur_board,
     for(i = 1; i <= num_robots; i++)
     {
       // Make sure there's robots to load here
-      int length_check = fgetw(fp);
-      fseek(fp, -2, SEEK_CUR);
+      int length_check = mfgetw(mf);
+      mfseek(mf, -2, SEEK_CUR);
       if(length_check < 0)
       {
         // Send off the error and then tell validation to shut up for now
-        val_error(WORLD_ROBOT_MISSING, ftell(fp));
+        val_error(WORLD_ROBOT_MISSING, mftell(mf));
         set_validation_suppression(1);
         truncated = 1;
       }
 
-      cur_robot = load_robot_allocate(fp, savegame, version);
+      cur_robot = load_robot_allocate(mf, savegame, version);
       if(cur_robot->used)
       {
         cur_board->robot_list[i] = cur_robot;
@@ -492,7 +580,7 @@ __editor_maybe_static int load_board_direct(struct board *cur_board,
   /****************/
   /* Load scrolls */
   /****************/
-  num_scrolls = fgetc(fp);
+  num_scrolls = mfgetc(mf);
 
   if(num_scrolls == EOF)
     truncated = 1;
@@ -506,7 +594,7 @@ __editor_maybe_static int load_board_direct(struct board *cur_board,
   {
     for(i = 1; i <= num_scrolls; i++)
     {
-      cur_scroll = load_scroll_allocate(fp);
+      cur_scroll = load_scroll_allocate(mf);
       if(cur_scroll->used)
         cur_board->scroll_list[i] = cur_scroll;
       else
@@ -521,7 +609,7 @@ __editor_maybe_static int load_board_direct(struct board *cur_board,
   /****************/
   /* Load sensors */
   /****************/
-  num_sensors = fgetc(fp);
+  num_sensors = mfgetc(mf);
 
   if(num_sensors == EOF)
     truncated = 1;
@@ -536,7 +624,7 @@ __editor_maybe_static int load_board_direct(struct board *cur_board,
   {
     for(i = 1; i <= num_sensors; i++)
     {
-      cur_sensor = load_sensor_allocate(fp);
+      cur_sensor = load_sensor_allocate(mf);
       if(cur_sensor->used)
         cur_board->sensor_list[i] = cur_sensor;
       else
@@ -649,36 +737,37 @@ err_invalid:
   return VAL_INVALID;
 }
 
-struct board *load_board_allocate(FILE *fp, int savegame, int version)
+struct board *load_board_allocate(struct memfile *mf, int savegame,
+ int version)
 {
   struct board *cur_board = cmalloc(sizeof(struct board));
   int board_size, board_location, last_location;
   enum val_result result;
 
-  board_size = fgetd(fp);
+  board_size = mfgetd(mf);
 
   // Skip deleted boards
   if(!board_size)
   {
-    fseek(fp, 4, SEEK_CUR);
+    mfseek(mf, 4, SEEK_CUR);
     goto err_out;
   }
 
-  board_location = fgetd(fp);
-  last_location = ftell(fp);
+  board_location = mfgetd(mf);
+  last_location = mftell(mf);
 
-  if(fseek(fp, board_location, SEEK_SET))
+  if(mfseek(mf, board_location, SEEK_SET))
   {
     val_error(WORLD_BOARD_MISSING, board_location);
     goto err_out;
   }
 
-  result = load_board_direct(cur_board, fp, board_size, savegame, version);
+  result = load_board_direct(cur_board, mf, board_size, savegame, version);
 
   if(result != VAL_SUCCESS)
     create_blank_board(cur_board);
 
-  fseek(fp, last_location, SEEK_SET);
+  mfseek(mf, last_location, SEEK_SET);
   return cur_board;
 
 err_out:
@@ -686,158 +775,185 @@ err_out:
   return NULL;
 }
 
-static void save_RLE2_plane(char *plane, FILE *fp, int size)
+// Read in a board load_world left in the world file. If it can't be read,
+// it becomes a blank board, as it would have been if loaded right away.
+void load_lazy_board(struct board *cur_board, FILE *fp, int savegame,
+ int version)
 {
-  int i, runsize;
-  char current_char;
+  enum val_result result = VAL_MISSING;
+  struct memfile mf;
 
-  for(i = 0; i < size; i++)
+  if(fseek(fp, cur_board->file_offset, SEEK_SET))
   {
-    current_char = plane[i];
-    runsize = 1;
+    val_error(WORLD_BOARD_MISSING, cur_board->file_offset);
+  }
+  else
+  {
+    mfopen_file(&mf, fp);
+    result = load_board_direct(cur_board, &mf, cur_board->file_size,
+     savegame, version);
+    mfclose(&mf);
+  }
 
-    while((i < (size - 1)) && (plane[i + 1] == current_char) &&
-     (runsize < 127))
-    {
-      i++;
-      runsize++;
-    }
+  if(result != VAL_SUCCESS)
+    create_blank_board(cur_board);
+}
 
-    // Put the runsize if necessary
-    if((runsize > 1) || current_char & 0x80)
-    {
-      fputc(runsize | 0x80, fp);
-      // Put the run character
-      fputc(current_char, fp);
-    }
-    else
+static void save_RLE2_plane(char *plane, struct memfile *mf, int size)
+{
+  unsigned char *src = (unsigned char *)plane;
+  unsigned char *dest;
+  int i = 0, len, runsize;
+
+  // At worst every character takes two bytes
+  mfreserve(mf, size * 2);
+  dest = mf->current;
+
+  while(i < size)
+  {
+    len = rle2_single_length(src + i, size - i);
+    memcpy(dest, src + i, len);
+    dest += len;
+    i += len;
+
+    if(i < size)
     {
-      fputc(current_char, fp);
+      runsize = rle2_run_length(src + i, MIN(size - i, 127));
+
+      // Put the runsize if necessary
+      if((runsize > 1) || (src[i] & 0x80))
+        *(dest++) = runsize | 0x80;
+
+      *(dest++) = src[i];
+      i += runsize;
     }
   }
+
+  mfadvance(mf, dest - mf->current);
 }
 
-int save_board(struct board *cur_board, FILE *fp, int savegame, int version)
+int save_board(struct board *cur_board, struct memfile *mf, int savegame,
+ int version)
 {
   int num_robots, num_scrolls, num_sensors;
-  int start_location = ftell(fp);
+  int start_location = mftell(mf);
   int board_width = cur_board->board_width;
   int board_height = cur_board->board_height;
   int board_size = board_width * board_height;
   int i;
 
   // Board mode is now ignored, put 0
-  fputc(0, fp);
+  mfputc(0, mf);
   // Put overlay mode
 
   if(cur_board->overlay_mode)
   {
-    fputc(0, fp);
-    fputc(cur_board->overlay_mode, fp);
-    fputw(cur_board->board_width, fp);
-    fputw(cur_board->board_height, fp);
-    save_RLE2_plane(cur_board->overlay, fp, board_size);
-    fputw(cur_board->board_width, fp);
-    fputw(cur_board->board_height, fp);
-    save_RLE2_plane(cur_board->overlay_color, fp, board_size);
-  }
-
-  fputw(board_width, fp);
-  fputw(board_height, fp);
-  save_RLE2_plane(cur_board->level_id, fp, board_size);
-  fputw(board_width, fp);
-  fputw(board_height, fp);
-  save_RLE2_plane(cur_board->level_color, fp, board_size);
-  fputw(board_width, fp);
-  fputw(board_height, fp);
-  save_RLE2_plane(cur_board->level_param, fp, board_size);
-  fputw(board_width, fp);
-  fputw(board_height, fp);
-  save_RLE2_plane(cur_board->level_under_id, fp, board_size);
-  fputw(board_width, fp);
-  fputw(board_height, fp);
-  save_RLE2_plane(cur_board->level_under_color, fp, board_size);
-  fputw(board_width, fp);
-  fputw(board_height, fp);
-  save_RLE2_plane(cur_board->level_under_param, fp, board_size);
+    mfputc(0, mf);
+    mfputc(cur_board->overlay_mode, mf);
+    mfputw(cur_board->board_width, mf);
+    mfputw(cur_board->board_height, mf);
+    save_RLE2_plane(cur_board->overlay, mf, board_size);
+    mfputw(cur_board->board_width, mf);
+    mfputw(cur_board->board_height, mf);
+    save_RLE2_plane(cur_board->overlay_color, mf, board_size);
+  }
+
+  mfputw(board_width, mf);
+  mfputw(board_height, mf);
+  save_RLE2_plane(cur_board->level_id, mf, board_size);
+  mfputw(board_width, mf);
+  mfputw(board_height, mf);
+  save_RLE2_plane(cur_board->level_color, mf, board_size);
+  mfputw(board_width, mf);
+  mfputw(board_height, mf);
+  save_RLE2_plane(cur_board->level_param, mf, board_size);
+  mfputw(board_width, mf);
+  mfputw(board_height, mf);
+  save_RLE2_plane(cur_board->level_under_id, mf, board_size);
+  mfputw(board_width, mf);
+  mfputw(board_height, mf);
+  save_RLE2_plane(cur_board->level_under_color, mf, board_size);
+  mfputw(board_width, mf);
+  mfputw(board_height, mf);
+  save_RLE2_plane(cur_board->level_under_param, mf, board_size);
 
   // Save board parameters
 
   {
     size_t len = strlen(cur_board->mod_playing);
-    fputw((int)len, fp);
+    mfputw((int)len, mf);
     if(len)
-      fwrite(cur_board->mod_playing, len, 1, fp);
-  }
-
-  fputc(cur_board->viewport_x, fp);
-  fputc(cur_board->viewport_y, fp);
-  fputc(cur_board->viewport_width, fp);
-  fputc(cur_board->viewport_height, fp);
-  fputc(cur_board->can_shoot, fp);
-  fputc(cur_board->can_bomb, fp);
-  fputc(cur_board->fire_burn_brown, fp);
-  fputc(cur_board->fire_burn_space, fp);
-  fputc(cur_board->fire_burn_fakes, fp);
-  fputc(cur_board->fire_burn_trees, fp);
-  fputc(cur_board->explosions_leave, fp);
-  fputc(cur_board->save_mode, fp);
-  fputc(cur_board->forest_becomes, fp);
-  fputc(cur_board->collect_bombs, fp);
-  fputc(cur_board->fire_burns, fp);
+      mfwrite(cur_board->mod_playing, len, 1, mf);
+  }
+
+  mfputc(cur_board->viewport_x, mf);
+  mfputc(cur_board->viewport_y, mf);
+  mfputc(cur_board->viewport_width, mf);
+  mfputc(cur_board->viewport_height, mf);
+  mfputc(cur_board->can_shoot, mf);
+  mfputc(cur_board->can_bomb, mf);
+  mfputc(cur_board->fire_burn_brown, mf);
+  mfputc(cur_board->fire_burn_space, mf);
+  mfputc(cur_board->fire_burn_fakes, mf);
+  mfputc(cur_board->fire_burn_trees, mf);
+  mfputc(cur_board->explosions_leave, mf);
+  mfputc(cur_board->save_mode, mf);
+  mfputc(cur_board->forest_becomes, mf);
+  mfputc(cur_board->collect_bombs, mf);
+  mfputc(cur_board->fire_burns, mf);
 
   for(i = 0; i < 4; i++)
   {
-    fputc(cur_board->board_dir[i], fp);
+    mfputc(cur_board->board_dir[i], mf);
   }
 
-  fputc(cur_board->restart_if_zapped, fp);
-  fputw(cur_board->time_limit, fp);
+  mfputc(cur_board->restart_if_zapped, mf);
+  mfputw(cur_board->time_limit, mf);
 
   if(savegame)
   {
     size_t len;
 
-    fputc(cur_board->last_key, fp);
-    fputw(cur_board->num_input, fp);
-    fputw((int)cur_board->input_size, fp);
+    mfputc(cur_board->last_key, mf);
+    mfputw(cur_board->num_input, mf);
+    mfputw((int)cur_board->input_size, mf);
 
     len = strlen(cur_board->input_string);
-    fputw((int)len, fp);
+    mfputw((int)len, mf);
     if(len)
-      fwrite(cur_board->input_string, len, 1, fp);
+      mfwrite(cur_board->input_string, len, 1, mf);
 
-    fputc(cur_board->player_last_dir, fp);
+    mfputc(cur_board->player_last_dir, mf);
 
     len = strlen(cur_board->bottom_mesg);
-    fputw((int)len, fp);
+    mfputw((int)len, mf);
     if(len)
-      fwrite(cur_board->bottom_mesg, len, 1, fp);
-
-    fputc(cur_board->b_mesg_timer, fp);
-    fputc(cur_board->lazwall_start, fp);
-    fputc(cur_board->b_mesg_row, fp);
-    fputc(cur_board->b_mesg_col, fp);
-    fputw(cur_board->scroll_x, fp);
-    fputw(cur_board->scroll_y, fp);
-    fputw(cur_board->locked_x, fp);
-    fputw(cur_board->locked_y, fp);
+      mfwrite(cur_board->bottom_mesg, len, 1, mf);
+
+    mfputc(cur_board->b_mesg_timer, mf);
+    mfputc(cur_board->lazwall_start, mf);
+    mfputc(cur_board->b_mesg_row, mf);
+    mfputc(cur_board->b_mesg_col, mf);
+    mfputw(cur_board->scroll_x, mf);
+    mfputw(cur_board->scroll_y, mf);
+    mfputw(cur_board->locked_x, mf);
+    mfputw(cur_board->locked_y, mf);
   }
 
-  fputc(cur_board->player_ns_locked, fp);
-  fputc(cur_board->player_ew_locked, fp);
-  fputc(cur_board->player_attack_locked, fp);
+  mfputc(cur_board->player_ns_locked, mf);
+  mfputc(cur_board->player_ew_locked, mf);
+  mfputc(cur_board->player_attack_locked, mf);
 
   if(savegame)
   {
-    fputc(cur_board->volume, fp);
-    fputc(cur_board->volume_inc, fp);
-    fputc(cur_board->volume_target, fp);
+    mfputc(cur_board->volume, mf);
+    mfputc(cur_board->volume_inc, mf);
+    mfputc(cur_board->volume_target, mf);
   }
 
   // Save robots
   num_robots = cur_board->num_robots;
-  fputc(num_robots, fp);
+  mfputc(num_robots, mf);
 
   if(num_robots)
   {
@@ -846,13 +962,13 @@ int save_board(struct board *cur_board, FILE *fp, int savegame, int version)
     for(i = 1; i <= num_robots; i++)
     {
       cur_robot = cur_board->robot_list[i];
-      save_robot(cur_robot, fp, savegame, version);
+      save_robot(cur_robot, mf, savegame, version);
     }
   }
 
   // Save scrolls
   num_scrolls = cur_board->num_scrolls;
-  putc(num_scrolls, fp);
+  mfputc(num_scrolls, mf);
 
   if(num_scrolls)
   {
@@ -861,13 +977,13 @@ int save_board(struct board *cur_board, FILE *fp, int savegame, int version)
     for(i = 1; i <= num_scrolls; i++)
     {
       cur_scroll = cur_board->scroll_list[i];
-      save_scroll(cur_scroll, fp, savegame);
+      save_scroll(cur_scroll, mf, savegame);
     }
   }
 
   // Save sensors
   num_sensors = cur_board->num_sensors;
-  fputc(num_sensors, fp);
+  mfputc(num_sensors, mf);
 
   if(num_sensors)
   {
@@ -876,14 +992,14 @@ int save_board(struct board *cur_board, FILE *fp, int savegame, int version)
     for(i = 1; i <= num_sensors; i++)
     {
       cur_sensor = cur_board->sensor_list[i];
-      save_sensor(cur_sensor, fp, savegame);
+      save_sensor(cur_sensor, mf, savegame);
     }
   }
 
-  return (ftell(fp) - start_location);
+  return (mftell(mf) - start_location);
 }
 
-void clear_board(struct board *cur_board)
+static void free_board_data(struct board *cur_board)
 {
   int i;
   int num_robots_active = cur_board->num_robots_active;
@@ -900,6 +1016,7 @@ void clear_board(struct board *cur_board)
   free(cur_board->level_under_id);
   free(cur_board->level_under_param);
   free(cur_board->level_under_color);
+  free(cur_board->update_chunks);
 
   if(cur_board->overlay_mode)
   {
@@ -925,9 +1042,40 @@ void clear_board(struct board *cur_board)
       clear_sensor(sensor_list[i]);
 
   free(sensor_list);
+}
+
+void clear_board(struct board *cur_board)
+{
+  free_board_data(cur_board);
   free(cur_board);
 }
 
+// Drop everything but the name and file location of a lazily loaded board,
+// so it can be read in again when it's next needed.
+void unload_board(struct board *cur_board)
+{
+  char board_name[BOARD_NAME_SIZE];
+  int file_offset = cur_board->file_offset;
+  int file_size = cur_board->file_size;
+
+  memcpy(board_name, cur_board->board_name, BOARD_NAME_SIZE);
+  free_board_data(cur_board);
+
+  memset(cur_board, 0, sizeof(struct board));
+  memcpy(cur_board->board_name, board_name, BOARD_NAME_SIZE);
+  cur_board->file_offset = file_offset;
+  cur_board->file_size = file_size;
+}
+
+// Forget which parts of the board need updating, so the next update_board
+// call visits all of it. Used after the board was changed behind its back.
+
+void reset_board_update(struct board *cur_board)
+{
+  free(cur_board->update_chunks);
+  cur_board->update_chunks = NULL;
+}
+
 // Just a linear search. Boards aren't addressed by name very often.
 int find_board(struct world *mzx_world, char *name)
 {
@@ -28,21 +28,50 @@ __M_BEGIN_DECLS
 #include "board_struct.h"
 #include "world_struct.h"
 #include "validation.h"
+#include "memfile.h"
 
 #define MAX_BOARDS 250
 
+// update_board only visits the chunks of a board that are marked as maybe
+// holding something to update. Anything that puts an updating thing on the
+// board, or sets its update_done value, must mark the cell it changed.
+#define UPDATE_CHUNK_SHIFT 5
+#define UPDATE_CHUNK_SIZE (1 << UPDATE_CHUNK_SHIFT)
+
+static inline void mark_board_update(struct board *cur_board, int offset)
+{
+  unsigned int chunk = (unsigned int)offset >> UPDATE_CHUNK_SHIFT;
+
+  if(cur_board->update_chunks)
+    cur_board->update_chunks[chunk / 32] |= 1u << (chunk % 32);
+}
+
+// The game window reuses last frame's cells while the board's change stamp
+// stays the same. Anything that changes how the board looks (its level and
+// overlay, its robot and sensor chars or the player's direction) must mark
+// it. Stamps come from one clock, so a board loaded in place of another
+// never gets a stamp the window has already seen.
+CORE_LIBSPEC extern unsigned int board_change_clock;
+
+static inline void mark_board_changed(struct board *cur_board)
+{
+  cur_board->change_stamp = ++board_change_clock;
+}
+
 CORE_LIBSPEC void clear_board(struct board *cur_board);
-CORE_LIBSPEC struct board *load_board_allocate(FILE *fp, int savegame,
+CORE_LIBSPEC void reset_board_update(struct board *cur_board);
+CORE_LIBSPEC struct board *load_board_allocate(struct memfile *mf,
+ int savegame, int version);
+CORE_LIBSPEC int save_board(struct board *cur_board, struct memfile *mf,
+ int savegame, int version);
+CORE_LIBSPEC int load_board_direct(struct board *cur_board,
+ struct memfile *mf, int data_size, int savegame, int version);
+void load_lazy_board(struct board *cur_board, FILE *fp, int savegame,
  int version);
-CORE_LIBSPEC int save_board(struct board *cur_board, FILE *fp, int savegame, int version);
+void unload_board(struct board *cur_board);
 
 int find_board(struct world *mzx_world, char *name);
 
-#ifdef CONFIG_EDITOR
-CORE_LIBSPEC int load_board_direct(struct board *cur_board, FILE *fp,
-int data_size, int savegame, int version);
-#endif // CONFIG_EDITOR
-
 __M_END_DECLS
 
 #endif // __BOARD_H
@@ -96,6 +96,22 @@ struct board
   int num_sensors;
   int num_sensors_allocated;
   struct sensor **sensor_list;
+
+  // Bitmap of the cell chunks update_board has to visit (see board.h)
+  unsigned int *update_chunks;
+
+  // When anything the game window draws from last changed (see board.h)
+  unsigned int change_stamp;
+
+  // Boards loaded lazily only have their name until they're needed, when
+  // they're read from file_offset in the world file (see get_board). A
+  // clean board hasn't been played on since, so it can be dropped again;
+  // last_used orders them for that.
+  bool loaded;
+  bool clean;
+  unsigned int last_used;
+  int file_offset;
+  int file_size;
 };
 
 __M_END_DECLS
@@ -0,0 +1,11 @@
+#define PLATFORM "linux-amd64"
+#define VERSION "Git"
+#define VERSION_DATE " (20261018)"
+#define CONFDIR "./"
+#define CONFFILE "config.txt"
+#define SHAREDIR "."
+#define CONFIG_EDITOR
+#define CONFIG_HELPSYS
+#define CONFIG_UTILS
+#define CONFIG_PTHREAD_MUTEXES
+#define CONFIG_CHECK_ALLOC
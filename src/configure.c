@@ -172,12 +172,70 @@ static void config_disassemble_base(struct config_info *conf, char *name,
     conf->disassemble_base = new_base;
 }
 
+static void config_benchmark_cycles(struct config_info *conf, char *name,
+ char *value, char *extended_data)
+{
+  conf->benchmark_cycles = strtoul(value, NULL, 10);
+}
+
+static void config_benchmark_input(struct config_info *conf, char *name,
+ char *value, char *extended_data)
+{
+  strncpy(conf->benchmark_input, value, 256);
+  conf->benchmark_input[255] = 0;
+}
+
+static void config_benchmark_seed(struct config_info *conf, char *name,
+ char *value, char *extended_data)
+{
+  conf->benchmark_seed = strtoul(value, NULL, 10);
+}
+
+static void config_benchmark_suite(struct config_info *conf, char *name,
+ char *value, char *extended_data)
+{
+  strncpy(conf->benchmark_suite, value, 256);
+  conf->benchmark_suite[255] = 0;
+}
+
+static void config_trace_events(struct config_info *conf, char *name,
+ char *value, char *extended_data)
+{
+  conf->trace_events = strtoul(value, NULL, 10);
+}
+
+static void config_trace_file(struct config_info *conf, char *name,
+ char *value, char *extended_data)
+{
+  strncpy(conf->trace_file, value, 256);
+  conf->trace_file[255] = 0;
+}
+
+static void config_robot_profile(struct config_info *conf, char *name,
+ char *value, char *extended_data)
+{
+  strncpy(conf->robot_profile, value, 256);
+  conf->robot_profile[255] = 0;
+}
+
 static void config_set_audio_buffer(struct config_info *conf, char *name,
  char *value, char *extended_data)
 {
   conf->buffer_size = strtoul(value, NULL, 10);
 }
 
+static void config_set_audio_output(struct config_info *conf, char *name,
+ char *value, char *extended_data)
+{
+  strncpy(conf->audio_output, value, 16);
+}
+
+static void config_set_audio_wav_file(struct config_info *conf, char *name,
+ char *value, char *extended_data)
+{
+  strncpy(conf->audio_wav_file, value, 256);
+}
+
 static void config_set_resolution(struct config_info *conf, char *name,
  char *value, char *extended_data)
 {
@@ -225,6 +283,13 @@ static void config_set_sam_volume(struct config_info *conf, char *name,
   conf->sam_volume = CLAMP(new_volume, 1, 8);
 }
 
+static void config_set_sample_cache_size(struct config_info *conf,
+ char *name, char *value, char *extended_data)
+{
+  unsigned long new_size = strtoul(value, NULL, 10);
+  conf->sample_cache_size = MIN(new_size, 1024 * 1024);
+}
+
 static void config_save_file(struct config_info *conf, char *name,
  char *value, char *extended_data)
 {
@@ -422,6 +487,18 @@ static void config_startup_editor(struct config_info *conf, char *name,
   conf->startup_editor = strtoul(value, NULL, 10);
 }
 
+static void config_lazy_board_loading(struct config_info *conf, char *name,
+ char *value, char *extended_data)
+{
+  conf->lazy_board_loading = strtoul(value, NULL, 10);
+}
+
+static void config_lazy_board_memory(struct config_info *conf, char *name,
+ char *value, char *extended_data)
+{
+  conf->lazy_board_memory = strtoul(value, NULL, 10);
+}
+
 static void config_set_video_ratio(struct config_info *conf, char *name,
  char *value, char *extended_data)
 {
@@ -446,7 +523,13 @@ static void config_set_num_buffered_events(struct config_info *conf,
 static const struct config_entry config_options[] =
 {
   { "audio_buffer", config_set_audio_buffer },
+  { "audio_output", config_set_audio_output },
   { "audio_sample_rate", config_set_audio_freq },
+  { "audio_wav_file", config_set_audio_wav_file },
+  { "benchmark_cycles", config_benchmark_cycles },
+  { "benchmark_input", config_benchmark_input },
+  { "benchmark_seed", config_benchmark_seed },
+  { "benchmark_suite", config_benchmark_suite },
   { "disassemble_base", config_disassemble_base },
   { "disassemble_extras", config_disassemble_extras },
   { "enable_oversampling", config_enable_oversampling },
@@ -460,6 +543,8 @@ static const struct config_entry config_options[] =
   { "include*", include_config },
   { "joy!axis!", joy_axis_set },
   { "joy!button!", joy_button_set },
+  { "lazy_board_loading", config_lazy_board_loading },
+  { "lazy_board_memory", config_lazy_board_memory },
   { "mask_midchars", config_mask_midchars },
   { "modplug_resample_mode", config_mp_resample_mode },
   { "music_on", config_set_music },
@@ -473,6 +558,8 @@ static const struct config_entry config_options[] =
   { "pc_speaker_on", config_set_pc_speaker },
   { "pc_speaker_volume", config_set_sfx_volume },
   { "resample_mode", config_resample_mode },
+  { "robot_profile", config_robot_profile },
+  { "sample_cache_size", config_set_sample_cache_size },
   { "sample_volume", config_set_sam_volume },
   { "save_file", config_save_file },
 #ifdef CONFIG_NETWORK
@@ -483,6 +570,8 @@ static const struct config_entry config_options[] =
   { "startup_file", config_startup_file },
   { "startup_path", config_startup_path },
   { "system_mouse", config_system_mouse },
+  { "trace_events", config_trace_events },
+  { "trace_file", config_trace_file },
 #ifdef CONFIG_UPDATER
   { "update_branch_pin", config_update_branch_pin },
   { "update_host", config_update_host },
@@ -537,11 +626,14 @@ static const struct config_info default_options =
   // Audio options
   AUDIO_SAMPLE_RATE,            // output_frequency
   AUDIO_BUFFER_SIZE,            // buffer_size
+  "device",                     // audio_output
+  "audio.wav",                  // audio_wav_file
   0,                            // oversampling_on
   1,                            // resample_mode
   2,                            // modplug_resample_mode
   8,                            // music_volume
   8,                            // sam_volume
+  8192,                         // sample_cache_size
   8,                            // pc_speaker_volume
   1,                            // music_on
   1,                            // pc_speaker_on
@@ -554,6 +646,15 @@ static const struct config_info default_options =
   1,                            // disassemble_extras
   10,                           // disassemble_base
   0,                            // startup_editor
+  0,                            // lazy_board_loading
+  16384,                        // lazy_board_memory
+  0,                            // benchmark_cycles
+  "",                           // benchmark_input
+  1,                            // benchmark_seed
+  "",                           // benchmark_suite
+  "",                           // robot_profile
+  "",                           // trace_file
+  65536,                        // trace_events
 
   1,                            // mask_midchars
   false,                        // system_mouse
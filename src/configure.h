@@ -51,11 +51,14 @@ struct config_info
   // Audio options
   int output_frequency;
   int buffer_size;
+  char audio_output[16];
+  char audio_wav_file[256];
   int oversampling_on;
   int resample_mode;
   int modplug_resample_mode;
   int music_volume;
   int sam_volume;
+  int sample_cache_size;
   int pc_speaker_volume;
   int music_on;
   int pc_speaker_on;
@@ -68,6 +71,15 @@ struct config_info
   int disassemble_extras;
   int disassemble_base;
   int startup_editor;
+  int lazy_board_loading;
+  int lazy_board_memory;
+  int benchmark_cycles;
+  char benchmark_input[256];
+  unsigned int benchmark_seed;
+  char benchmark_suite[256];
+  char robot_profile[256];
+  char trace_file[256];
+  int trace_events;
 
   // Misc options
   int mask_midchars;
@@ -17,7 +17,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
-// New counter.cpp. Sorted lists make for faster searching.
+// New counter.cpp. User counters are hashed for faster searching.
 // Builtins are also cleaned up by being put on a seperate list.
 
 #include <stdlib.h>
@@ -362,6 +362,7 @@ static void playerfacedir_write(struct world *mzx_world,
 
   src_board->player_last_dir =
    (src_board->player_last_dir & 0x0F) | (value << 4);
+  mark_board_changed(src_board);
 }
 
 static int playerlastdir_read(struct world *mzx_world,
@@ -445,7 +446,11 @@ static void board_id_write(struct world *mzx_world,
   char cvalue = value;
 
   if((cvalue < SENSOR) && (src_board->level_id[offset] < SENSOR))
+  {
     src_board->level_id[offset] = cvalue;
+    mark_board_update(src_board, offset);
+    mark_board_changed(src_board);
+  }
 }
 
 static int board_param_read(struct world *mzx_world,
@@ -462,7 +467,10 @@ static void board_param_write(struct world *mzx_world,
   struct board *src_board = mzx_world->current_board;
 
   if(src_board->level_id[offset] < 122)
+  {
     src_board->level_param[offset] = value;
+    mark_board_changed(src_board);
+  }
 }
 
 static int red_value_read(struct world *mzx_world,
@@ -767,6 +775,7 @@ static void spr_cx_write(struct world *mzx_world,
 {
   int spr_num = strtol(name + 3, NULL, 10) & (MAX_SPRITES - 1);
   (mzx_world->sprite_list[spr_num])->col_x = value;
+  update_sprite_index(mzx_world, spr_num);
 }
 
 static void spr_cy_write(struct world *mzx_world,
@@ -774,6 +783,7 @@ static void spr_cy_write(struct world *mzx_world,
 {
   int spr_num = strtol(name + 3, NULL, 10) & (MAX_SPRITES - 1);
   (mzx_world->sprite_list[spr_num])->col_y = value;
+  update_sprite_index(mzx_world, spr_num);
 }
 
 static void spr_height_write(struct world *mzx_world,
@@ -817,6 +827,7 @@ static void spr_x_write(struct world *mzx_world,
 {
   int spr_num = strtol(name + 3, NULL, 10) & (MAX_SPRITES - 1);
   (mzx_world->sprite_list[spr_num])->x = value;
+  update_sprite_index(mzx_world, spr_num);
 }
 
 static void spr_y_write(struct world *mzx_world,
@@ -824,6 +835,7 @@ static void spr_y_write(struct world *mzx_world,
 {
   int spr_num = strtol(name + 3, NULL, 10) & (MAX_SPRITES - 1);
   (mzx_world->sprite_list[spr_num])->y = value;
+  update_sprite_index(mzx_world, spr_num);
 }
 
 static void spr_vlayer_write(struct world *mzx_world,
@@ -861,6 +873,7 @@ static void spr_off_write(struct world *mzx_world,
 {
   int spr_num = strtol(name + 3, NULL, 10) & (MAX_SPRITES - 1);
   (mzx_world->sprite_list[spr_num])->flags &= ~SPRITE_INITIALIZED;
+  update_sprite_index(mzx_world, spr_num);
 }
 
 static void spr_swap_write(struct world *mzx_world,
@@ -871,6 +884,7 @@ static void spr_swap_write(struct world *mzx_world,
   struct sprite *dest = mzx_world->sprite_list[value];
   mzx_world->sprite_list[value] = src;
   mzx_world->sprite_list[spr_num] = dest;
+  invalidate_sprite_index(mzx_world);
 }
 
 static void spr_cwidth_write(struct world *mzx_world,
@@ -878,6 +892,7 @@ static void spr_cwidth_write(struct world *mzx_world,
 {
   int spr_num = strtol(name + 3, NULL, 10) & (MAX_SPRITES - 1);
   (mzx_world->sprite_list[spr_num])->col_width = value;
+  update_sprite_index(mzx_world, spr_num);
 }
 
 static void spr_cheight_write(struct world *mzx_world,
@@ -885,6 +900,7 @@ static void spr_cheight_write(struct world *mzx_world,
 {
   int spr_num = strtol(name + 3, NULL, 10) & (MAX_SPRITES - 1);
   (mzx_world->sprite_list[spr_num])->col_height = value;
+  update_sprite_index(mzx_world, spr_num);
 }
 
 static void spr_setview_write(struct world *mzx_world,
@@ -1226,7 +1242,11 @@ static void bid_write(struct world *mzx_world,
   {
     offset = x + (y * board_width);
     if((cvalue < SENSOR) && (board->level_id[offset] < SENSOR))
+    {
       board->level_id[offset] = cvalue;
+      mark_board_update(board, offset);
+      mark_board_changed(board);
+    }
   }
 }
 
@@ -1261,7 +1281,10 @@ static void bpr_write(struct world *mzx_world,
   {
     offset = x + (y * board_width);
     if(board->level_id[offset] < 122)
+    {
       board->level_param[offset] = value;
+      mark_board_changed(board);
+    }
   }
 }
 
@@ -1331,7 +1354,10 @@ static void uid_write(struct world *mzx_world,
   if((x < board_width) && (y < board_height) &&
    !(flags[(int)board->level_id[offset]] & A_UNDER) &&
    (cvalue < SENSOR) && (board->level_under_id[offset] < SENSOR))
+  {
     board->level_under_id[offset] = cvalue;
+    mark_board_changed(board);
+  }
 }
 
 static int upr_read(struct world *mzx_world,
@@ -1364,7 +1390,10 @@ static void upr_write(struct world *mzx_world,
   if((x < board_width) && (y < board_height) &&
    !(flags[(int)board->level_id[offset]] & A_UNDER) &&
    (board->level_under_id[offset] < 122))
+  {
     board->level_under_param[offset] = value;
+    mark_board_changed(board);
+  }
 }
 
 /***** END THE STUPID BOARD ACCESS COUNTERS *****/
@@ -1944,42 +1973,91 @@ static void bimesg_write(struct world *mzx_world,
   mzx_world->bi_mesg_status = value & 1;
 }
 
+static void insert_string_hash(struct string **table, unsigned int size,
+ struct string *src)
+{
+  unsigned int mask = size - 1;
+  unsigned int pos = src->hash & mask;
+
+  while(table[pos])
+    pos = (pos + 1) & mask;
+
+  table[pos] = src;
+}
+
+static void resize_string_hash(struct world *mzx_world, unsigned int size)
+{
+  struct string **table = ccalloc(size, sizeof(struct string *));
+  int i;
+
+  for(i = 0; i < mzx_world->num_strings; i++)
+    insert_string_hash(table, size, mzx_world->string_list[i]);
+
+  free(mzx_world->string_hash);
+  mzx_world->string_hash = table;
+  mzx_world->string_hash_size = size;
+}
+
+// Rebuild the hash table from scratch; use after string_list has been
+// filled in directly (e.g. when loading a save).
+
+void rehash_string_list(struct world *mzx_world)
+{
+  unsigned int size = MIN_STRING_HASH;
+
+  while(size < (unsigned int)mzx_world->num_strings * 2)
+    size *= 2;
+
+  resize_string_hash(mzx_world, size);
+}
+
+static int compare_string_names(const void *a, const void *b)
+{
+  const struct string *sa = *(const struct string * const *)a;
+  const struct string *sb = *(const struct string * const *)b;
+  return strcasecmp(sa->name, sb->name);
+}
+
+// Like counter_list, string_list is in creation order until sorted.
+
+void sort_string_list(struct world *mzx_world)
+{
+  qsort(mzx_world->string_list, mzx_world->num_strings,
+   sizeof(struct string *), compare_string_names);
+}
+
+// If the string doesn't exist, next is set to the free hash slot it
+// would occupy, for add_string_preallocate.
+
 static struct string *find_string(struct world *mzx_world, const char *name,
  int *next)
 {
-  int bottom = 0, top = (mzx_world->num_strings) - 1, middle = 0;
-  int cmpval = 0;
-  struct string **base = mzx_world->string_list;
+  struct string **table = mzx_world->string_hash;
+  unsigned int hash = hash_name_nocase(name);
+  unsigned int mask, pos;
   struct string *current;
 
-  while(bottom <= top)
+  if(!table)
   {
-    middle = (top + bottom) / 2;
-    current = base[middle];
-    cmpval = strcasecmp(name, current->name);
+    *next = -1;
+    return NULL;
+  }
 
-    if(cmpval > 0)
-    {
-      bottom = middle + 1;
-    }
-    else
+  mask = mzx_world->string_hash_size - 1;
+  pos = hash & mask;
 
-    if(cmpval < 0)
-    {
-      top = middle - 1;
-    }
-    else
+  while((current = table[pos]))
+  {
+    if((current->hash == hash) && !strcasecmp(name, current->name))
     {
-      *next = middle;
+      *next = (int)pos;
       return current;
     }
-  }
 
-  if(cmpval > 0)
-    *next = middle + 1;
-  else
-    *next = middle;
+    pos = (pos + 1) & mask;
+  }
 
+  *next = (int)pos;
   return NULL;
 }
 
@@ -2044,13 +2122,27 @@ static int str_num_read(struct world *mzx_world,
   return 0;
 }
 
+// The caller must fill in the name and hash.
+
+static struct string *allocate_string(size_t name_length, size_t length)
+{
+  struct string *dest = cmalloc(sizeof(struct string) + name_length);
+  size_t storage_length = MAX(length, MIN_STRING_STORAGE);
+
+  dest->value = cmalloc(storage_length);
+  dest->storage_length = storage_length;
+  dest->allocated_length = length;
+  dest->length = length;
+
+  return dest;
+}
+
 static struct string *add_string_preallocate(struct world *mzx_world,
  const char *name, size_t length, int position)
 {
   int count = mzx_world->num_strings;
   int allocated = mzx_world->num_strings_allocated;
-  size_t name_length = strlen(name);
-  struct string **base = mzx_world->string_list;
+  unsigned int hash_size = mzx_world->string_hash_size;
   struct string *dest;
 
   // Need a reallocation?
@@ -2062,48 +2154,55 @@ static struct string *add_string_preallocate(struct world *mzx_world,
       allocated = MIN_STRING_ALLOCATE;
 
     mzx_world->string_list =
-     crealloc(base, sizeof(struct string *) * allocated);
+     crealloc(mzx_world->string_list, sizeof(struct string *) * allocated);
     mzx_world->num_strings_allocated = allocated;
-    base = mzx_world->string_list;
   }
 
-  // Doesn't exist, so create it
-  // First make space for it if it's not at the top
-  if(position != count)
-  {
-    base += position;
-    memmove((char *)(base + 1), (char *)base,
-     (count - position) * sizeof(struct string *));
-  }
-
-  // Allocate a string with room for the name and initial value
-  dest = cmalloc(sizeof(struct string) + name_length + length);
-
-  // Copy in the name, including NULL terminator.
+  // Doesn't exist, so create it at the end of the list. The value is
+  // NOT null terminated!
+  dest = allocate_string(strlen(name), length);
   strcpy(dest->name, name);
+  dest->hash = hash_name_nocase(name);
 
-  // Copy in the value. It is NOT null terminated!
-  dest->allocated_length = length;
-  dest->length = length;
-
-  dest->value = dest->storage_space + name_length;
   if(length > 0)
     memset(dest->value, ' ', length);
 
-  mzx_world->string_list[position] = dest;
+  mzx_world->string_list[count] = dest;
   mzx_world->num_strings = count + 1;
 
+  // Same deal as add_counter; the slot is stale if the table grows.
+  if((unsigned int)(count + 1) * 2 > hash_size)
+  {
+    if(hash_size)
+      resize_string_hash(mzx_world, hash_size * 2);
+    else
+      resize_string_hash(mzx_world, MIN_STRING_HASH);
+  }
+  else
+  {
+    mzx_world->string_hash[position] = dest;
+  }
+
   return dest;
 }
 
-static struct string *reallocate_string(struct world *mzx_world,
- struct string *src, int pos, size_t length)
+static void reallocate_string(struct string *src, size_t length)
 {
-  // Find the base length (take out the current length)
-  int base_length = (int)(src->value - (char *)src);
+  // Grow the value buffer geometrically so repeated appends don't have
+  // to copy the existing contents every time.
+  if(length > src->storage_length)
+  {
+    size_t storage_length = src->storage_length * 2;
 
-  src = crealloc(src, base_length + length);
-  src->value = (char *)src + base_length;
+    if(storage_length > MAX_STRING_LEN)
+      storage_length = MAX_STRING_LEN;
+
+    if(storage_length < length)
+      storage_length = length;
+
+    src->value = crealloc(src->value, storage_length);
+    src->storage_length = storage_length;
+  }
 
   // any new bits of the string should be space filled
   // versions up to and including 2.81h used to fill this with garbage
@@ -2114,9 +2213,6 @@ static struct string *reallocate_string(struct world *mzx_world,
   }
 
   src->allocated_length = length;
-
-  mzx_world->string_list[pos] = src;
-  return src;
 }
 
 static void force_string_length(struct world *mzx_world, const char *name,
@@ -2129,7 +2225,7 @@ static void force_string_length(struct world *mzx_world, const char *name,
     *str = add_string_preallocate(mzx_world, name, *length, next);
 
   else if(*length > (*str)->allocated_length)
-    *str = reallocate_string(mzx_world, *str, next, *length);
+    reallocate_string(*str, *length);
 
   /* Wipe string if the length has increased but not the allocated memory */
   if(*length > (*str)->length)
@@ -2515,7 +2611,34 @@ static const struct function_counter builtin_counters[] =
   { "vlayer_width", 0x0248, vlayer_width_read, vlayer_width_write }, // 2.69c
 };
 
-static int counter_first_letter[512];
+// Builtin counters are found by walking a trie of their names, built by
+// counter_fsg. Letters are folded the same way match_function_counter
+// folds them, and a run of digits (or -) is a single step, which is what
+// a ! or ? in a builtin's name stands for. A * ends the walk early.
+
+#define MAX_FUNCTION_COUNTER_NODES 2048
+#define FUNCTION_COUNTER_NUMBER 0xFF
+
+struct function_counter_node
+{
+  unsigned char key;
+  // Builtin named by the path to this node, or ending in * here
+  const struct function_counter *counter;
+  const struct function_counter *wildcard_counter;
+  // Set if counter's name has digits of its own to match
+  bool check_name;
+  short first_child;
+  short next_sibling;
+};
+
+// Node 0 is unused, so 0 can mean no node
+static struct function_counter_node
+ function_counter_nodes[MAX_FUNCTION_COUNTER_NODES];
+
+static int num_function_counter_nodes;
+
+// The first letter of a name is compared with tolower() instead
+static short function_counter_first_letter[256];
 
 static struct robot *get_robot_by_id(struct world *mzx_world, int id)
 {
@@ -2852,13 +2975,12 @@ int set_counter_special(struct world *mzx_world, char *char_value,
         if(cur_robot)
         {
           reallocate_robot(cur_robot, new_size);
-          clear_label_cache(cur_robot->label_list, cur_robot->num_labels);
+          clear_label_cache(cur_robot);
 
           memcpy(cur_robot->program_bytecode, new_program, new_size);
           cur_robot->stack_pointer = 0;
           cur_robot->cur_prog_line = 1;
-          cur_robot->label_list =
-           cache_robot_labels(cur_robot, &cur_robot->num_labels);
+          cache_robot_labels(cur_robot);
 
           // Restart this robot if either it was just a LOAD_ROBOT
           // OR LOAD_ROBOTn was used where n is &robot_id&.
@@ -2889,13 +3011,12 @@ int set_counter_special(struct world *mzx_world, char *char_value,
           new_size = ftell_and_rewind(bc_file);
 
           reallocate_robot(cur_robot, new_size);
-          clear_label_cache(cur_robot->label_list, cur_robot->num_labels);
+          clear_label_cache(cur_robot);
 
           fread(cur_robot->program_bytecode, new_size, 1, bc_file);
           cur_robot->cur_prog_line = 1;
           cur_robot->stack_pointer = 0;
-          cur_robot->label_list =
-           cache_robot_labels(cur_robot, &cur_robot->num_labels);
+          cache_robot_labels(cur_robot);
 
           // Restart this robot if either it was just a LOAD_BC
           // OR LOAD_BCn was used where n is &robot_id&.
@@ -3092,35 +3213,90 @@ static int builtin_gateway(struct world *mzx_world, struct counter *counter,
   return MAX(value, 0);
 }
 
+static void insert_counter_hash(struct counter **table, unsigned int size,
+ struct counter *src)
+{
+  unsigned int mask = size - 1;
+  unsigned int pos = src->hash & mask;
+
+  while(table[pos])
+    pos = (pos + 1) & mask;
+
+  table[pos] = src;
+}
+
+static void resize_counter_hash(struct world *mzx_world, unsigned int size)
+{
+  struct counter **table = ccalloc(size, sizeof(struct counter *));
+  int i;
+
+  for(i = 0; i < mzx_world->num_counters; i++)
+    insert_counter_hash(table, size, mzx_world->counter_list[i]);
+
+  free(mzx_world->counter_hash);
+  mzx_world->counter_hash = table;
+  mzx_world->counter_hash_size = size;
+}
+
+// Rebuild the hash table from scratch; use after counter_list has been
+// filled in directly (e.g. when loading a save).
+
+void rehash_counter_list(struct world *mzx_world)
+{
+  unsigned int size = MIN_COUNTER_HASH;
+
+  while(size < (unsigned int)mzx_world->num_counters * 2)
+    size *= 2;
+
+  resize_counter_hash(mzx_world, size);
+}
+
+static int compare_counters(const void *a, const void *b)
+{
+  const struct counter *ca = *(const struct counter * const *)a;
+  const struct counter *cb = *(const struct counter * const *)b;
+  return strcasecmp(ca->name, cb->name);
+}
+
+// New counters are appended to counter_list, so sort it only when the
+// order matters (save files and the debugger). The hash table holds
+// pointers rather than list positions and is unaffected.
+
+void sort_counter_list(struct world *mzx_world)
+{
+  qsort(mzx_world->counter_list, mzx_world->num_counters,
+   sizeof(struct counter *), compare_counters);
+}
+
+// If the counter doesn't exist, next is set to the free hash slot it
+// would occupy, for add_counter.
+
 static struct counter *find_counter(struct world *mzx_world, const char *name,
  int *next)
 {
-  int bottom = 0, top = (mzx_world->num_counters) - 1, middle = 0;
-  int cmpval = 0;
-  struct counter **base = mzx_world->counter_list;
+  struct counter **table = mzx_world->counter_hash;
+  unsigned int hash = hash_name_nocase(name);
+  unsigned int mask, pos;
   struct counter *current;
 
-  while(bottom <= top)
+  if(!table)
   {
-    middle = (top + bottom) / 2;
-    current = base[middle];
-    cmpval = strcasecmp(name, current->name);
+    *next = -1;
+    return NULL;
+  }
 
-    if(cmpval > 0)
-      bottom = middle + 1;
-    else
+  mask = mzx_world->counter_hash_size - 1;
+  pos = hash & mask;
 
-    if(cmpval < 0)
-      top = middle - 1;
-    else
+  while((current = table[pos]))
+  {
+    if((current->hash == hash) && !strcasecmp(name, current->name))
       return current;
-  }
 
-  if(cmpval > 0)
-    *next = middle + 1;
-  else
-    *next = middle;
+    pos = (pos + 1) & mask;
+  }
 
+  *next = (int)pos;
   return NULL;
 }
 
@@ -3228,33 +3404,54 @@ int match_function_counter(const char *dest, const char *src)
 
 static const struct function_counter *find_function_counter(const char *name)
 {
-  const struct function_counter *base = builtin_counters;
-  int first_letter = tolower((int)name[0]) * 2;
-  int bottom, top, middle;
-  int cmpval;
+  const struct function_counter *wildcard = NULL;
+  struct function_counter_node *node;
+  const char *src = name + 1;
+  int cur_char;
+  int key;
+  int i;
 
-  bottom = counter_first_letter[first_letter];
-  top = counter_first_letter[first_letter + 1];
+  i = function_counter_first_letter[(unsigned char)name[0]];
 
-  if(bottom != -1)
+  while(i)
   {
-    while(bottom <= top)
+    node = function_counter_nodes + i;
+
+    if(node->wildcard_counter)
+      wildcard = node->wildcard_counter;
+
+    cur_char = *src;
+
+    if(!cur_char)
     {
-      middle = (top + bottom) / 2;
-      cmpval = match_function_counter(name + 1, (base[middle]).name + 1);
+      if(node->counter && (!node->check_name ||
+       !match_function_counter(name + 1, node->counter->name + 1)))
+        return node->counter;
 
-      if(cmpval > 0)
-        bottom = middle + 1;
-      else
+      break;
+    }
 
-      if(cmpval < 0)
-        top = middle - 1;
-      else
-        return base + middle;
+    src++;
+
+    if(((cur_char >= '0') && (cur_char <= '9')) || (cur_char == '-'))
+    {
+      while(((*src >= '0') && (*src <= '9')) || (*src == '-'))
+        src++;
+
+      key = FUNCTION_COUNTER_NUMBER;
     }
+    else
+    {
+      key = (unsigned char)cur_char & 0xDF;
+    }
+
+    i = node->first_child;
+
+    while(i && (function_counter_nodes[i].key != key))
+      i = function_counter_nodes[i].next_sibling;
   }
 
-  return NULL;
+  return wildcard;
 }
 
 static void add_counter(struct world *mzx_world, const char *name,
@@ -3262,7 +3459,7 @@ static void add_counter(struct world *mzx_world, const char *name,
 {
   int count = mzx_world->num_counters;
   int allocated = mzx_world->num_counters_allocated;
-  struct counter **base = mzx_world->counter_list;
+  unsigned int hash_size = mzx_world->counter_hash_size;
   struct counter *cdest;
 
   // Need a reallocation?
@@ -3274,28 +3471,36 @@ static void add_counter(struct world *mzx_world, const char *name,
       allocated = MIN_COUNTER_ALLOCATE;
 
     mzx_world->counter_list =
-     crealloc(base, sizeof(struct counter *) * allocated);
-    base = mzx_world->counter_list;
+     crealloc(mzx_world->counter_list, sizeof(struct counter *) * allocated);
     mzx_world->num_counters_allocated = allocated;
   }
 
-  // Doesn't exist, so create it
-  // First make space for it if it's not at the top
-  if(position != count)
-  {
-    base += position;
-    memmove((char *)(base + 1), (char *)base,
-     (count - position) * sizeof(struct counter *));
-  }
-
+  // Doesn't exist, so create it at the end of the list
   cdest = cmalloc(sizeof(struct counter) + strlen(name));
   strcpy(cdest->name, name);
   cdest->value = value;
   cdest->gateway_write = NULL;
   cdest->gateway_dec = NULL;
+  cdest->hash = hash_name_nocase(name);
+  cdest->builtin_name = (find_function_counter(name) != NULL);
 
-  mzx_world->counter_list[position] = cdest;
+  mzx_world->counter_list[count] = cdest;
   mzx_world->num_counters = count + 1;
+
+  // Keep the hash table at most half full. Growing it rehashes every
+  // counter (including this one), so the slot find_counter gave us is
+  // only used if the table stays the same size.
+  if((unsigned int)(count + 1) * 2 > hash_size)
+  {
+    if(hash_size)
+      resize_counter_hash(mzx_world, hash_size * 2);
+    else
+      resize_counter_hash(mzx_world, MIN_COUNTER_HASH);
+  }
+  else
+  {
+    mzx_world->counter_hash[position] = cdest;
+  }
 }
 
 static void add_string(struct world *mzx_world, const char *name,
@@ -3307,12 +3512,114 @@ static void add_string(struct world *mzx_world, const char *name,
   memcpy(dest->value, src->value, src->length);
 }
 
+// Returns the user counter called name, if it exists and no builtin
+// counter would handle that name in this world. Unlike the lookup by name,
+// the result stays valid until the world's counters are cleared.
+
+struct counter *find_user_counter(struct world *mzx_world, const char *name,
+ bool *builtin)
+{
+  const struct function_counter *fdest;
+  struct counter *cdest;
+  int next;
+
+  cdest = find_counter(mzx_world, name, &next);
+  *builtin = false;
+
+  if(cdest && !cdest->builtin_name)
+    return cdest;
+
+  fdest = find_function_counter(name);
+
+  if(fdest && (mzx_world->version >= fdest->minimum_version))
+  {
+    *builtin = true;
+    return NULL;
+  }
+
+  return cdest;
+}
+
+// Prepare to read the counter called name repeatedly. This must give the
+// same result get_counter would for the lifetime of the world's counters.
+
+void init_counter_lookup(struct world *mzx_world, const char *name,
+ struct counter_lookup *lookup)
+{
+  const struct function_counter *fdest = find_function_counter(name);
+
+  if(fdest && fdest->function_read &&
+   (mzx_world->version >= fdest->minimum_version))
+    lookup->function = fdest;
+  else
+    lookup->function = NULL;
+
+  lookup->counter = NULL;
+}
+
+int get_counter_lookup(struct world *mzx_world, const char *name,
+ struct counter_lookup *lookup, int id)
+{
+  int next;
+
+  if(lookup->function)
+    return lookup->function->function_read(mzx_world, lookup->function,
+     name, id);
+
+  if(!lookup->counter)
+  {
+    lookup->counter = find_counter(mzx_world, name, &next);
+
+    if(!lookup->counter)
+      return 0;
+  }
+
+  return lookup->counter->value;
+}
+
+// These operate on a counter that is known to be a plain user counter
+// (see find_user_counter), applying its gateways.
+
+void set_counter_ref(struct world *mzx_world, struct counter *cdest,
+ int value, int id)
+{
+  // See if there's a gateway
+  if(cdest->gateway_write)
+    value = cdest->gateway_write(mzx_world, cdest, cdest->name, value, id);
+
+  cdest->value = value;
+}
+
+void inc_counter_ref(struct world *mzx_world, struct counter *cdest,
+ int value, int id)
+{
+  set_counter_ref(mzx_world, cdest, cdest->value + value, id);
+}
+
+void dec_counter_ref(struct world *mzx_world, struct counter *cdest,
+ int value, int id)
+{
+  if(cdest->gateway_dec)
+    value = cdest->gateway_dec(mzx_world, cdest, cdest->name, value, id);
+
+  set_counter_ref(mzx_world, cdest, cdest->value - value, id);
+}
+
 void set_counter(struct world *mzx_world, const char *name, int value, int id)
 {
   const struct function_counter *fdest;
   struct counter *cdest;
   int next = 0;
 
+  // Most names are existing user counters; skip the builtins for those
+  cdest = find_counter(mzx_world, name, &next);
+
+  if(cdest && !cdest->builtin_name)
+  {
+    set_counter_ref(mzx_world, cdest, value, id);
+    return;
+  }
+
   fdest = find_function_counter(name);
 
   if(fdest && (mzx_world->version >= fdest->minimum_version))
@@ -3328,22 +3635,10 @@ void set_counter(struct world *mzx_world, const char *name, int value, int id)
   }
   else
   {
-    cdest = find_counter(mzx_world, name, &next);
-
     if(cdest)
-    {
-      // See if there's a gateway
-      if(cdest->gateway_write)
-      {
-        value = cdest->gateway_write(mzx_world, cdest, name, value, id);
-      }
-
-      cdest->value = value;
-    }
+      set_counter_ref(mzx_world, cdest, value, id);
     else
-    {
       add_counter(mzx_world, name, value, next);
-    }
   }
 }
 
@@ -3521,7 +3816,7 @@ void set_string(struct world *mzx_world, const char *name, struct string *src,
         new_allocated = allocated;
         allocated *= 2;
 
-        dest = reallocate_string(mzx_world, dest, next, allocated);
+        reallocate_string(dest, allocated);
         dest_value = dest->value;
       }
     }
@@ -3660,6 +3955,11 @@ int get_counter(struct world *mzx_world, const char *name, int id)
   struct counter *cdest;
   int next;
 
+  cdest = find_counter(mzx_world, name, &next);
+
+  if(cdest && !cdest->builtin_name)
+    return cdest->value;
+
   fdest = find_function_counter(name);
 
   if(fdest && fdest->function_read &&
@@ -3672,8 +3972,6 @@ int get_counter(struct world *mzx_world, const char *name, int id)
       return 0;
   }
 
-  cdest = find_counter(mzx_world, name, &next);
-
   if(cdest)
     return cdest->value;
 
@@ -3725,6 +4023,14 @@ void inc_counter(struct world *mzx_world, const char *name, int value, int id)
   int current_value;
   int next = 0;
 
+  cdest = find_counter(mzx_world, name, &next);
+
+  if(cdest && !cdest->builtin_name)
+  {
+    inc_counter_ref(mzx_world, cdest, value, id);
+    return;
+  }
+
   fdest = find_function_counter(name);
 
   if(fdest && fdest->function_read && fdest->function_write &&
@@ -3737,23 +4043,10 @@ void inc_counter(struct world *mzx_world, const char *name, int value, int id)
   }
   else
   {
-    cdest = find_counter(mzx_world, name, &next);
-
     if(cdest)
-    {
-      value += cdest->value;
-
-      if(cdest->gateway_write)
-      {
-        value = cdest->gateway_write(mzx_world, cdest, name, value, id);
-      }
-
-      cdest->value = value;
-    }
+      inc_counter_ref(mzx_world, cdest, value, id);
     else
-    {
       add_counter(mzx_world, name, value, next);
-    }
   }
 }
 
@@ -3781,12 +4074,12 @@ void inc_string(struct world *mzx_world, const char *name, struct string *src,
        (src_end >= dest->value))
       {
         char *old_dest_value = dest->value;
-        dest = reallocate_string(mzx_world, dest, next, new_length);
+        reallocate_string(dest, new_length);
         src->value += (int)(dest->value - old_dest_value);
       }
       else
       {
-        dest = reallocate_string(mzx_world, dest, next, new_length);
+        reallocate_string(dest, new_length);
       }
     }
 
@@ -3806,6 +4099,14 @@ void dec_counter(struct world *mzx_world, const char *name, int value, int id)
   int current_value;
   int next = 0;
 
+  cdest = find_counter(mzx_world, name, &next);
+
+  if(cdest && !cdest->builtin_name)
+  {
+    dec_counter_ref(mzx_world, cdest, value, id);
+    return;
+  }
+
   fdest = find_function_counter(name);
 
   if(fdest && fdest->function_read && fdest->function_write &&
@@ -3818,30 +4119,10 @@ void dec_counter(struct world *mzx_world, const char *name, int value, int id)
   }
   else
   {
-    cdest = find_counter(mzx_world, name, &next);
-
     if(cdest)
-    {
-      if(cdest->gateway_dec)
-      {
-        gateway_dec_function gateway_dec =
-         (gateway_dec_function)cdest->gateway_dec;
-        value = gateway_dec(mzx_world, cdest, name, value, id);
-      }
-
-      value = cdest->value - value;
-
-      if(cdest->gateway_write)
-      {
-        value = cdest->gateway_write(mzx_world, cdest, name, value, id);
-      }
-
-      cdest->value = value;
-    }
+      dec_counter_ref(mzx_world, cdest, value, id);
     else
-    {
       add_counter(mzx_world, name, -value, next);
-    }
   }
 }
 
@@ -4080,91 +4361,175 @@ bool is_string(char *buffer)
   return true;
 }
 
-void counter_fsg(void)
+static int add_function_counter_node(int parent, int key)
 {
-  char cur_char = (builtin_counters[0]).name[0];
-  char old_char;
+  int i = num_function_counter_nodes;
+
+  assert(i < MAX_FUNCTION_COUNTER_NODES);
+  num_function_counter_nodes++;
+
+  function_counter_nodes[i].key = key;
+  function_counter_nodes[i].first_child = 0;
+  function_counter_nodes[i].next_sibling = 0;
+
+  if(parent)
+  {
+    function_counter_nodes[i].next_sibling =
+     function_counter_nodes[parent].first_child;
+    function_counter_nodes[parent].first_child = i;
+  }
+
+  return i;
+}
+
+static void add_function_counter(const struct function_counter *fdest,
+ const char *name)
+{
+  const char *src = name;
+  int first_letter = (unsigned char)name[0];
+  bool check_name = false;
+  int key;
   int i, i2;
 
-  for(i = 0, i2 = 0; i < 256; i++)
+  i = function_counter_first_letter[first_letter];
+  if(!i)
   {
-    if(i != cur_char)
-    {
-      counter_first_letter[i * 2] = -1;
-      counter_first_letter[(i * 2) + 1] = -1;
-    }
-    else
+    i = add_function_counter_node(0, first_letter);
+    function_counter_first_letter[first_letter] = i;
+    function_counter_first_letter[toupper(first_letter)] = i;
+  }
+
+  for(src++; *src; src++)
+  {
+    switch(*src)
     {
-      counter_first_letter[i * 2] = i2;
-      old_char = cur_char;
+      case '*':
+      {
+        function_counter_nodes[i].wildcard_counter = fdest;
+        return;
+      }
 
-      while(cur_char == old_char)
+      case '?':
       {
-        i2++;
-        if(i2 == num_builtin_counters)
-          break;
-        cur_char = builtin_counters[i2].name[0];
+        // Matches zero or more digits, so add it both ways
+        char buffer[32];
+        size_t offset = src - name;
+
+        memcpy(buffer, name, offset);
+        strcpy(buffer + offset, src + 1);
+        add_function_counter(fdest, buffer);
+
+        buffer[offset] = '!';
+        strcpy(buffer + offset + 1, src + 1);
+        add_function_counter(fdest, buffer);
+        return;
       }
 
-      counter_first_letter[(i * 2) + 1] = i2 - 1;
+      case '!':
+        key = FUNCTION_COUNTER_NUMBER;
+        break;
+
+      default:
+      {
+        if(((*src >= '0') && (*src <= '9')) || (*src == '-'))
+        {
+          while(((src[1] >= '0') && (src[1] <= '9')) || (src[1] == '-'))
+            src++;
+
+          key = FUNCTION_COUNTER_NUMBER;
+          check_name = true;
+        }
+        else
+          key = (unsigned char)*src & 0xDF;
+
+        break;
+      }
     }
+
+    i2 = function_counter_nodes[i].first_child;
+
+    while(i2 && (function_counter_nodes[i2].key != key))
+      i2 = function_counter_nodes[i2].next_sibling;
+
+    if(!i2)
+      i2 = add_function_counter_node(i, key);
+
+    i = i2;
+  }
+
+  // A ? matching no digits doesn't replace a builtin with that exact name
+  if(!function_counter_nodes[i].counter)
+  {
+    function_counter_nodes[i].counter = fdest;
+    function_counter_nodes[i].check_name = check_name;
   }
 }
 
-struct counter *load_counter(FILE *fp)
+void counter_fsg(void)
 {
-  int value = fgetd(fp);
-  int name_length = fgetd(fp);
+  int i;
+
+  memset(function_counter_nodes, 0, sizeof(function_counter_nodes));
+  memset(function_counter_first_letter, 0,
+   sizeof(function_counter_first_letter));
+  num_function_counter_nodes = 1;
+
+  for(i = 0; i < num_builtin_counters; i++)
+    add_function_counter(builtin_counters + i, builtin_counters[i].name);
+}
+
+struct counter *load_counter(struct memfile *mf)
+{
+  int value = mfgetd(mf);
+  int name_length = mfgetd(mf);
 
   struct counter *src_counter =
    cmalloc(sizeof(struct counter) + name_length);
-  fread(src_counter->name, name_length, 1, fp);
+  mfread(src_counter->name, name_length, 1, mf);
   src_counter->name[name_length] = 0;
   src_counter->value = value;
 
   src_counter->gateway_write = NULL;
   src_counter->gateway_dec = NULL;
+  src_counter->hash = hash_name_nocase(src_counter->name);
+  src_counter->builtin_name =
+   (find_function_counter(src_counter->name) != NULL);
 
   return src_counter;
 }
 
-struct string *load_string(FILE *fp)
+struct string *load_string(struct memfile *mf)
 {
-  int name_length = fgetd(fp);
-  int str_length = fgetd(fp);
-
-  struct string *src_string =
-   cmalloc(sizeof(struct string) + name_length + str_length - 1);
-
-  fread(src_string->name, name_length, 1, fp);
+  int name_length = mfgetd(mf);
+  int str_length = mfgetd(mf);
 
-  src_string->value = src_string->storage_space + name_length;
+  struct string *src_string = allocate_string(name_length, str_length);
 
-  fread(src_string->value, str_length, 1, fp);
+  mfread(src_string->name, name_length, 1, mf);
   src_string->name[name_length] = 0;
+  src_string->hash = hash_name_nocase(src_string->name);
 
-  src_string->length = str_length;
-  src_string->allocated_length = str_length;
+  mfread(src_string->value, str_length, 1, mf);
 
   return src_string;
 }
 
-void save_counter(FILE *fp, struct counter *src_counter)
+void save_counter(struct memfile *mf, struct counter *src_counter)
 {
   size_t name_length = strlen(src_counter->name);
 
-  fputd(src_counter->value, fp);
-  fputd((int)name_length, fp);
-  fwrite(src_counter->name, name_length, 1, fp);
+  mfputd(src_counter->value, mf);
+  mfputd((int)name_length, mf);
+  mfwrite(src_counter->name, name_length, 1, mf);
 }
 
-void save_string(FILE *fp, struct string *src_string)
+void save_string(struct memfile *mf, struct string *src_string)
 {
   size_t name_length = strlen(src_string->name);
   size_t str_length = src_string->length;
 
-  fputd((int)name_length, fp);
-  fputd((int)str_length, fp);
-  fwrite(src_string->name, name_length, 1, fp);
-  fwrite(src_string->value, str_length, 1, fp);
+  mfputd((int)name_length, mf);
+  mfputd((int)str_length, mf);
+  mfwrite(src_string->name, name_length, 1, mf);
+  mfwrite(src_string->value, str_length, 1, mf);
 }
@@ -29,6 +29,7 @@ __M_BEGIN_DECLS
 
 #include "world_struct.h"
 #include "counter_struct.h"
+#include "memfile.h"
 
 CORE_LIBSPEC int match_function_counter(const char *dest, const char *src);
 CORE_LIBSPEC void set_counter(struct world *mzx_world, const char *name,
@@ -36,9 +37,25 @@ CORE_LIBSPEC void set_counter(struct world *mzx_world, const char *name,
 CORE_LIBSPEC void set_string(struct world *mzx_world, const char *name, 
  struct string *src, int id);
 CORE_LIBSPEC void counter_fsg(void);
+CORE_LIBSPEC void sort_counter_list(struct world *mzx_world);
+CORE_LIBSPEC void sort_string_list(struct world *mzx_world);
 
 void initialize_gateway_functions(struct world *mzx_world);
+void rehash_counter_list(struct world *mzx_world);
+void rehash_string_list(struct world *mzx_world);
 int get_counter(struct world *mzx_world, const char *name, int id);
+struct counter *find_user_counter(struct world *mzx_world, const char *name,
+ bool *builtin);
+void init_counter_lookup(struct world *mzx_world, const char *name,
+ struct counter_lookup *lookup);
+int get_counter_lookup(struct world *mzx_world, const char *name,
+ struct counter_lookup *lookup, int id);
+void set_counter_ref(struct world *mzx_world, struct counter *cdest,
+ int value, int id);
+void inc_counter_ref(struct world *mzx_world, struct counter *cdest,
+ int value, int id);
+void dec_counter_ref(struct world *mzx_world, struct counter *cdest,
+ int value, int id);
 void inc_counter(struct world *mzx_world, const char *name, int value, int id);
 void dec_counter(struct world *mzx_world, const char *name, int value, int id);
 void mul_counter(struct world *mzx_world, const char *name, int value, int id);
@@ -59,17 +76,26 @@ int set_counter_special(struct world *mzx_world, char *char_value,
  int value, int id);
 bool is_string(char *buffer);
 
-struct counter *load_counter(FILE *fp);
-struct string *load_string(FILE *fp);
-void save_counter(FILE *fp, struct counter *src_counter);
-void save_string(FILE *fp, struct string *src_string);
+struct counter *load_counter(struct memfile *mf);
+struct string *load_string(struct memfile *mf);
+void save_counter(struct memfile *mf, struct counter *src_counter);
+void save_string(struct memfile *mf, struct string *src_string);
 
 // Even old games tended to use at least this many.
 #define MIN_COUNTER_ALLOCATE 32
 
+// Smallest counter hash table; it is kept at most half full
+#define MIN_COUNTER_HASH 64
+
 // These take up more room...
 #define MIN_STRING_ALLOCATE 4
 
+// Smallest string hash table; it is kept at most half full
+#define MIN_STRING_HASH 16
+
+// Smallest value buffer given to a string
+#define MIN_STRING_STORAGE 16
+
 // Strings cannot be longer than 1M
 #define MAX_STRING_LEN (1 << 20)
 
@@ -27,6 +27,7 @@ __M_BEGIN_DECLS
 
 struct world;
 struct counter;
+struct function_counter;
 
 typedef int (*gateway_write_function)(struct world *mzx_world,
  struct counter *counter, const char *name, int value, int id);
@@ -39,22 +40,26 @@ struct counter
   int value;
   gateway_write_function gateway_write;
   gateway_dec_function gateway_dec;
+  unsigned int hash;
+  // Set if a builtin counter could handle this name
+  bool builtin_name;
   char name[1];
 };
 
-// TODO - Give strings a dynamic length. It would expand
-// set ends up being larger than the current size.
-
-// "storage_space" is just there for show.. the truth is,
-// name and storage share space. It's messy, but fast and
-// space efficient.
+// A counter name that will be read repeatedly, with the builtin lookup
+// done ahead of time (see init_counter_lookup). The user counter is filled
+// in once it exists.
+struct counter_lookup
+{
+  const struct function_counter *function;
+  struct counter *counter;
+};
 
-// storage_space doesn't actually have to have anything,
-// however (in fact, neither does name). Strings can
-// be used as pointers to hold intermediate or immediate
-// values. For instance, string literals and spliced
-// strings. Anyone who uses strings in this way has a few
-// responsibilities, however:
+// Strings don't have to have a name or a value buffer of
+// their own. Strings can be used as pointers to hold
+// intermediate or immediate values. For instance, string
+// literals and spliced strings. Anyone who uses strings in
+// this way has a few responsibilities, however:
 // The string must be properly initialized so length and
 // value are set (allocated_length need not be set)
 // The actual string list must not contain any of these
@@ -67,22 +72,24 @@ struct counter
 // the second operand.
 
 // In a normal (persistent string, initialized by
-// add_string) string the struct will be over-initialized
-// to contain room for both the name and the value; value
-// will then point into the storage space somewhere. The
-// name comes first and is a fixed size. The value comes
-// after it and is of a dynamic length (allocated_length).
-// Allocated_length will typically end up larger than
-// length if the string's size is changed.
+// add_string) string the struct is over-allocated to hold
+// the name, and value points to a separate buffer of
+// storage_length bytes. The buffer grows geometrically, so
+// the struct itself never moves and appending to a string
+// doesn't copy it each time. Allocated_length is the size
+// the string has been forced to (which older worlds can
+// observe); it will typically end up larger than length if
+// the string's size is changed.
 
 struct string
 {
   size_t length;
   size_t allocated_length;
+  size_t storage_length;
   char *value;
+  unsigned int hash;
 
   char name[1];
-  char storage_space[1];
 };
 
 // Special counter returns for opening files
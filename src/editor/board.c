@@ -21,6 +21,7 @@
 
 #include "../board.h"
 #include "../extmem.h"
+#include "../memfile.h"
 #include "../world.h"
 
 #include "world.h"
@@ -51,14 +52,17 @@ static struct board *load_board_allocate_direct(FILE *fp, int version)
 {
   struct board *cur_board = cmalloc(sizeof(struct board));
   int board_start, board_end;
+  struct memfile mf;
 
   board_start = ftell(fp);
   fseek(fp, 0, SEEK_END);
   board_end = ftell(fp);
   fseek(fp, board_start, SEEK_SET);
 
-  load_board_direct(cur_board, fp, (board_end - board_start), 0, version);
-  fread(cur_board->board_name, 25, 1, fp);
+  mfopen_file(&mf, fp);
+  load_board_direct(cur_board, &mf, (board_end - board_start), 0, version);
+  mfread(cur_board->board_name, 25, 1, &mf);
+  mfclose(&mf);
   return cur_board;
 }
 
@@ -108,6 +112,7 @@ struct board *create_blank_board(void)
   cur_board->level_under_color = cmalloc(100 * 100);
   cur_board->overlay = cmalloc(100 * 100);
   cur_board->overlay_color = cmalloc(100 * 100);
+  cur_board->update_chunks = NULL;
   cur_board->mod_playing[0] = 0;
   cur_board->viewport_x = 0;
   cur_board->viewport_y = 0;
@@ -152,6 +157,9 @@ struct board *create_blank_board(void)
   cur_board->volume = 255;
   cur_board->volume_inc = 0;
   cur_board->volume_target = 255;
+  cur_board->loaded = true;
+  cur_board->clean = false;
+  cur_board->last_used = 0;
 
   cur_board->num_robots = 0;
   cur_board->num_robots_active = 0;
@@ -182,19 +190,24 @@ struct board *create_blank_board(void)
 void save_board_file(struct board *cur_board, char *name)
 {
   FILE *board_file = fopen_unsafe(name, "wb");
+  struct memfile mf;
 
   if(board_file)
   {
-    fputc(0xff, board_file);
+    mfopen_write(&mf, 0);
+    mfputc(0xff, &mf);
 
-    fputc('M', board_file);
-    fputc((WORLD_VERSION >> 8) & 0xff, board_file);
-    fputc(WORLD_VERSION & 0xff, board_file);
+    mfputc('M', &mf);
+    mfputc((WORLD_VERSION >> 8) & 0xff, &mf);
+    mfputc(WORLD_VERSION & 0xff, &mf);
 
     optimize_null_objects(cur_board);
-    save_board(cur_board, board_file, 0, WORLD_VERSION);
+    save_board(cur_board, &mf, 0, WORLD_VERSION);
     // Write name
-    fwrite(cur_board->board_name, 25, 1, board_file);
+    mfwrite(cur_board->board_name, 25, 1, &mf);
+
+    mfsave(&mf, board_file);
+    mfclose(&mf);
     fclose(board_file);
   }
 }
@@ -455,5 +468,6 @@ void change_board_size(struct board *src_board, int new_width, int new_height)
     // Set the new sizes
     src_board->board_width = new_width;
     src_board->board_height = new_height;
+    reset_board_update(src_board);
   }
 }
@@ -25,11 +25,15 @@
 #include "../window.h"
 #include "../intake.h"
 #include "../world.h"
+#include "../profile.h"
+#include "../legacy_rasm.h"
 
 #include <string.h>
 
 #define CVALUE_COL_OFFSET 63
 
+#define PROFILE_TOP_COMMANDS 5
+
 static void copy_substring_escaped(struct string *str, char *buf,
  unsigned int size)
 {
@@ -101,10 +105,13 @@ void __debug_counters(struct world *mzx_world)
   int selected = 0;
   int i, i2;
   struct dialog di;
-  struct element *elements[3];
+  struct element *elements[5];
 
   m_show();
 
+  sort_counter_list(mzx_world);
+  sort_string_list(mzx_world);
+
   for(i = 0; i < mzx_world->num_counters; i++)
   {
     var_list[i] = cmalloc(76);
@@ -149,11 +156,14 @@ void __debug_counters(struct world *mzx_world)
   {
     elements[0] = construct_list_box(2, 2, (const char **)var_list,
      num_vars, 19, 75, 0, &selected, false);
-    elements[1] = construct_button(23, 22, "Export", 1);
-    elements[2] = construct_button(45, 22, "Done", -1);
+    elements[1] = construct_button(8, 22, "Export", 1);
+    elements[2] = construct_button(21, 22,
+     robot_profiling ? "Stop profiler" : "Start profiler", 2);
+    elements[3] = construct_button(42, 22, "Save profile", 3);
+    elements[4] = construct_button(61, 22, "Done", -1);
 
     construct_dialog_ext(&di, "Debug Variables", 0, 0,
-     80, 25, elements, 3, 0, 0, 0, NULL);
+     80, 25, elements, 5, 0, 0, 0, NULL);
 
     dialog_result = run_dialog(mzx_world, &di);
 
@@ -277,6 +287,28 @@ void __debug_counters(struct world *mzx_world)
         fclose(fp);
       }
     }
+    else
+
+    if(dialog_result == 2)
+    {
+      if(robot_profiling)
+        profile_robots_stop();
+      else
+        profile_robots_start();
+    }
+    else
+
+    if(dialog_result == 3)
+    {
+      char export_name[128];
+      const char *csv_ext[] = { ".CSV", NULL };
+
+      export_name[0] = 0;
+
+      if(!new_file(mzx_world, csv_ext, ".csv", export_name,
+       "Save robot profile", 1))
+        profile_robots_export(export_name);
+    }
 
     destruct_dialog(&di);
 
@@ -290,12 +322,40 @@ void __debug_counters(struct world *mzx_world)
   free(var_list);
 }
 
+// While the profiler runs, the commands that took the longest so far are
+// listed above the debug box
+
+static void draw_profile_box(int x, int y)
+{
+  struct robot_profile_entry top[PROFILE_TOP_COMMANDS];
+  char line[40];
+  Uint64 total_time;
+  int num_top = profile_robots_top(top, PROFILE_TOP_COMMANDS, &total_time);
+  int i;
+
+  draw_window_box(x, y, x + 39, y + PROFILE_TOP_COMMANDS + 1,
+   DI_DEBUG_BOX, DI_DEBUG_BOX_DARK, DI_DEBUG_BOX_CORNER, 0, 1);
+  write_string(" Slowest commands ", x + 2, y, DI_DEBUG_LABEL, 0);
+
+  for(i = 0; i < num_top; i++)
+  {
+    snprintf(line, 40, "%-14.14s %5d %-10.10s %5.1f%%",
+     top[i].robot_name, top[i].line, get_command_name(top[i].cmd),
+     total_time ? (double)top[i].time * 100.0 / total_time : 0.0);
+
+    write_string(line, x + 1, y + i + 1, DI_DEBUG_NUMBER, 0);
+  }
+}
+
 void __draw_debug_box(struct world *mzx_world, int x, int y, int d_x, int d_y)
 {
   struct board *src_board = mzx_world->current_board;
   int i;
   int robot_mem = 0;
 
+  if(robot_profiling)
+    draw_profile_box((x >= 20) ? x - 20 : x, y - PROFILE_TOP_COMMANDS - 2);
+
   draw_window_box(x, y, x + 19, y + 5, DI_DEBUG_BOX, DI_DEBUG_BOX_DARK,
    DI_DEBUG_BOX_CORNER, 0, 1);
 
@@ -1073,6 +1073,9 @@ static void __edit_world(struct world *mzx_world, int reload_curr_file)
      !stat(curr_file, &stat_res) &&
      reload_world(mzx_world, curr_file, &fade))
     {
+      // The editor needs every board at hand
+      load_all_boards(mzx_world);
+
       mzx_world->current_board_id = mzx_world->first_board;
       mzx_world->current_board =
        mzx_world->board_list[mzx_world->current_board_id];
@@ -2035,6 +2038,8 @@ static void __edit_world(struct world *mzx_world, int reload_curr_file)
                 //create_blank_world(mzx_world);
               }
 
+              load_all_boards(mzx_world);
+
               mzx_world->current_board_id = mzx_world->first_board;
               mzx_world->current_board =
                mzx_world->board_list[mzx_world->current_board_id];
@@ -3230,6 +3235,9 @@ static void __edit_world(struct world *mzx_world, int reload_curr_file)
           cursor_off();
           m_hide();
 
+          // The editor doesn't mark what it changes, so redraw everything
+          mark_board_changed(src_board);
+
           do
           {
             draw_viewport(mzx_world);
@@ -3297,6 +3305,7 @@ static void __edit_world(struct world *mzx_world, int reload_curr_file)
             cursor_off();
             src_board = mzx_world->board_list[current_board_id];
             fix_board(mzx_world, current_board_id);
+            mark_board_changed(src_board);
             set_counter(mzx_world, "TIME", src_board->time_limit, 0);
             send_robot_def(mzx_world, 0, 11);
             send_robot_def(mzx_world, 0, 10);
@@ -3323,6 +3332,8 @@ static void __edit_world(struct world *mzx_world, int reload_curr_file)
               modified = 0;
             }
 
+            load_all_boards(mzx_world);
+
             load_editor_palette();
 
             scroll_color = 15;
@@ -135,6 +135,9 @@ void ec_load_char_ascii(Uint32 char_number)
 {
   memcpy(graphics.charset + (char_number * CHAR_SIZE),
    ascii_charset + (char_number * CHAR_SIZE), CHAR_SIZE);
+  ec_update_blank_chars(char_number, 1);
+  graphics.dirty_chars[char_number] = 1;
+  graphics.chars_dirty = true;
 
   // some renderers may want to map charsets to textures
   if(graphics.renderer.remap_charsets)
@@ -145,6 +148,9 @@ void ec_load_char_mzx(Uint32 char_number)
 {
   memcpy(graphics.charset + (char_number * CHAR_SIZE),
    graphics.default_charset + (char_number * CHAR_SIZE), CHAR_SIZE);
+  ec_update_blank_chars(char_number, 1);
+  graphics.dirty_chars[char_number] = 1;
+  graphics.chars_dirty = true;
 
   // some renderers may want to map charsets to textures
   if(graphics.renderer.remap_charsets)
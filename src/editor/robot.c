@@ -115,6 +115,9 @@ void duplicate_robot_direct_source(struct robot *cur_robot,
 
   // Bytecode starts as NULL.
   copy_robot->program_bytecode = NULL;
+  copy_robot->param_cache = NULL;
+  copy_robot->param_cache_size = 0;
+  copy_robot->num_param_cache = 0;
 
   // Give the robot a new, fresh stack
   copy_robot->stack = NULL;
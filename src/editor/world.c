@@ -26,6 +26,7 @@
 #include "../window.h"
 #include "../world.h"
 #include "../idput.h"
+#include "../memfile.h"
 
 #include "board.h"
 #include "robot.h"
@@ -154,6 +155,7 @@ bool append_world(struct world *mzx_world, const char *file)
   int board_width, board_height;
   char *level_id, *level_param;
   int input_version;
+  struct memfile mf;
   FILE *fp;
 
   fp = try_load_world(file, false, &input_version, NULL);
@@ -194,12 +196,16 @@ bool append_world(struct world *mzx_world, const char *file)
    sizeof(struct board *) * (old_num_boards + num_boards));
 
   // Append boards
+  mfopen_file(&mf, fp);
+
   for(i = old_num_boards; i < old_num_boards + num_boards; i++)
   {
-    mzx_world->board_list[i] = load_board_allocate(fp, 0, input_version);
+    mzx_world->board_list[i] = load_board_allocate(&mf, 0, input_version);
     cur_board = mzx_world->board_list[i];
   }
 
+  mfclose(&mf);
+
   // Go back to where the names are
   fseek(fp, last_pos, SEEK_SET);
   for(i = old_num_boards; i < old_num_boards + num_boards; i++)
@@ -28,6 +28,7 @@
 #include "window.h"
 #include "graphics.h"
 #include "event.h"
+#include "benchmark.h"
 
 
 // Error type names by type code:
@@ -59,6 +60,10 @@ int error(const char *string, unsigned int type, unsigned int options,
 
   type_name = error_type_names[type];
 
+  // Benchmark runs close the dialog right away, so the message is logged
+  if(benchmark.dismiss_dialogs)
+    warn("Closed for the benchmark:%s%s\n", type_name, string);
+
   // If graphics couldn't initialize, print the error to stderr and abort.
   if(!has_video_initialized())
   {
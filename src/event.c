@@ -17,6 +17,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "benchmark.h"
 #include "event.h"
 #include "graphics.h"
 #include "util.h"
@@ -424,6 +425,9 @@ void wait_event(void)
 
   __wait_event();
   update_autorepeat();
+
+  if(benchmark.dismiss_dialogs)
+    benchmark_dismiss();
 }
 
 Uint32 update_event_status_delay(void)
@@ -431,6 +435,12 @@ Uint32 update_event_status_delay(void)
   int rval = update_event_status();
   int delay_ticks;
 
+  if(benchmark.dismiss_dialogs)
+  {
+    benchmark_dismiss();
+    return rval;
+  }
+
   if(!last_update_time)
     last_update_time = get_ticks();
 
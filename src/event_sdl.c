@@ -21,6 +21,7 @@
 #include "event.h"
 #include "platform.h"
 #include "graphics.h"
+#include "trace.h"
 
 #include "SDL.h"
 
@@ -273,7 +274,10 @@ static bool process_event(SDL_Event *event)
 
       if(ckey == IKEY_F12)
       {
-        dump_screen();
+        if(tracing && get_ctrl_status(keycode_internal))
+          trace_save();
+        else
+          dump_screen();
         break;
       }
 
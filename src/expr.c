@@ -62,6 +62,75 @@ static char *expr_skip_whitespace(char *expression)
   return expression;
 }
 
+#ifndef CONFIG_DEBYTECODE
+
+// Copy the name of a 'counter' argument, starting after the opening quote
+// (or &), into name; up to 256 characters. Nested expressions may contain
+// the quote character. On success the argument is left after the closing
+// quote and the length of the name is returned, otherwise -1.
+
+static int scan_counter_name(char **_argument, char t_char, char *name)
+{
+  char *argument = *_argument + 1;
+  int count = 0;
+
+  // Remember, null terminator is evil; if it's hit exit completely.
+  while(((*argument) != t_char) && (count < 256))
+  {
+    // If a nested expression is hit closing 's should be ignored
+    if((*argument) == '(')
+    {
+      int close_paren_count = 1;
+      // The number of )'s to expect.. finding one decreases it..
+      // And finding a ( increases it.
+
+      while((close_paren_count) && (count < 256))
+      {
+        name[count] = *argument;
+        argument++;
+        count++;
+
+        switch(*argument)
+        {
+          case '\0':
+          {
+            *_argument = argument;
+            return -1;
+          }
+          case ')':
+          {
+            close_paren_count--;
+            break;
+          }
+          case '(':
+          {
+            close_paren_count++;
+            break;
+          }
+        }
+      }
+    }
+    else
+    {
+      if(*argument == '\0')
+      {
+        *_argument = argument;
+        return -1;
+      }
+
+      name[count] = *argument;
+      argument++;
+      count++;
+    }
+  }
+
+  name[count] = '\0';
+  *_argument = argument + 1;
+  return count;
+}
+
+#endif // !CONFIG_DEBYTECODE
+
 static int parse_argument(struct world *mzx_world, char **_argument,
  int *type, int id)
 {
@@ -325,70 +394,19 @@ static int parse_argument(struct world *mzx_world, char **_argument,
     case '&':
     case '\'':
     {
-      // Find where the next ' or & is
-      char t_char = first_char;
-      char temp[256];
-      char temp2[256];
-      int count = 0;
-
-      argument++;
+      char temp[257];
+      char temp2[ROBOT_MAX_TR];
 
-      // Remember, null terminator is evil; if it's hit exit completely.
-      while(((*argument) != t_char) && (count < 256))
+      if(scan_counter_name(&argument, first_char, temp) < 0)
       {
-        // If a nested expression is hit closing 's should be ignored
-        if((*argument) == '(')
-        {
-          int close_paren_count = 1;
-          // The number of )'s to expect.. finding one decreases it..
-          // And finding a ( increases it.
-
-          while((close_paren_count) && (count < 256))
-          {
-            temp[count] = *argument;
-            argument++;
-            count++;
-
-            switch(*argument)
-            {
-              case '\0':
-              {
-                *type = -1;
-                *_argument = argument;
-                return -1;
-              }
-              case ')':
-              {
-                close_paren_count--;
-                break;
-              }
-              case '(':
-              {
-                close_paren_count++;
-                break;
-              }
-            }
-          }
-        }
-        else
-        {
-          if(*argument == '\0')
-          {
-            *type = -1;
-            *_argument = argument;
-            return -1;
-          }
-
-          temp[count] = *argument;
-          argument++;
-          count++;
-        }
+        *type = -1;
+        *_argument = argument;
+        return -1;
       }
 
       *type = 0;
-      *_argument = argument + 1;
+      *_argument = argument;
 
-      temp[count] = '\0';
       tr_msg(mzx_world, temp, id, temp2);
       return get_counter(mzx_world, temp2, id);
     }
@@ -620,6 +638,450 @@ err_out:
   return value;
 }
 
+// Compiled expressions. Robots evaluate the same expressions over and over,
+// so parameters that are expressions can be compiled once to a small stack
+// program (see parse_param). Evaluation is still strictly left to right;
+// the program reads counters in the same order and updates the last value
+// (#) at the same points as parse_expression would.
+
+enum expr_opcode
+{
+  EXPR_VALUE,               // Push value
+  EXPR_LAST_VALUE,          // Push the last expression value
+  EXPR_COUNTER,             // Push counter number value
+  EXPR_NEGATE,
+  EXPR_COMPLEMENT,
+  EXPR_SET_LAST_VALUE,      // Store the top of the stack as the last value
+  EXPR_OPERATION            // Apply operation value to the top two values
+};
+
+struct expr_instruction
+{
+  enum expr_opcode opcode;
+  int value;
+};
+
+struct expr_counter
+{
+  struct counter_lookup lookup;
+  // Set if the name has to go through tr_msg() first
+  bool translate;
+  char *name;
+};
+
+struct expression
+{
+  int num_instructions;
+  int num_instructions_allocated;
+  struct expr_instruction *instructions;
+  int num_counters;
+  struct expr_counter *counters;
+};
+
+// Deeper expressions are left to parse_expression.
+#define MAX_EXPR_STACK 32
+
+void free_expression(struct expression *expr)
+{
+  int i;
+
+  if(!expr)
+    return;
+
+  for(i = 0; i < expr->num_counters; i++)
+    free(expr->counters[i].name);
+
+  free(expr->counters);
+  free(expr->instructions);
+  free(expr);
+}
+
+int evaluate_expression(struct world *mzx_world, struct expression *expr,
+ int id)
+{
+  struct expr_instruction *current = expr->instructions;
+  struct expr_instruction *end = current + expr->num_instructions;
+  int stack[MAX_EXPR_STACK];
+  int *top = stack - 1;
+
+  for(; current < end; current++)
+  {
+    switch(current->opcode)
+    {
+      case EXPR_VALUE:
+        *(++top) = current->value;
+        break;
+
+      case EXPR_LAST_VALUE:
+        *(++top) = last_val;
+        break;
+
+      case EXPR_COUNTER:
+      {
+        struct expr_counter *src = expr->counters + current->value;
+
+        if(src->translate)
+        {
+          char name_translated[ROBOT_MAX_TR];
+
+          tr_msg(mzx_world, src->name, id, name_translated);
+          *(++top) = get_counter(mzx_world, name_translated, id);
+        }
+        else
+        {
+          *(++top) =
+           get_counter_lookup(mzx_world, src->name, &(src->lookup), id);
+        }
+        break;
+      }
+
+      case EXPR_NEGATE:
+        *top = -(*top);
+        break;
+
+      case EXPR_COMPLEMENT:
+        *top = ~(*top);
+        break;
+
+      case EXPR_SET_LAST_VALUE:
+        last_val = *top;
+        break;
+
+      case EXPR_OPERATION:
+        top--;
+        *top = evaluate_operation(top[0], (enum op)current->value, top[1]);
+        break;
+    }
+  }
+
+  last_val = stack[0];
+  return stack[0];
+}
+
+#ifndef CONFIG_DEBYTECODE
+
+struct expr_compiler
+{
+  struct world *mzx_world;
+  struct expression *expr;
+  int depth;
+  // If the expression reads # anywhere, nested values must update it too
+  bool uses_last;
+  bool error;
+};
+
+// Adds an instruction, folding it into the previous ones when all of its
+// operands are constants.
+
+static void emit_instruction(struct expr_compiler *compiler,
+ enum expr_opcode opcode, int value)
+{
+  struct expression *expr = compiler->expr;
+  struct expr_instruction *prev;
+  int count = expr->num_instructions;
+
+  if(compiler->error)
+    return;
+
+  prev = count ? expr->instructions + count - 1 : NULL;
+
+  switch(opcode)
+  {
+    case EXPR_VALUE:
+    case EXPR_LAST_VALUE:
+    case EXPR_COUNTER:
+    {
+      compiler->depth++;
+      if(compiler->depth > MAX_EXPR_STACK)
+      {
+        compiler->error = true;
+        return;
+      }
+      break;
+    }
+
+    case EXPR_NEGATE:
+    {
+      if(prev->opcode == EXPR_VALUE)
+      {
+        prev->value = -(prev->value);
+        return;
+      }
+      break;
+    }
+
+    case EXPR_COMPLEMENT:
+    {
+      if(prev->opcode == EXPR_VALUE)
+      {
+        prev->value = ~(prev->value);
+        return;
+      }
+      break;
+    }
+
+    case EXPR_SET_LAST_VALUE:
+    {
+      if(!compiler->uses_last)
+        return;
+      break;
+    }
+
+    case EXPR_OPERATION:
+    {
+      compiler->depth--;
+      if((count >= 2) && (prev->opcode == EXPR_VALUE) &&
+       (prev[-1].opcode == EXPR_VALUE))
+      {
+        prev[-1].value =
+         evaluate_operation(prev[-1].value, (enum op)value, prev->value);
+        expr->num_instructions--;
+        return;
+      }
+      break;
+    }
+  }
+
+  if(count == expr->num_instructions_allocated)
+  {
+    if(count)
+      expr->num_instructions_allocated *= 2;
+    else
+      expr->num_instructions_allocated = 8;
+
+    expr->instructions = crealloc(expr->instructions,
+     sizeof(struct expr_instruction) * expr->num_instructions_allocated);
+  }
+
+  expr->instructions[count].opcode = opcode;
+  expr->instructions[count].value = value;
+  expr->num_instructions = count + 1;
+}
+
+static void emit_counter(struct expr_compiler *compiler, const char *name)
+{
+  struct expression *expr = compiler->expr;
+  struct expr_counter *dest;
+
+  expr->counters = crealloc(expr->counters,
+   sizeof(struct expr_counter) * (expr->num_counters + 1));
+
+  dest = expr->counters + expr->num_counters;
+  dest->name = cmalloc(strlen(name) + 1);
+  strcpy(dest->name, name);
+
+  // Expressions are only compiled for 2.44+ worlds, where tr_msg() also
+  // evaluates nested expressions.
+  dest->translate = (strpbrk(name, "&(") != NULL);
+  if(!dest->translate)
+    init_counter_lookup(compiler->mzx_world, name, &(dest->lookup));
+
+  emit_instruction(compiler, EXPR_COUNTER, expr->num_counters);
+  expr->num_counters++;
+}
+
+static bool compile_group(struct expr_compiler *compiler, char **_expression);
+
+// Mirrors parse_argument, but emits code for values instead of reading
+// them. Returns the operator for operator arguments.
+
+static int compile_argument(struct expr_compiler *compiler, char **_argument,
+ int *type)
+{
+  char *argument = *_argument;
+  int first_char = *argument;
+
+  switch(first_char)
+  {
+    case '-':
+    case '~':
+    {
+      int t2;
+
+      // A - followed by a space is subtraction
+      if((first_char == '-') && isspace((int)argument[1]))
+        break;
+
+      argument++;
+      compile_argument(compiler, &argument, &t2);
+      *_argument = argument;
+
+      if((t2 != 0) && (t2 != 2))
+      {
+        *type = -1;
+        return -1;
+      }
+
+      if(first_char == '-')
+        emit_instruction(compiler, EXPR_NEGATE, 0);
+      else
+        emit_instruction(compiler, EXPR_COMPLEMENT, 0);
+
+      *type = 2;
+      return 0;
+    }
+
+    // Don't skip past the end of the expression
+    case '!':
+    {
+      if(argument[1] == '\0')
+      {
+        *type = -1;
+        return -1;
+      }
+      break;
+    }
+
+    case '#':
+    {
+      emit_instruction(compiler, EXPR_LAST_VALUE, 0);
+      *type = 0;
+      *_argument = argument + 1;
+      return 0;
+    }
+
+    case '(':
+    {
+      argument++;
+      if(!compile_group(compiler, &argument))
+      {
+        *type = -1;
+        *_argument = argument;
+        return -1;
+      }
+
+      emit_instruction(compiler, EXPR_SET_LAST_VALUE, 0);
+      *type = 0;
+      *_argument = argument;
+      return 0;
+    }
+
+    case '&':
+    case '\'':
+    {
+      char name[257];
+      int length = scan_counter_name(&argument, first_char, name);
+
+      *_argument = argument;
+
+      // Overlong names aren't parsed sensibly; leave them alone.
+      if((length < 0) || (length >= 256))
+      {
+        *type = -1;
+        return -1;
+      }
+
+      emit_counter(compiler, name);
+      *type = 0;
+      return 0;
+    }
+
+    default:
+    {
+      if((first_char >= '0') && (first_char <= '9'))
+      {
+        char *end_p;
+        int val = (int)strtol(argument, &end_p, 0);
+
+        emit_instruction(compiler, EXPR_VALUE, val);
+        *type = 0;
+        *_argument = end_p;
+        return 0;
+      }
+      break;
+    }
+  }
+
+  // Everything else is an operator or invalid; neither reads anything.
+  return parse_argument(compiler->mzx_world, _argument, type, -1);
+}
+
+// Mirrors parse_expression.
+
+static bool compile_group(struct expr_compiler *compiler, char **_expression)
+{
+  char *expression = *_expression;
+  int c_operator;
+  int current_arg;
+
+  expression = expr_skip_whitespace(expression);
+  compile_argument(compiler, &expression, &current_arg);
+
+  if((current_arg != 0) && (current_arg != 2))
+    return false;
+
+  expression = expr_skip_whitespace(expression);
+
+  while(!compiler->error)
+  {
+    if(*expression == ')')
+    {
+      expression++;
+      break;
+    }
+
+    c_operator = compile_argument(compiler, &expression, &current_arg);
+
+    // A negative number here is considered + num
+    if(current_arg == 2)
+    {
+      emit_instruction(compiler, EXPR_OPERATION, OP_ADDITION);
+    }
+    else
+    {
+      if(current_arg != 1)
+        return false;
+
+      expression = expr_skip_whitespace(expression);
+      compile_argument(compiler, &expression, &current_arg);
+
+      if((current_arg != 0) && (current_arg != 2))
+        return false;
+
+      emit_instruction(compiler, EXPR_OPERATION, c_operator);
+    }
+    expression = expr_skip_whitespace(expression);
+  }
+
+  *_expression = expression;
+  return !compiler->error;
+}
+
+// Compile an expression (starting after the opening parenthesis) that
+// makes up the rest of a parameter. Returns NULL if it can't be compiled,
+// in which case it should be left to parse_expression.
+
+struct expression *compile_expression(struct world *mzx_world,
+ char *expression)
+{
+  struct expr_compiler compiler;
+
+  compiler.mzx_world = mzx_world;
+  compiler.expr = ccalloc(1, sizeof(struct expression));
+  compiler.depth = 0;
+  compiler.uses_last = (strchr(expression, '#') != NULL);
+  compiler.error = false;
+
+  if(!compile_group(&compiler, &expression) || *expression)
+  {
+    free_expression(compiler.expr);
+    return NULL;
+  }
+
+  return compiler.expr;
+}
+
+#else // CONFIG_DEBYTECODE
+
+struct expression *compile_expression(struct world *mzx_world,
+ char *expression)
+{
+  // Only the legacy expression syntax is compiled
+  return NULL;
+}
+
+#endif // CONFIG_DEBYTECODE
+
 #ifdef CONFIG_DEBYTECODE
 
 int parse_string_expression(struct world *mzx_world, char **_expression,
@@ -29,6 +29,14 @@ __M_BEGIN_DECLS
 int parse_expression(struct world *mzx_world, char **expression, int *error,
  int id);
 
+struct expression;
+
+struct expression *compile_expression(struct world *mzx_world,
+ char *expression);
+int evaluate_expression(struct world *mzx_world, struct expression *expr,
+ int id);
+void free_expression(struct expression *expr);
+
 #ifdef CONFIG_DEBYTECODE
 int parse_string_expression(struct world *mzx_world, char **_expression,
  int id, char *output);
@@ -52,6 +52,8 @@
 #include "fsafeopen.h"
 #include "extmem.h"
 #include "util.h"
+#include "benchmark.h"
+#include "trace.h"
 
 #define MESG_TIMEOUT 160
 
@@ -117,6 +119,35 @@ static int update_music;
 
 static bool editing = true;
 
+// Start loading the modules of the boards the current board leads to, so
+// they're ready to play if the player goes there.
+
+static void prefetch_board_modules(struct world *mzx_world)
+{
+  struct board *src_board = mzx_world->current_board;
+  char *filenames[4];
+  int count = 0;
+  int i;
+
+  for(i = 0; i < 4; i++)
+  {
+    int board_id = src_board->board_dir[i];
+    struct board *dest_board;
+
+    if(board_id >= mzx_world->num_boards)
+      continue;
+
+    // Don't bother with the module that's already playing, or with boards
+    // that haven't been read in yet
+    dest_board = mzx_world->board_list[board_id];
+    if(dest_board && dest_board->loaded &&
+     strcasecmp(dest_board->mod_playing, mzx_world->real_mod_playing))
+      filenames[count++] = dest_board->mod_playing;
+  }
+
+  prefetch_modules(filenames, count);
+}
+
 //Bit 1- +1
 //Bit 2- -1
 //Bit 4- +width
@@ -630,6 +661,8 @@ static void give_potion(struct world *mzx_world, enum potion type)
           if(level_id[offset] == BOMB)
           {
             level_id[offset] = EXPLOSION;
+            mark_board_update(src_board, offset);
+            mark_board_changed(src_board);
             if(level_param[offset] == 0)
               level_param[offset] = 32;
             else
@@ -651,6 +684,8 @@ static void give_potion(struct world *mzx_world, enum potion type)
           if(level_id[offset] == (char)DRAGON)
           {
             level_id[offset] = GHOST;
+            mark_board_update(src_board, offset);
+            mark_board_changed(src_board);
             level_param[offset] = 51;
           }
         }
@@ -672,6 +707,8 @@ static void give_potion(struct world *mzx_world, enum potion type)
           if(is_enemy(d_id))
           {
             level_id[offset] = (char)DRAGON;
+            mark_board_update(src_board, offset);
+            mark_board_changed(src_board);
             level_color[offset] = 4;
             level_param[offset] = 102;
           }
@@ -903,8 +940,7 @@ __editor_maybe_static void draw_viewport(struct world *mzx_world)
   }
 }
 
-// Returns non-0 to skip all keys this cycle
-static int update(struct world *mzx_world, int game, int *fadein)
+static int __update(struct world *mzx_world, int game, int *fadein)
 {
   int start_ticks = get_ticks();
   int time_remaining;
@@ -1035,6 +1071,7 @@ static int update(struct world *mzx_world, int game, int *fadein)
             reload = 2;
             src_board->player_last_dir =
              (src_board->player_last_dir & 0x0F) | (move_dir << 4);
+            mark_board_changed(src_board);
           }
         }
       }
@@ -1049,6 +1086,7 @@ static int update(struct world *mzx_world, int game, int *fadein)
       {
         move_player(mzx_world, 0);
         src_board->player_last_dir = (src_board->player_last_dir & 0x0F);
+        mark_board_changed(src_board);
       }
       if(key_up_delay <= REPEAT_WAIT)
         mzx_world->key_up_delay = key_up_delay + 1;
@@ -1064,6 +1102,7 @@ static int update(struct world *mzx_world, int game, int *fadein)
         move_player(mzx_world, 1);
         src_board->player_last_dir =
          (src_board->player_last_dir & 0x0F) + 0x10;
+        mark_board_changed(src_board);
       }
       if(key_down_delay <= REPEAT_WAIT)
         mzx_world->key_down_delay = key_down_delay + 1;
@@ -1079,6 +1118,7 @@ static int update(struct world *mzx_world, int game, int *fadein)
         move_player(mzx_world, 2);
         src_board->player_last_dir =
          (src_board->player_last_dir & 0x0F) + 0x20;
+        mark_board_changed(src_board);
       }
       if(key_right_delay <= REPEAT_WAIT)
         mzx_world->key_right_delay = key_right_delay + 1;
@@ -1094,6 +1134,7 @@ static int update(struct world *mzx_world, int game, int *fadein)
         move_player(mzx_world, 3);
         src_board->player_last_dir =
          (src_board->player_last_dir & 0x0F) + 0x30;
+        mark_board_changed(src_board);
       }
       if(key_left_delay <= REPEAT_WAIT)
         mzx_world->key_left_delay = key_left_delay + 1;
@@ -1147,6 +1188,7 @@ static int update(struct world *mzx_world, int game, int *fadein)
           level_under_id[d_offset] = 37;
           level_under_color[d_offset] = 8;
           level_under_param[d_offset] = mzx_world->bomb_type << 7;
+          mark_board_changed(src_board);
           play_sfx(mzx_world, 33 + mzx_world->bomb_type);
 
           if(mzx_world->bomb_type)
@@ -1164,7 +1206,10 @@ static int update(struct world *mzx_world, int game, int *fadein)
   if((src_board->robot_list[0] != NULL) &&
    (src_board->robot_list[0])->used)
   {
+    cycle_scope_begin(BENCHMARK_ROBOTS, "global_robot");
     run_robot(mzx_world, 0, -1, -1);
+    cycle_scope_end();
+
     src_board = mzx_world->current_board;
     level_under_id = src_board->level_under_id;
     board_width = src_board->board_width;
@@ -1188,7 +1233,9 @@ static int update(struct world *mzx_world, int game, int *fadein)
     if(flags[(int)level_under_id[d_offset]] & A_ENTRANCE)
       entrance = 0;
 
+    cycle_scope_begin(BENCHMARK_BOARD, "update_board");
     update_board(mzx_world);
+    cycle_scope_end();
 
     src_board = mzx_world->current_board;
     level_under_id = src_board->level_under_id;
@@ -1339,6 +1386,8 @@ static int update(struct world *mzx_world, int game, int *fadein)
   {
     int top_x, top_y;
 
+    cycle_scope_begin(BENCHMARK_DRAW, "draw");
+
     // Draw border
     draw_viewport(mzx_world);
 
@@ -1380,11 +1429,21 @@ static int update(struct world *mzx_world, int game, int *fadein)
     }
     else
     {
+      trace_begin("draw_game_window");
       draw_game_window(src_board, top_x, top_y);
+      trace_end();
     }
 
     // Add sprites
+    cycle_scope_begin(BENCHMARK_SPRITES, "draw_sprites");
     draw_sprites(mzx_world);
+    cycle_scope_end();
+
+    if(benchmark.active)
+    {
+      benchmark.sprites_drawn += mzx_world->sprites_drawn;
+      benchmark.sprite_chars_drawn += mzx_world->sprite_chars_drawn;
+    }
 
     // Add time limit
     time_remaining = get_counter(mzx_world, "TIME", 0);
@@ -1480,10 +1539,18 @@ static int update(struct world *mzx_world, int game, int *fadein)
     if(pal_update)
       update_palette();
 
+    trace_begin("update_screen");
     update_screen();
+    trace_end();
+
+    cycle_scope_end();
   }
 
-  if(mzx_world->mzx_speed > 1)
+  // Audio with no device to play it is timed by the cycles instead
+  advance_audio_clock(16 * MAX(mzx_world->mzx_speed - 1, 1));
+
+  // Benchmarks run as fast as they can
+  if((mzx_world->mzx_speed > 1) && !benchmark.active)
   {
     // Number of ms the update cycle took
     total_ticks = (16 * (mzx_world->mzx_speed - 1))
@@ -1491,7 +1558,9 @@ static int update(struct world *mzx_world, int game, int *fadein)
     if(total_ticks < 0)
       total_ticks = 0;
     // Delay for 16 * (speed - 1) since the beginning of the update
+    trace_begin("delay");
     delay(total_ticks);
+    trace_end();
   }
 
   if(*fadein)
@@ -1545,8 +1614,11 @@ static int update(struct world *mzx_world, int game, int *fadein)
 
     if(mzx_world->current_board_id != target_board)
     {
+       // The board being left has been played on, so it has to stay loaded
+       mzx_world->current_board->clean = false;
        mzx_world->current_board_id = target_board;
-       set_current_board_ext(mzx_world, mzx_world->board_list[target_board]);
+       set_current_board_ext(mzx_world, get_board(mzx_world, target_board));
+       prefetch_board_modules(mzx_world);
     }
 
     src_board = mzx_world->current_board;
@@ -1715,12 +1787,14 @@ static int update(struct world *mzx_world, int game, int *fadein)
     // Now... Set player_last_dir for direction FACED
     src_board->player_last_dir = (src_board->player_last_dir & 0x0F) |
      (saved_player_last_dir & 0xF0);
+    mark_board_changed(src_board);
 
     // ...and if player ended up on ICE, set last dir pressed as well
     if((enum thing)level_under_id[mzx_world->player_x +
      (mzx_world->player_y * board_width)] == ICE)
     {
       src_board->player_last_dir = saved_player_last_dir;
+      mark_board_changed(src_board);
     }
 
     // Fix palette
@@ -1742,6 +1816,19 @@ static int update(struct world *mzx_world, int game, int *fadein)
   return 0;
 }
 
+// Returns non-0 to skip all keys this cycle
+static int update(struct world *mzx_world, int game, int *fadein)
+{
+  int skip_keys;
+
+  // Each update is a frame of the trace
+  trace_begin("frame");
+  skip_keys = __update(mzx_world, game, fadein);
+  trace_end();
+
+  return skip_keys;
+}
+
 static void focus_on_player(struct world *mzx_world)
 {
   int player_x   = mzx_world->player_x;
@@ -1770,6 +1857,8 @@ __editor_maybe_static void play_game(struct world *mzx_world)
 
   set_context(91);
 
+  prefetch_board_modules(mzx_world);
+
   do
   {
     focus_on_player(mzx_world);
@@ -2148,6 +2237,84 @@ __editor_maybe_static void play_game(struct world *mzx_world)
   clear_sfx_queue();
 }
 
+// Play the startup world for benchmark_cycles cycles as fast as possible,
+// with keys from the benchmark input script. Robots still get the keys,
+// but the menus and dialogs they would open in play_game are left out, and
+// the ones robots open are closed right away (see benchmark_dismiss).
+
+void benchmark_game(struct world *mzx_world)
+{
+  struct config_info *conf = &(mzx_world->conf);
+  char keylbl[5] = "KEY?";
+  struct board *src_board;
+  int fadein = 0;
+  int fade = 0;
+  int swapped;
+  int cycle;
+  int key;
+
+  if(!benchmark_init(conf))
+    return;
+
+  if(!reload_world(mzx_world, curr_file, &fade))
+  {
+    warn("Failed to load '%s' for the benchmark\n", curr_file);
+    return;
+  }
+
+  if(mzx_world->current_board_id != mzx_world->first_board)
+  {
+    mzx_world->current_board_id = mzx_world->first_board;
+    set_current_board_ext(mzx_world,
+     get_board(mzx_world, mzx_world->current_board_id));
+  }
+
+  src_board = mzx_world->current_board;
+
+  send_robot_def(mzx_world, 0, 11);
+  send_robot_def(mzx_world, 0, 10);
+
+  load_board_module(src_board);
+  strcpy(mzx_world->real_mod_playing, src_board->mod_playing);
+  set_counter(mzx_world, "TIME", src_board->time_limit, 0);
+
+  find_player(mzx_world);
+  mzx_world->player_restart_x = mzx_world->player_x;
+  mzx_world->player_restart_y = mzx_world->player_y;
+  insta_fadein();
+
+  benchmark_start();
+
+  for(cycle = 0; cycle < conf->benchmark_cycles; cycle++)
+  {
+    swapped = update(mzx_world, 1, &fadein);
+    update_event_status();
+    benchmark_input(cycle);
+
+    if(swapped)
+      continue;
+
+    key = get_key(keycode_internal);
+
+    if(key)
+    {
+      int key_char = get_key(keycode_unicode);
+
+      if(key_char)
+      {
+        keylbl[3] = key_char;
+        send_robot_all_def(mzx_world, keylbl);
+      }
+
+      if(key == IKEY_RETURN)
+        send_robot_all_def(mzx_world, "KeyEnter");
+    }
+  }
+
+  benchmark_finish(mzx_world, cycle);
+  end_module();
+}
+
 void title_screen(struct world *mzx_world)
 {
   int fadein = 1;
@@ -2383,7 +2550,7 @@ void title_screen(struct world *mzx_world)
               {
                 mzx_world->current_board_id = mzx_world->first_board;
                 set_current_board_ext(mzx_world,
-                 mzx_world->board_list[mzx_world->current_board_id]);
+                 get_board(mzx_world, mzx_world->current_board_id));
               }
 
               src_board = mzx_world->current_board;
@@ -2712,14 +2879,18 @@ void rotate(struct world *mzx_world, int x, int y, int dir)
         cur_offset = offset + offs[i];
         next_offset = offset + offs[i + 1];
         level_id[cur_offset] = level_id[next_offset];
+        mark_board_update(src_board, cur_offset);
+        mark_board_changed(src_board);
         level_color[cur_offset] = level_color[next_offset];
         level_param[cur_offset] = level_param[next_offset];
       }
 
       cur_offset = offset + offs[7];
       level_id[cur_offset] = (char)id;
+      mark_board_update(src_board, cur_offset);
       level_color[cur_offset] = color;
       level_param[cur_offset] = param;
+      mark_board_changed(src_board);
     }
   }
   else
@@ -2876,7 +3047,7 @@ int move_player(struct world *mzx_world, int dir)
       case 0: // North- Enter south side
       {
         mzx_world->target_y =
-         (mzx_world->board_list[board_dir])->board_height - 1;
+         (get_board(mzx_world, board_dir))->board_height - 1;
         break;
       }
 
@@ -2895,7 +3066,7 @@ int move_player(struct world *mzx_world, int dir)
       case 3: // West- Enter east side
       {
         mzx_world->target_x =
-         (mzx_world->board_list[board_dir])->board_width - 1;
+         (get_board(mzx_world, board_dir))->board_width - 1;
         break;
       }
     }
@@ -3157,6 +3328,7 @@ int grab_item(struct world *mzx_world, int offset, int dir)
             return 0;
 
           src_board->level_param[offset] = 0;
+          mark_board_changed(src_board);
           give_potion(mzx_world, (enum potion)item);
           break;
         }
@@ -3174,6 +3346,7 @@ int grab_item(struct world *mzx_world, int offset, int dir)
             return 0;
 
           src_board->level_param[offset] = 0;
+          mark_board_changed(src_board);
           give_potion(mzx_world, (enum potion)item);
           break;
         }
@@ -3198,6 +3371,7 @@ int grab_item(struct world *mzx_world, int offset, int dir)
       }
       // Empty chest
       src_board->level_param[offset] = 0;
+      mark_board_changed(src_board);
       break;
     }
 
@@ -3278,7 +3452,9 @@ int grab_item(struct world *mzx_world, int offset, int dir)
         // Light bomb
         play_sfx(mzx_world, 33);
         src_board->level_id[offset] = 37;
+        mark_board_update(src_board, offset);
         src_board->level_param[offset] = param << 7;
+        mark_board_changed(src_board);
       }
       break;
     }
@@ -3344,7 +3520,9 @@ int grab_item(struct world *mzx_world, int offset, int dir)
       }
 
       src_board->level_id[offset] = 42;
+      mark_board_update(src_board, offset);
       src_board->level_param[offset] = (param & 7);
+      mark_board_changed(src_board);
 
       if(move(mzx_world, x, y, door_first_movement[param & 7],
        CAN_PUSH | CAN_LAVAWALK | CAN_FIREWALK | CAN_WATERWALK))
@@ -3353,6 +3531,7 @@ int grab_item(struct world *mzx_world, int offset, int dir)
         play_sfx(mzx_world, 19);
         level_id[offset] = 41;
         level_param[offset] = param & 7;
+        mark_board_changed(src_board);
       }
       else
       {
@@ -3382,7 +3561,9 @@ int grab_item(struct world *mzx_world, int offset, int dir)
       }
 
       src_board->level_id[offset] = (char)OPEN_GATE;
+      mark_board_update(src_board, offset);
       src_board->level_param[offset] = 22;
+      mark_board_changed(src_board);
       play_sfx(mzx_world, 15);
       break;
     }
@@ -3430,6 +3611,7 @@ int grab_item(struct world *mzx_world, int offset, int dir)
       else
       {
         src_board->level_id[offset] = (char)FLOOR;
+        mark_board_changed(src_board);
         return 1;
       }
       break;
@@ -3447,6 +3629,7 @@ int grab_item(struct world *mzx_world, int offset, int dir)
     case INVIS_WALL:
     {
       src_board->level_id[offset] = (char)NORMAL;
+      mark_board_changed(src_board);
       set_mesg(mzx_world, "Oof! You ran into an invisible wall.");
       play_sfx(mzx_world, 12);
       break;
@@ -3455,7 +3638,9 @@ int grab_item(struct world *mzx_world, int offset, int dir)
     case MINE:
     {
       src_board->level_id[offset] = (char)EXPLOSION;
+      mark_board_update(src_board, offset);
       src_board->level_param[offset] = param & 240;
+      mark_board_changed(src_board);
       play_sfx(mzx_world, 36);
       break;
     }
@@ -3463,7 +3648,9 @@ int grab_item(struct world *mzx_world, int offset, int dir)
     case EYE:
     {
       src_board->level_id[offset] = (char)EXPLOSION;
+      mark_board_update(src_board, offset);
       src_board->level_param[offset] = (param << 1) & 112;
+      mark_board_changed(src_board);
       break;
     }
 
@@ -3483,6 +3670,7 @@ int grab_item(struct world *mzx_world, int offset, int dir)
         break;
 
       src_board->level_id[offset] = (char)BREAKAWAY;
+      mark_board_changed(src_board);
       break;
     }
 
@@ -31,6 +31,7 @@ __M_BEGIN_DECLS
 #include "world_struct.h"
 
 CORE_LIBSPEC void title_screen(struct world *mzx_world);
+CORE_LIBSPEC void benchmark_game(struct world *mzx_world);
 CORE_LIBSPEC void find_player(struct world *mzx_world);
 
 void set_intro_mesg_timer(unsigned int time);
@@ -33,8 +33,10 @@
 #include "idput.h"
 #include "const.h"
 #include "idarray.h"
+#include "board.h"
 #include "robot.h"
 #include "util.h"
+#include "benchmark.h"
 
 // For missile turning (directions)
 
@@ -186,6 +188,61 @@ static int arraydir2(struct board *src_board, int x, int y,
   return 0;
 }
 
+// Find the first chunk at or after the given one that's marked for updates.
+// Returns num_chunks if there aren't any.
+
+static int next_update_chunk(unsigned int *update_chunks, int chunk,
+ int num_chunks)
+{
+  unsigned int bits;
+
+  while(chunk < num_chunks)
+  {
+    bits = update_chunks[chunk / 32] >> (chunk % 32);
+
+    if(bits)
+    {
+      while(!(bits & 1))
+      {
+        bits >>= 1;
+        chunk++;
+      }
+      return chunk;
+    }
+
+    chunk = (chunk | 31) + 1;
+  }
+
+  return num_chunks;
+}
+
+// Find the last chunk at or before the given one that's marked for updates.
+// Returns -1 if there aren't any.
+
+static int prev_update_chunk(unsigned int *update_chunks, int chunk)
+{
+  unsigned int bits;
+
+  while(chunk >= 0)
+  {
+    bits = update_chunks[chunk / 32] << (31 - (chunk % 32));
+
+    if(bits)
+    {
+      while(!(bits & 0x80000000))
+      {
+        bits <<= 1;
+        chunk--;
+      }
+      return chunk;
+    }
+
+    chunk = (chunk & ~31) - 1;
+  }
+
+  return -1;
+}
+
 // This is the big one. Update all of the stuff on the screen..
 
 void update_board(struct world *mzx_world)
@@ -193,6 +250,7 @@ void update_board(struct world *mzx_world)
   int i;
   int x, y;
   int level_offset;
+  int chunk, chunk_start, chunk_end;
   struct board *src_board = mzx_world->current_board;
   struct robot *cur_robot;
   char *level_id = src_board->level_id;
@@ -208,6 +266,31 @@ void update_board(struct world *mzx_world)
   char current_color;
   enum thing current_under_id;
   char *update_done = mzx_world->update_done;
+  int board_size = board_width * board_height;
+  int num_chunks = (board_size + UPDATE_CHUNK_SIZE - 1) >> UPDATE_CHUNK_SHIFT;
+  unsigned int *update_chunks;
+
+  // A board starts out with all of its chunks marked. Coming back to it from
+  // another board does the same, since update_done was used for that board.
+  if(!src_board->update_chunks || (mzx_world->update_done_board != src_board))
+  {
+    int num_words = (num_chunks + 31) / 32;
+
+    if(!src_board->update_chunks)
+      src_board->update_chunks = cmalloc(num_words * sizeof(unsigned int));
+
+    memset(src_board->update_chunks, 0xFF, num_words * sizeof(unsigned int));
+
+    if(num_chunks % 32)
+    {
+      src_board->update_chunks[num_words - 1] =
+       (1u << (num_chunks % 32)) - 1;
+    }
+
+    mzx_world->update_done_board = src_board;
+  }
+
+  update_chunks = src_board->update_chunks;
 
   // Toggle slow_down
   mzx_world->slow_down ^= 1;
@@ -220,15 +303,46 @@ void update_board(struct world *mzx_world)
     cur_robot->status = 0;
   }
 
-  memset(update_done, 0, board_width * board_height);
+  // Anything with update_done set is in a marked chunk
+  for(chunk = next_update_chunk(update_chunks, 0, num_chunks);
+   chunk < num_chunks;
+   chunk = next_update_chunk(update_chunks, chunk + 1, num_chunks))
+  {
+    chunk_start = chunk << UPDATE_CHUNK_SHIFT;
+    chunk_end = MIN(chunk_start + UPDATE_CHUNK_SIZE, board_size);
+    memset(update_done + chunk_start, 0, chunk_end - chunk_start);
+  }
 
-  // The big update loop
-  for(y = 0, level_offset = 0; y < board_height; y++)
+  // The big update loop. This only visits the marked chunks, but goes
+  // through them in the same order as a scan of the whole board would.
+  for(chunk = next_update_chunk(update_chunks, 0, num_chunks);
+   chunk < num_chunks;
+   chunk = next_update_chunk(update_chunks, chunk + 1, num_chunks))
   {
-    for(x = 0; x < board_width; x++, level_offset++)
+    level_offset = chunk << UPDATE_CHUNK_SHIFT;
+    chunk_end = MIN(level_offset + UPDATE_CHUNK_SIZE, board_size);
+    y = level_offset / board_width;
+    x = level_offset - (y * board_width);
+
+    // Unmark the chunk; it's marked again if anything is left to update
+    update_chunks[chunk / 32] &= ~(1u << (chunk % 32));
+
+    for(; level_offset < chunk_end; level_offset++, x++)
     {
+      if(x == board_width)
+      {
+        x = 0;
+        y++;
+      }
+
       current_id = (enum thing)level_id[level_offset];
 
+      if(update_done[level_offset] ||
+       ((current_id >= 25) && (flags[(int)current_id] & A_UPDATE)))
+      {
+        mark_board_update(src_board, level_offset);
+      }
+
       // If the char's update done value is set or the id is < 25
       // (space trough W water) then there's nothing to do here;
       // go to the next one.
@@ -246,7 +360,9 @@ void update_board(struct world *mzx_world)
         case ROBOT:
         case ROBOT_PUSHABLE:
         {
+          benchmark_enter(BENCHMARK_ROBOTS);
           run_robot(mzx_world, current_param, x, y);
+          benchmark_leave();
 
           if(mzx_world->swapped)
           {
@@ -266,6 +382,7 @@ void update_board(struct world *mzx_world)
             {
               // Start anim at 1
               level_param[level_offset] = 1;
+              mark_board_changed(src_board);
             }
           }
           else
@@ -275,11 +392,13 @@ void update_board(struct world *mzx_world)
           {
             // Reset animation
             level_param[level_offset] = 0;
+            mark_board_changed(src_board);
           }
           else
           {
             // Increase animation
             level_param[level_offset] = current_param + 1;
+            mark_board_changed(src_board);
           }
 
           break;
@@ -298,10 +417,12 @@ void update_board(struct world *mzx_world)
             if(current_param == 2)
             {
               level_param[level_offset] = 0;
+              mark_board_changed(src_board);
             }
             else
             {
               level_param[level_offset] = current_param + 1;
+              mark_board_changed(src_board);
             }
           }
           break;
@@ -319,11 +440,13 @@ void update_board(struct world *mzx_world)
             if(current_param != 5)
             {
               level_param[level_offset] = current_param + 1;
+              mark_board_changed(src_board);
             }
             else
             {
               // Reset the animation
               level_param[level_offset] = 0;
+              mark_board_changed(src_board);
             }
           }
 
@@ -338,6 +461,7 @@ void update_board(struct world *mzx_world)
             {
               level_under_id[level_offset] = (char)STILL_WATER;
               level_under_color[level_offset] = 25;
+              mark_board_changed(src_board);
             }
             id_remove_top(mzx_world, x, y);
             break;
@@ -357,6 +481,7 @@ void update_board(struct world *mzx_world)
             // Fire turns into dark grey ash
             level_id[level_offset] = (char)FLOOR;
             level_color[level_offset] = 8;
+            mark_board_changed(src_board);
           }
 
           // Put fire all around
@@ -445,6 +570,7 @@ void update_board(struct world *mzx_world)
               // Decrease stage
               current_param -= 0x10;
               level_param[level_offset] = current_param;
+              mark_board_changed(src_board);
 
               // Put explosion at each direction
               for(i = 3; i >= 0; i--)
@@ -530,6 +656,7 @@ void update_board(struct world *mzx_world)
                   {
                     // Decrease HP
                     level_param[offset] = new_param - 0x20;
+                    mark_board_changed(src_board);
                     continue;
                   }
                 }
@@ -567,16 +694,19 @@ void update_board(struct world *mzx_world)
               // Leave ash if the params say so
               level_id[level_offset] = (char)FLOOR;
               level_color[level_offset] = 8;
+              mark_board_changed(src_board);
               break;
             }
             // Otherwise leave fire
             level_id[level_offset] = (char)FIRE;
             level_param[level_offset] = 0;
+            mark_board_changed(src_board);
           }
           else
           {
             // Otherwise go to the next stage
             level_param[level_offset] = current_param + 1;
+            mark_board_changed(src_board);
           }
           break;
         }
@@ -589,6 +719,7 @@ void update_board(struct world *mzx_world)
             break;
 
           level_param[level_offset] = inc_param(current_param, 3);
+          mark_board_changed(src_board);
           rotate(mzx_world, x, y, current_id - CW_ROTATE);
           break;
         }
@@ -603,11 +734,13 @@ void update_board(struct world *mzx_world)
           {
             // Increase animation
             level_param[level_offset] = current_param + 0x08;
+            mark_board_changed(src_board);
           }
           else
           {
             // Otherwise, erase anim bits
             level_param[level_offset] = current_param & 0xE7;
+            mark_board_changed(src_board);
           }
           break;
         }
@@ -620,6 +753,7 @@ void update_board(struct world *mzx_world)
           // Flip animation and store
           current_param ^= 1;
           level_param[level_offset] = current_param;
+          mark_board_changed(src_board);
           // Try moving
 
           status = move(mzx_world, x, y, direction,
@@ -652,6 +786,7 @@ void update_board(struct world *mzx_world)
                 // Put fire
                 level_id[level_offset] = (char)FIRE;
                 level_param[level_offset] = 0;
+                mark_board_changed(src_board);
               }
             }
           }
@@ -674,6 +809,7 @@ void update_board(struct world *mzx_world)
             // Otherwise change direction; try cw then ccw
             int new_direction = cwturndir[(int)current_param];
             level_param[level_offset] = new_direction;
+            mark_board_changed(src_board);
             status = move(mzx_world, x, y, new_direction,
              move_params);
             // Did it hit something that's not the player? Try ccw.
@@ -681,6 +817,7 @@ void update_board(struct world *mzx_world)
             {
               new_direction = ccwturndir[(int)current_param];
               level_param[level_offset] = new_direction;
+              mark_board_changed(src_board);
               status = move(mzx_world, x, y, new_direction, move_params);
               if(status)
                 status = HIT_PLAYER;
@@ -693,6 +830,7 @@ void update_board(struct world *mzx_world)
             // If so, leave explosion
             level_id[level_offset] = (char)EXPLOSION;
             level_param[level_offset] = 48;
+            mark_board_changed(src_board);
             play_sfx(mzx_world, 36);
           }
 
@@ -711,6 +849,7 @@ void update_board(struct world *mzx_world)
           else
           {
             level_param[level_offset] = current_param - 1;
+            mark_board_changed(src_board);
             seek_dir = find_seek(mzx_world, x, y);
             if(move(mzx_world, x, y, seek_dir,
              CAN_PUSH | CAN_LAVAWALK | CAN_FIREWALK |
@@ -741,11 +880,13 @@ void update_board(struct world *mzx_world)
             {
               // Otherwise, erase anim bits
               level_param[level_offset] = current_param & 0xF9;
+              mark_board_changed(src_board);
             }
             else
             {
               // Increase animation
               level_param[level_offset] = current_param + 2;
+              mark_board_changed(src_board);
             }
           }
           break;
@@ -766,6 +907,7 @@ void update_board(struct world *mzx_world)
           // Flip count and store
           current_param ^= 8;
           level_param[level_offset] = current_param;
+          mark_board_changed(src_board);
 
           // If the flipflop or fast-movement is set, move
           if((current_param & 0x08) || !(current_param & 0x04))
@@ -806,6 +948,7 @@ void update_board(struct world *mzx_world)
               // Set direction
               current_param |= m_dir;
               level_param[level_offset] = current_param;
+              mark_board_changed(src_board);
             }
           }
           break;
@@ -816,6 +959,7 @@ void update_board(struct world *mzx_world)
           // Flip count and store
           current_param ^= 0x80;
           level_param[level_offset] = current_param;
+          mark_board_changed(src_board);
 
           // If the flipflop or fast-movement is set, move
           if((current_param & 0x80) || !(current_param & 0x40))
@@ -843,6 +987,7 @@ void update_board(struct world *mzx_world)
               // Explode (place explosion)
               level_id[level_offset] = EXPLOSION;
               level_param[level_offset] = radius;
+              mark_board_changed(src_board);
               play_sfx(mzx_world, 36);
             }
           }
@@ -865,6 +1010,7 @@ void update_board(struct world *mzx_world)
 
             // Zero out move cycle
             level_param[level_offset] = current_param & 0x9F;
+            mark_board_changed(src_board);
 
             // See if a "smart move" should be made
             if(rval < intelligence)
@@ -890,6 +1036,7 @@ void update_board(struct world *mzx_world)
           {
             // Increment move cycle
             level_param[level_offset] = current_param + 0x20;
+            mark_board_changed(src_board);
           }
 
           break;
@@ -947,6 +1094,7 @@ void update_board(struct world *mzx_world)
             {
               // Increase cycle
               level_param[level_offset] = current_param + 4;
+              mark_board_changed(src_board);
             }
           }
           break;
@@ -964,6 +1112,7 @@ void update_board(struct world *mzx_world)
             enum move_status status;
             // Clear cycle
             level_param[level_offset] = current_param & 0xCF;
+            mark_board_changed(src_board);
 
             status = move(mzx_world, x, y, direction,
              CAN_PUSH | CAN_TRANSPORT | REACT_PLAYER);
@@ -982,6 +1131,7 @@ void update_board(struct world *mzx_world)
               {
                 // Change direction
                 level_param[level_offset] = current_param ^ 1;
+                mark_board_changed(src_board);
               }
             }
           }
@@ -989,6 +1139,7 @@ void update_board(struct world *mzx_world)
           {
             // Increase cycle
             level_param[level_offset] = current_param + 0x10;
+            mark_board_changed(src_board);
           }
 
           break;
@@ -1007,6 +1158,7 @@ void update_board(struct world *mzx_world)
             int m_dir;
             // Clear cycle
             level_param[level_offset] = current_param & 0x3F;
+            mark_board_changed(src_board);
 
             if(rval < intelligence)
             {
@@ -1037,6 +1189,7 @@ void update_board(struct world *mzx_world)
           {
             // Increase cycle
             level_param[level_offset] = current_param + 0x40;
+            mark_board_changed(src_board);
           }
 
           break;
@@ -1057,6 +1210,7 @@ void update_board(struct world *mzx_world)
               enum move_status status;
               // Zero out movement
               level_param[level_offset] = current_param & 0xE7;
+              mark_board_changed(src_board);
 
               // One out of 8 moves is random
 
@@ -1090,6 +1244,7 @@ void update_board(struct world *mzx_world)
             else
             {
               level_param[level_offset] = current_param + 8;
+              mark_board_changed(src_board);
             }
           }
 
@@ -1120,6 +1275,7 @@ void update_board(struct world *mzx_world)
 
             // Toggle cycle flipflop off
             level_param[level_offset] = current_param & 0xEF;
+            mark_board_changed(src_board);
 
             // Is there not water there or is it not affected by it?
             if(!(current_param & 0x20) || (m_dir > 3))
@@ -1150,6 +1306,7 @@ void update_board(struct world *mzx_world)
           {
             // Toggle cycle flipflop on
             level_param[level_offset] = current_param | 0x10;
+            mark_board_changed(src_board);
           }
 
           break;
@@ -1241,6 +1398,7 @@ void update_board(struct world *mzx_world)
           // Toggle cycle flipflop
           current_param ^= 0x40;
           level_param[level_offset] = current_param;
+          mark_board_changed(src_board);
 
           // Is the cycle count ready or is fast movement on?
           if((current_param & 0x40) || !(current_param & 0x20))
@@ -1288,11 +1446,13 @@ void update_board(struct world *mzx_world)
             {
               // Zero out move cycle and move bit
               level_param[level_offset] = current_param & 0xC3;
+              mark_board_changed(src_board);
             }
             else
             {
               // Increase move cycle
               level_param[level_offset] = current_param + 4;
+              mark_board_changed(src_board);
             }
           }
           else
@@ -1311,6 +1471,7 @@ void update_board(struct world *mzx_world)
             }
 
             level_param[level_offset] = current_param;
+            mark_board_changed(src_board);
 
             if(rval < intelligence)
             {
@@ -1432,6 +1593,7 @@ void update_board(struct world *mzx_world)
           }
 
           level_param[level_offset] = current_param;
+          mark_board_changed(src_board);
 
           // Fall through
         }
@@ -1501,6 +1663,7 @@ void update_board(struct world *mzx_world)
 
             // Zero out move cycle
             level_param[level_offset] &= 0x9F;
+            mark_board_changed(src_board);
 
             if(player_dist_x < 0) player_dist_x = -player_dist_x;
             if(player_dist_y < 0) player_dist_y = -player_dist_y;
@@ -1520,6 +1683,7 @@ void update_board(struct world *mzx_world)
           else
           {
             level_param[level_offset] = current_param + 0x20;
+            mark_board_changed(src_board);
           }
 
           break;
@@ -1553,6 +1717,7 @@ void update_board(struct world *mzx_world)
           }
 
           level_param[level_offset] = current_param;
+          mark_board_changed(src_board);
 
           intelligence = current_param & 0x03;
           rval = Random(4);
@@ -1585,6 +1750,7 @@ void update_board(struct world *mzx_world)
         case ENERGIZER:
         {
           level_param[level_offset] = inc_param(current_param, 7);
+          mark_board_changed(src_board);
           break;
         }
 
@@ -1605,11 +1771,13 @@ void update_board(struct world *mzx_world)
               }
 
               level_id[level_offset] = 38;
+              mark_board_changed(src_board);
               play_sfx(mzx_world, 36);
             }
             else
             {
               level_param[level_offset] = current_param + 1;
+              mark_board_changed(src_board);
             }
           }
           break;
@@ -1631,11 +1799,13 @@ void update_board(struct world *mzx_world)
               // Turn into a regular door
               level_param[level_offset] = current_param & 0x07;
               level_id[level_offset] = (char)DOOR;
+              mark_board_changed(src_board);
             }
             else
             {
               // Otherwise, add to, reset the wait the stage
               level_param[level_offset] = stage + 8;
+              mark_board_changed(src_board);
             }
 
             // Only do this if movement is possible
@@ -1647,12 +1817,14 @@ void update_board(struct world *mzx_world)
                 // Reset the param and make the door open
                 level_id[level_offset] = OPEN_DOOR;
                 level_param[level_offset] = current_param;
+                mark_board_changed(src_board);
               }
             }
           }
           else
           {
             level_param[level_offset] = current_param + 0x20;
+            mark_board_changed(src_board);
           }
           break;
         }
@@ -1664,12 +1836,14 @@ void update_board(struct world *mzx_world)
           {
             // Make it closed gate
             level_id[level_offset] = (char)GATE;
+            mark_board_changed(src_board);
             play_sfx(mzx_world, 25);
           }
           else
           {
             // Decrease wait
             level_param[level_offset] = current_param - 1;
+            mark_board_changed(src_board);
           }
 
           break;
@@ -1690,6 +1864,7 @@ void update_board(struct world *mzx_world)
             // Can't move; try other direction
             level_id[level_offset] =
              ((int)flip_dir(current_id) + N_MOVING_WALL);
+            mark_board_changed(src_board);
           }
           break;
         }
@@ -1712,7 +1887,10 @@ void update_board(struct world *mzx_world)
         case LIFE:
         {
           if(!slow_down)
+          {
             level_param[level_offset] = inc_param(current_param, 3);
+            mark_board_changed(src_board);
+          }
 
           break;
         }
@@ -1730,11 +1908,13 @@ void update_board(struct world *mzx_world)
             {
               // Loop back
               level_id[level_offset] = WHIRLPOOL_1;
+              mark_board_changed(src_board);
             }
             else
             {
               // Increase "frame"
               level_id[level_offset] = current_id + 1;
+              mark_board_changed(src_board);
             }
           }
 
@@ -1747,11 +1927,13 @@ void update_board(struct world *mzx_world)
           if((current_param & 0x0E) != 0x0E)
           {
             level_param[level_offset] = current_param + 2;
+            mark_board_changed(src_board);
           }
           else
           {
             // Animate
             level_param[level_offset] = (current_param & 0xF1) ^ 1;
+            mark_board_changed(src_board);
           }
           break;
         }
@@ -1797,18 +1979,31 @@ void update_board(struct world *mzx_world)
   }
 
   // Run all of the robots _again_, this time in reverse order.
-  level_offset = (board_width * board_height) - 1;
-
-  for(y = board_height - 1; y >= 0; y--)
+  // Every robot is still in a marked chunk.
+  for(chunk = prev_update_chunk(update_chunks, num_chunks - 1); chunk >= 0;
+   chunk = prev_update_chunk(update_chunks, chunk - 1))
   {
-    for(x = board_width - 1; x >= 0; x--)
+    chunk_start = chunk << UPDATE_CHUNK_SHIFT;
+    level_offset = MIN(chunk_start + UPDATE_CHUNK_SIZE, board_size) - 1;
+    y = level_offset / board_width;
+    x = level_offset - (y * board_width);
+
+    for(; level_offset >= chunk_start; level_offset--, x--)
     {
+      if(x < 0)
+      {
+        x = board_width - 1;
+        y--;
+      }
+
       current_id = (enum thing)level_id[level_offset];
       if(is_robot(current_id))
       {
         current_param = level_param[level_offset];
         // May change the source board (with swap world or load game)
+        benchmark_enter(BENCHMARK_ROBOTS);
         run_robot(mzx_world, -current_param, x, y);
+        benchmark_leave();
 
         if(mzx_world->swapped)
         {
@@ -1816,7 +2011,6 @@ void update_board(struct world *mzx_world)
           return;
         }
       }
-      level_offset--;
     }
   }
 
@@ -2040,6 +2234,7 @@ static void push_player_sensor(struct world *mzx_world, int p_offset,
   level_under_id[d_offset] = (char)SENSOR;
   level_under_color[d_offset] = color;
   level_under_param[d_offset] = param;
+  mark_board_changed(src_board);
 
   push_sensor(mzx_world, level_under_param[d_offset]);
 }
@@ -2187,8 +2382,10 @@ int push(struct world *mzx_world, int x, int y, int dir, int checking)
           // Otherwise, put the last one in the new one, and make
           // the current one the new last one.
           level_id[d_offset] = p_id;
+          mark_board_update(src_board, d_offset);
           level_param[d_offset] = p_param;
           level_color[d_offset] = p_color;
+          mark_board_changed(src_board);
 
           // How about a pushable robot?
           if(d_id == ROBOT_PUSHABLE)
@@ -2321,8 +2518,10 @@ void shoot(struct world *mzx_world, int x, int y, int dir, int type)
       {
         // Turn into explosion
         level_id[d_offset] = 38;
+        mark_board_update(src_board, d_offset);
         // Get rid of count and anim fields in param
         level_param[d_offset] = d_param & 0xF0;
+        mark_board_changed(src_board);
         play_sfx(mzx_world, 36);
         break;
       }
@@ -2354,7 +2553,9 @@ void shoot(struct world *mzx_world, int x, int y, int dir, int type)
         if(type == ENEMY_BULLET) break;
         // Turn into explosion
         level_id[d_offset] = (char)EXPLOSION;
+        mark_board_update(src_board, d_offset);
         level_param[d_offset] = (d_param & 0x38) << 1;
+        mark_board_changed(src_board);
         play_sfx(mzx_world, 36);
         break;
       }
@@ -2385,6 +2586,7 @@ void shoot(struct world *mzx_world, int x, int y, int dir, int type)
           {
             // Otherwise, take an HP
             level_param[d_offset] = d_param - 0x40;
+            mark_board_changed(src_board);
             play_sfx(mzx_world, 45);
           }
           else
@@ -2431,6 +2633,7 @@ void shoot(struct world *mzx_world, int x, int y, int dir, int type)
           {
             // Take away a hit point
             level_param[d_offset] = d_param - 0x20;
+            mark_board_changed(src_board);
             play_sfx(mzx_world, 45);
           }
         }
@@ -2453,6 +2656,7 @@ void shoot(struct world *mzx_world, int x, int y, int dir, int type)
         {
           // Remove HP
           level_param[d_offset] = d_param ^ 0x80;
+          mark_board_changed(src_board);
           play_sfx(mzx_world, 45);
         }
         break;
@@ -50,6 +50,7 @@
 #endif // CONFIG_SDL
 
 #include "util.h"
+#include "benchmark.h"
 
 #define CURSOR_BLINK_RATE 115
 
@@ -81,6 +82,8 @@ static const struct renderer_data renderers[] =
 #if defined(CONFIG_RENDER_GX)
   { "gx", render_gx_register },
 #endif
+  // Last, so it's never the fallback when there's a real display
+  { "headless", render_headless_register },
   { NULL, NULL }
 };
 
@@ -105,9 +108,36 @@ static const struct rgb_color default_pal[16] =
   { 255, 255, 255, 0 }
 };
 
+// Sprite collision checks want to know if a char is blank far more often
+// than the charset changes, so keep that in a table.
+__editor_maybe_static void ec_update_blank_chars(Uint32 first, Uint32 count)
+{
+  Uint8 *src = graphics.charset + (first * CHAR_SIZE);
+  Uint32 i, i2;
+  Uint8 bits;
+
+  for(i = first; i < first + count; i++)
+  {
+    bits = 0;
+
+    for(i2 = 0; i2 < CHAR_SIZE; i2++, src++)
+      bits |= *src;
+
+    graphics.blank_chars[i] = !bits;
+  }
+}
+
+bool ec_is_blank(Uint8 chr)
+{
+  return graphics.blank_chars[chr];
+}
+
 void ec_change_byte(Uint8 chr, Uint8 byte, Uint8 new_value)
 {
   graphics.charset[(chr * CHAR_SIZE) + byte] = new_value;
+  ec_update_blank_chars(chr, 1);
+  graphics.dirty_chars[chr] = 1;
+  graphics.chars_dirty = true;
 
   if(graphics.renderer.remap_charbyte)
     graphics.renderer.remap_charbyte(&graphics, chr, byte);
@@ -116,6 +146,9 @@ void ec_change_byte(Uint8 chr, Uint8 byte, Uint8 new_value)
 void ec_change_char(Uint8 chr, char *matrix)
 {
   memcpy(graphics.charset + (chr * CHAR_SIZE), matrix, CHAR_SIZE);
+  ec_update_blank_chars(chr, 1);
+  graphics.dirty_chars[chr] = 1;
+  graphics.chars_dirty = true;
 
   if(graphics.renderer.remap_char)
     graphics.renderer.remap_char(&graphics, chr);
@@ -142,6 +175,10 @@ Sint32 ec_load_set(char *name)
 
   fclose(fp);
 
+  ec_update_blank_chars(0, CHARSET_SIZE);
+
+  graphics.redraw_all = true;
+
   // some renderers may want to map charsets to textures
   if(graphics.renderer.remap_charsets)
     graphics.renderer.remap_charsets(&graphics);
@@ -160,6 +197,8 @@ __editor_maybe_static void ec_load_set_secondary(const char *name,
   fread(dest, CHAR_SIZE, CHARSET_SIZE, fp);
   fclose(fp);
 
+  graphics.redraw_all = true;
+
   // some renderers may want to map charsets to textures
   if(graphics.renderer.remap_charsets)
     graphics.renderer.remap_charsets(&graphics);
@@ -180,6 +219,10 @@ Sint32 ec_load_set_var(char *name, Uint8 pos)
   fread(graphics.charset + (pos * CHAR_SIZE), CHAR_SIZE, size, fp);
   fclose(fp);
 
+  ec_update_blank_chars(pos, size);
+
+  graphics.redraw_all = true;
+
   // some renderers may want to map charsets to textures
   if(graphics.renderer.remap_charsets)
     graphics.renderer.remap_charsets(&graphics);
@@ -190,6 +233,9 @@ Sint32 ec_load_set_var(char *name, Uint8 pos)
 void ec_mem_load_set(Uint8 *chars)
 {
   memcpy(graphics.charset, chars, CHAR_SIZE * CHARSET_SIZE);
+  ec_update_blank_chars(0, CHARSET_SIZE);
+
+  graphics.redraw_all = true;
 
   // some renderers may want to map charsets to textures
   if(graphics.renderer.remap_charsets)
@@ -209,6 +255,7 @@ __editor_maybe_static void ec_load_mzx(void)
 static void update_colors(struct rgb_color *palette, Uint32 count)
 {
   graphics.renderer.update_colors(&graphics, palette, count);
+  graphics.palette_generation++;
 }
 
 static Uint32 make_palette(struct rgb_color *palette)
@@ -646,10 +693,11 @@ void update_screen(void)
 
     graphics.renderer.render_cursor(&graphics,
      graphics.cursor_x, graphics.cursor_y, cursor_color, lines, offset);
+    render_invalidate(&graphics, graphics.cursor_x, graphics.cursor_y, 1, 1);
   }
   if(graphics.mouse_status)
   {
-    int mouse_x, mouse_y;
+    int mouse_x, mouse_y, mouse_w, mouse_h;
     get_real_mouse_position(&mouse_x, &mouse_y);
 
     mouse_x = (mouse_x / graphics.mouse_width_mul) * graphics.mouse_width_mul;
@@ -657,6 +705,11 @@ void update_screen(void)
 
     graphics.renderer.render_mouse(&graphics, mouse_x, mouse_y,
      graphics.mouse_width_mul, graphics.mouse_height_mul);
+
+    // The pointer covers the cells from its top left to its bottom right pixel
+    mouse_w = (mouse_x + graphics.mouse_width_mul - 1) / 8 - mouse_x / 8 + 1;
+    mouse_h = (mouse_y + graphics.mouse_height_mul - 1) / 14 - mouse_y / 14 + 1;
+    render_invalidate(&graphics, mouse_x / 8, mouse_y / 14, mouse_w, mouse_h);
   }
   graphics.renderer.sync_screen(&graphics);
 }
@@ -688,7 +741,7 @@ void vquick_fadeout(void)
       update_palette();
       update_screen();
       ticks = get_ticks() - ticks;
-      if(ticks <= 16)
+      if((ticks <= 16) && !benchmark.active)
         delay(16 - ticks);
     }
     graphics.fade_status = 1;
@@ -721,7 +774,7 @@ void vquick_fadein(void)
       update_palette();
       update_screen();
       ticks = get_ticks() - ticks;
-      if(ticks <= 16)
+      if((ticks <= 16) && !benchmark.active)
         delay(16 - ticks);
     }
   }
@@ -995,6 +1048,9 @@ bool set_video_mode(void)
     graphics.fullscreen = fullscreen;
   }
 
+  // The renderer's buffers are new; nothing in them has been drawn yet
+  graphics.redraw_all = true;
+
   return graphics.renderer.set_video_mode(&graphics,
    target_width, target_height, target_depth, fullscreen, resize);
 }
@@ -94,6 +94,7 @@ struct graphics_data
   Uint32 screen_mode;
   struct char_element text_video[SCREEN_W * SCREEN_H];
   Uint8 charset[CHAR_SIZE * CHARSET_SIZE * NUM_CHARSETS];
+  bool blank_chars[CHARSET_SIZE];
   struct rgb_color palette[SMZX_PAL_SIZE];
   struct rgb_color intensity_palette[SMZX_PAL_SIZE];
   struct rgb_color backup_palette[SMZX_PAL_SIZE];
@@ -126,8 +127,26 @@ struct graphics_data
   Uint8 default_charset[CHAR_SIZE * CHARSET_SIZE];
 
   Uint32 flat_intensity_palette[SMZX_PAL_SIZE];
+  Uint32 palette_generation;
   struct renderer renderer;
   void *render_data;
+
+  // What the software renderers last drew where, so they only have to draw
+  // the cells that changed since (see render.c)
+  struct char_element drawn_video[SCREEN_W * SCREEN_H];
+  Uint8 dirty_chars[CHARSET_SIZE * NUM_CHARSETS];
+  bool chars_dirty;
+  bool redraw_all;
+  void *drawn_pixels;
+  Uint32 drawn_pitch;
+  Uint32 drawn_screen_mode;
+  Uint32 drawn_palette;
+
+  // The cells drawn to by the last update_screen
+  Uint32 drawn_x1;
+  Uint32 drawn_y1;
+  Uint32 drawn_x2;
+  Uint32 drawn_y2;
 };
 
 CORE_LIBSPEC void color_string(const char *string, Uint32 x, Uint32 y,
@@ -214,6 +233,7 @@ void get_screen(struct char_element *dest);
 
 void ec_change_byte(Uint8 chr, Uint8 byte, Uint8 new_value);
 Uint8 ec_read_byte(Uint8 chr, Uint8 byte);
+bool ec_is_blank(Uint8 chr);
 Sint32 ec_load_set(char *name);
 void ec_mem_save_set(Uint8 *chars);
 
@@ -240,6 +260,7 @@ void focus_pixel(int x, int y);  // Pixel coordinates
 CORE_LIBSPEC extern struct graphics_data graphics;
 CORE_LIBSPEC void ec_load_mzx(void);
 CORE_LIBSPEC void ec_load_set_secondary(const char *name, Uint8 *dest);
+CORE_LIBSPEC void ec_update_blank_chars(Uint32 first, Uint32 count);
 #endif // CONFIG_EDITOR
 
 #ifdef CONFIG_HELPSYS
@@ -19,6 +19,7 @@
  */
 
 #include "idarray.h"
+#include "board.h"
 #include "data.h"
 #include "const.h"
 #include "util.h"
@@ -52,6 +53,8 @@ void offs_place_id(struct world *mzx_world, unsigned int offset,
 
   // Mark as updated
   mzx_world->update_done[offset] = 1;
+  mark_board_update(src_board, offset);
+  mark_board_changed(src_board);
 
   // Is it a sensor and is the player being put on it?
   // Or, can it be moved under and can the new item not be moved under?
@@ -102,6 +105,8 @@ void offs_remove_id(struct world *mzx_world, unsigned int offset)
   enum thing id = (enum thing)src_board->level_id[offset];
 
   src_board->level_id[offset] = src_board->level_under_id[offset];
+  mark_board_update(src_board, offset);
+  mark_board_changed(src_board);
   src_board->level_param[offset] = src_board->level_under_param[offset];
   src_board->level_color[offset] = src_board->level_under_color[offset];
 
@@ -147,4 +152,6 @@ void id_remove_under(struct world *mzx_world, int array_x, int array_y)
   }
 
   mzx_world->update_done[offset] = 1;
+  mark_board_update(src_board, offset);
+  mark_board_changed(src_board);
 }
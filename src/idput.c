@@ -18,6 +18,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "const.h"
 #include "graphics.h"
@@ -453,34 +454,24 @@ unsigned char get_id_under_color(struct board *src_board, int id_offset)
   );
 }
 
-void id_put(struct board *src_board, unsigned char x_pos, unsigned char y_pos,
- int array_x, int array_y, int ovr_x, int ovr_y)
+// Work out the char and color id_put draws for a cell, including the
+// overlay if it's turned on.
+
+static void get_id_put(struct board *src_board, int array_offset,
+ int overlay_offset, unsigned char *ret_c, unsigned char *ret_color)
 {
-  int array_offset, overlay_offset;
   int overlay_mode = src_board->overlay_mode;
-  int board_width = src_board->board_width;
-
   unsigned char c, color;
 
-  array_offset = (array_y * board_width) + array_x;
-
   if(!(overlay_mode & 128) && (overlay_mode & 3) &&
    ((overlay_mode & 3) != 3))
   {
-    if(overlay_mode & 2)
-    {
-      overlay_offset = (ovr_y * board_width) + ovr_x;
-    }
-    else
-    {
-      overlay_offset = array_offset;
-    }
-
     c = src_board->overlay[overlay_offset];
     color = src_board->overlay_color[overlay_offset];
     if(overlay_mode & 64)
     {
-      draw_char_ext(c, color, x_pos, y_pos, 0, 0);
+      *ret_c = c;
+      *ret_color = color;
       return;
     }
 
@@ -524,26 +515,191 @@ void id_put(struct board *src_board, unsigned char x_pos, unsigned char y_pos,
     color = get_id_color(src_board, array_offset);
   }
 
+  *ret_c = c;
+  *ret_color = color;
+}
+
+void id_put(struct board *src_board, unsigned char x_pos, unsigned char y_pos,
+ int array_x, int array_y, int ovr_x, int ovr_y)
+{
+  int array_offset, overlay_offset;
+  int overlay_mode = src_board->overlay_mode;
+  int board_width = src_board->board_width;
+
+  unsigned char c, color;
+
+  array_offset = (array_y * board_width) + array_x;
+
+  if(overlay_mode & 2)
+  {
+    overlay_offset = (ovr_y * board_width) + ovr_x;
+  }
+  else
+  {
+    overlay_offset = array_offset;
+  }
+
+  get_id_put(src_board, array_offset, overlay_offset, &c, &color);
   draw_char_ext(c, color, x_pos, y_pos, 0, 0);
 }
 
+// These things look at more than their own cell to pick a char, so they're
+// redrawn every frame.
+
+static bool is_volatile_id(enum thing cell_id)
+{
+  switch(cell_id)
+  {
+    case LINE:
+    case WEB:
+    case THICK_WEB:
+    case SENSOR:
+    case ROBOT:
+    case ROBOT_PUSHABLE:
+    case PLAYER:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+// What each cell of the game window was drawn from last frame, and what it
+// was drawn as. While the board's change stamp (see board.h) stays the same
+// the cells are drawn straight from here; otherwise a cell is only worked
+// out again when something it's drawn from changes. Anything affecting every
+// cell at once starts over.
+
+struct game_window_cell
+{
+  unsigned char id;
+  unsigned char param;
+  unsigned char color;
+  unsigned char under_color;
+  unsigned char overlay_char;
+  unsigned char overlay_color;
+  unsigned char draw_char;
+  unsigned char draw_color;
+};
+
+static struct
+{
+  bool valid;
+  unsigned int change_stamp;
+  int board_width;
+  int array_x;
+  int array_y;
+  int viewport_width;
+  int viewport_height;
+  int overlay_mode;
+  unsigned char scroll_color;
+  unsigned char id_chars[455];
+  struct game_window_cell cells[SCREEN_W * SCREEN_H];
+} game_window;
+
 void draw_game_window(struct board *src_board, int array_x, int array_y)
 {
+  struct game_window_cell *cell = game_window.cells;
+  char *level_id = src_board->level_id;
+  char *level_param = src_board->level_param;
+  char *level_color = src_board->level_color;
+  char *level_under_color = src_board->level_under_color;
+  char *overlay = src_board->overlay;
+  char *overlay_color = src_board->overlay_color;
+  int overlay_mode = src_board->overlay_mode;
+  int board_width = src_board->board_width;
+  int array_offset, overlay_offset;
+  bool use_overlay, valid;
+  unsigned char id, param, color, under_color;
+  unsigned char ovr_char = 0, ovr_color = 0;
   int x_limit, y_limit;
   int x, y;
-  int a_x, a_y;
   int o_x, o_y;
 
   x_limit = src_board->viewport_width;
   y_limit = src_board->viewport_height;
 
-  for(y = src_board->viewport_y, a_y = array_y, o_y = 0; o_y < y_limit;
-   y++, a_y++, o_y++)
+  use_overlay = !(overlay_mode & 128) && (overlay_mode & 3) &&
+   ((overlay_mode & 3) != 3);
+
+  valid = game_window.valid &&
+   (game_window.board_width == board_width) &&
+   (game_window.array_x == array_x) && (game_window.array_y == array_y) &&
+   (game_window.viewport_width == x_limit) &&
+   (game_window.viewport_height == y_limit) &&
+   (game_window.overlay_mode == overlay_mode) &&
+   (game_window.scroll_color == scroll_color) &&
+   !memcmp(game_window.id_chars, id_chars, sizeof(id_chars));
+
+  // Nothing on the board changed, so neither did any of the cells
+  if(valid && (game_window.change_stamp == src_board->change_stamp))
   {
-    for(x = src_board->viewport_x, a_x = array_x, o_x = 0;
-     o_x < x_limit; x++, a_x++, o_x++)
+    for(y = src_board->viewport_y, o_y = 0; o_y < y_limit; y++, o_y++)
     {
-      id_put(src_board, x, y, a_x, a_y, o_x, o_y);
+      for(x = src_board->viewport_x, o_x = 0; o_x < x_limit;
+       x++, o_x++, cell++)
+        draw_char_ext(cell->draw_char, cell->draw_color, x, y, 0, 0);
+    }
+
+    return;
+  }
+
+  game_window.change_stamp = src_board->change_stamp;
+
+  if(!valid)
+  {
+    game_window.valid = true;
+    game_window.board_width = board_width;
+    game_window.array_x = array_x;
+    game_window.array_y = array_y;
+    game_window.viewport_width = x_limit;
+    game_window.viewport_height = y_limit;
+    game_window.overlay_mode = overlay_mode;
+    game_window.scroll_color = scroll_color;
+    memcpy(game_window.id_chars, id_chars, sizeof(id_chars));
+  }
+
+  for(y = src_board->viewport_y, o_y = 0; o_y < y_limit; y++, o_y++)
+  {
+    array_offset = ((array_y + o_y) * board_width) + array_x;
+
+    if(overlay_mode & 2)
+      overlay_offset = o_y * board_width;
+    else
+      overlay_offset = array_offset;
+
+    for(x = src_board->viewport_x, o_x = 0; o_x < x_limit;
+     x++, o_x++, array_offset++, overlay_offset++, cell++)
+    {
+      id = level_id[array_offset];
+      param = level_param[array_offset];
+      color = level_color[array_offset];
+      under_color = level_under_color[array_offset];
+
+      if(use_overlay)
+      {
+        ovr_char = overlay[overlay_offset];
+        ovr_color = overlay_color[overlay_offset];
+      }
+
+      if(!valid || (cell->id != id) || (cell->param != param) ||
+       (cell->color != color) || (cell->under_color != under_color) ||
+       (cell->overlay_char != ovr_char) ||
+       (cell->overlay_color != ovr_color) ||
+       is_volatile_id((enum thing)id))
+      {
+        cell->id = id;
+        cell->param = param;
+        cell->color = color;
+        cell->under_color = under_color;
+        cell->overlay_char = ovr_char;
+        cell->overlay_color = ovr_color;
+
+        get_id_put(src_board, array_offset, overlay_offset,
+         &cell->draw_char, &cell->draw_color);
+      }
+
+      draw_char_ext(cell->draw_char, cell->draw_color, x, y, 0, 0);
     }
   }
 }
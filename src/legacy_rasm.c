@@ -722,6 +722,15 @@ static const struct mzx_command command_list[] =
   { "enable",         2, cm255 }
 };
 
+// The name a command number is written with
+const char *get_command_name(int cmd)
+{
+  if((cmd < 0) || (cmd >= (int)(sizeof(command_list) / sizeof(*command_list))))
+    return "?";
+
+  return command_list[cmd].name;
+}
+
 static const char *const command_fragments[69] =
 {
   "not",
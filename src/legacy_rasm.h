@@ -58,6 +58,7 @@ struct search_entry_short
 };
 
 CORE_LIBSPEC int get_color(char *cmd_line);
+CORE_LIBSPEC const char *get_command_name(int cmd);
 
 extern const char special_first_char[256];
 
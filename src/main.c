@@ -43,9 +43,12 @@
 #include "error.h"
 #include "idput.h"
 #include "audio.h"
+#include "benchmark.h"
 #include "util.h"
 #include "world.h"
 #include "counter.h"
+#include "profile.h"
+#include "trace.h"
 #include "run_stubs.h"
 #include "network/network.h"
 
@@ -71,6 +74,7 @@ __libspec int main(int argc, char *argv[])
 
   // Keep this 7.2k structure off the stack..
   static struct world mzx_world;
+  char profile_dir[MAX_PATH];
 
   if(!platform_init())
     goto err_out;
@@ -137,6 +141,10 @@ __libspec int main(int argc, char *argv[])
   else
     info("Network layer disabled.\n");
 
+  // Traces have to start before the audio does
+  if(mzx_world.conf.trace_file[0])
+    trace_start(mzx_world.conf.trace_file, mzx_world.conf.trace_events);
+
   init_event();
 
   if(!init_video(&mzx_world.conf, CAPTION))
@@ -159,8 +167,28 @@ __libspec int main(int argc, char *argv[])
   mzx_world.mzx_speed = mzx_world.conf.mzx_speed;
   mzx_world.default_speed = mzx_world.mzx_speed;
 
+  // Worlds can change the directory, so the profile is written relative to
+  // the one the game started in
+  if(mzx_world.conf.robot_profile[0])
+  {
+    getcwd(profile_dir, MAX_PATH);
+    profile_robots_start();
+  }
+
   // Run main game (mouse is hidden and palette is faded)
-  title_screen(&mzx_world);
+  if(mzx_world.conf.benchmark_suite[0])
+    benchmark_suite(&mzx_world);
+  else if(mzx_world.conf.benchmark_cycles > 0)
+    benchmark_game(&mzx_world);
+  else
+    title_screen(&mzx_world);
+
+  if(mzx_world.conf.robot_profile[0])
+  {
+    profile_robots_stop();
+    chdir(profile_dir);
+    profile_robots_export(mzx_world.conf.robot_profile);
+  }
 
   vquick_fadeout();
 
@@ -176,6 +204,12 @@ __libspec int main(int argc, char *argv[])
 
   quit_audio();
 
+  if(tracing)
+  {
+    trace_save();
+    trace_stop();
+  }
+
   err = 0;
 err_network_layer_exit:
   network_layer_exit(&mzx_world.conf);
@@ -0,0 +1,269 @@
+/* MegaZeux
+ *
+ * Copyright (C) 2026 MegaZeux contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "memfile.h"
+
+// Read from a block of memory
+
+void mfopen(struct memfile *mf, void *src, size_t len)
+{
+  mf->start = src;
+  mf->current = mf->start;
+  mf->end = mf->start + len;
+  mf->limit = mf->end;
+  mf->fp = NULL;
+  mf->offset = 0;
+  mf->owned = false;
+  mf->write = false;
+}
+
+// Read through fp, starting from where it is now. fp shouldn't be used
+// directly until the memfile is closed.
+
+void mfopen_file(struct memfile *mf, FILE *fp)
+{
+  mf->start = cmalloc(MEMFILE_WINDOW_SIZE);
+  mf->current = mf->start;
+  mf->end = mf->start;
+  mf->limit = mf->start + MEMFILE_WINDOW_SIZE;
+  mf->fp = fp;
+  mf->offset = ftell(fp);
+  mf->owned = true;
+  mf->write = false;
+}
+
+// Write to memory, starting with room for len bytes
+
+void mfopen_write(struct memfile *mf, size_t len)
+{
+  if(!len)
+    len = MEMFILE_WINDOW_SIZE;
+
+  mf->start = cmalloc(len);
+  mf->current = mf->start;
+  mf->end = mf->start;
+  mf->limit = mf->start + len;
+  mf->fp = NULL;
+  mf->offset = 0;
+  mf->owned = true;
+  mf->write = true;
+}
+
+void mfclose(struct memfile *mf)
+{
+  // Leave the file where it would be if it had been read directly
+  if(mf->fp)
+    fseek(mf->fp, mftell(mf), SEEK_SET);
+
+  if(mf->owned)
+    free(mf->start);
+
+  mf->start = NULL;
+  mf->current = NULL;
+  mf->end = NULL;
+  mf->limit = NULL;
+}
+
+// Write everything that's been written to the memfile to fp
+
+size_t mfsave(struct memfile *mf, FILE *fp)
+{
+  size_t len = mf->end - mf->start;
+
+  if(!len)
+    return 0;
+
+  return fwrite(mf->start, len, 1, fp) * len;
+}
+
+// Move whatever's left to the start of the window and fill the rest from
+// the file. Returns the amount that can now be read.
+
+size_t mffill(struct memfile *mf)
+{
+  size_t left = mf->end - mf->current;
+  size_t len;
+
+  if(!mf->fp)
+    return left;
+
+  mf->offset += mf->current - mf->start;
+  memmove(mf->start, mf->current, left);
+
+  len = fread(mf->start + left, 1, (mf->limit - mf->start) - left, mf->fp);
+
+  mf->current = mf->start;
+  mf->end = mf->start + left + len;
+  return left + len;
+}
+
+// Make room to write len bytes at the current position
+
+void mfreserve(struct memfile *mf, size_t len)
+{
+  size_t pos = mf->current - mf->start;
+  size_t used = mf->end - mf->start;
+  size_t alloc = mf->limit - mf->start;
+
+  if(pos + len <= alloc)
+    return;
+
+  while(alloc < pos + len)
+    alloc *= 2;
+
+  mf->start = crealloc(mf->start, alloc);
+  mf->current = mf->start + pos;
+  mf->end = mf->start + used;
+  mf->limit = mf->start + alloc;
+}
+
+size_t mfread(void *dest, size_t size, size_t count, struct memfile *mf)
+{
+  unsigned char *pos = dest;
+  size_t total = size * count;
+  size_t left = total;
+  size_t len;
+
+  if(!total)
+    return 0;
+
+  while(left)
+  {
+    len = mf->end - mf->current;
+    if(len > left)
+      len = left;
+
+    memcpy(pos, mf->current, len);
+    mf->current += len;
+    pos += len;
+    left -= len;
+
+    if(!left || !mf->fp)
+      break;
+
+    // Anything too big for the window goes straight to its destination
+    if(left >= MEMFILE_WINDOW_SIZE)
+    {
+      mf->offset += mf->current - mf->start;
+      mf->current = mf->start;
+      mf->end = mf->start;
+
+      len = fread(pos, 1, left, mf->fp);
+      mf->offset += len;
+      left -= len;
+      break;
+    }
+
+    if(!mffill(mf))
+      break;
+  }
+
+  return (total - left) / size;
+}
+
+size_t mfwrite(const void *src, size_t size, size_t count, struct memfile *mf)
+{
+  size_t total = size * count;
+
+  if((size_t)(mf->limit - mf->current) < total)
+    mfreserve(mf, total);
+
+  memcpy(mf->current, src, total);
+  mfadvance(mf, total);
+  return count;
+}
+
+int mfseek(struct memfile *mf, long offset, int whence)
+{
+  long len = mf->end - mf->start;
+  long pos;
+
+  switch(whence)
+  {
+    case SEEK_SET:
+      pos = offset;
+      break;
+
+    case SEEK_CUR:
+      pos = mftell(mf) + offset;
+      break;
+
+    case SEEK_END:
+      if(mf->fp)
+      {
+        if(fseek(mf->fp, offset, SEEK_END))
+          return -1;
+
+        mf->offset = ftell(mf->fp);
+        mf->current = mf->start;
+        mf->end = mf->start;
+        return 0;
+      }
+      pos = len + offset;
+      break;
+
+    default:
+      return -1;
+  }
+
+  if(pos < 0)
+    return -1;
+
+  if(mf->write)
+  {
+    // Like a file, skipping past the end leaves a gap of zeroes
+    if(pos > len)
+    {
+      mf->current = mf->end;
+      mfreserve(mf, pos - len);
+      memset(mf->end, 0, pos - len);
+      mf->end = mf->start + pos;
+    }
+
+    mf->current = mf->start + pos;
+    return 0;
+  }
+
+  if(!mf->fp)
+  {
+    // Also like a file, reading past the end just gets EOF
+    if(pos > len)
+      pos = len;
+
+    mf->current = mf->start + pos;
+    return 0;
+  }
+
+  if((pos >= mf->offset) && (pos <= mf->offset + len))
+  {
+    mf->current = mf->start + (pos - mf->offset);
+    return 0;
+  }
+
+  if(fseek(mf->fp, pos, SEEK_SET))
+    return -1;
+
+  mf->offset = pos;
+  mf->current = mf->start;
+  mf->end = mf->start;
+  return 0;
+}
@@ -0,0 +1,173 @@
+/* MegaZeux
+ *
+ * Copyright (C) 2026 MegaZeux contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// Stand-ins for the stdio calls worlds, boards, robots and counters are
+// read and written with. A memfile is read either from a block of memory
+// or through a window onto a file that's refilled as it runs dry, and is
+// written to a block of memory that grows as needed and goes out to the
+// file in one fwrite. The byte and word calls are inline, so they don't
+// pay for a function call and a stream lock each like fgetc/fputc do.
+
+#ifndef __MEMFILE_H
+#define __MEMFILE_H
+
+#include "compat.h"
+
+__M_BEGIN_DECLS
+
+#include <stdio.h>
+
+// Size of the window used when reading through a file
+#define MEMFILE_WINDOW_SIZE (32 * 1024)
+
+struct memfile
+{
+  unsigned char *start;
+  unsigned char *current;
+  // Reading: end of the data available
+  // Writing: end of the data written so far
+  unsigned char *end;
+  // Writing: end of the allocated block
+  unsigned char *limit;
+
+  // File read through, and its position at start
+  FILE *fp;
+  long offset;
+
+  bool owned;
+  bool write;
+};
+
+CORE_LIBSPEC void mfopen(struct memfile *mf, void *src, size_t len);
+CORE_LIBSPEC void mfopen_file(struct memfile *mf, FILE *fp);
+CORE_LIBSPEC void mfopen_write(struct memfile *mf, size_t len);
+CORE_LIBSPEC void mfclose(struct memfile *mf);
+CORE_LIBSPEC size_t mfsave(struct memfile *mf, FILE *fp);
+
+CORE_LIBSPEC size_t mffill(struct memfile *mf);
+CORE_LIBSPEC void mfreserve(struct memfile *mf, size_t len);
+
+CORE_LIBSPEC size_t mfread(void *dest, size_t size, size_t count,
+ struct memfile *mf);
+CORE_LIBSPEC size_t mfwrite(const void *src, size_t size, size_t count,
+ struct memfile *mf);
+CORE_LIBSPEC int mfseek(struct memfile *mf, long offset, int whence);
+
+static inline long mftell(struct memfile *mf)
+{
+  return mf->offset + (long)(mf->current - mf->start);
+}
+
+static inline int mfgetc(struct memfile *mf)
+{
+  if((mf->current >= mf->end) && !mffill(mf))
+    return EOF;
+
+  return *(mf->current++);
+}
+
+static inline int mfgetw(struct memfile *mf)
+{
+  int a, b;
+
+  if(mf->end - mf->current >= 2)
+  {
+    a = mf->current[0];
+    b = mf->current[1];
+    mf->current += 2;
+  }
+  else
+  {
+    a = mfgetc(mf);
+    b = mfgetc(mf);
+    if((a == EOF) || (b == EOF))
+      return EOF;
+  }
+
+  return (b << 8) | a;
+}
+
+static inline int mfgetd(struct memfile *mf)
+{
+  int a, b, c, d;
+
+  if(mf->end - mf->current >= 4)
+  {
+    a = mf->current[0];
+    b = mf->current[1];
+    c = mf->current[2];
+    d = mf->current[3];
+    mf->current += 4;
+  }
+  else
+  {
+    a = mfgetc(mf);
+    b = mfgetc(mf);
+    c = mfgetc(mf);
+    d = mfgetc(mf);
+    if((a == EOF) || (b == EOF) || (c == EOF) || (d == EOF))
+      return EOF;
+  }
+
+  return (d << 24) | (c << 16) | (b << 8) | a;
+}
+
+// Data written past the end of what's there grows the block
+
+static inline void mfadvance(struct memfile *mf, size_t len)
+{
+  mf->current += len;
+  if(mf->current > mf->end)
+    mf->end = mf->current;
+}
+
+static inline void mfputc(int src, struct memfile *mf)
+{
+  if(mf->current >= mf->limit)
+    mfreserve(mf, 1);
+
+  mf->current[0] = src;
+  mfadvance(mf, 1);
+}
+
+static inline void mfputw(int src, struct memfile *mf)
+{
+  if(mf->limit - mf->current < 2)
+    mfreserve(mf, 2);
+
+  mf->current[0] = src & 0xFF;
+  mf->current[1] = (src >> 8) & 0xFF;
+  mfadvance(mf, 2);
+}
+
+static inline void mfputd(int src, struct memfile *mf)
+{
+  if(mf->limit - mf->current < 4)
+    mfreserve(mf, 4);
+
+  mf->current[0] = src & 0xFF;
+  mf->current[1] = (src >> 8) & 0xFF;
+  mf->current[2] = (src >> 16) & 0xFF;
+  mf->current[3] = (src >> 24) & 0xFF;
+  mfadvance(mf, 4);
+}
+
+__M_END_DECLS
+
+#endif // __MEMFILE_H
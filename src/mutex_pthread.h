@@ -28,12 +28,22 @@ __M_BEGIN_DECLS
 #include "pthread.h"
 
 typedef pthread_mutex_t platform_mutex;
+typedef pthread_cond_t platform_cond;
+typedef pthread_t platform_thread;
+
+#define THREAD_RES void *
+#define THREAD_RETURN do { return NULL; } while(0)
 
 static inline void platform_mutex_init(platform_mutex *mutex)
 {
   pthread_mutex_init(mutex, NULL);
 }
 
+static inline void platform_mutex_destroy(platform_mutex *mutex)
+{
+  pthread_mutex_destroy(mutex);
+}
+
 static inline bool platform_mutex_lock(platform_mutex *mutex)
 {
   if(pthread_mutex_lock(mutex))
@@ -48,6 +58,39 @@ static inline bool platform_mutex_unlock(platform_mutex *mutex)
   return true;
 }
 
+static inline void platform_cond_init(platform_cond *cond)
+{
+  pthread_cond_init(cond, NULL);
+}
+
+static inline bool platform_cond_wait(platform_cond *cond,
+ platform_mutex *mutex)
+{
+  if(pthread_cond_wait(cond, mutex))
+    return false;
+  return true;
+}
+
+static inline bool platform_cond_broadcast(platform_cond *cond)
+{
+  if(pthread_cond_broadcast(cond))
+    return false;
+  return true;
+}
+
+static inline bool platform_thread_create(platform_thread *thread,
+ THREAD_RES (*start_function)(void *), void *data)
+{
+  if(pthread_create(thread, NULL, start_function, data))
+    return false;
+  return true;
+}
+
+static inline void platform_thread_join(platform_thread *thread)
+{
+  pthread_join(*thread, NULL);
+}
+
 __M_END_DECLS
 
 #endif // __MUTEX_PTHREAD_H
@@ -27,12 +27,22 @@ __M_BEGIN_DECLS
 #include "SDL_thread.h"
 
 typedef SDL_mutex* platform_mutex;
+typedef SDL_cond* platform_cond;
+typedef SDL_Thread* platform_thread;
+
+#define THREAD_RES int
+#define THREAD_RETURN do { return 0; } while(0)
 
 static inline void platform_mutex_init(platform_mutex *mutex)
 {
   *mutex = SDL_CreateMutex();
 }
 
+static inline void platform_mutex_destroy(platform_mutex *mutex)
+{
+  SDL_DestroyMutex(*mutex);
+}
+
 static inline bool platform_mutex_lock(platform_mutex *mutex)
 {
   if(SDL_LockMutex(*mutex))
@@ -47,6 +57,40 @@ static inline bool platform_mutex_unlock(platform_mutex *mutex)
   return true;
 }
 
+static inline void platform_cond_init(platform_cond *cond)
+{
+  *cond = SDL_CreateCond();
+}
+
+static inline bool platform_cond_wait(platform_cond *cond,
+ platform_mutex *mutex)
+{
+  if(SDL_CondWait(*cond, *mutex))
+    return false;
+  return true;
+}
+
+static inline bool platform_cond_broadcast(platform_cond *cond)
+{
+  if(SDL_CondBroadcast(*cond))
+    return false;
+  return true;
+}
+
+static inline bool platform_thread_create(platform_thread *thread,
+ THREAD_RES (*start_function)(void *), void *data)
+{
+  *thread = SDL_CreateThread(start_function, data);
+  if(!*thread)
+    return false;
+  return true;
+}
+
+static inline void platform_thread_join(platform_thread *thread)
+{
+  SDL_WaitThread(*thread, NULL);
+}
+
 __M_END_DECLS
 
 #endif // __MUTEX_SDL_H
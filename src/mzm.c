@@ -23,6 +23,7 @@
 #include "mzm.h"
 #include "data.h"
 #include "idput.h"
+#include "memfile.h"
 #include "world.h"
 #include "validation.h"
 
@@ -128,6 +129,7 @@ void save_mzm(struct world *mzx_world, char *name, int start_x, int start_y,
         if(num_robots)
         {
           struct robot **robot_list = src_board->robot_list;
+          struct memfile mf;
 
           robot_table_position = ftell(output_file);
           fseek(output_file, 8, SEEK_SET);
@@ -142,12 +144,17 @@ void save_mzm(struct world *mzx_world, char *name, int start_x, int start_y,
 
           // Back to robot table position
           fseek(output_file, robot_table_position, SEEK_SET);
+          mfopen_write(&mf, 0);
 
           for(i = 0; i < num_robots; i++)
           {
             // Save each robot
-            save_robot(robot_list[robot_numbers[i]], output_file, savegame, mzx_world->version);
+            save_robot(robot_list[robot_numbers[i]], &mf, savegame,
+             mzx_world->version);
           }
+
+          mfsave(&mf, output_file);
+          mfclose(&mf);
         }
 
         break;
@@ -333,6 +340,10 @@ int load_mzm(struct world *mzx_world, char *name, int start_x, int start_y,
 //      goto err_close;
     }
 
+    // Loading to the board or the overlay changes how the board looks
+    if(mode != 2)
+      mark_board_changed(mzx_world->current_board);
+
     switch(mode)
     {
       // Write to board
@@ -410,6 +421,7 @@ int load_mzm(struct world *mzx_world, char *name, int start_x, int start_y,
                 if(src_id != PLAYER)
                 {
                   level_id[offset] = current_id;
+                  mark_board_update(src_board, offset);
                   level_param[offset] = fgetc(input_file);
                   level_color[offset] = fgetc(input_file);
                   level_under_id[offset] = fgetc(input_file);
@@ -463,6 +475,7 @@ int load_mzm(struct world *mzx_world, char *name, int start_x, int start_y,
               int current_x, current_y;
               int offset;
               int new_param;
+              struct memfile mf;
 
               // If we're loading a "runtime MZM" then it means that we're loading
               // bytecode. And to do this we must both be in-game and must be
@@ -474,6 +487,7 @@ int load_mzm(struct world *mzx_world, char *name, int start_x, int start_y,
                (mzx_world->version < mzm_world_version)))
               {
                 fseek(input_file, robots_location, SEEK_SET);
+                mfopen_file(&mf, input_file);
 
                 for(i = 0; i < num_robots; i++)
                 {
@@ -491,7 +505,7 @@ int load_mzm(struct world *mzx_world, char *name, int start_x, int start_y,
                   if(current_x != -1)
                   {
                     set_validation_suppression(1);
-                    cur_robot = load_robot_allocate(input_file, savegame_mode,
+                    cur_robot = load_robot_allocate(&mf, savegame_mode,
                      mzm_world_version);
 
                     offset = current_x + (current_y * board_width);
@@ -505,10 +519,11 @@ int load_mzm(struct world *mzx_world, char *name, int start_x, int start_y,
               else
               {
                 fseek(input_file, robots_location, SEEK_SET);
+                mfopen_file(&mf, input_file);
 
                 for(i = 0; i < num_robots; i++)
                 {
-                  cur_robot = load_robot_allocate(input_file, savegame_mode,
+                  cur_robot = load_robot_allocate(&mf, savegame_mode,
                    mzm_world_version);
                   current_x = robot_x_locations[i];
                   current_y = robot_y_locations[i];
@@ -550,6 +565,8 @@ int load_mzm(struct world *mzx_world, char *name, int start_x, int start_y,
                   }
                 }
               }
+
+              mfclose(&mf);
             }
             break;
           }
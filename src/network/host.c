@@ -77,6 +77,7 @@ struct host
   const char *name;
   const char *endpoint;
   bool proxied;
+  bool keep_alive;
   int proto;
   int af;
   int fd;
@@ -701,6 +702,7 @@ struct host *host_create(enum host_type type, enum host_family fam)
   h->proto = proto;
   h->af = af;
   h->fd = fd;
+  h->keep_alive = true;
   return h;
 }
 
@@ -784,6 +786,10 @@ static bool __recv(struct host *h, void *buffer, unsigned int len)
       return false;
     }
 
+    // the other end closed the connection
+    if(count == 0)
+      return false;
+
     if(h->cancel_cb && h->cancel_cb())
       return false;
   }
@@ -1168,22 +1174,11 @@ static ssize_t zlib_skip_gzip_header(char *initial, unsigned long len)
   return gzip - (Bytef *)initial;
 }
 
-enum host_status host_recv_file(struct host *h, const char *url,
- FILE *file, const char *expected_type)
+enum host_status host_send_request(struct host *h, const char *url,
+ long offset)
 {
-  bool mid_inflate = false, mid_chunk = false, deflated = false;
-  unsigned int content_length = 0;
   const char *host_name = h->name;
-  unsigned long len = 0, pos = 0;
   char line[LINE_BUF_LEN];
-  z_stream stream;
-  size_t line_len;
-
-  enum {
-    NONE,
-    NORMAL,
-    CHUNKED,
-  } transfer_type = NONE;
 
   // Tell the server that we support pipelining
   snprintf(line, LINE_BUF_LEN, "GET %s HTTP/1.1", url);
@@ -1201,14 +1196,46 @@ enum host_status host_recv_file(struct host *h, const char *url,
   if(http_send_line(h, line) < 0)
     return -HOST_SEND_FAILED;
 
-  // We support DEFLATE/GZIP payloads
-  if(http_send_line(h, "Accept-Encoding: gzip") < 0)
-    return -HOST_SEND_FAILED;
+  /* When resuming, the range has to be of the file itself, so don't ask
+   * for it compressed. Otherwise we support DEFLATE/GZIP payloads.
+   */
+  if(offset > 0)
+  {
+    snprintf(line, LINE_BUF_LEN, "Range: bytes=%ld-", offset);
+    line[LINE_BUF_LEN - 1] = 0;
+    if(http_send_line(h, line) < 0)
+      return -HOST_SEND_FAILED;
+  }
+  else
+  {
+    if(http_send_line(h, "Accept-Encoding: gzip") < 0)
+      return -HOST_SEND_FAILED;
+  }
 
   // Black line tells server we are done
   if(http_send_line(h, "") < 0)
     return -HOST_SEND_FAILED;
 
+  return HOST_SUCCESS;
+}
+
+enum host_status host_recv_response(struct host *h, FILE *file,
+ const char *expected_type, long offset)
+{
+  bool mid_inflate = false, mid_chunk = false, deflated = false;
+  unsigned int content_length = 0;
+  unsigned long len = 0, pos = 0;
+  char line[LINE_BUF_LEN];
+  bool partial = false;
+  z_stream stream;
+  int line_len;
+
+  enum {
+    NONE,
+    NORMAL,
+    CHUNKED,
+  } transfer_type = NONE;
+
   // Read in the HTTP status line
   line_len = http_recv_line(h, line, LINE_BUF_LEN);
 
@@ -1219,13 +1246,22 @@ enum host_status host_recv_file(struct host *h, const char *url,
    * pipelining may not advertise full HTTP/1.1 compliance (e.g.
    * `perlbal' httpd).
    *
-   * MegaZeux only cares about pipelining.
+   * MegaZeux only cares about pipelining. A resumed transfer may instead
+   * get "206 Partial Content", or the whole file again if the server
+   * doesn't do ranges.
    */
-  if(line_len != 15 ||
-   strncmp(line, "HTTP/1.", 7) != 0 ||
-   strcmp(&line[7 + 1], " 200 OK") != 0)
+  if(line_len < 12 || strncmp(line, "HTTP/1.", 7) != 0)
+    return -HOST_HTTP_INVALID_STATUS;
+
+  if(offset > 0 && strncmp(&line[7 + 1], " 206 ", 5) == 0)
+    partial = true;
+
+  else if(line_len != 15 || strcmp(&line[7 + 1], " 200 OK") != 0)
     return -HOST_HTTP_INVALID_STATUS;
 
+  // Connections stay open after the response, unless this is HTTP/1.0
+  h->keep_alive = (line[7] != '0');
+
   // Now parse the HTTP headers, extracting only the pertinent fields
 
   while(true)
@@ -1254,6 +1290,8 @@ enum host_status host_recv_file(struct host *h, const char *url,
      *   Transfer-Encoding  Instead of Content-Length, can only be "chunked"
      *   Content-Type       Text or binary; also used for sanity checks
      *   Content-Encoding   Present and set to 'gzip' if deflated
+     *   Content-Range      Where a partial payload starts
+     *   Connection         Set to 'close' if this is the last response
      */
 
     if(strcmp(key, "Content-Length") == 0)
@@ -1288,7 +1326,33 @@ enum host_status host_recv_file(struct host *h, const char *url,
 
       deflated = true;
     }
+
+    else if(strcmp(key, "Content-Range") == 0)
+    {
+      char *endptr;
+
+      // It must start where we asked it to
+      if(strncmp(value, "bytes ", 6) != 0 ||
+       strtoul(value + 6, &endptr, 10) != (unsigned long)offset ||
+       endptr[0] != '-')
+        return -HOST_HTTP_INVALID_HEADER;
+    }
+
+    else if(strcmp(key, "Connection") == 0)
+    {
+      if(strcasecmp(value, "close") == 0)
+        h->keep_alive = false;
+    }
+  }
+
+  // Partial payloads go after what we already have
+  if(partial)
+  {
+    if(fseek(file, offset, SEEK_SET))
+      return -HOST_FWRITE_FAILED;
   }
+  else
+    rewind(file);
 
   if(transfer_type != NORMAL && transfer_type != CHUNKED)
     return -HOST_HTTP_INVALID_TRANSFER_ENCODING;
@@ -1480,6 +1544,22 @@ enum host_status host_recv_file(struct host *h, const char *url,
   return HOST_SUCCESS;
 }
 
+enum host_status host_recv_file(struct host *h, const char *url,
+ FILE *file, const char *expected_type)
+{
+  enum host_status ret = host_send_request(h, url, 0);
+
+  if(ret != HOST_SUCCESS)
+    return ret;
+
+  return host_recv_response(h, file, expected_type, 0);
+}
+
+bool host_keep_alive(struct host *h)
+{
+  return h->keep_alive;
+}
+
 void host_set_callbacks(struct host *h, void (*send_cb)(long offset),
  void (*recv_cb)(long offset), bool (*cancel_cb)(void))
 {
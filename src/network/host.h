@@ -138,6 +138,46 @@ UPDATER_LIBSPEC bool host_connect(struct host *h, const char *hostname,
 UPDATER_LIBSPEC enum host_status host_recv_file(struct host *h,
  const char *url, FILE *file, const char *expected_type);
 
+/**
+ * Send an HTTP request for a file without waiting for the response. Several
+ * requests may be sent before any responses are read (pipelining); they are
+ * answered in the order they were sent, with \ref host_recv_response.
+ *
+ * @param h      Host to converse in HTTP with
+ * @param url    HTTP URL to transfer
+ * @param offset Position in the file to resume from (or 0 for all of it)
+ *
+ * @return See \ref host_status.
+ */
+UPDATER_LIBSPEC enum host_status host_send_request(struct host *h,
+ const char *url, long offset);
+
+/**
+ * Stream the response to the oldest outstanding request to disk. If the
+ * request was for part of the file, the payload is written from `offset'
+ * onwards; if the server sent the whole file instead, it starts again from
+ * the beginning.
+ *
+ * @param h             Host to converse in HTTP with
+ * @param file          File to stream to disk
+ * @param expected_type MIME type to expect in response
+ * @param offset        Position that was passed to \ref host_send_request
+ *
+ * @return See \ref host_status.
+ */
+UPDATER_LIBSPEC enum host_status host_recv_response(struct host *h,
+ FILE *file, const char *expected_type, long offset);
+
+/**
+ * Whether the connection can be used for more requests. This is false once
+ * the server has said it will close the connection after its last response.
+ *
+ * @param h Host to check
+ *
+ * @return Whether more requests can be sent to `h'
+ */
+UPDATER_LIBSPEC bool host_keep_alive(struct host *h);
+
 /**
  * Set send/recv callbacks which will be called (potentially many times) as
  * the library fills the send/recv buffers for "block transfers". HTTP headers
@@ -22,10 +22,56 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
 
-#define BLOCK_SIZE    4096UL
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+#define BLOCK_SIZE    65536UL
 #define LINE_BUF_LEN  256
 
+#define MANIFEST_CACHE "manifest.cache"
+
+// Local files are hashed by a few threads at once where there are threads
+#if defined(CONFIG_AUDIO) && !defined(CONFIG_WII) && !defined(CONFIG_NDS)
+#define MANIFEST_HASH_THREADS 4
+#endif
+
+/* The cache remembers what each file hashed to last time, along with its
+ * size and modification time. Files that haven't been touched since then
+ * aren't hashed again.
+ */
+struct manifest_cache_entry
+{
+  Uint32 sha256[8];
+  unsigned long size;
+  unsigned long mtime;
+  char *name;
+};
+
+struct manifest_check
+{
+  struct manifest_entry *e;
+  unsigned long mtime;
+  Uint32 sha256[8];
+  bool needs_hash;
+  bool hashed;
+  bool valid;
+};
+
+struct manifest_check_pool
+{
+  struct manifest_check *checks;
+  int num_checks;
+  int next_check;
+#ifdef MANIFEST_HASH_THREADS
+  platform_mutex mutex;
+#endif
+};
+
 static bool manifest_parse_sha256(const char *p, Uint32 sha256[8])
 {
   int i, j;
@@ -276,6 +322,7 @@ static void manifest_lists_remove_duplicate_names(
 
 bool manifest_compute_sha256(struct SHA256_ctx *ctx, FILE *f, unsigned long len)
 {
+  char *block = cmalloc(BLOCK_SIZE);
   unsigned long pos = 0;
 
   SHA256_init(ctx);
@@ -283,15 +330,18 @@ bool manifest_compute_sha256(struct SHA256_ctx *ctx, FILE *f, unsigned long len)
   while(pos < len)
   {
     unsigned long block_size = MIN(BLOCK_SIZE, len - pos);
-    char block[BLOCK_SIZE];
 
     if(fread(block, block_size, 1, f) != 1)
+    {
+      free(block);
       return false;
+    }
 
     SHA256_update(ctx, block, block_size);
     pos += block_size;
   }
 
+  free(block);
   SHA256_final(ctx);
   return true;
 }
@@ -318,10 +368,239 @@ bool manifest_entry_check_validity(struct manifest_entry *e, FILE *f)
   return true;
 }
 
+static struct manifest_cache_entry *manifest_cache_load(int *num_cached)
+{
+  struct manifest_cache_entry *cache = NULL;
+  int num_allocated = 0;
+  int num = 0;
+  char buffer[LINE_BUF_LEN];
+  FILE *f;
+
+  *num_cached = 0;
+
+  f = fopen_unsafe(MANIFEST_CACHE, "rb");
+  if(!f)
+    return NULL;
+
+  while(fgets(buffer, LINE_BUF_LEN, f))
+  {
+    struct manifest_cache_entry *c;
+    char *m = buffer, *line;
+    size_t line_len;
+
+    if(num == num_allocated)
+    {
+      num_allocated = MAX(num_allocated * 2, 64);
+      cache = crealloc(cache,
+       num_allocated * sizeof(struct manifest_cache_entry));
+    }
+
+    c = cache + num;
+
+    // Same as the manifest, with the modification time before the name
+    line = strsep(&m, " ");
+    if(!line || !manifest_parse_sha256(line, c->sha256))
+      break;
+
+    line = strsep(&m, " ");
+    if(!line || !manifest_parse_size(line, &c->size))
+      break;
+
+    line = strsep(&m, " ");
+    if(!line || !manifest_parse_size(line, &c->mtime))
+      break;
+
+    line = strsep(&m, "\n");
+    if(!line)
+      break;
+
+    line_len = strlen(line);
+    c->name = cmalloc(line_len + 1);
+    memcpy(c->name, line, line_len + 1);
+    num++;
+  }
+
+  // A cache that's been mangled is only worth ignoring
+  if(!feof(f))
+  {
+    while(num > 0)
+      free(cache[--num].name);
+  }
+
+  fclose(f);
+
+  *num_cached = num;
+  return cache;
+}
+
+static void manifest_cache_free(struct manifest_cache_entry *cache,
+ int num_cached)
+{
+  int i;
+
+  for(i = 0; i < num_cached; i++)
+    free(cache[i].name);
+
+  free(cache);
+}
+
+/* Files modified in the same second as the check started might change
+ * again without their time changing, so those aren't cached yet.
+ */
+static void manifest_cache_save(struct manifest_check *checks, int num_checks,
+ unsigned long check_time)
+{
+  struct manifest_check *c;
+  FILE *f;
+  int i;
+
+  // It's only a cache, so there's nothing to do if it can't be written
+  f = fopen_unsafe(MANIFEST_CACHE, "wb");
+  if(!f)
+    return;
+
+  for(i = 0; i < num_checks; i++)
+  {
+    c = checks + i;
+
+    if(!c->hashed || (c->mtime >= check_time))
+      continue;
+
+    fprintf(f, "%08x%08x%08x%08x%08x%08x%08x%08x %lu %lu %s\n",
+     c->sha256[0], c->sha256[1], c->sha256[2], c->sha256[3],
+     c->sha256[4], c->sha256[5], c->sha256[6], c->sha256[7],
+     c->e->size, c->mtime, c->e->name);
+  }
+
+  fclose(f);
+}
+
+// Decide what a file needs without opening it, if possible
+
+static void manifest_check_prepare(struct manifest_check *c,
+ struct manifest_entry *e, struct manifest_cache_entry *cache,
+ int num_cached)
+{
+  struct stat st;
+  int i;
+
+  c->e = e;
+
+  // It must exist and be the same length
+  if(stat(e->name, &st) || !S_ISREG(st.st_mode) ||
+   ((unsigned long)st.st_size != e->size))
+    return;
+
+  c->mtime = (unsigned long)st.st_mtime;
+
+  for(i = 0; i < num_cached; i++)
+  {
+    if((cache[i].size == e->size) && (cache[i].mtime == c->mtime) &&
+     !strcmp(cache[i].name, e->name))
+    {
+      memcpy(c->sha256, cache[i].sha256, sizeof(Uint32) * 8);
+      c->hashed = true;
+      c->valid = !memcmp(c->sha256, e->sha256, sizeof(Uint32) * 8);
+      return;
+    }
+  }
+
+  c->needs_hash = true;
+}
+
+static void manifest_check_hash(struct manifest_check *c)
+{
+  struct SHA256_ctx ctx;
+  FILE *f;
+
+  f = fopen_unsafe(c->e->name, "rb");
+  if(!f)
+    return;
+
+  if(manifest_compute_sha256(&ctx, f, c->e->size))
+  {
+    memcpy(c->sha256, ctx.H, sizeof(Uint32) * 8);
+    c->hashed = true;
+    c->valid = !memcmp(c->sha256, c->e->sha256, sizeof(Uint32) * 8);
+  }
+
+  fclose(f);
+}
+
+static void manifest_check_worker(struct manifest_check_pool *pool)
+{
+  int i;
+
+  while(true)
+  {
+#ifdef MANIFEST_HASH_THREADS
+    platform_mutex_lock(&pool->mutex);
+    i = pool->next_check++;
+    platform_mutex_unlock(&pool->mutex);
+#else
+    i = pool->next_check++;
+#endif
+
+    if(i >= pool->num_checks)
+      break;
+
+    if(pool->checks[i].needs_hash)
+      manifest_check_hash(pool->checks + i);
+  }
+}
+
+#ifdef MANIFEST_HASH_THREADS
+
+static THREAD_RES manifest_check_thread(void *data)
+{
+  manifest_check_worker((struct manifest_check_pool *)data);
+  THREAD_RETURN;
+}
+
+#endif // MANIFEST_HASH_THREADS
+
+static void manifest_check_all(struct manifest_check *checks, int num_checks)
+{
+  struct manifest_check_pool pool;
+#ifdef MANIFEST_HASH_THREADS
+  platform_thread threads[MANIFEST_HASH_THREADS - 1];
+  int num_threads;
+#endif
+
+  pool.checks = checks;
+  pool.num_checks = num_checks;
+  pool.next_check = 0;
+
+#ifdef MANIFEST_HASH_THREADS
+  platform_mutex_init(&pool.mutex);
+
+  // This thread works through the list as well, so it's fine if none start
+  for(num_threads = 0; num_threads < MANIFEST_HASH_THREADS - 1; num_threads++)
+    if(!platform_thread_create(threads + num_threads,
+     manifest_check_thread, &pool))
+      break;
+
+  manifest_check_worker(&pool);
+
+  while(num_threads > 0)
+    platform_thread_join(threads + --num_threads);
+
+  platform_mutex_destroy(&pool.mutex);
+#else
+  manifest_check_worker(&pool);
+#endif
+}
+
 static void manifest_add_list_validate_augment(struct manifest_entry *local,
  struct manifest_entry **added)
 {
   struct manifest_entry *e, *a = *added;
+  struct manifest_cache_entry *cache;
+  struct manifest_check *checks;
+  unsigned long check_time = (unsigned long)time(NULL);
+  int num_checks = 0;
+  int num_cached;
+  int i;
 
   // Scan along to penultimate `added' (if we have any)
   if(a)
@@ -329,21 +608,30 @@ static void manifest_add_list_validate_augment(struct manifest_entry *local,
       a = a->next;
 
   for(e = local; e; e = e->next)
+    num_checks++;
+
+  if(!num_checks)
+    return;
+
+  checks = ccalloc(num_checks, sizeof(struct manifest_check));
+  cache = manifest_cache_load(&num_cached);
+
+  for(e = local, i = 0; e; e = e->next, i++)
+    manifest_check_prepare(checks + i, e, cache, num_cached);
+
+  manifest_cache_free(cache, num_cached);
+
+  manifest_check_all(checks, num_checks);
+  manifest_cache_save(checks, num_checks, check_time);
+
+  for(i = 0; i < num_checks; i++)
   {
     struct manifest_entry *new_added;
-    FILE *f;
 
-    f = fopen_unsafe(e->name, "rb");
-    if(f)
-    {
-      if(manifest_entry_check_validity(e, f))
-      {
-        fclose(f);
-        continue;
-      }
-      fclose(f);
-    }
+    if(checks[i].valid)
+      continue;
 
+    e = checks[i].e;
     warn("Local file '%s' failed manifest validation\n", e->name);
 
     new_added = manifest_entry_copy(e);
@@ -355,6 +643,8 @@ static void manifest_add_list_validate_augment(struct manifest_entry *local,
     else
       a = *added = new_added;
   }
+
+  free(checks);
 }
 
 bool manifest_get_updates(struct host *h, const char *basedir,
@@ -403,61 +693,120 @@ bool manifest_get_updates(struct host *h, const char *basedir,
   return true;
 }
 
-bool manifest_entry_download_replace(struct host *h, const char *basedir,
- struct manifest_entry *e, void (*delete_hook)(const char *file))
+/* Files are downloaded next to where they belong, with this appended to
+ * their names, and only moved into place once they're valid. If a download
+ * is interrupted, the next attempt carries on from where it left off.
+ */
+#define PARTIAL_SUFFIX ".part"
+
+static long manifest_entry_partial_size(struct manifest_entry *e)
 {
   char buf[LINE_BUF_LEN];
-  enum host_status ret;
-  bool valid = false;
-  FILE *f;
+  struct stat s;
 
-  /* Try to open our target file. If we can't open it, it might be
-   * write protected or in-use. In this case, it may be possible to
-   * rename the original file out of the way. Try this trick first.
-   */
-  f = fopen_unsafe(e->name, "w+b");
-  if(!f)
-  {
-    snprintf(buf, LINE_BUF_LEN, "%s~", e->name);
-    if(rename(e->name, buf))
-    {
-      warn("Failed to rename in-use file '%s' to '%s'\n", e->name, buf);
-      goto err_out;
-    }
+  snprintf(buf, LINE_BUF_LEN, "%s" PARTIAL_SUFFIX, e->name);
 
-    if(delete_hook)
-      delete_hook(buf);
+  // Anything that isn't shorter than the whole file is useless
+  if(stat(buf, &s) || (unsigned long)s.st_size >= e->size)
+    return 0;
 
-    f = fopen_unsafe(e->name, "w+b");
-    if(!f)
-    {
-      warn("Unable to open file '%s' for writing\n", e->name);
-      goto err_out;
-    }
-  }
+  return (long)s.st_size;
+}
+
+bool manifest_entry_request(struct host *h, const char *basedir,
+ struct manifest_entry *e)
+{
+  char buf[LINE_BUF_LEN];
+  enum host_status ret;
 
   snprintf(buf, LINE_BUF_LEN, "%s/%08x%08x%08x%08x%08x%08x%08x%08x", basedir,
     e->sha256[0], e->sha256[1], e->sha256[2], e->sha256[3],
     e->sha256[4], e->sha256[5], e->sha256[6], e->sha256[7]);
 
-  ret = host_recv_file(h, buf, f, "application/octet-stream");
+  ret = host_send_request(h, buf, manifest_entry_partial_size(e));
+  if(ret != HOST_SUCCESS)
+  {
+    warn("File '%s' could not be requested (error %d)\n", e->name, ret);
+    return false;
+  }
+
+  return true;
+}
+
+bool manifest_entry_receive_replace(struct host *h, struct manifest_entry *e,
+ void (*delete_hook)(const char *file))
+{
+  char part[LINE_BUF_LEN];
+  char buf[LINE_BUF_LEN];
+  enum host_status ret;
+  long offset;
+  FILE *f;
+
+  snprintf(part, LINE_BUF_LEN, "%s" PARTIAL_SUFFIX, e->name);
+
+  /* This has to agree with what manifest_entry_request asked for, which it
+   * will unless something else touched the partial file in between.
+   */
+  offset = manifest_entry_partial_size(e);
+
+  f = fopen_unsafe(part, offset ? "r+b" : "w+b");
+  if(!f)
+  {
+    warn("Unable to open file '%s' for writing\n", part);
+    return false;
+  }
+
+  // A failed download is kept so it can be resumed
+  ret = host_recv_response(h, f, "application/octet-stream", offset);
   if(ret != HOST_SUCCESS)
   {
     warn("File '%s' could not be downloaded (error %d)\n", e->name, ret);
-    goto err_close;
+    fclose(f);
+    return false;
   }
 
   rewind(f);
   if(!manifest_entry_check_validity(e, f))
   {
     warn("File '%s' failed validation\n", e->name);
-    goto err_close;
+    fclose(f);
+    unlink(part);
+    return false;
   }
 
-  valid = true;
-err_close:
   fclose(f);
-err_out:
-  return valid;
+
+  /* Move the original file out of the way. If it can't be deleted, it might
+   * be write protected or in-use; in this case, it may still be possible to
+   * rename it.
+   */
+  if(unlink(e->name) && errno != ENOENT)
+  {
+    snprintf(buf, LINE_BUF_LEN, "%s~", e->name);
+    if(rename(e->name, buf))
+    {
+      warn("Failed to rename in-use file '%s' to '%s'\n", e->name, buf);
+      return false;
+    }
+
+    if(delete_hook)
+      delete_hook(buf);
+  }
+
+  if(rename(part, e->name))
+  {
+    warn("Failed to rename '%s' to '%s'\n", part, e->name);
+    return false;
+  }
+
+  return true;
 }
 
+bool manifest_entry_download_replace(struct host *h, const char *basedir,
+ struct manifest_entry *e, void (*delete_hook)(const char *file))
+{
+  if(!manifest_entry_request(h, basedir, e))
+    return false;
+
+  return manifest_entry_receive_replace(h, e, delete_hook);
+}
@@ -19,7 +19,6 @@
 
 #include "sha256.h"
 
-#include "../platform_endian.h"
 #include "../util.h"
 
 #include <string.h>
@@ -60,89 +59,184 @@ static const Uint32 H_initial[] = {
   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
 };
 
-#if PLATFORM_BYTE_ORDER == PLATFORM_LIL_ENDIAN
+static inline Uint32 load_bigendian(const Uint8 *data)
+{
+  return ((Uint32)data[0] << 24) | ((Uint32)data[1] << 16) |
+   ((Uint32)data[2] << 8) | (Uint32)data[3];
+}
 
-static void convert_to_bigendian(void *data, int len)
+static inline void store_bigendian(Uint8 *data, Uint32 value)
 {
-  Uint32 *data_as_words = data;
-  Uint8 *data_as_bytes;
-  Uint32 temp;
-  Uint8 *temp_as_bytes = (Uint8 *)&temp;
-  int i;
+  data[0] = value >> 24;
+  data[1] = value >> 16;
+  data[2] = value >> 8;
+  data[3] = value;
+}
 
-  for(i = 0; i < len / 4; i++)
-  {
-    temp = data_as_words[i];
-    data_as_bytes = (Uint8 *)&data_as_words[i];
+// Hash the given number of 64 byte blocks into the state
+
+static void SHA256_transform(Uint32 state[8], const Uint8 *data,
+ Uint32 blocks)
+{
+  Uint32 A, B, C, D, E, F, G, H;
+  Uint32 T1, T2;
+  Uint32 W[64];
+  int t;
 
-    data_as_bytes[0] = temp_as_bytes[3];
-    data_as_bytes[1] = temp_as_bytes[2];
-    data_as_bytes[2] = temp_as_bytes[1];
-    data_as_bytes[3] = temp_as_bytes[0];
+  while(blocks--)
+  {
+    A = state[0];
+    B = state[1];
+    C = state[2];
+    D = state[3];
+    E = state[4];
+    F = state[5];
+    G = state[6];
+    H = state[7];
+
+    for(t = 0; t < 16; t++)
+      W[t] = load_bigendian(data + t * 4);
+
+    for(t = 16; t < 64; t++)
+      W[t] = sig1(W[t - 2]) + W[t - 7] + sig0(W[t - 15]) + W[t - 16];
+
+    for(t = 0; t < 64; t++)
+    {
+      T1 = H + SIG1(E) + Ch(E,F,G) + K[t] + W[t];
+      T2 = SIG0(A) + Maj(A,B,C);
+      H = G;
+      G = F;
+      F = E;
+      E = D + T1;
+      D = C;
+      C = B;
+      B = A;
+      A = T1 + T2;
+    }
+
+    state[0] += A;
+    state[1] += B;
+    state[2] += C;
+    state[3] += D;
+    state[4] += E;
+    state[5] += F;
+    state[6] += G;
+    state[7] += H;
+
+    data += 64;
   }
 }
 
-#else
+/* Most x86 CPUs since 2017 have instructions for SHA-256, which do two
+ * rounds at a time and most of the message schedule. Whether this one has
+ * them is checked at runtime, so builds for older CPUs still work.
+ */
 
-static inline void convert_to_bigendian(void *data, int len) { }
+#if (defined(__x86_64__) || defined(__i386__)) && \
+ (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ >= 5)))
 
-#endif
+#include <cpuid.h>
+#include <immintrin.h>
 
-static void SHA256_transform(struct SHA256_ctx *ctx)
- {
-  Uint32 A = ctx->H[0];
-  Uint32 B = ctx->H[1];
-  Uint32 C = ctx->H[2];
-  Uint32 D = ctx->H[3];
-  Uint32 E = ctx->H[4];
-  Uint32 F = ctx->H[5];
-  Uint32 G = ctx->H[6];
-  Uint32 H = ctx->H[7];
-  Uint32 T1, T2;
-  Uint32 W[64];
-  int t;
+#define SHA256_X86
 
-  memcpy(W, ctx->M, 64);
+__attribute__((target("sha,sse4.1")))
+static void SHA256_transform_x86(Uint32 state[8], const Uint8 *data,
+ Uint32 blocks)
+{
+  const __m128i swap_mask =
+   _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i state0, state1, abef, cdgh, msg, tmp;
+  __m128i W[4];
+  int i;
 
-  for(t = 16; t < 64; t++)
-    W[t] = sig1(W[t - 2]) + W[t - 7] + sig0(W[t - 15]) + W[t - 16];
+  // The instructions want the state as ABEF and CDGH
+  tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0xB1);
+  state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(state + 4)),
+   0x1B);
+  state0 = _mm_alignr_epi8(tmp, state1, 8);
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);
 
-  for(t = 0; t < 64; t++)
+  while(blocks--)
   {
-    T1 = H + SIG1(E) + Ch(E,F,G) + K[t] + W[t];
-    T2 = SIG0(A) + Maj(A,B,C);
-    H = G;
-    G = F;
-    F = E;
-    E = D + T1;
-    D = C;
-    C = B;
-    B = A;
-    A = T1 + T2;
+    abef = state0;
+    cdgh = state1;
+
+    // Four rounds at a time; W holds the last 16 words of the schedule
+    for(i = 0; i < 16; i++)
+    {
+      if(i < 4)
+      {
+        W[i] = _mm_shuffle_epi8(
+         _mm_loadu_si128((const __m128i *)(data + i * 16)), swap_mask);
+      }
+      else
+      {
+        tmp = _mm_sha256msg1_epu32(W[i & 3], W[(i + 1) & 3]);
+        tmp = _mm_add_epi32(tmp,
+         _mm_alignr_epi8(W[(i + 3) & 3], W[(i + 2) & 3], 4));
+        W[i & 3] = _mm_sha256msg2_epu32(tmp, W[(i + 3) & 3]);
+      }
+
+      msg = _mm_add_epi32(W[i & 3],
+       _mm_loadu_si128((const __m128i *)(K + i * 4)));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+      msg = _mm_shuffle_epi32(msg, 0x0E);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+    }
+
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+    data += 64;
   }
 
-  ctx->H[0] += A;
-  ctx->H[1] += B;
-  ctx->H[2] += C;
-  ctx->H[3] += D;
-  ctx->H[4] += E;
-  ctx->H[5] += F;
-  ctx->H[6] += G;
-  ctx->H[7] += H;
+  tmp = _mm_shuffle_epi32(state0, 0x1B);
+  state1 = _mm_shuffle_epi32(state1, 0xB1);
+  state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+  state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+  _mm_storeu_si128((__m128i *)state, state0);
+  _mm_storeu_si128((__m128i *)(state + 4), state1);
+}
+
+static bool cpu_has_sha(void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  if(__get_cpuid_max(0, NULL) < 7)
+    return false;
+
+  // SSSE3 and SSE4.1
+  __cpuid(1, eax, ebx, ecx, edx);
+  if(!(ecx & (1 << 9)) || !(ecx & (1 << 19)))
+    return false;
+
+  // SHA
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return (ebx & (1 << 29)) != 0;
 }
 
+#endif // SHA256_X86
+
 void SHA256_init(struct SHA256_ctx *ctx)
 {
   memcpy(ctx->H, H_initial, 8 * sizeof(Uint32));
   ctx->lbits = 0;
   ctx->hbits = 0;
   ctx->mlen = 0;
+  ctx->transform = SHA256_transform;
+
+#ifdef SHA256_X86
+  if(cpu_has_sha())
+    ctx->transform = SHA256_transform_x86;
+#endif
 }
 
 void SHA256_update(struct SHA256_ctx *ctx, const void *vdata, Uint32 data_len)
 {
   const Uint8 *data = vdata;
   Uint32 low_bits;
+  Uint32 blocks;
   Uint32 use;
 
   /* convert data_len to bits and add to the 64 bit word
@@ -156,45 +250,52 @@ void SHA256_update(struct SHA256_ctx *ctx, const void *vdata, Uint32 data_len)
   if(ctx->lbits < low_bits)
     ctx->hbits++;
 
-  /* deal with first block */
+  /* finish off a block left over from before */
 
-  use = MIN((Uint32)(64 - ctx->mlen), data_len);
-  memcpy(ctx->M + ctx->mlen, data, use );
-  ctx->mlen += use;
-  data_len -= use;
-  data += use;
-
-  while(ctx->mlen == 64)
+  if(ctx->mlen)
   {
-    convert_to_bigendian(ctx->M, 64);
-    SHA256_transform(ctx);
-    use = MIN(64, data_len);
-    memcpy(ctx->M, data, use);
-    ctx->mlen = use;
+    use = MIN((Uint32)(64 - ctx->mlen), data_len);
+    memcpy(ctx->M + ctx->mlen, data, use);
+    ctx->mlen += use;
     data_len -= use;
-    data += use; /* was missing */
+    data += use;
+
+    if(ctx->mlen < 64)
+      return;
+
+    ctx->transform(ctx->H, ctx->M, 1);
+    ctx->mlen = 0;
+  }
+
+  /* whole blocks are hashed straight from the data */
+
+  blocks = data_len / 64;
+  if(blocks)
+  {
+    ctx->transform(ctx->H, data, blocks);
+    data_len -= blocks * 64;
+    data += blocks * 64;
   }
+
+  memcpy(ctx->M, data, data_len);
+  ctx->mlen = data_len;
 }
 
 void SHA256_final(struct SHA256_ctx *ctx)
 {
-  if(ctx->mlen < 56)
-  {
-    ctx->M[ctx->mlen++] = 0x80;
-    memset(ctx->M + ctx->mlen, 0x00, 56 - ctx->mlen);
-    convert_to_bigendian(ctx->M, 56);
-  }
-  else
+  ctx->M[ctx->mlen++] = 0x80;
+
+  if(ctx->mlen > 56)
   {
-    ctx->M[ctx->mlen++] = 0x80;
     memset(ctx->M + ctx->mlen, 0x00, 64 - ctx->mlen);
-    convert_to_bigendian(ctx->M, 64);
-    SHA256_transform(ctx);
-    memset(ctx->M, 0x00, 56);
+    ctx->transform(ctx->H, ctx->M, 1);
+    ctx->mlen = 0;
   }
 
-  memcpy(ctx->M + 56, &ctx->hbits, 8);
-  SHA256_transform(ctx);
+  memset(ctx->M + ctx->mlen, 0x00, 56 - ctx->mlen);
+  store_bigendian(ctx->M + 56, ctx->hbits);
+  store_bigendian(ctx->M + 60, ctx->lbits);
+  ctx->transform(ctx->H, ctx->M, 1);
 }
 
 #ifdef SHA256TEST
@@ -33,6 +33,7 @@ struct SHA256_ctx
   Uint32 lbits;
   Uint8 M[64];
   Uint8 mlen;
+  void (*transform)(Uint32 state[8], const Uint8 *data, Uint32 blocks);
 };
 
 void SHA256_init(struct SHA256_ctx *ctx);
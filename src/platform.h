@@ -69,6 +69,8 @@ int real_main(int argc, char *argv[]);
 
 CORE_LIBSPEC void delay(Uint32 ms);
 CORE_LIBSPEC Uint32 get_ticks(void);
+// Microseconds from a clock that never goes backwards, for timing
+CORE_LIBSPEC Uint64 get_ticks_us(void);
 CORE_LIBSPEC bool platform_init(void);
 CORE_LIBSPEC void platform_quit(void);
 
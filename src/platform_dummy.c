@@ -19,7 +19,8 @@
 
 // Below is a very simple example of the stubs you must implement to port
 // to another non-SDL platform. Please note that this file exists to have
-// non-SDL builds compile, but is in no way functional.
+// non-SDL builds compile; it has no input, so it's only good for running
+// worlds headless (video_output = headless) with benchmark_cycles set.
 
 #include "platform.h"
 #include "event.h"
@@ -52,6 +53,19 @@ Uint32 get_ticks(void)
   return (Uint32)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
 }
 
+Uint64 get_ticks_us(void)
+{
+  struct timespec ts;
+
+  if(clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+  {
+    perror("clock_gettime");
+    return 0;
+  }
+
+  return (Uint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 bool platform_init(void)
 {
   // stub
@@ -86,9 +100,10 @@ void __wait_event(void)
 
 #ifdef CONFIG_AUDIO
 
-void init_audio_platform(struct config_info *conf)
+bool init_audio_platform(struct config_info *conf)
 {
   // stub
+  return false;
 }
 
 void quit_audio_platform(void)
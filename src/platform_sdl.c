@@ -30,6 +30,12 @@
 
 #include "SDL.h"
 
+#ifdef __WIN32__
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 #ifdef CONFIG_PSP
 #include <pspsdk.h>
 #include <psppower.h>
@@ -50,6 +56,28 @@ Uint32 get_ticks(void)
   return SDL_GetTicks();
 }
 
+Uint64 get_ticks_us(void)
+{
+#if defined(__WIN32__)
+  static LARGE_INTEGER frequency;
+  LARGE_INTEGER count;
+
+  if(!frequency.QuadPart)
+    QueryPerformanceFrequency(&frequency);
+
+  QueryPerformanceCounter(&count);
+  return (Uint64)count.QuadPart * 1000000 / frequency.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (Uint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+  // SDL 1.2 has nothing finer than milliseconds
+  return (Uint64)SDL_GetTicks() * 1000;
+#endif
+}
+
 bool platform_init(void)
 {
   Uint32 flags = SDL_INIT_VIDEO | SDL_INIT_JOYSTICK;
@@ -0,0 +1,282 @@
+/* MegaZeux
+ *
+ * Copyright (C) 2026 MegaZeux contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+#include "legacy_rasm.h"
+#include "util.h"
+
+#define MIN_PROFILE_HASH 256
+
+bool robot_profiling;
+
+// Entries are looked up by board, robot, position and command through an
+// open addressed table of indices into the entry list (0 is empty).
+static struct robot_profile_entry *entries;
+static int num_entries;
+static int num_entries_allocated;
+static int *entry_hash;
+static int entry_hash_size;
+
+// The command being timed, if any
+static int current_entry = -1;
+static Uint64 current_start;
+
+static unsigned int hash_entry(int board_id, int robot_id, int offset,
+ int cmd)
+{
+  unsigned int hash = (unsigned int)board_id * 0x9E3779B1;
+  hash = (hash ^ (unsigned int)robot_id) * 0x85EBCA77;
+  hash = (hash ^ (unsigned int)offset) * 0xC2B2AE3D;
+  hash = (hash ^ (unsigned int)cmd) * 0x27D4EB2F;
+  return hash ^ (hash >> 15);
+}
+
+static void rehash_entries(int new_size)
+{
+  struct robot_profile_entry *entry;
+  unsigned int pos;
+  int i;
+
+  free(entry_hash);
+  entry_hash = ccalloc(new_size, sizeof(int));
+  entry_hash_size = new_size;
+
+  for(i = 0; i < num_entries; i++)
+  {
+    entry = entries + i;
+    pos = hash_entry(entry->board_id, entry->robot_id, entry->offset,
+     entry->cmd) & (new_size - 1);
+
+    while(entry_hash[pos])
+      pos = (pos + 1) & (new_size - 1);
+
+    entry_hash[pos] = i + 1;
+  }
+}
+
+// Commands are numbered from 1 in the order they appear in the program
+static int find_line(const char *program, int offset)
+{
+  int pos = 1;
+  int line = 1;
+
+  while((pos < offset) && program[pos])
+  {
+    pos += (unsigned char)program[pos] + 2;
+    line++;
+  }
+
+  return line;
+}
+
+static int find_entry(int board_id, int robot_id, struct robot *cur_robot,
+ int offset, int cmd)
+{
+  struct robot_profile_entry *entry;
+  unsigned int pos;
+  int index;
+
+  if(num_entries * 2 >= entry_hash_size)
+    rehash_entries(MAX(entry_hash_size * 2, MIN_PROFILE_HASH));
+
+  pos = hash_entry(board_id, robot_id, offset, cmd) & (entry_hash_size - 1);
+
+  while(entry_hash[pos])
+  {
+    index = entry_hash[pos] - 1;
+    entry = entries + index;
+
+    // A new robot can take the place of an old one, so check the name too
+    if((entry->board_id == board_id) && (entry->robot_id == robot_id) &&
+     (entry->offset == offset) && (entry->cmd == cmd) &&
+     !strcmp(entry->robot_name, cur_robot->robot_name))
+      return index;
+
+    pos = (pos + 1) & (entry_hash_size - 1);
+  }
+
+  if(num_entries == num_entries_allocated)
+  {
+    num_entries_allocated = MAX(num_entries_allocated * 2, 64);
+    entries = crealloc(entries,
+     num_entries_allocated * sizeof(struct robot_profile_entry));
+  }
+
+  index = num_entries;
+  entry = entries + index;
+  num_entries++;
+
+  entry->board_id = board_id;
+  entry->robot_id = robot_id;
+  memcpy(entry->robot_name, cur_robot->robot_name, 15);
+  entry->robot_name[14] = 0;
+  entry->offset = offset;
+  entry->line = find_line(cur_robot->program_bytecode, offset);
+  entry->cmd = cmd;
+  entry->count = 0;
+  entry->time = 0;
+
+  entry_hash[pos] = index + 1;
+  return index;
+}
+
+void __profile_robot_command(struct world *mzx_world, int id,
+ struct robot *cur_robot, int offset, int cmd)
+{
+  Uint64 now = get_ticks_us();
+
+  if(current_entry >= 0)
+    entries[current_entry].time += now - current_start;
+
+  current_entry = find_entry(mzx_world->current_board_id, id, cur_robot,
+   offset, cmd);
+
+  entries[current_entry].count++;
+  current_start = now;
+}
+
+void __profile_robot_end(void)
+{
+  if(current_entry >= 0)
+  {
+    entries[current_entry].time += get_ticks_us() - current_start;
+    current_entry = -1;
+  }
+}
+
+// Starting again throws away what was collected before
+
+void profile_robots_start(void)
+{
+  free(entries);
+  free(entry_hash);
+  entries = NULL;
+  entry_hash = NULL;
+  num_entries = 0;
+  num_entries_allocated = 0;
+  entry_hash_size = 0;
+  current_entry = -1;
+
+  robot_profiling = true;
+}
+
+void profile_robots_stop(void)
+{
+  __profile_robot_end();
+  robot_profiling = false;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+  const struct robot_profile_entry *entry_a = a;
+  const struct robot_profile_entry *entry_b = b;
+
+  if(entry_a->time != entry_b->time)
+    return (entry_a->time < entry_b->time) ? 1 : -1;
+
+  if(entry_a->count != entry_b->count)
+    return (entry_a->count < entry_b->count) ? 1 : -1;
+
+  return 0;
+}
+
+// Copy the max commands that took the longest into dest, slowest first.
+// Returns how many were copied.
+
+int profile_robots_top(struct robot_profile_entry *dest, int max,
+ Uint64 *total_time)
+{
+  Uint64 total = 0;
+  int count = 0;
+  int i, j;
+
+  for(i = 0; i < num_entries; i++)
+  {
+    total += entries[i].time;
+
+    // Insert it among the slowest so far, if it belongs there
+    for(j = count; j > 0; j--)
+    {
+      if(compare_entries(entries + i, dest + j - 1) >= 0)
+        break;
+
+      if(j < max)
+        dest[j] = dest[j - 1];
+    }
+
+    if(j < max)
+    {
+      dest[j] = entries[i];
+      if(count < max)
+        count++;
+    }
+  }
+
+  if(total_time)
+    *total_time = total;
+
+  return count;
+}
+
+bool profile_robots_export(const char *file_name)
+{
+  struct robot_profile_entry *sorted;
+  struct robot_profile_entry *entry;
+  FILE *fp = fopen_unsafe(file_name, "wb");
+  int i, j;
+
+  if(!fp)
+  {
+    warn("Failed to open '%s' for the robot profile\n", file_name);
+    return false;
+  }
+
+  sorted = cmalloc(MAX(num_entries, 1) * sizeof(struct robot_profile_entry));
+  memcpy(sorted, entries, num_entries * sizeof(struct robot_profile_entry));
+  qsort(sorted, num_entries, sizeof(struct robot_profile_entry),
+   compare_entries);
+
+  fprintf(fp, "board,robot_id,robot,line,command,count,time_ms\n");
+
+  for(i = 0; i < num_entries; i++)
+  {
+    entry = sorted + i;
+    fprintf(fp, "%d,%d,\"", entry->board_id, entry->robot_id);
+
+    // Quotes in names are doubled, as CSV has it
+    for(j = 0; entry->robot_name[j]; j++)
+    {
+      if(entry->robot_name[j] == '"')
+        fputc('"', fp);
+      fputc(entry->robot_name[j], fp);
+    }
+
+    fprintf(fp, "\",%d,%s,%u,%u.%03u\n", entry->line,
+     get_command_name(entry->cmd), entry->count,
+     (Uint32)(entry->time / 1000), (Uint32)(entry->time % 1000));
+  }
+
+  free(sorted);
+  fclose(fp);
+  return true;
+}
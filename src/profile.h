@@ -0,0 +1,77 @@
+/* MegaZeux
+ *
+ * Copyright (C) 2026 MegaZeux contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// The robot profiler counts how often each command of each robot runs and
+// how long it takes, so slow worlds can be traced back to the robots (and
+// the lines) responsible. A command's time runs until the next command
+// starts or the robot's turn ends.
+
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include "compat.h"
+
+__M_BEGIN_DECLS
+
+#include "platform.h"
+#include "robot_struct.h"
+#include "world_struct.h"
+
+struct robot_profile_entry
+{
+  int board_id;
+  int robot_id;
+  char robot_name[15];
+  // Position of the command in the program and its line number, from 1
+  int offset;
+  int line;
+  int cmd;
+
+  Uint32 count;
+  Uint64 time;
+};
+
+CORE_LIBSPEC extern bool robot_profiling;
+
+CORE_LIBSPEC void profile_robots_start(void);
+CORE_LIBSPEC void profile_robots_stop(void);
+CORE_LIBSPEC int profile_robots_top(struct robot_profile_entry *dest, int max,
+ Uint64 *total_time);
+CORE_LIBSPEC bool profile_robots_export(const char *file_name);
+
+void __profile_robot_command(struct world *mzx_world, int id,
+ struct robot *cur_robot, int offset, int cmd);
+void __profile_robot_end(void);
+
+static inline void profile_robot_command(struct world *mzx_world, int id,
+ struct robot *cur_robot, int offset, int cmd)
+{
+  if(robot_profiling)
+    __profile_robot_command(mzx_world, id, cur_robot, offset, cmd);
+}
+
+static inline void profile_robot_end(void)
+{
+  if(robot_profiling)
+    __profile_robot_end();
+}
+
+__M_END_DECLS
+
+#endif // __PROFILE_H
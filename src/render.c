@@ -20,10 +20,12 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "platform.h"
 #include "graphics.h"
 #include "render.h"
+#include "util.h"
 
 static void set_colors8_mzx (struct graphics_data *graphics,
  Uint32 *char_colors, Uint8 bg, Uint8 fg)
@@ -283,6 +285,241 @@ void (*const set_colors32[4])
   set_colors32_smzx3
 };
 
+// Expand the 14 rows of a char to 32bpp pixels. In MZX mode each bit picks
+// char_colors[0] or [1]; in SMZX modes each pair of bits picks one of
+// char_colors[0-3] for two pixels. SSE2 and NEON are part of the base
+// x86-64 and ARMv8 instruction sets, so they're chosen at compile time.
+// A row is exactly one AVX2 vector, but AVX2 isn't in the base set, so
+// those versions are only used if render_start finds the CPU has it.
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+ (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+
+#include <emmintrin.h>
+
+#ifdef X86_TARGETS
+
+#include <immintrin.h>
+
+#define RENDER_AVX2
+
+static bool render_use_avx2;
+
+// Each pixel's color is picked from colors with the bits of the row that
+// are shifted down to the bottom by shift and kept by mask
+#define RENDER_ROW_AVX2(colors, shift, mask)                              \
+  _mm256_permutevar8x32_epi32(colors, _mm256_and_si256(                 \
+   _mm256_srlv_epi32(_mm256_set1_epi32(*char_ptr), shift), mask))
+
+__attribute__((target("avx2")))
+static void render_char32_avx2(Uint32 *dest, Uint8 *char_ptr,
+ Uint32 line_advance, Uint32 *char_colors)
+{
+  const __m256i shift = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+  const __m256i mask = _mm256_set1_epi32(0x01);
+  __m256i colors = _mm256_setr_epi32(char_colors[0], char_colors[1],
+   0, 0, 0, 0, 0, 0);
+  int i;
+
+  for(i = 0; i < 14; i++, char_ptr++, dest += line_advance)
+    _mm256_storeu_si256((__m256i *)dest, RENDER_ROW_AVX2(colors, shift, mask));
+}
+
+__attribute__((target("avx2")))
+static void render_char32s_avx2(Uint32 *dest, Uint8 *char_ptr,
+ Uint32 line_advance, Uint32 *char_colors)
+{
+  const __m256i shift = _mm256_setr_epi32(6, 6, 4, 4, 2, 2, 0, 0);
+  const __m256i mask = _mm256_set1_epi32(0x03);
+  __m256i colors = _mm256_setr_epi32(char_colors[0], char_colors[1],
+   char_colors[2], char_colors[3], 0, 0, 0, 0);
+  int i;
+
+  for(i = 0; i < 14; i++, char_ptr++, dest += line_advance)
+    _mm256_storeu_si256((__m256i *)dest, RENDER_ROW_AVX2(colors, shift, mask));
+}
+
+#endif // X86_TARGETS
+
+// Lanes are set to all ones where the bit for them is set in row
+#define bit_mask_sse2(row, bits) \
+ _mm_cmpeq_epi32(_mm_and_si128(row, bits), bits)
+
+// Lanes are a where mask is clear and a ^ a_xor_b (b) where it's set
+#define select_sse2(a, a_xor_b, mask) \
+ _mm_xor_si128(a, _mm_and_si128(a_xor_b, mask))
+
+static inline void render_char32(Uint32 *dest, Uint8 *char_ptr,
+ Uint32 line_advance, Uint32 *char_colors)
+{
+  const __m128i hi_bits = _mm_set_epi32(0x10, 0x20, 0x40, 0x80);
+  const __m128i lo_bits = _mm_set_epi32(0x01, 0x02, 0x04, 0x08);
+  __m128i bg = _mm_set1_epi32(char_colors[0]);
+  __m128i bg_fg = _mm_xor_si128(bg, _mm_set1_epi32(char_colors[1]));
+  __m128i row;
+  int i;
+
+#ifdef RENDER_AVX2
+  if(render_use_avx2)
+  {
+    render_char32_avx2(dest, char_ptr, line_advance, char_colors);
+    return;
+  }
+#endif
+
+  for(i = 0; i < 14; i++, char_ptr++, dest += line_advance)
+  {
+    row = _mm_set1_epi32(*char_ptr);
+    _mm_storeu_si128((__m128i *)dest,
+     select_sse2(bg, bg_fg, bit_mask_sse2(row, hi_bits)));
+    _mm_storeu_si128((__m128i *)(dest + 4),
+     select_sse2(bg, bg_fg, bit_mask_sse2(row, lo_bits)));
+  }
+}
+
+static inline void render_char32s(Uint32 *dest, Uint8 *char_ptr,
+ Uint32 line_advance, Uint32 *char_colors)
+{
+  // The high and low bits of each pixel's pair
+  const __m128i hi_high = _mm_set_epi32(0x20, 0x20, 0x80, 0x80);
+  const __m128i hi_low = _mm_set_epi32(0x10, 0x10, 0x40, 0x40);
+  const __m128i lo_high = _mm_set_epi32(0x02, 0x02, 0x08, 0x08);
+  const __m128i lo_low = _mm_set_epi32(0x01, 0x01, 0x04, 0x04);
+  __m128i c0 = _mm_set1_epi32(char_colors[0]);
+  __m128i c1 = _mm_set1_epi32(char_colors[1]);
+  __m128i c0_c2 = _mm_xor_si128(c0, _mm_set1_epi32(char_colors[2]));
+  __m128i c1_c3 = _mm_xor_si128(c1, _mm_set1_epi32(char_colors[3]));
+  __m128i row, high, a, b;
+  int i;
+
+#ifdef RENDER_AVX2
+  if(render_use_avx2)
+  {
+    render_char32s_avx2(dest, char_ptr, line_advance, char_colors);
+    return;
+  }
+#endif
+
+  for(i = 0; i < 14; i++, char_ptr++, dest += line_advance)
+  {
+    row = _mm_set1_epi32(*char_ptr);
+
+    high = bit_mask_sse2(row, hi_high);
+    a = select_sse2(c0, c0_c2, high);
+    b = select_sse2(c1, c1_c3, high);
+    _mm_storeu_si128((__m128i *)dest,
+     select_sse2(a, _mm_xor_si128(a, b), bit_mask_sse2(row, hi_low)));
+
+    high = bit_mask_sse2(row, lo_high);
+    a = select_sse2(c0, c0_c2, high);
+    b = select_sse2(c1, c1_c3, high);
+    _mm_storeu_si128((__m128i *)(dest + 4),
+     select_sse2(a, _mm_xor_si128(a, b), bit_mask_sse2(row, lo_low)));
+  }
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+static inline void render_char32(Uint32 *dest, Uint8 *char_ptr,
+ Uint32 line_advance, Uint32 *char_colors)
+{
+  static const Uint32 hi_bits_init[4] = { 0x80, 0x40, 0x20, 0x10 };
+  static const Uint32 lo_bits_init[4] = { 0x08, 0x04, 0x02, 0x01 };
+  uint32x4_t hi_bits = vld1q_u32(hi_bits_init);
+  uint32x4_t lo_bits = vld1q_u32(lo_bits_init);
+  uint32x4_t bg = vdupq_n_u32(char_colors[0]);
+  uint32x4_t fg = vdupq_n_u32(char_colors[1]);
+  uint32x4_t row;
+  int i;
+
+  for(i = 0; i < 14; i++, char_ptr++, dest += line_advance)
+  {
+    row = vdupq_n_u32(*char_ptr);
+    vst1q_u32(dest, vbslq_u32(vtstq_u32(row, hi_bits), fg, bg));
+    vst1q_u32(dest + 4, vbslq_u32(vtstq_u32(row, lo_bits), fg, bg));
+  }
+}
+
+static inline void render_char32s(Uint32 *dest, Uint8 *char_ptr,
+ Uint32 line_advance, Uint32 *char_colors)
+{
+  // The high and low bits of each pixel's pair
+  static const Uint32 hi_high_init[4] = { 0x80, 0x80, 0x20, 0x20 };
+  static const Uint32 hi_low_init[4] = { 0x40, 0x40, 0x10, 0x10 };
+  static const Uint32 lo_high_init[4] = { 0x08, 0x08, 0x02, 0x02 };
+  static const Uint32 lo_low_init[4] = { 0x04, 0x04, 0x01, 0x01 };
+  uint32x4_t hi_high = vld1q_u32(hi_high_init);
+  uint32x4_t hi_low = vld1q_u32(hi_low_init);
+  uint32x4_t lo_high = vld1q_u32(lo_high_init);
+  uint32x4_t lo_low = vld1q_u32(lo_low_init);
+  uint32x4_t c0 = vdupq_n_u32(char_colors[0]);
+  uint32x4_t c1 = vdupq_n_u32(char_colors[1]);
+  uint32x4_t c2 = vdupq_n_u32(char_colors[2]);
+  uint32x4_t c3 = vdupq_n_u32(char_colors[3]);
+  uint32x4_t row, high;
+  int i;
+
+  for(i = 0; i < 14; i++, char_ptr++, dest += line_advance)
+  {
+    row = vdupq_n_u32(*char_ptr);
+
+    high = vtstq_u32(row, hi_high);
+    vst1q_u32(dest, vbslq_u32(vtstq_u32(row, hi_low),
+     vbslq_u32(high, c3, c1), vbslq_u32(high, c2, c0)));
+
+    high = vtstq_u32(row, lo_high);
+    vst1q_u32(dest + 4, vbslq_u32(vtstq_u32(row, lo_low),
+     vbslq_u32(high, c3, c1), vbslq_u32(high, c2, c0)));
+  }
+}
+
+#else
+
+static inline void render_char32(Uint32 *dest, Uint8 *char_ptr,
+ Uint32 line_advance, Uint32 *char_colors)
+{
+  Uint32 current_char_byte;
+  Uint32 i;
+  Sint32 i2;
+
+  for(i = 0; i < 14; i++)
+  {
+    current_char_byte = *char_ptr;
+    char_ptr++;
+    for(i2 = 7; i2 >= 0; i2--, dest++)
+    {
+      *dest = char_colors[(current_char_byte >> i2) & 0x01];
+    }
+    dest += line_advance - 8;
+  }
+}
+
+static inline void render_char32s(Uint32 *dest, Uint8 *char_ptr,
+ Uint32 line_advance, Uint32 *char_colors)
+{
+  Uint32 current_char_byte;
+  Uint32 current_color;
+  Uint32 i;
+  Sint32 i2;
+
+  for(i = 0; i < 14; i++)
+  {
+    current_char_byte = *char_ptr;
+    char_ptr++;
+    for(i2 = 6; i2 >= 0; i2 -= 2, dest += 2)
+    {
+      current_color = char_colors[(current_char_byte >> i2) & 0x03];
+      *dest = current_color;
+      *(dest + 1) = current_color;
+    }
+    dest += line_advance - 8;
+  }
+}
+
+#endif
+
 #ifdef CONFIG_RENDER_YUV
 
 #include "render_yuv.h"
@@ -317,6 +554,97 @@ void (*const yuv2_set_colors[4])
 
 #endif
 
+// The software renderers only draw the cells that changed since they last
+// drew to the same pixels: cells with a different char or colors, or whose
+// char graphic changed. Everything is drawn again when the palette or the
+// screen mode changes, or when asked to with redraw_all.
+
+static bool render_start(struct graphics_data *graphics, void *pixels,
+ Uint32 pitch)
+{
+  bool all = graphics->redraw_all ||
+   (graphics->drawn_pixels != pixels) || (graphics->drawn_pitch != pitch) ||
+   (graphics->drawn_screen_mode != graphics->screen_mode) ||
+   (graphics->drawn_palette != graphics->palette_generation);
+
+#ifdef RENDER_AVX2
+  render_use_avx2 = cpu_has_avx2();
+#endif
+
+  graphics->redraw_all = false;
+  graphics->drawn_pixels = pixels;
+  graphics->drawn_pitch = pitch;
+  graphics->drawn_screen_mode = graphics->screen_mode;
+  graphics->drawn_palette = graphics->palette_generation;
+
+  graphics->drawn_x1 = SCREEN_W;
+  graphics->drawn_y1 = SCREEN_H;
+  graphics->drawn_x2 = 0;
+  graphics->drawn_y2 = 0;
+
+  return all;
+}
+
+static void render_area(struct graphics_data *graphics, Uint32 x, Uint32 y,
+ Uint32 x2, Uint32 y2)
+{
+  if(x < graphics->drawn_x1)
+    graphics->drawn_x1 = x;
+  if(y < graphics->drawn_y1)
+    graphics->drawn_y1 = y;
+  if(x2 > graphics->drawn_x2)
+    graphics->drawn_x2 = x2;
+  if(y2 > graphics->drawn_y2)
+    graphics->drawn_y2 = y2;
+}
+
+// Check if a cell needs drawing. If it does, it's remembered as drawn.
+
+static inline bool render_cell(struct graphics_data *graphics,
+ struct char_element *src, Uint32 x, Uint32 y, bool all)
+{
+  struct char_element *drawn = graphics->drawn_video + (y * SCREEN_W) + x;
+
+  if(all || (drawn->char_value != src->char_value) ||
+   (drawn->bg_color != src->bg_color) || (drawn->fg_color != src->fg_color) ||
+   (graphics->chars_dirty && (src->char_value < CHARSET_SIZE * NUM_CHARSETS) &&
+   graphics->dirty_chars[src->char_value]))
+  {
+    *drawn = *src;
+    render_area(graphics, x, y, x + 1, y + 1);
+    return true;
+  }
+
+  return false;
+}
+
+static void render_finish(struct graphics_data *graphics)
+{
+  if(graphics->chars_dirty)
+  {
+    memset(graphics->dirty_chars, 0, sizeof(graphics->dirty_chars));
+    graphics->chars_dirty = false;
+  }
+}
+
+// Something other than the renderers drew over these cells (the cursor or
+// the mouse pointer); draw them again next time.
+
+void render_invalidate(struct graphics_data *graphics, Uint32 x, Uint32 y,
+ Uint32 w, Uint32 h)
+{
+  Uint32 x2 = MIN(x + w, SCREEN_W);
+  Uint32 y2 = MIN(y + h, SCREEN_H);
+  Uint32 i, i2;
+
+  for(i = y; i < y2; i++)
+    for(i2 = x; i2 < x2; i2++)
+      graphics->drawn_video[(i * SCREEN_W) + i2].char_value = 0xFFFF;
+
+  if((x < x2) && (y < y2))
+    render_area(graphics, x, y, x2, y2);
+}
+
 // Nominally 8-bit (Character graphics 8 bytes wide)
 void render_graph8(Uint8 *pixels, Uint32 pitch, struct graphics_data *graphics,
  void (*set_colors)(struct graphics_data *, Uint32 *, Uint8, Uint8))
@@ -333,6 +661,8 @@ void render_graph8(Uint8 *pixels, Uint32 pitch, struct graphics_data *graphics,
   Uint32 line_advance = pitch / 4;
   Uint32 row_advance = line_advance * 14;
 
+  bool all = render_start(graphics, pixels, pitch);
+
   dest = (Uint32 *)pixels;
 
   for(i = 0; i < 25; i++)
@@ -341,28 +671,33 @@ void render_graph8(Uint8 *pixels, Uint32 pitch, struct graphics_data *graphics,
     for(i2 = 0; i2 < 80; i2++)
     {
       ldest = dest;
-      if((src->bg_color != old_bg) || (src->fg_color != old_fg))
+      if(render_cell(graphics, src, i2, i, all))
       {
-        set_colors(graphics, char_colors, src->bg_color, src->fg_color);
-        old_bg = src->bg_color;
-        old_fg = src->fg_color;
-      }
+        if((src->bg_color != old_bg) || (src->fg_color != old_fg))
+        {
+          set_colors(graphics, char_colors, src->bg_color, src->fg_color);
+          old_bg = src->bg_color;
+          old_fg = src->fg_color;
+        }
 
-      char_ptr = graphics->charset + (src->char_value * 14);
-      src++;
-      for(i3 = 0; i3 < 14; i3++)
-      {
-        current_char_byte = *char_ptr;
-        char_ptr++;
-        *dest = char_colors[current_char_byte >> 4];
-        *(dest + 1) = char_colors[current_char_byte & 0x0F];
-        dest += line_advance;
+        char_ptr = graphics->charset + (src->char_value * 14);
+        for(i3 = 0; i3 < 14; i3++)
+        {
+          current_char_byte = *char_ptr;
+          char_ptr++;
+          *dest = char_colors[current_char_byte >> 4];
+          *(dest + 1) = char_colors[current_char_byte & 0x0F];
+          dest += line_advance;
+        }
       }
 
+      src++;
       dest = ldest + 2;
     }
     dest = ldest2 + row_advance;
   }
+
+  render_finish(graphics);
 }
 
 // Nominally 16-bit (Character graphics 16 bytes wide)
@@ -382,6 +717,8 @@ void render_graph16(Uint16 *pixels, Uint32 pitch,
   Uint32 line_advance = pitch / 4;
   Uint32 row_advance = line_advance * 14;
 
+  bool all = render_start(graphics, pixels, pitch);
+
   dest = (Uint32 *)pixels;
 
   for(i = 0; i < 25; i++)
@@ -390,30 +727,35 @@ void render_graph16(Uint16 *pixels, Uint32 pitch,
     for(i2 = 0; i2 < 80; i2++)
     {
       ldest = dest;
-      if((src->bg_color != old_bg) || (src->fg_color != old_fg))
+      if(render_cell(graphics, src, i2, i, all))
       {
-        set_colors(graphics, char_colors, src->bg_color, src->fg_color);
-        old_bg = src->bg_color;
-        old_fg = src->fg_color;
-      }
+        if((src->bg_color != old_bg) || (src->fg_color != old_fg))
+        {
+          set_colors(graphics, char_colors, src->bg_color, src->fg_color);
+          old_bg = src->bg_color;
+          old_fg = src->fg_color;
+        }
 
-      char_ptr = graphics->charset + (src->char_value * 14);
-      src++;
-      for(i3 = 0; i3 < 14; i3++)
-      {
-        current_char_byte = *char_ptr;
-        char_ptr++;
-        *dest = char_colors[current_char_byte >> 6];
-        *(dest + 1) = char_colors[(current_char_byte >> 4) & 0x03];
-        *(dest + 2) = char_colors[(current_char_byte >> 2) & 0x03];
-        *(dest + 3) = char_colors[current_char_byte & 0x03];
-        dest += line_advance;
+        char_ptr = graphics->charset + (src->char_value * 14);
+        for(i3 = 0; i3 < 14; i3++)
+        {
+          current_char_byte = *char_ptr;
+          char_ptr++;
+          *dest = char_colors[current_char_byte >> 6];
+          *(dest + 1) = char_colors[(current_char_byte >> 4) & 0x03];
+          *(dest + 2) = char_colors[(current_char_byte >> 2) & 0x03];
+          *(dest + 3) = char_colors[current_char_byte & 0x03];
+          dest += line_advance;
+        }
       }
 
+      src++;
       dest = ldest + 4;
     }
     dest = ldest2 + row_advance;
   }
+
+  render_finish(graphics);
 }
 
 // Nominally 32-bit (Character graphics 32 bytes wide)
@@ -428,13 +770,12 @@ void render_graph32(Uint32 *pixels, Uint32 pitch,
   Uint8 old_fg = 255;
   Uint8 *char_ptr;
   Uint32 char_colors[2];
-  Uint32 current_char_byte;
-  Uint32 i, i2, i3;
-  Sint32 i4;
+  Uint32 i, i2;
   Uint32 line_advance = pitch / 4;
-  Uint32 line_advance_sub = line_advance - 8;
   Uint32 row_advance = line_advance * 14;
 
+  bool all = render_start(graphics, pixels, pitch);
+
   dest = pixels;
 
   for(i = 0; i < 25; i++)
@@ -443,30 +784,26 @@ void render_graph32(Uint32 *pixels, Uint32 pitch,
     for(i2 = 0; i2 < 80; i2++)
     {
       ldest = dest;
-      if((src->bg_color != old_bg) || (src->fg_color != old_fg))
+      if(render_cell(graphics, src, i2, i, all))
       {
-        set_colors(graphics, char_colors, src->bg_color, src->fg_color);
-        old_bg = src->bg_color;
-        old_fg = src->fg_color;
-      }
-
-      char_ptr = graphics->charset + (src->char_value * 14);
-      src++;
-      for(i3 = 0; i3 < 14; i3++)
-      {
-        current_char_byte = *char_ptr;
-        char_ptr++;
-        for(i4 = 7; i4 >= 0; i4--, dest++)
+        if((src->bg_color != old_bg) || (src->fg_color != old_fg))
         {
-          *dest = char_colors[(current_char_byte >> i4) & 0x01];
+          set_colors(graphics, char_colors, src->bg_color, src->fg_color);
+          old_bg = src->bg_color;
+          old_fg = src->fg_color;
         }
-        dest += line_advance_sub;
+
+        char_ptr = graphics->charset + (src->char_value * 14);
+        render_char32(dest, char_ptr, line_advance, char_colors);
       }
 
+      src++;
       dest = ldest + 8;
     }
     dest = ldest2 + row_advance;
   }
+
+  render_finish(graphics);
 }
 
 void render_graph32s(Uint32 *pixels, Uint32 pitch,
@@ -480,14 +817,12 @@ void render_graph32s(Uint32 *pixels, Uint32 pitch,
   Uint8 old_fg = 255;
   Uint8 *char_ptr;
   Uint32 char_colors[4];
-  Uint32 current_char_byte;
-  Uint32 current_color;
-  Uint32 i, i2, i3;
-  Sint32 i4;
+  Uint32 i, i2;
   Uint32 line_advance = pitch / 4;
-  Uint32 line_advance_sub = line_advance - 8;
   Uint32 row_advance = line_advance * 14;
 
+  bool all = render_start(graphics, pixels, pitch);
+
   dest = pixels;
 
   for(i = 0; i < 25; i++)
@@ -496,32 +831,26 @@ void render_graph32s(Uint32 *pixels, Uint32 pitch,
     for(i2 = 0; i2 < 80; i2++)
     {
       ldest = dest;
-      if((src->bg_color != old_bg) || (src->fg_color != old_fg))
+      if(render_cell(graphics, src, i2, i, all))
       {
-        set_colors(graphics, char_colors, src->bg_color, src->fg_color);
-        old_bg = src->bg_color;
-        old_fg = src->fg_color;
-      }
-
-      char_ptr = graphics->charset + (src->char_value * 14);
-      src++;
-      for(i3 = 0; i3 < 14; i3++)
-      {
-        current_char_byte = *char_ptr;
-        char_ptr++;
-        for(i4 = 6; i4 >= 0; i4 -= 2, dest += 2)
+        if((src->bg_color != old_bg) || (src->fg_color != old_fg))
         {
-          current_color = char_colors[(current_char_byte >> i4) & 0x03];
-          *dest = current_color;
-          *(dest + 1) = current_color;
+          set_colors(graphics, char_colors, src->bg_color, src->fg_color);
+          old_bg = src->bg_color;
+          old_fg = src->fg_color;
         }
-        dest += line_advance_sub;
+
+        char_ptr = graphics->charset + (src->char_value * 14);
+        render_char32s(dest, char_ptr, line_advance, char_colors);
       }
 
+      src++;
       dest = ldest + 8;
     }
     dest = ldest2 + row_advance;
   }
+
+  render_finish(graphics);
 }
 
 void render_cursor(Uint32 *pixels, Uint32 pitch, Uint8 bpp, Uint32 x, Uint32 y,
@@ -50,6 +50,9 @@ void render_graph32s(Uint32 *pixels, Uint32 pitch,
  struct graphics_data *graphics,
  void (*set_colors)(struct graphics_data *, Uint32 *, Uint8, Uint8));
 
+void render_invalidate(struct graphics_data *graphics, Uint32 x, Uint32 y,
+ Uint32 w, Uint32 h);
+
 void render_cursor(Uint32 *pixels, Uint32 pitch, Uint8 bpp, Uint32 x, Uint32 y,
  Uint32 color, Uint8 lines, Uint8 offset);
 void render_mouse(Uint32 *pixels, Uint32 pitch, Uint8 bpp, Uint32 x, Uint32 y,
@@ -0,0 +1,126 @@
+/* MegaZeux
+ *
+ * Copyright (C) 2026 MegaZeux contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// A renderer for machines without a display. The screen is drawn with the
+// software renderer's routines to a 32bpp buffer in memory that's never
+// shown, so drawing costs about what it would with a window open.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "graphics.h"
+#include "render.h"
+#include "renderers.h"
+#include "util.h"
+
+#define HEADLESS_WIDTH  640
+#define HEADLESS_HEIGHT 350
+#define HEADLESS_PITCH  (HEADLESS_WIDTH * 4)
+
+static bool headless_init_video(struct graphics_data *graphics,
+ struct config_info *conf)
+{
+  graphics->allow_resize = 0;
+  graphics->bits_per_pixel = 32;
+  graphics->fullscreen = false;
+  graphics->window_width = HEADLESS_WIDTH;
+  graphics->window_height = HEADLESS_HEIGHT;
+
+  graphics->render_data =
+   ccalloc(HEADLESS_WIDTH * HEADLESS_HEIGHT, sizeof(Uint32));
+
+  return set_video_mode();
+}
+
+static void headless_free_video(struct graphics_data *graphics)
+{
+  free(graphics->render_data);
+  graphics->render_data = NULL;
+}
+
+static bool headless_check_video_mode(struct graphics_data *graphics,
+ int width, int height, int depth, bool fullscreen, bool resize)
+{
+  return true;
+}
+
+static bool headless_set_video_mode(struct graphics_data *graphics,
+ int width, int height, int depth, bool fullscreen, bool resize)
+{
+  return true;
+}
+
+static void headless_update_colors(struct graphics_data *graphics,
+ struct rgb_color *palette, Uint32 count)
+{
+  Uint32 i;
+
+  for(i = 0; i < count; i++)
+  {
+    graphics->flat_intensity_palette[i] = 0xFF000000 |
+     (palette[i].r << 16) | (palette[i].g << 8) | palette[i].b;
+  }
+}
+
+static void headless_render_graph(struct graphics_data *graphics)
+{
+  Uint32 *pixels = graphics->render_data;
+  Uint32 mode = graphics->screen_mode;
+
+  if(!mode)
+    render_graph32(pixels, HEADLESS_PITCH, graphics, set_colors32[mode]);
+  else
+    render_graph32s(pixels, HEADLESS_PITCH, graphics, set_colors32[mode]);
+}
+
+static void headless_render_cursor(struct graphics_data *graphics,
+ Uint32 x, Uint32 y, Uint8 color, Uint8 lines, Uint8 offset)
+{
+  render_cursor(graphics->render_data, HEADLESS_PITCH, 32, x, y,
+   graphics->flat_intensity_palette[color], lines, offset);
+}
+
+static void headless_render_mouse(struct graphics_data *graphics,
+ Uint32 x, Uint32 y, Uint8 w, Uint8 h)
+{
+  render_mouse(graphics->render_data, HEADLESS_PITCH, 32, x, y,
+   0xFFFFFFFF, w, h);
+}
+
+static void headless_sync_screen(struct graphics_data *graphics)
+{
+  // Nothing to show it on
+}
+
+void render_headless_register(struct renderer *renderer)
+{
+  memset(renderer, 0, sizeof(struct renderer));
+  renderer->init_video = headless_init_video;
+  renderer->free_video = headless_free_video;
+  renderer->check_video_mode = headless_check_video_mode;
+  renderer->set_video_mode = headless_set_video_mode;
+  renderer->update_colors = headless_update_colors;
+  renderer->resize_screen = resize_screen_standard;
+  renderer->get_screen_coords = get_screen_coords_centered;
+  renderer->set_screen_coords = set_screen_coords_centered;
+  renderer->render_graph = headless_render_graph;
+  renderer->render_cursor = headless_render_cursor;
+  renderer->render_mouse = headless_render_mouse;
+  renderer->sync_screen = headless_sync_screen;
+}
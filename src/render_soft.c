@@ -176,7 +176,23 @@ static void soft_render_mouse(struct graphics_data *graphics,
 
 static void soft_sync_screen(struct graphics_data *graphics)
 {
-  SDL_Flip(graphics->render_data);
+  SDL_Surface *screen = graphics->render_data;
+  Uint32 x1 = graphics->drawn_x1;
+  Uint32 y1 = graphics->drawn_y1;
+  Uint32 x2 = graphics->drawn_x2;
+  Uint32 y2 = graphics->drawn_y2;
+
+  // Only upload the cells that were actually drawn to
+  if((x1 == 0) && (y1 == 0) && (x2 == SCREEN_W) && (y2 == SCREEN_H))
+  {
+    SDL_Flip(screen);
+  }
+  else if((x1 < x2) && (y1 < y2))
+  {
+    SDL_UpdateRect(screen,
+     ((screen->w - 640) / 2) + (x1 * 8), ((screen->h - 350) / 2) + (y1 * 14),
+     (x2 - x1) * 8, (y2 - y1) * 14);
+  }
 }
 
 void render_soft_register(struct renderer *renderer)
@@ -55,6 +55,7 @@ void render_nds_register(struct renderer *renderer);
 #if defined(CONFIG_RENDER_GX)
 void render_gx_register(struct renderer *renderer);
 #endif
+void render_headless_register(struct renderer *renderer);
 
 __M_END_DECLS
 
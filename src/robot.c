@@ -25,6 +25,7 @@
 #include <assert.h>
 
 #include "const.h"
+#include "counter.h"
 #include "game.h"
 #include "game2.h"
 #include "idarray.h"
@@ -41,25 +42,7 @@
 #include "legacy_rasm.h"
 #include "validation.h"
 
-static int cmp_labels(const void *dest, const void *src)
-{
-  struct label *lsrc = *((struct label **)src);
-  struct label *ldest = *((struct label **)dest);
-  int cmp_primary = strcasecmp(ldest->name, lsrc->name);
-
-  // A match needs to go on a secondary criteria.
-  if(!cmp_primary)
-  {
-    if(ldest->position == 0)
-      return 1;
-
-    return ldest->position - lsrc->position;
-  }
-  else
-  {
-    return cmp_primary;
-  }
-}
+#define LABEL_ZAP_BITS (sizeof(unsigned int) * 8)
 
 // TODO: If bytecode isn't valid then this is done at a bad time. It should
 // really be done when robots are assembled, rather than when they're loaded.
@@ -68,7 +51,7 @@ static int cmp_labels(const void *dest, const void *src)
 #ifdef CONFIG_DEBYTECODE
 static
 #endif
-struct label **cache_robot_labels(struct robot *robot, int *num_labels)
+void cache_robot_labels(struct robot *robot)
 {
   int labels_allocated = 16;
   int labels_found = 0;
@@ -79,6 +62,14 @@ struct label **cache_robot_labels(struct robot *robot, int *num_labels)
   char *robot_program = robot->program_bytecode;
   struct label **label_list = ccalloc(16, sizeof(struct label *));
   struct label *current_label;
+  struct label_group *label_hash;
+  struct label_group *group;
+  unsigned int *label_zapped;
+  int *label_groups;
+  int hash_size = 16;
+  int hash_mask;
+  int num_words;
+  int pos;
 
   for(i = 1; i < (robot->program_bytecode_length - 1); i++)
   {
@@ -104,11 +95,6 @@ struct label **cache_robot_labels(struct robot *robot, int *num_labels)
           current_label->position = i;
       }
 
-      if(cmd == ROBOTIC_CMD_ZAPPED_LABEL)
-        current_label->zapped = 1;
-      else
-        current_label->zapped = 0;
-
       // Do we need more room?
       if(labels_found == labels_allocated)
       {
@@ -124,24 +110,125 @@ struct label **cache_robot_labels(struct robot *robot, int *num_labels)
     i = next;
   }
 
+  robot->num_labels = labels_found;
+
   if(!labels_found)
   {
-    *num_labels = 0;
     free(label_list);
-    return NULL;
+    robot->label_list = NULL;
+    robot->label_hash = NULL;
+    robot->label_hash_size = 0;
+    robot->label_zapped = NULL;
+    return;
+  }
+
+  // Group the labels by name. The hash table is kept at most half full.
+  while(hash_size < labels_found * 2)
+    hash_size *= 2;
+
+  hash_mask = hash_size - 1;
+  label_hash = ccalloc(hash_size, sizeof(struct label_group));
+  label_groups = cmalloc(labels_found * sizeof(int));
+
+  for(i = 0; i < labels_found; i++)
+  {
+    unsigned int hash = hash_name_nocase(label_list[i]->name);
+
+    pos = hash & hash_mask;
+    group = label_hash + pos;
+
+    while(group->num_labels && ((group->hash != hash) ||
+     strcasecmp(group->labels[0]->name, label_list[i]->name)))
+    {
+      pos = (pos + 1) & hash_mask;
+      group = label_hash + pos;
+    }
+
+    // Until the groups are laid out, labels just points to the first one
+    if(!group->num_labels)
+    {
+      group->hash = hash;
+      group->labels = label_list + i;
+    }
+
+    group->num_labels++;
+    label_groups[i] = pos;
   }
 
-  if(labels_found != labels_allocated)
+  // Give each group its own run of the label list and of the zap bitmap.
+  // Labels are added to groups in program order, which is the order
+  // duplicate labels are tried in (the label at the very end of the
+  // program, with position 0, is last).
+  for(i = 0, num_words = 0; i < hash_size; i++)
+    num_words += (label_hash[i].num_labels + LABEL_ZAP_BITS - 1) /
+     LABEL_ZAP_BITS;
+
+  robot->label_list = cmalloc(labels_found * sizeof(struct label *));
+  label_zapped = ccalloc(num_words, sizeof(unsigned int));
+
+  for(i = 0, pos = 0, num_words = 0; i < hash_size; i++)
   {
-    label_list =
-     crealloc(label_list, sizeof(struct label *) * labels_found);
+    group = label_hash + i;
+
+    if(group->num_labels)
+    {
+      group->labels = robot->label_list + pos;
+      group->zapped = label_zapped + num_words;
+
+      pos += group->num_labels;
+      num_words += (group->num_labels + LABEL_ZAP_BITS - 1) / LABEL_ZAP_BITS;
+      group->num_labels = 0;
+    }
+  }
+
+  for(i = 0; i < labels_found; i++)
+  {
+    current_label = label_list[i];
+    group = label_hash + label_groups[i];
+    pos = group->num_labels;
+
+    group->labels[pos] = current_label;
+    group->num_labels++;
+
+    if(robot_program[current_label->cmd_position] == ROBOTIC_CMD_ZAPPED_LABEL)
+      group->zapped[pos / LABEL_ZAP_BITS] |= 1u << (pos % LABEL_ZAP_BITS);
   }
 
-  // Now sort the list
-  qsort(label_list, labels_found, sizeof(struct label *), cmp_labels);
+  free(label_groups);
+  free(label_list);
 
-  *num_labels = labels_found;
-  return label_list;
+  robot->label_hash = label_hash;
+  robot->label_hash_size = hash_size;
+  robot->label_zapped = label_zapped;
+}
+
+#ifdef CONFIG_DEBYTECODE
+static
+#endif
+void clear_label_cache(struct robot *cur_robot)
+{
+  int i;
+
+  if(cur_robot->label_list)
+  {
+    for(i = 0; i < cur_robot->num_labels; i++)
+    {
+      free(cur_robot->label_list[i]);
+    }
+
+    free(cur_robot->label_list);
+    free(cur_robot->label_hash);
+    free(cur_robot->label_zapped);
+  }
+
+  // Cached jump targets point into the label hash
+  clear_param_cache(cur_robot);
+
+  cur_robot->label_list = NULL;
+  cur_robot->num_labels = 0;
+  cur_robot->label_hash = NULL;
+  cur_robot->label_hash_size = 0;
+  cur_robot->label_zapped = NULL;
 }
 
 int get_robot_id(struct board *src_board, const char *name)
@@ -222,9 +309,9 @@ void create_blank_robot(struct robot *r, int savegame)
   for(int i = 0; i<32; i++)
     r->local[i] = 0;
 
-  free(r->label_list);
-  r->num_labels = 0;
-  r->label_list = NULL;
+  clear_label_cache(r);
+
+  clear_param_cache(r);
 
   free(r->stack);
   r->stack_size = 0;
@@ -233,25 +320,34 @@ void create_blank_robot(struct robot *r, int savegame)
 
 }
 
-struct robot *load_robot_allocate(FILE *fp, int savegame, int version)
+struct robot *load_robot_allocate(struct memfile *mf, int savegame,
+ int version)
 {
   struct robot *cur_robot = cmalloc(sizeof(struct robot));
-  load_robot(cur_robot, fp, savegame, version);
+  load_robot(cur_robot, mf, savegame, version);
   return cur_robot;
 }
 
 // Most of this stuff does not have to be loaded unless savegame
 // is set.
-void load_robot(struct robot *cur_robot, FILE *fp, int savegame, int version)
+void load_robot(struct robot *cur_robot, struct memfile *mf, int savegame,
+ int version)
 {
   int program_length;
   int i;
 
-  int robot_location = ftell(fp);
+  int robot_location = mftell(mf);
 
   cur_robot->stack = NULL;
   cur_robot->label_list = NULL;
+  cur_robot->num_labels = 0;
+  cur_robot->label_hash = NULL;
+  cur_robot->label_hash_size = 0;
+  cur_robot->label_zapped = NULL;
   cur_robot->program_bytecode = NULL;
+  cur_robot->param_cache = NULL;
+  cur_robot->param_cache_size = 0;
+  cur_robot->num_param_cache = 0;
 
   cur_robot->world_version = version;
 
@@ -260,13 +356,13 @@ void load_robot(struct robot *cur_robot, FILE *fp, int savegame, int version)
 
   if(version >= VERSION_PROGRAM_SOURCE)
   {
-    program_length = fgetd(fp);
+    program_length = mfgetd(mf);
   }
   else
 #endif
   {
-    program_length = fgetw(fp);
-    fseek(fp, 2, SEEK_CUR);
+    program_length = mfgetw(mf);
+    mfseek(mf, 2, SEEK_CUR);
   }
 
   if(program_length == EOF)
@@ -275,28 +371,28 @@ void load_robot(struct robot *cur_robot, FILE *fp, int savegame, int version)
     goto err_out;
   }
 
-  fread(cur_robot->robot_name, 15, 1, fp);
-  cur_robot->robot_char = fgetc(fp);
-  cur_robot->cur_prog_line = fgetw(fp);
-  cur_robot->pos_within_line = fgetc(fp);
-  cur_robot->robot_cycle = fgetc(fp);
-  cur_robot->cycle_count = fgetc(fp);
-  cur_robot->bullet_type = fgetc(fp);
-  cur_robot->is_locked = fgetc(fp);
-  cur_robot->can_lavawalk = fgetc(fp);
-  cur_robot->walk_dir = (enum dir)fgetc(fp);
-  cur_robot->last_touch_dir = (enum dir)fgetc(fp);
-  cur_robot->last_shot_dir = (enum dir)fgetc(fp);
-  cur_robot->xpos = fgetw(fp);
-  cur_robot->ypos = fgetw(fp);
-  cur_robot->status = fgetc(fp);
+  mfread(cur_robot->robot_name, 15, 1, mf);
+  cur_robot->robot_char = mfgetc(mf);
+  cur_robot->cur_prog_line = mfgetw(mf);
+  cur_robot->pos_within_line = mfgetc(mf);
+  cur_robot->robot_cycle = mfgetc(mf);
+  cur_robot->cycle_count = mfgetc(mf);
+  cur_robot->bullet_type = mfgetc(mf);
+  cur_robot->is_locked = mfgetc(mf);
+  cur_robot->can_lavawalk = mfgetc(mf);
+  cur_robot->walk_dir = (enum dir)mfgetc(mf);
+  cur_robot->last_touch_dir = (enum dir)mfgetc(mf);
+  cur_robot->last_shot_dir = (enum dir)mfgetc(mf);
+  cur_robot->xpos = mfgetw(mf);
+  cur_robot->ypos = mfgetw(mf);
+  cur_robot->status = mfgetc(mf);
   // Skip local - these are in the save files now
-  fseek(fp, 2, SEEK_CUR);
-  cur_robot->used = fgetc(fp);
+  mfseek(mf, 2, SEEK_CUR);
+  cur_robot->used = mfgetc(mf);
   if(version <= 0x0253)
-    cur_robot->loop_count = fgetw(fp);
+    cur_robot->loop_count = mfgetw(mf);
   else
-    fseek(fp, 2, SEEK_CUR);
+    mfseek(mf, 2, SEEK_CUR);
 
   // Periodic EOF check
   if(cur_robot->ypos < 0)
@@ -308,20 +404,20 @@ void load_robot(struct robot *cur_robot, FILE *fp, int savegame, int version)
     int stack_size;
 
     if(version >= 0x0254)
-      cur_robot->loop_count = fgetd(fp);
+      cur_robot->loop_count = mfgetd(mf);
 
     for(i = 0; i < 32; i++)
-      cur_robot->local[i] = fgetd(fp);
+      cur_robot->local[i] = mfgetd(mf);
 
-    stack_size = fgetd(fp);
-    cur_robot->stack_pointer = fgetd(fp);
+    stack_size = mfgetd(mf);
+    cur_robot->stack_pointer = mfgetd(mf);
 
     if(stack_size == EOF)
       goto err_invalid;
 
     cur_robot->stack = ccalloc(stack_size, sizeof(int));
     for(i = 0; i < stack_size; i++)
-      cur_robot->stack[i] = fgetd(fp);
+      cur_robot->stack[i] = mfgetd(mf);
 
     cur_robot->stack_size = stack_size;
 
@@ -335,7 +431,7 @@ void load_robot(struct robot *cur_robot, FILE *fp, int savegame, int version)
       // The program is bytecode and we have to convert it to sourcecode.
       char *program_legacy_bytecode = cmalloc(program_length);
 
-      if(!fread(program_legacy_bytecode, program_length, 1, fp))
+      if(!mfread(program_legacy_bytecode, program_length, 1, mf))
       {
         free(program_legacy_bytecode);
         goto err_invalid;
@@ -368,7 +464,7 @@ void load_robot(struct robot *cur_robot, FILE *fp, int savegame, int version)
       // shouldn't be possible though.
       cur_robot->program_bytecode = cmalloc(program_length);
       cur_robot->program_bytecode_length = program_length;
-      if(!fread(cur_robot->program_bytecode, program_length, 1, fp))
+      if(!mfread(cur_robot->program_bytecode, program_length, 1, mf))
         goto err_invalid;
 
     }
@@ -377,8 +473,7 @@ void load_robot(struct robot *cur_robot, FILE *fp, int savegame, int version)
     cur_robot->program_source_length = 0;
 
     // TODO: This has to be made part of what's saved one day.
-    cur_robot->label_list =
-     cache_robot_labels(cur_robot, &cur_robot->num_labels);
+    cache_robot_labels(cur_robot);
 #endif /* CONFIG_DEBYTECODE */
   }
   else
@@ -402,7 +497,7 @@ void load_robot(struct robot *cur_robot, FILE *fp, int savegame, int version)
       {
         // The program is bytecode and we have to convert it to sourcecode.
         char *program_legacy_bytecode = cmalloc(program_length);
-        if(!fread(program_legacy_bytecode, program_length, 1, fp))
+        if(!mfread(program_legacy_bytecode, program_length, 1, mf))
         {
           free(program_legacy_bytecode);
           goto err_invalid;
@@ -419,7 +514,7 @@ void load_robot(struct robot *cur_robot, FILE *fp, int savegame, int version)
       else
       {
         // Skip over program, we're not going to use it.
-        fseek(fp, program_length, SEEK_CUR);
+        mfseek(mf, program_length, SEEK_CUR);
         cur_robot->program_source = NULL;
         cur_robot->program_source_length = 0;
       }
@@ -430,7 +525,7 @@ void load_robot(struct robot *cur_robot, FILE *fp, int savegame, int version)
       cur_robot->program_source = cmalloc(program_length + 1);
       cur_robot->program_source_length = program_length;
 
-      if(!fread(cur_robot->program_source, program_length, 1, fp))
+      if(!mfread(cur_robot->program_source, program_length, 1, mf))
         goto err_invalid;
 
       cur_robot->program_source[program_length] = 0;
@@ -448,7 +543,7 @@ void load_robot(struct robot *cur_robot, FILE *fp, int savegame, int version)
   {
     cur_robot->program_bytecode = cmalloc(program_length);
 
-    if(!fread(cur_robot->program_bytecode, program_length, 1, fp))
+    if(!mfread(cur_robot->program_bytecode, program_length, 1, mf))
       goto err_invalid;
 
     if(VAL_SUCCESS != validate_legacy_bytecode(cur_robot->program_bytecode, program_length))
@@ -457,8 +552,7 @@ void load_robot(struct robot *cur_robot, FILE *fp, int savegame, int version)
     // Now create a label cache IF the robot is in use
     if(cur_robot->used)
     {
-      cur_robot->label_list =
-       cache_robot_labels(cur_robot, &cur_robot->num_labels);
+      cache_robot_labels(cur_robot);
     }
   }
 #endif /* !CONFIG_DEBYTECODE */
@@ -515,22 +609,22 @@ static int robot_stack_pop(struct robot *cur_robot)
   }
 }
 
-static void load_scroll(struct scroll *cur_scroll, FILE *fp)
+static void load_scroll(struct scroll *cur_scroll, struct memfile *mf)
 {
   int scroll_size;
 
   cur_scroll->mesg = NULL;
-  cur_scroll->num_lines = fgetw(fp);
-  fseek(fp, 2, SEEK_CUR); // Skip junk
-  scroll_size = fgetw(fp);
+  cur_scroll->num_lines = mfgetw(mf);
+  mfseek(mf, 2, SEEK_CUR); // Skip junk
+  scroll_size = mfgetw(mf);
   cur_scroll->mesg_size = scroll_size;
-  cur_scroll->used = fgetc(fp);
+  cur_scroll->used = mfgetc(mf);
 
   if(scroll_size < 0)
     goto scroll_err;
 
   cur_scroll->mesg = cmalloc(scroll_size);
-  if(!fread(cur_scroll->mesg, scroll_size, 1, fp))
+  if(!mfread(cur_scroll->mesg, scroll_size, 1, mf))
     goto scroll_err;
 
   return;
@@ -546,24 +640,24 @@ scroll_err:
   strcpy(cur_scroll->mesg, "\x01\x0A");
 }
 
-struct scroll *load_scroll_allocate(FILE *fp)
+struct scroll *load_scroll_allocate(struct memfile *mf)
 {
   struct scroll *cur_scroll = cmalloc(sizeof(struct scroll));
-  load_scroll(cur_scroll, fp);
+  load_scroll(cur_scroll, mf);
   return cur_scroll;
 }
 
-static void load_sensor(struct sensor *cur_sensor, FILE *fp)
+static void load_sensor(struct sensor *cur_sensor, struct memfile *mf)
 {
-  if(!fread(cur_sensor->sensor_name, 15, 1, fp))
+  if(!mfread(cur_sensor->sensor_name, 15, 1, mf))
     goto sensor_err;
 
-  cur_sensor->sensor_char = fgetc(fp);
+  cur_sensor->sensor_char = mfgetc(mf);
 
-  if(!fread(cur_sensor->robot_to_mesg, 15, 1, fp))
+  if(!mfread(cur_sensor->robot_to_mesg, 15, 1, mf))
     goto sensor_err;
 
-  cur_sensor->used = fgetc(fp);
+  cur_sensor->used = mfgetc(mf);
 
   return;
 
@@ -575,14 +669,15 @@ sensor_err:
   cur_sensor->used = 1;
 }
 
-struct sensor *load_sensor_allocate(FILE *fp)
+struct sensor *load_sensor_allocate(struct memfile *mf)
 {
   struct sensor *cur_sensor = cmalloc(sizeof(struct sensor));
-  load_sensor(cur_sensor, fp);
+  load_sensor(cur_sensor, mf);
   return cur_sensor;
 }
 
-void save_robot(struct robot *cur_robot, FILE *fp, int savegame, int version)
+void save_robot(struct robot *cur_robot, struct memfile *mf, int savegame,
+ int version)
 {
   int program_length;
   int i;
@@ -604,58 +699,58 @@ void save_robot(struct robot *cur_robot, FILE *fp, int savegame, int version)
   }
 
   // As of 2.83 we're writing out 4 byte sizes.
-  fputd(program_length, fp);
+  mfputd(program_length, mf);
 #else /* !CONFIG_DEBYTECODE */
   program_length = cur_robot->program_bytecode_length;
-  fputw(program_length, fp);
+  mfputw(program_length, mf);
   // Junk
-  fputw(0, fp);
+  mfputw(0, mf);
 #endif /* !CONFIG_DEBYTECODE */
 
-  fwrite(cur_robot->robot_name, 15, 1, fp);
-  fputc(cur_robot->robot_char, fp);
+  mfwrite(cur_robot->robot_name, 15, 1, mf);
+  mfputc(cur_robot->robot_char, mf);
   if(savegame)
   {
-    fputw(cur_robot->cur_prog_line, fp);
-    fputc(cur_robot->pos_within_line, fp);
-    fputc(cur_robot->robot_cycle, fp);
-    fputc(cur_robot->cycle_count, fp);
-    fputc(cur_robot->bullet_type, fp);
-    fputc(cur_robot->is_locked, fp);
-    fputc(cur_robot->can_lavawalk, fp);
-    fputc(cur_robot->walk_dir, fp);
-    fputc(cur_robot->last_touch_dir, fp);
-    fputc(cur_robot->last_shot_dir, fp);
-    fputw(cur_robot->xpos, fp);
-    fputw(cur_robot->ypos, fp);
-    fputc(cur_robot->status, fp);
+    mfputw(cur_robot->cur_prog_line, mf);
+    mfputc(cur_robot->pos_within_line, mf);
+    mfputc(cur_robot->robot_cycle, mf);
+    mfputc(cur_robot->cycle_count, mf);
+    mfputc(cur_robot->bullet_type, mf);
+    mfputc(cur_robot->is_locked, mf);
+    mfputc(cur_robot->can_lavawalk, mf);
+    mfputc(cur_robot->walk_dir, mf);
+    mfputc(cur_robot->last_touch_dir, mf);
+    mfputc(cur_robot->last_shot_dir, mf);
+    mfputw(cur_robot->xpos, mf);
+    mfputw(cur_robot->ypos, mf);
+    mfputc(cur_robot->status, mf);
   }
   else
   {
     // Put some "default" values here instead
-    fputw(1, fp);
-    fputc(0, fp);
-    fputc(0, fp);
-    fputc(0, fp);
-    fputc(1, fp);
-    fputc(0, fp);
-    fputc(0, fp);
-    fputc(0, fp);
-    fputc(0, fp);
-    fputc(0, fp);
-    fputw(cur_robot->xpos, fp);
-    fputw(cur_robot->ypos, fp);
-    fputc(0, fp);
+    mfputw(1, mf);
+    mfputc(0, mf);
+    mfputc(0, mf);
+    mfputc(0, mf);
+    mfputc(1, mf);
+    mfputc(0, mf);
+    mfputc(0, mf);
+    mfputc(0, mf);
+    mfputc(0, mf);
+    mfputc(0, mf);
+    mfputw(cur_robot->xpos, mf);
+    mfputw(cur_robot->ypos, mf);
+    mfputc(0, mf);
   }
 
   // Junk local
-  fputw(0, fp);
-  fputc(cur_robot->used, fp);
+  mfputw(0, mf);
+  mfputc(cur_robot->used, mf);
   // loop_count
   if(version <= 0x0253)
-    fputw(cur_robot->loop_count, fp);
+    mfputw(cur_robot->loop_count, mf);
   else // junk
-    fputw(0, fp);
+    mfputw(0, mf);
 
   // If savegame, there's some additional information to get
   if(savegame)
@@ -664,22 +759,22 @@ void save_robot(struct robot *cur_robot, FILE *fp, int savegame, int version)
 
     // Write the local counters
     if(version >= 0x0254)
-      fputd(cur_robot->loop_count, fp);
+      mfputd(cur_robot->loop_count, mf);
 
     for(i = 0; i < 32; i++)
     {
-      fputd(cur_robot->local[i], fp);
+      mfputd(cur_robot->local[i], mf);
     }
 
     // Put the stack size
-    fputd(stack_size, fp);
+    mfputd(stack_size, mf);
     // Put the stack pointer
-    fputd(cur_robot->stack_pointer, fp);
+    mfputd(cur_robot->stack_pointer, mf);
     // Put the stack
 
     for(i = 0; i < stack_size; i++)
     {
-      fputd(cur_robot->stack[i], fp);
+      mfputd(cur_robot->stack[i], mf);
     }
   }
 
@@ -689,49 +784,30 @@ void save_robot(struct robot *cur_robot, FILE *fp, int savegame, int version)
   // the zap status stored somewhere else.
 
   if(!savegame)
-    fwrite(cur_robot->program_source, program_length, 1, fp);
+    mfwrite(cur_robot->program_source, program_length, 1, mf);
   else
 #endif
-    fwrite(cur_robot->program_bytecode, program_length, 1, fp);
+    mfwrite(cur_robot->program_bytecode, program_length, 1, mf);
 }
 
-void save_scroll(struct scroll *cur_scroll, FILE *fp, int savegame)
+void save_scroll(struct scroll *cur_scroll, struct memfile *mf, int savegame)
 {
   int scroll_size = (int)cur_scroll->mesg_size;
 
-  fputw(cur_scroll->num_lines, fp);
-  fputw(0, fp);
-  fputw(scroll_size, fp);
-  fputc(cur_scroll->used, fp);
+  mfputw(cur_scroll->num_lines, mf);
+  mfputw(0, mf);
+  mfputw(scroll_size, mf);
+  mfputc(cur_scroll->used, mf);
 
-  fwrite(cur_scroll->mesg, scroll_size, 1, fp);
+  mfwrite(cur_scroll->mesg, scroll_size, 1, mf);
 }
 
-void save_sensor(struct sensor *cur_sensor, FILE *fp, int savegame)
+void save_sensor(struct sensor *cur_sensor, struct memfile *mf, int savegame)
 {
-  fwrite(cur_sensor->sensor_name, 15, 1, fp);
-  fputc(cur_sensor->sensor_char, fp);
-  fwrite(cur_sensor->robot_to_mesg, 15, 1, fp);
-  fputc(cur_sensor->used, fp);
-}
-
-#ifdef CONFIG_DEBYTECODE
-static
-#endif
-void clear_label_cache(struct label **label_list, int num_labels)
-{
-  int i;
-
-  if(label_list)
-  {
-    for(i = 0; i < num_labels; i++)
-    {
-      free(label_list[i]);
-    }
-
-    free(label_list);
-    label_list = NULL;
-  }
+  mfwrite(cur_sensor->sensor_name, 15, 1, mf);
+  mfputc(cur_sensor->sensor_char, mf);
+  mfwrite(cur_sensor->robot_to_mesg, 15, 1, mf);
+  mfputc(cur_sensor->used, mf);
 }
 
 void clear_robot_contents(struct robot *cur_robot)
@@ -753,11 +829,13 @@ void clear_robot_contents(struct robot *cur_robot)
   }
 #endif
 
+  clear_param_cache(cur_robot);
+
   // It could be in the editor, or possibly it was never executed.
   if(cur_robot->program_bytecode)
   {
     if(cur_robot->used)
-      clear_label_cache(cur_robot->label_list, cur_robot->num_labels);
+      clear_label_cache(cur_robot);
     free(cur_robot->program_bytecode);
     cur_robot->program_bytecode = NULL;
     cur_robot->program_bytecode_length = 0;
@@ -840,6 +918,9 @@ void clear_sensor(struct sensor *cur_sensor)
 
 void reallocate_robot(struct robot *robot, int size)
 {
+  // The program is about to be replaced
+  clear_param_cache(robot);
+
   robot->program_bytecode = crealloc(robot->program_bytecode, size);
   robot->program_bytecode_length = size;
 }
@@ -852,166 +933,110 @@ void reallocate_scroll(struct scroll *scroll, size_t size)
   scroll->mesg_size = size;
 }
 
-static struct label *find_label(struct robot *cur_robot, const char *name)
+static struct label_group *find_label_group(struct robot *cur_robot,
+ const char *name)
 {
-  int total = cur_robot->num_labels - 1;
-  int bottom = 0, top = total, middle = 0;
-  int cmpval = 0;
-  struct label **base = cur_robot->label_list;
-  struct label *current;
-
-  while(bottom <= top)
-  {
-    middle = (top + bottom) / 2;
-    current = base[middle];
-
-    cmpval = strcasecmp(name, current->name);
+  struct label_group *label_hash = cur_robot->label_hash;
+  struct label_group *group;
+  unsigned int hash, mask, pos;
 
-    if(cmpval > 0)
-    {
-      bottom = middle + 1;
-    }
-    else
-    {
-      if(cmpval < 0)
-      {
-        top = middle - 1;
-      }
-      else
-      {
-        // Found a match, see if there's an earlier one
-        while(middle)
-        {
-          current = base[middle - 1];
-          if(!strcasecmp(current->name, name))
-          {
-            middle--;
-          }
-          else
-          {
-            break;
-          }
-        }
+  if(!label_hash)
+    return NULL;
 
-        current = base[middle];
+  hash = hash_name_nocase(name);
+  mask = cur_robot->label_hash_size - 1;
+  pos = hash & mask;
 
-        // Now find a non-zapped one
-        while(middle <= total)
-        {
-          if(current->zapped)
-          {
-            if(middle == total)
-              return NULL;
-
-            middle++;
-            current = base[middle];
-            if(strcasecmp(current->name, name))
-            {
-              return NULL;
-            }
-          }
-          else
-          {
-            break;
-          }
-        }
+  while((group = label_hash + pos)->num_labels)
+  {
+    if((group->hash == hash) && !strcasecmp(name, group->labels[0]->name))
+      return group;
 
-        return current;
-      }
-    }
+    pos = (pos + 1) & mask;
   }
 
   return NULL;
 }
 
-static int find_label_position(struct robot *cur_robot, const char *name)
+// Index of the first label in the group that isn't zapped, or -1
+
+static int find_unzapped_label(struct label_group *group)
 {
-  struct label *cur_label = find_label(cur_robot, name);
+  unsigned int bits;
+  int i, i2;
 
-  if(cur_label)
-  {
-    return cur_label->position;
-  }
-  else
+  for(i = 0; i < group->num_labels; i += LABEL_ZAP_BITS)
   {
-    return -1;
+    bits = ~(group->zapped[i / LABEL_ZAP_BITS]);
+
+    if(bits)
+    {
+      for(i2 = i; !(bits & 1); i2++)
+        bits >>= 1;
+
+      if(i2 < group->num_labels)
+        return i2;
+
+      break;
+    }
   }
+
+  return -1;
 }
 
-// This should return the last zapped label found, for restore label
-// to work correctly.
+// Index of the last zapped label in the group, or -1
 
-static struct label *find_zapped_label(struct robot *cur_robot, char *name)
+static int find_last_zapped_label(struct label_group *group)
 {
-  int total = cur_robot->num_labels - 1;
-  int bottom = 0, top = total, middle = 0;
-  int cmpval = 0;
-  struct label **base = cur_robot->label_list;
-  struct label *current;
+  unsigned int high_bit = 1u << (LABEL_ZAP_BITS - 1);
+  unsigned int bits;
+  int i, i2;
 
-  while(bottom <= top)
+  for(i = (group->num_labels - 1) / LABEL_ZAP_BITS; i >= 0; i--)
   {
-    middle = (top + bottom) / 2;
-    current = base[middle];
-    cmpval = strcasecmp(name, current->name);
+    bits = group->zapped[i];
 
-    if(cmpval > 0)
-    {
-      bottom = middle + 1;
-    }
-    else
+    if(bits)
     {
-      if(cmpval < 0)
-      {
-        top = middle - 1;
-      }
-      else
-      {
-       // Found a match, see if there's a later one
-        while(middle < total)
-        {
-          current = base[middle + 1];
-          if(!strcasecmp(current->name, name))
-          {
-            middle++;
-          }
-          else
-          {
-            break;
-          }
-        }
+      for(i2 = (i + 1) * LABEL_ZAP_BITS - 1; !(bits & high_bit); i2--)
+        bits <<= 1;
 
-        current = base[middle];
+      return i2;
+    }
+  }
 
-        // Now find a zapped one
-        while(middle >= 0)
-        {
-          if(!current->zapped)
-          {
-            if(!middle)
-              return NULL;
+  return -1;
+}
 
-            middle--;
-            current = base[middle];
-            if(strcasecmp(current->name, name))
-            {
-              return NULL;
-            }
-          }
-          else
-          {
-            break;
-          }
-        }
+static struct label *find_label(struct robot *cur_robot, const char *name)
+{
+  struct label_group *group = find_label_group(cur_robot, name);
+  int i;
 
-        return current;
-      }
-    }
+  if(group)
+  {
+    i = find_unzapped_label(group);
+    if(i >= 0)
+      return group->labels[i];
   }
 
   return NULL;
 }
 
+static int find_label_position(struct robot *cur_robot, const char *name)
+{
+  struct label *cur_label = find_label(cur_robot, name);
+
+  if(cur_label)
+  {
+    return cur_label->position;
+  }
+  else
+  {
+    return -1;
+  }
+}
+
 // Returns 1 if found, first is the first robot in the list,
 // last is the last. If not found, first and last are the position to place
 // into.
@@ -1296,6 +1321,7 @@ static void send_sensor_command(struct world *mzx_world, int id, int command)
         level_under_id[player_offset] = 122;
         level_under_param[player_offset] = id;
         level_under_color[player_offset] = level_color[x + (y * board_width)];
+        mark_board_changed(src_board);
         id_remove_top(mzx_world, x, y);
       }
       else
@@ -1341,6 +1367,7 @@ static void send_sensor_command(struct world *mzx_world, int id, int command)
            command - 512;
         }
       }
+      mark_board_changed(src_board);
       break;
     }
   }
@@ -2005,6 +2032,239 @@ int move_dir(struct board *src_board, int *x, int *y, enum dir dir)
   return 0;
 }
 
+void clear_param_cache(struct robot *cur_robot)
+{
+  int i;
+
+  for(i = 0; i < cur_robot->param_cache_size; i++)
+    if(cur_robot->param_cache[i].offset)
+      free_expression(cur_robot->param_cache[i].expression);
+
+  free(cur_robot->param_cache);
+  cur_robot->param_cache = NULL;
+  cur_robot->param_cache_size = 0;
+  cur_robot->num_param_cache = 0;
+}
+
+// Would tr_msg() return this text unchanged?
+
+static bool param_needs_translation(struct world *mzx_world, const char *src)
+{
+#ifdef CONFIG_DEBYTECODE
+  return strpbrk(src, "\\(<") != NULL;
+#else
+  if(mzx_world->version >= 0x244)
+    return strpbrk(src, "&(") != NULL;
+
+  return strchr(src, '&') != NULL;
+#endif
+}
+
+static void insert_param_cache(struct param_cache *table, int size,
+ struct param_cache *src)
+{
+  int mask = size - 1;
+  int pos = src->offset & mask;
+
+  while(table[pos].offset)
+    pos = (pos + 1) & mask;
+
+  table[pos] = *src;
+}
+
+static void resize_param_cache(struct robot *cur_robot, int size)
+{
+  struct param_cache *old_table = cur_robot->param_cache;
+  struct param_cache *table = ccalloc(size, sizeof(struct param_cache));
+  int i;
+
+  for(i = 0; i < cur_robot->param_cache_size; i++)
+    if(old_table[i].offset)
+      insert_param_cache(table, size, old_table + i);
+
+  free(old_table);
+  cur_robot->param_cache = table;
+  cur_robot->param_cache_size = size;
+}
+
+// Find the cache entry for the parameter text at param, creating it if it
+// doesn't exist yet. Returns NULL if param isn't part of the bytecode of
+// robot id (e.g. it was already translated into a buffer).
+
+static struct param_cache *get_param_cache(struct world *mzx_world,
+ char *param, int id)
+{
+  struct board *src_board = mzx_world->current_board;
+  struct robot *cur_robot;
+  struct param_cache *table;
+  struct param_cache *current;
+  int offset, mask, pos;
+
+  if((id < 0) || (id > src_board->num_robots))
+    return NULL;
+
+  cur_robot = src_board->robot_list[id];
+  if(!cur_robot || !cur_robot->program_bytecode)
+    return NULL;
+
+  if((param <= cur_robot->program_bytecode) ||
+   (param >= cur_robot->program_bytecode + cur_robot->program_bytecode_length))
+    return NULL;
+
+  // Offset 0 is the program's 0xFF header, so it can mark empty slots
+  offset = (int)(param - cur_robot->program_bytecode);
+
+  table = cur_robot->param_cache;
+  if(table)
+  {
+    mask = cur_robot->param_cache_size - 1;
+    pos = offset & mask;
+
+    while(table[pos].offset)
+    {
+      if(table[pos].offset == offset)
+        return table + pos;
+
+      pos = (pos + 1) & mask;
+    }
+  }
+
+  // Keep the table at most half full
+  if((cur_robot->num_param_cache + 1) * 2 > cur_robot->param_cache_size)
+  {
+    if(cur_robot->param_cache_size)
+      resize_param_cache(cur_robot, cur_robot->param_cache_size * 2);
+    else
+      resize_param_cache(cur_robot, MIN_PARAM_CACHE);
+  }
+
+  table = cur_robot->param_cache;
+  mask = cur_robot->param_cache_size - 1;
+  pos = offset & mask;
+
+  while(table[pos].offset)
+    pos = (pos + 1) & mask;
+
+  current = table + pos;
+  current->offset = offset;
+  current->counter = NULL;
+  current->expression = NULL;
+  current->labels = NULL;
+
+  if(param_needs_translation(mzx_world, param))
+  {
+    current->type = PARAM_CACHE_TRANSLATE;
+
+    // Parameters that are entirely an expression are compiled up front
+    if((param[0] == '(') && (mzx_world->version >= 0x244))
+    {
+      current->expression = compile_expression(mzx_world, param + 1);
+      if(current->expression)
+        current->type = PARAM_CACHE_EXPRESSION;
+    }
+  }
+  else
+    current->type = PARAM_CACHE_NAME;
+
+  cur_robot->num_param_cache++;
+  return current;
+}
+
+// Jump to a label named literally in the robot's own program, as
+// send_robot_self would. The label's group is only looked up the first
+// time, after which a jump just has to find the first label not zapped.
+// Returns -1 if the label has to be translated and sent normally.
+
+int send_self_label_param(struct world *mzx_world, char *param, int id)
+{
+  struct robot *cur_robot = mzx_world->current_board->robot_list[id];
+  struct param_cache *entry;
+  int i;
+
+  // Subroutines need the stack, so they're always sent normally
+  if(param[0] == '#')
+    return -1;
+
+  entry = get_param_cache(mzx_world, param, id);
+  if(!entry)
+    return -1;
+
+  if(entry->type == PARAM_CACHE_NAME)
+  {
+    entry->labels = find_label_group(cur_robot, param);
+    entry->type = PARAM_CACHE_LABEL;
+  }
+  else
+
+  if(entry->type != PARAM_CACHE_LABEL)
+    return -1;
+
+  if(entry->labels)
+  {
+    i = find_unzapped_label(entry->labels);
+
+    if(i >= 0)
+    {
+      set_robot_position(cur_robot, entry->labels->labels[i]->position);
+      return 0;
+    }
+  }
+
+  return 2;
+}
+
+// If the parameter text names a plain user counter literally, returns that
+// counter; otherwise the caller must translate and look up the name itself.
+
+static struct counter *get_param_counter(struct world *mzx_world,
+ struct param_cache *entry, char *param)
+{
+  bool builtin;
+
+  switch(entry->type)
+  {
+    case PARAM_CACHE_COUNTER:
+      return entry->counter;
+
+    case PARAM_CACHE_NAME:
+    {
+      // Commands treat string names specially, so leave those alone
+      if(is_string(param))
+      {
+        entry->type = PARAM_CACHE_BUILTIN;
+        return NULL;
+      }
+
+      // Counters are never removed while the program is live, so once
+      // the counter exists the reference can be kept.
+      entry->counter = find_user_counter(mzx_world, param, &builtin);
+
+      if(entry->counter)
+        entry->type = PARAM_CACHE_COUNTER;
+      else
+
+      if(builtin)
+        entry->type = PARAM_CACHE_BUILTIN;
+
+      return entry->counter;
+    }
+
+    default:
+      return NULL;
+  }
+}
+
+struct counter *param_counter_ref(struct world *mzx_world, char *param,
+ int id)
+{
+  struct param_cache *entry = get_param_cache(mzx_world, param, id);
+
+  if(!entry)
+    return NULL;
+
+  return get_param_counter(mzx_world, entry, param);
+}
+
 // Returns the numeric value pointed to OR the numeric value represented
 // by the counter string pointed to. (the ptr is at the param within the
 // command)
@@ -2013,6 +2273,8 @@ int move_dir(struct board *src_board, int *x, int *y, enum dir dir)
 int parse_param(struct world *mzx_world, char *program, int id)
 {
   char ibuff[ROBOT_MAX_TR];
+  struct param_cache *entry;
+  struct counter *cdest;
 
   if(program[0] == 0)
   {
@@ -2020,6 +2282,19 @@ int parse_param(struct world *mzx_world, char *program, int id)
     return (signed short)((int)program[1] | (int)(program[2] << 8));
   }
 
+  // Plain counters named literally are looked up once and cached, and
+  // expressions are only compiled once
+  entry = get_param_cache(mzx_world, program + 1, id);
+  if(entry)
+  {
+    if(entry->type == PARAM_CACHE_EXPRESSION)
+      return evaluate_expression(mzx_world, entry->expression, id);
+
+    cdest = get_param_counter(mzx_world, entry, program + 1);
+    if(cdest)
+      return cdest->value;
+  }
+
   // Expressions - Exo
   if((program[1] == '(') && mzx_world->version >= 0x244)
   {
@@ -2097,29 +2372,51 @@ char *next_param_pos(char *ptr)
 // Both of these can only be done from an actively executing program,
 // so they will have valid bytecode.
 
+// Restore the last zapped label with this name.
+
 int restore_label(struct robot *cur_robot, char *label)
 {
-  struct label *dest_label = find_zapped_label(cur_robot, label);
+  struct label_group *group = find_label_group(cur_robot, label);
+  struct label *dest_label;
+  int i;
 
-  if(dest_label)
+  if(group)
   {
-    cur_robot->program_bytecode[dest_label->cmd_position] = ROBOTIC_CMD_LABEL;
-    dest_label->zapped = 0;
-    return 1;
+    i = find_last_zapped_label(group);
+
+    if(i >= 0)
+    {
+      dest_label = group->labels[i];
+      cur_robot->program_bytecode[dest_label->cmd_position] =
+       ROBOTIC_CMD_LABEL;
+      group->zapped[i / LABEL_ZAP_BITS] &= ~(1u << (i % LABEL_ZAP_BITS));
+      return 1;
+    }
   }
 
   return 0;
 }
 
+// Zap the first label with this name that isn't zapped.
+
 int zap_label(struct robot *cur_robot, char *label)
 {
-  struct label *dest_label = find_label(cur_robot, label);
+  struct label_group *group = find_label_group(cur_robot, label);
+  struct label *dest_label;
+  int i;
 
-  if(dest_label)
+  if(group)
   {
-    cur_robot->program_bytecode[dest_label->cmd_position] = ROBOTIC_CMD_ZAPPED_LABEL;
-    dest_label->zapped = 1;
-    return 1;
+    i = find_unzapped_label(group);
+
+    if(i >= 0)
+    {
+      dest_label = group->labels[i];
+      cur_robot->program_bytecode[dest_label->cmd_position] =
+       ROBOTIC_CMD_ZAPPED_LABEL;
+      group->zapped[i / LABEL_ZAP_BITS] |= 1u << (i % LABEL_ZAP_BITS);
+      return 1;
+    }
   }
 
   return 0;
@@ -3009,45 +3306,32 @@ void duplicate_robot_direct(struct robot *cur_robot,
  struct robot *copy_robot, int x, int y)
 {
   char *dest_program_location, *src_program_location;
-  struct label *src_label, *dest_label;
-  int i, program_length, num_labels;
-  ptrdiff_t program_offset;
+  int program_length;
 
 #ifdef CONFIG_DEBYTECODE
   prepare_robot_bytecode(cur_robot);
 #endif
   program_length = cur_robot->program_bytecode_length;
-  num_labels = cur_robot->num_labels;
 
   // Copy all the contents
   memcpy(copy_robot, cur_robot, sizeof(struct robot));
   // We need unique copies of the program and the label cache.
   copy_robot->program_bytecode = cmalloc(program_length);
 
+  // The parameter cache will be rebuilt as the copy runs.
+  copy_robot->param_cache = NULL;
+  copy_robot->param_cache_size = 0;
+  copy_robot->num_param_cache = 0;
+
   src_program_location = cur_robot->program_bytecode;
   dest_program_location = copy_robot->program_bytecode;
 
   memcpy(dest_program_location, src_program_location, program_length);
 
-  if(num_labels)
-    copy_robot->label_list = ccalloc(num_labels, sizeof(struct label *));
-  else
-    copy_robot->label_list = NULL;
-
-  program_offset = dest_program_location - src_program_location;
-
-  // Copy each individual label pointer over
-  for(i = 0; i < num_labels; i++)
-  {
-    copy_robot->label_list[i] = cmalloc(sizeof(struct label));
-
-    src_label = cur_robot->label_list[i];
-    dest_label = copy_robot->label_list[i];
-
-    memcpy(dest_label, src_label, sizeof(struct label));
-    // The name pointer actually has to be readjusted to match the new program
-    dest_label->name += program_offset;
-  }
+  // The labels have to point into the new program; which ones are zapped
+  // was copied with it.
+  if(cur_robot->label_list)
+    cache_robot_labels(copy_robot);
 
 #ifdef CONFIG_DEBYTECODE
   // FIXME: Short-term fix to repair copy block operations that contain robots
@@ -3109,6 +3393,9 @@ void replace_robot(struct board *src_board, struct robot *src_robot,
 
   if(dest_id)
     change_robot_name(src_board, cur_robot, src_robot->robot_name);
+
+  // The copy brings its char along
+  mark_board_changed(src_board);
 }
 
 // Like duplicate_robot_direct, but for scrolls.
@@ -3322,6 +3609,8 @@ void optimize_null_objects(struct board *src_board)
     }
   }
 
+  mark_board_changed(src_board);
+
   // Free the lists
   free(robot_id_translation_list);
   free(scroll_id_translation_list);
@@ -3334,6 +3623,8 @@ void prepare_robot_bytecode(struct robot *cur_robot)
 {
   if(cur_robot->program_bytecode == NULL)
   {
+    clear_param_cache(cur_robot);
+
     cur_robot->program_bytecode =
      assemble_program(cur_robot->program_source,
      &(cur_robot->program_bytecode_length));
@@ -3341,8 +3632,7 @@ void prepare_robot_bytecode(struct robot *cur_robot)
     // This was moved here from load robot - only build up the labels once the
     // robot's actually used. But eventually this should be combined with
     // assemble_program.
-    cur_robot->label_list =
-     cache_robot_labels(cur_robot, &cur_robot->num_labels);
+    cache_robot_labels(cur_robot);
 
     // FIXME: Short-term fix to repair copy block operations that contain
     //        robots in debytecode; freeing program_source everywhere causes
@@ -27,6 +27,7 @@ __M_BEGIN_DECLS
 #include "robot_struct.h"
 #include "board_struct.h"
 #include "world_struct.h"
+#include "memfile.h"
 
 // Let's not let a robot's stack get larger than 64k right now.
 // The value is a bit arbitrary, but it's mainly there to prevent MZX from
@@ -35,6 +36,9 @@ __M_BEGIN_DECLS
 #define ROBOT_START_STACK 4
 #define ROBOT_MAX_STACK   65536
 
+// Smallest parameter cache; it is kept at most half full
+#define MIN_PARAM_CACHE   16
+
 #ifdef CONFIG_DEBYTECODE
 
 // This is the version where programs became source code instead of
@@ -55,10 +59,8 @@ void prepare_robot_bytecode(struct robot *cur_robot);
 #else /* !CONFIG_DEBYTECODE */
 
 CORE_LIBSPEC void reallocate_robot(struct robot *robot, int size);
-CORE_LIBSPEC struct label **cache_robot_labels(struct robot *robot,
- int *num_labels);
-
-void clear_label_cache(struct label **label_list, int num_labels);
+CORE_LIBSPEC void cache_robot_labels(struct robot *robot);
+CORE_LIBSPEC void clear_label_cache(struct robot *robot);
 void change_robot_name(struct board *src_board, struct robot *cur_robot,
  char *new_name);
 void add_robot_name_entry(struct board *src_board, struct robot *cur_robot,
@@ -73,6 +75,7 @@ CORE_LIBSPEC void duplicate_robot_direct(struct robot *cur_robot,
 #endif /* !CONFIG_DEBYTECODE */
 
 CORE_LIBSPEC void clear_robot_contents(struct robot *cur_robot);
+CORE_LIBSPEC void clear_param_cache(struct robot *cur_robot);
 CORE_LIBSPEC void clear_robot_id(struct board *src_board, int id);
 CORE_LIBSPEC void clear_scroll_id(struct board *src_board, int id);
 CORE_LIBSPEC void clear_sensor_id(struct board *src_board, int id);
@@ -98,13 +101,16 @@ CORE_LIBSPEC void setup_overlay(struct board *src_board, int mode);
 CORE_LIBSPEC void replace_player(struct world *mzx_world);
 
 void create_blank_robot(struct robot *cur_robot, int savegame);
-struct robot *load_robot_allocate(FILE *fp, int savegame, int version);
-void load_robot(struct robot *cur_robot, FILE *fp, int savegame, int version);
-struct scroll *load_scroll_allocate(FILE *fp);
-struct sensor *load_sensor_allocate(FILE *fp);
-void save_robot(struct robot *cur_robot, FILE *fp, int savegame, int version);
-void save_scroll(struct scroll *cur_scroll, FILE *fp, int savegame);
-void save_sensor(struct sensor *cur_sensor, FILE *fp, int savegame);
+struct robot *load_robot_allocate(struct memfile *mf, int savegame,
+ int version);
+void load_robot(struct robot *cur_robot, struct memfile *mf, int savegame,
+ int version);
+struct scroll *load_scroll_allocate(struct memfile *mf);
+struct sensor *load_sensor_allocate(struct memfile *mf);
+void save_robot(struct robot *cur_robot, struct memfile *mf, int savegame,
+ int version);
+void save_scroll(struct scroll *cur_scroll, struct memfile *mf, int savegame);
+void save_sensor(struct sensor *cur_sensor, struct memfile *mf, int savegame);
 void clear_robot(struct robot *cur_robot);
 void clear_scroll(struct scroll *cur_scroll);
 void clear_sensor(struct sensor *cur_sensor);
@@ -135,6 +141,9 @@ int zap_label(struct robot *cur_robot, char *label);
 int next_param(char *ptr, int pos);
 char *next_param_pos(char *ptr);
 int parse_param(struct world *mzx_world, char *robot, int id);
+int send_self_label_param(struct world *mzx_world, char *param, int id);
+struct counter *param_counter_ref(struct world *mzx_world, char *param,
+ int id);
 enum thing parse_param_thing(struct world *mzx_world, char *program);
 enum dir parse_param_dir(struct world *mzx_world, char *program);
 enum equality parse_param_eq(struct world *mzx_world, char *program);
@@ -33,8 +33,38 @@ struct label
   int position;
   // Used for zapping.
   int cmd_position;
-  // Set to 1 if zapped
-  int zapped;
+};
+
+// The labels in a robot with the same name, in program order (the order
+// they're tried in). A bit is set in zapped for each one that's zapped.
+struct label_group
+{
+  unsigned int hash;
+  int num_labels;
+  struct label **labels;
+  unsigned int *zapped;
+};
+
+enum param_cache_type
+{
+  PARAM_CACHE_TRANSLATE,  // Has interpolation; must be translated every time
+  PARAM_CACHE_NAME,       // Literal, but not (yet) an existing user counter
+  PARAM_CACHE_BUILTIN,    // Literal name of a builtin (function) counter
+  PARAM_CACHE_COUNTER,    // Literal name of an existing user counter
+  PARAM_CACHE_EXPRESSION, // Compiled expression
+  PARAM_CACHE_LABEL       // Literal label in the robot's own program
+};
+
+// Decoded form of a string parameter in a robot's program, keyed by the
+// offset of the parameter's text in the bytecode. Entries are built the
+// first time a parameter is used and thrown away with the program.
+struct param_cache
+{
+  int offset;
+  enum param_cache_type type;
+  struct counter *counter;
+  struct expression *expression;
+  struct label_group *labels;
 };
 
 struct scroll
@@ -100,6 +130,15 @@ struct robot
 
   int num_labels;
   struct label **label_list;
+  // Hash table of label names; label_list is ordered by group
+  int label_hash_size;
+  struct label_group *label_hash;
+  unsigned int *label_zapped;
+
+  // Hash table of decoded parameters (not saved)
+  int param_cache_size;
+  int num_param_cache;
+  struct param_cache *param_cache;
 
   int stack_size;
   int stack_pointer;
@@ -46,6 +46,7 @@
 #include "fsafeopen.h"
 #include "extmem.h"
 #include "util.h"
+#include "profile.h"
 
 #define parsedir(a, b, c, d) \
  parsedir(mzx_world, a, b, c, d, _bl[0], _bl[1], _bl[2], _bl[3])
@@ -236,6 +237,7 @@ static int place_under_xy(struct board *src_board, enum thing id, int color,
   level_under_id[offset] = (char)id;
   level_under_color[offset] = color;
   level_under_param[offset] = param;
+  mark_board_changed(src_board);
 
   return 1;
 }
@@ -363,10 +365,19 @@ static int get_random_range(int min_value, int max_value)
 static int send_self_label_tr(struct world *mzx_world, char *param, int id)
 {
   char label_buffer[ROBOT_MAX_TR];
-  tr_msg(mzx_world, param, id, label_buffer);
+  int result;
+
+  // Literal labels go straight to their cached position
+  result = send_self_label_param(mzx_world, param, id);
+
+  if(result < 0)
+  {
+    tr_msg(mzx_world, param, id, label_buffer);
+    result = send_robot_self(mzx_world,
+     mzx_world->current_board->robot_list[id], label_buffer, 1);
+  }
 
-  if(send_robot_self(mzx_world,
-   mzx_world->current_board->robot_list[id], label_buffer, 1))
+  if(result)
   {
     return 0;
   }
@@ -658,6 +669,7 @@ __editor_maybe_static void copy_board_buffer_to_board(struct board *src_board,
         if(src_id_cur != PLAYER)
         {
           level_id[dest_offset] = src_id_cur;
+          mark_board_update(src_board, dest_offset);
           level_param[dest_offset] = src_param[src_offset];
           level_color[dest_offset] = src_color[src_offset];
           level_under_id[dest_offset] = src_under_id[src_offset];
@@ -667,12 +679,15 @@ __editor_maybe_static void copy_board_buffer_to_board(struct board *src_board,
         else
         {
           level_id[dest_offset] = src_under_id[src_offset];
+          mark_board_update(src_board, dest_offset);
           level_param[dest_offset] = src_under_param[src_offset];
           level_color[dest_offset] = src_under_color[src_offset];
         }
       }
     }
   }
+
+  mark_board_changed(src_board);
 }
 
 __editor_maybe_static void copy_layer_to_buffer(int x, int y,
@@ -804,6 +819,8 @@ __editor_maybe_static void copy_layer_to_board(struct board *src_board,
       }
     }
   }
+
+  mark_board_changed(src_board);
 }
 
 void setup_overlay(struct board *src_board, int mode)
@@ -825,6 +842,7 @@ void setup_overlay(struct board *src_board, int mode)
     memset(src_board->overlay_color, 7, board_size);
   }
   src_board->overlay_mode = mode;
+  mark_board_changed(src_board);
 }
 
 static void copy_block(struct world *mzx_world, int id, int x, int y,
@@ -1025,6 +1043,7 @@ static void copy_block(struct world *mzx_world, int id, int x, int y,
         copy_buffer_to_layer(dest_x, dest_y, width, height,
          char_buffer, color_buffer, src_board->overlay,
          src_board->overlay_color, dest_width);
+        mark_board_changed(src_board);
 
         free(color_buffer);
         free(char_buffer);
@@ -1039,6 +1058,7 @@ static void copy_block(struct world *mzx_world, int id, int x, int y,
        height, mzx_world->vlayer_chars, mzx_world->vlayer_colors,
        src_board->overlay, src_board->overlay_color, src_width,
        dest_width);
+      mark_board_changed(src_board);
 
       break;
     }
@@ -1145,7 +1165,7 @@ void replace_player(struct world *mzx_world)
 
 // Run a single robot through a single cycle.
 // If id is negative, only run it if status is 2
-void run_robot(struct world *mzx_world, int id, int x, int y)
+static void __run_robot(struct world *mzx_world, int id, int x, int y)
 {
   struct board *src_board = mzx_world->current_board;
   struct robot *cur_robot;
@@ -1292,6 +1312,8 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
     // Get command number
     cmd = cmd_ptr[0];
 
+    profile_robot_command(mzx_world, id, cur_robot, old_pos, cmd);
+
     // Act according to command
     switch(cmd)
     {
@@ -1442,6 +1464,8 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
           color = fix_color(color, level_color[offset]);
           level_color[offset] = color;
           level_id[offset] = new_id;
+          mark_board_update(src_board, offset);
+          mark_board_changed(src_board);
 
           // Param- Only change if not becoming a robot
           if(!is_robot(new_id))
@@ -1473,6 +1497,7 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
       case ROBOTIC_CMD_CHAR: // Char
       {
         cur_robot->robot_char = parse_param(mzx_world, cmd_ptr + 1, id);
+        mark_board_changed(src_board);
         break;
       }
 
@@ -1484,6 +1509,7 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
           level_color[offset] =
            fix_color(parse_param(mzx_world, cmd_ptr + 1, id),
            level_color[offset]);
+          mark_board_changed(src_board);
         }
         break;
       }
@@ -1521,10 +1547,14 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
         char *src_string = next_param_pos(cmd_ptr + 1);
         char src_buffer[ROBOT_MAX_TR];
         char dest_buffer[ROBOT_MAX_TR];
-        tr_msg(mzx_world, dest_string, id, dest_buffer);
+        struct counter *cdest =
+         param_counter_ref(mzx_world, dest_string, id);
+
+        if(!cdest)
+          tr_msg(mzx_world, dest_string, id, dest_buffer);
 
         // Setting a string
-        if(is_string(dest_buffer))
+        if(!cdest && is_string(dest_buffer))
         {
           struct string dest;
 
@@ -1565,6 +1595,9 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
 
           if(mzx_world->special_counter_return != FOPEN_NONE)
           {
+            if(cdest)
+              strcpy(dest_buffer, cdest->name);
+
             gotoed = set_counter_special(mzx_world, dest_buffer, value, id);
 
             // We loaded a new game successfully; get out of here
@@ -1593,6 +1626,12 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
             }
           }
           else
+
+          if(cdest)
+          {
+            set_counter_ref(mzx_world, cdest, value, id);
+          }
+          else
           {
             set_counter(mzx_world, dest_buffer, value, id);
           }
@@ -1607,6 +1646,17 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
         char *src_string = next_param_pos(cmd_ptr + 1);
         char src_buffer[ROBOT_MAX_TR];
         char dest_buffer[ROBOT_MAX_TR];
+        struct counter *cdest =
+         param_counter_ref(mzx_world, dest_string, id);
+
+        if(cdest)
+        {
+          int value = parse_param(mzx_world, src_string, id);
+          inc_counter_ref(mzx_world, cdest, value, id);
+          last_label = -1;
+          break;
+        }
+
         tr_msg(mzx_world, dest_string, id, dest_buffer);
 
         // Incrementing a string
@@ -1649,8 +1699,18 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
         char *dest_string = cmd_ptr + 2;
         char *src_string = next_param_pos(cmd_ptr + 1);
         char dest_buffer[ROBOT_MAX_TR];
+        struct counter *cdest =
+         param_counter_ref(mzx_world, dest_string, id);
         int value;
 
+        if(cdest)
+        {
+          value = parse_param(mzx_world, src_string, id);
+          dec_counter_ref(mzx_world, cdest, value, id);
+          last_label = -1;
+          break;
+        }
+
         tr_msg(mzx_world, dest_string, id, dest_buffer);
         value = parse_param(mzx_world, src_string, id);
 
@@ -2356,6 +2416,8 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
           level_param[offset] =
            (parse_param(mzx_world, cmd_ptr + 1, id) - 1) * 16;
           level_id[offset] = (char)EXPLOSION;
+          mark_board_update(src_board, offset);
+          mark_board_changed(src_board);
           clear_robot_id(src_board, id);
         }
         return;
@@ -2861,11 +2923,14 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
                 int cp_param = level_param[src_offset];
                 int cp_color = level_color[src_offset];
                 level_id[src_offset] = level_id[dest_offset];
+                mark_board_update(src_board, src_offset);
                 level_param[src_offset] = level_param[dest_offset];
                 level_color[src_offset] = level_color[dest_offset];
                 level_id[dest_offset] = cp_id;
+                mark_board_update(src_board, dest_offset);
                 level_param[dest_offset] = cp_param;
                 level_color[dest_offset] = cp_color;
+                mark_board_changed(src_board);
                 // Figure blocked vars
                 update_blocked = 1;
               }
@@ -3064,8 +3129,7 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
 
           if((unsigned int)put_param < 256)
           {
-            plot_sprite(mzx_world, mzx_world->sprite_list[put_param],
-             put_color, put_x, put_y);
+            plot_sprite(mzx_world, put_param, put_color, put_x, put_y);
           }
         }
         else
@@ -3610,12 +3674,12 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
 
         if(board_id != NO_BOARD)
         {
-          set_current_board_ext(mzx_world, mzx_world->board_list[board_id]);
+          set_current_board_ext(mzx_world, get_board(mzx_world, board_id));
           prefix_mid_xy(mzx_world, &teleport_x, &teleport_y, x, y);
 
           // And switch back
           set_current_board_ext(mzx_world,
-           mzx_world->board_list[current_board_id]);
+           get_board(mzx_world, current_board_id));
           mzx_world->target_board = board_id;
           mzx_world->target_x = teleport_x;
           mzx_world->target_y = teleport_y;
@@ -3951,6 +4015,7 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
         if(id)
         {
           level_id[x + (y * board_width)] = ROBOT_PUSHABLE;
+          mark_board_changed(src_board);
         }
         break;
       }
@@ -3960,6 +4025,7 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
         if(id)
         {
           level_id[x + (y * board_width)] = ROBOT;
+          mark_board_changed(src_board);
         }
         break;
       }
@@ -4151,6 +4217,8 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
               // Change the color and the ID
               level_color[offset] = fix_color(put_color, d_color);
               level_id[offset] = put_id;
+              mark_board_update(src_board, offset);
+              mark_board_changed(src_board);
 
               if(((d_id == ROBOT_PUSHABLE) || (d_id == ROBOT)) &&
                (put_id != ROBOT) && (put_id != ROBOT_PUSHABLE))
@@ -4597,8 +4665,10 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
         if(dest_id != -1)
         {
           level_id[offset] = duplicate_id;
+          mark_board_update(src_board, offset);
           level_color[offset] = duplicate_color;
           level_param[offset] = dest_id;
+          mark_board_changed(src_board);
 
           x = duplicate_x;
           y = duplicate_y;
@@ -4645,8 +4715,10 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
         if(dest_id != -1)
         {
           level_id[offset] = duplicate_id;
+          mark_board_update(src_board, offset);
           level_color[offset] = duplicate_color;
           level_param[offset] = dest_id;
+          mark_board_changed(src_board);
 
           x = duplicate_x;
           y = duplicate_y;
@@ -5457,6 +5529,7 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
 
         src_board->overlay[offset] = put_char;
         src_board->overlay_color[offset] = put_color;
+        mark_board_changed(src_board);
         break;
       }
 
@@ -5491,6 +5564,7 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
           {
             overlay[i] = dest_char;
             overlay_color[i] = fix_color(dest_color, d_color);
+            mark_board_changed(src_board);
           }
         }
 
@@ -5521,6 +5595,7 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
            ((src_fg == 16) || (src_fg == (d_color & 0x0F))))
           {
             overlay_color[i] = fix_color(dest_color, d_color);
+            mark_board_changed(src_board);
           }
         }
         break;
@@ -5565,6 +5640,7 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
           current_char = *write_string;
           offset++;
         }
+        mark_board_changed(src_board);
         break;
       }
 
@@ -5699,3 +5775,11 @@ void run_robot(struct world *mzx_world, int id, int x, int y)
   cur_robot->xpos = x;
   cur_robot->ypos = y;
 }
+
+void run_robot(struct world *mzx_world, int id, int x, int y)
+{
+  __run_robot(mzx_world, id, x, y);
+
+  // The last command run is timed up to here
+  profile_robot_end();
+}
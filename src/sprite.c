@@ -22,6 +22,7 @@
 // Global declarations:
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "data.h"
 #include "sprite.h"
@@ -31,35 +32,268 @@
 #include "game.h"
 #include "world.h"
 
-// For the qsort.
-static int compare_spr(const void *dest, const void *src)
+// Sprite numbers in the order they were last drawn in with y ordering on.
+// Sprites rarely change places in it from one frame to the next, so
+// fixing it up with an insertion sort is close to linear.
+static Uint8 y_order[MAX_SPRITES];
+static bool y_order_valid;
+
+// Whether sprite a should be drawn before sprite b with y ordering on.
+static bool draw_before(struct sprite **sprite_list, int a, int b)
 {
-  struct sprite *spr_dest = *((struct sprite **)dest);
-  struct sprite *spr_src = *((struct sprite **)src);
+  struct sprite *spr_a = sprite_list[a];
+  struct sprite *spr_b = sprite_list[b];
+  int y_a, y_b;
+
+  // Inactive sprites go at the end, in no particular order
+  if(!(spr_a->flags & SPRITE_INITIALIZED))
+    return false;
+
+  if(!(spr_b->flags & SPRITE_INITIALIZED))
+    return true;
+
+  y_a = spr_a->y + spr_a->col_y;
+  y_b = spr_b->y + spr_b->col_y;
+
+  if(y_a != y_b)
+    return y_a < y_b;
+
+  // Keep sprites on the same line in number order
+  return a < b;
+}
+
+static void sort_y_order(struct sprite **sprite_list)
+{
+  int i, i2;
+  int cur;
+
+  if(!y_order_valid)
+  {
+    for(i = 0; i < MAX_SPRITES; i++)
+      y_order[i] = i;
+
+    y_order_valid = true;
+  }
+
+  for(i = 1; i < MAX_SPRITES; i++)
+  {
+    cur = y_order[i];
 
-  return ((spr_dest->y + spr_dest->col_y) -
-   (spr_src->y + spr_src->col_y));
+    for(i2 = i; (i2 > 0) && draw_before(sprite_list, cur, y_order[i2 - 1]);
+     i2--)
+      y_order[i2] = y_order[i2 - 1];
+
+    y_order[i2] = cur;
+  }
 }
 
 static int is_blank(char c)
 {
-  int cp[4];
-  int blank = 0;
+  return ec_is_blank(c);
+}
+
+// Broadphase for sprite_colliding_xy. The board is split into cells of
+// 8x8 chars, which are wrapped onto a 16x16 grid of buckets so any board
+// size (and sprites off the board) can be handled. Each bucket has a bit
+// for every sprite whose collision box touches it, so a check only has to
+// run the exact test against the sprites in the buckets its box touches.
+// Sprites the grid can't place safely (negative sizes, or sizes and
+// positions so large the exact test would overflow) are kept in a mask
+// that's always checked instead.
+
+#define SPRITE_CELL_SHIFT   3
+#define SPRITE_GRID_SHIFT   4
+#define SPRITE_GRID_SIZE    (1 << SPRITE_GRID_SHIFT)
+#define SPRITE_GRID_MASK    (SPRITE_GRID_SIZE - 1)
+#define SPRITE_INDEX_LIMIT  (1 << 24)
+#define SPRITE_MASK_WORDS   (MAX_SPRITES / 32)
+
+enum sprite_index_state
+{
+  SPRITE_NOT_INDEXED,
+  SPRITE_IN_GRID,
+  SPRITE_UNPLACED
+};
+
+struct sprite_cells
+{
+  enum sprite_index_state state;
+  int x1;
+  int y1;
+  int x2;
+  int y2;
+};
+
+struct sprite_index
+{
+  Uint32 buckets[SPRITE_GRID_SIZE * SPRITE_GRID_SIZE][SPRITE_MASK_WORDS];
+  Uint32 unplaced[SPRITE_MASK_WORDS];
+  struct sprite_cells cells[MAX_SPRITES];
+};
+
+static bool get_sprite_cells(struct sprite_cells *cells, int x, int y,
+ int width, int height)
+{
+  if((width <= 0) || (height <= 0) ||
+   (width > SPRITE_INDEX_LIMIT) || (height > SPRITE_INDEX_LIMIT) ||
+   (x < -SPRITE_INDEX_LIMIT) || (x > SPRITE_INDEX_LIMIT) ||
+   (y < -SPRITE_INDEX_LIMIT) || (y > SPRITE_INDEX_LIMIT))
+    return false;
+
+  cells->x1 = x >> SPRITE_CELL_SHIFT;
+  cells->y1 = y >> SPRITE_CELL_SHIFT;
+  cells->x2 = (x + width - 1) >> SPRITE_CELL_SHIFT;
+  cells->y2 = (y + height - 1) >> SPRITE_CELL_SHIFT;
+
+  // Past the grid size every bucket is covered anyway
+  if(cells->x2 - cells->x1 >= SPRITE_GRID_SIZE)
+    cells->x2 = cells->x1 + SPRITE_GRID_SIZE - 1;
+
+  if(cells->y2 - cells->y1 >= SPRITE_GRID_SIZE)
+    cells->y2 = cells->y1 + SPRITE_GRID_SIZE - 1;
+
+  return true;
+}
+
+static void mark_sprite_cells(struct sprite_index *index,
+ struct sprite_cells *cells, int spr_num, bool set)
+{
+  Uint32 bit = 1U << (spr_num & 31);
+  int word = spr_num >> 5;
+  int bucket;
+  int cx, cy;
+
+  for(cy = cells->y1; cy <= cells->y2; cy++)
+  {
+    for(cx = cells->x1; cx <= cells->x2; cx++)
+    {
+      bucket = ((cy & SPRITE_GRID_MASK) << SPRITE_GRID_SHIFT) |
+       (cx & SPRITE_GRID_MASK);
+
+      if(set)
+        index->buckets[bucket][word] |= bit;
+      else
+        index->buckets[bucket][word] &= ~bit;
+    }
+  }
+}
+
+static void index_sprite(struct sprite_index *index,
+ struct sprite *cur_sprite, int spr_num)
+{
+  struct sprite_cells *cells = &(index->cells[spr_num]);
+
+  // These are never collided against, so leave them out entirely
+  if(!(cur_sprite->flags & SPRITE_INITIALIZED) ||
+   !(cur_sprite->col_width) || !(cur_sprite->col_height))
+  {
+    cells->state = SPRITE_NOT_INDEXED;
+    return;
+  }
+
+  if(get_sprite_cells(cells, cur_sprite->x + cur_sprite->col_x,
+   cur_sprite->y + cur_sprite->col_y, cur_sprite->col_width,
+   cur_sprite->col_height))
+  {
+    cells->state = SPRITE_IN_GRID;
+    mark_sprite_cells(index, cells, spr_num, true);
+  }
+  else
+  {
+    cells->state = SPRITE_UNPLACED;
+    index->unplaced[spr_num >> 5] |= 1U << (spr_num & 31);
+  }
+}
+
+static void unindex_sprite(struct sprite_index *index, int spr_num)
+{
+  struct sprite_cells *cells = &(index->cells[spr_num]);
+
+  if(cells->state == SPRITE_IN_GRID)
+    mark_sprite_cells(index, cells, spr_num, false);
+
+  else if(cells->state == SPRITE_UNPLACED)
+    index->unplaced[spr_num >> 5] &= ~(1U << (spr_num & 31));
+
+  cells->state = SPRITE_NOT_INDEXED;
+}
+
+static struct sprite_index *get_sprite_index(struct world *mzx_world)
+{
+  struct sprite_index *index = mzx_world->sprite_index;
+  int i;
 
-  cp[3] = 0;
-  ec_read_char(c, (char *)cp);
+  if(!index)
+  {
+    index = ccalloc(1, sizeof(struct sprite_index));
+
+    for(i = 0; i < MAX_SPRITES; i++)
+      index_sprite(index, mzx_world->sprite_list[i], i);
+
+    mzx_world->sprite_index = index;
+  }
+
+  return index;
+}
+
+// Call after changing the position, collision box or flags of a sprite.
+void update_sprite_index(struct world *mzx_world, int spr_num)
+{
+  struct sprite_index *index = mzx_world->sprite_index;
+
+  // If there's no index yet it'll be built from scratch when needed
+  if(index)
+  {
+    unindex_sprite(index, spr_num);
+    index_sprite(index, mzx_world->sprite_list[spr_num], spr_num);
+  }
+}
+
+// Call when sprites are rearranged or replaced wholesale.
+void invalidate_sprite_index(struct world *mzx_world)
+{
+  free(mzx_world->sprite_index);
+  mzx_world->sprite_index = NULL;
+}
 
-  blank |= cp[0];
-  blank |= cp[1];
-  blank |= cp[2];
-  blank |= cp[3];
+// Fill candidates with every sprite check_sprite at x, y might collide with.
+static void get_sprite_candidates(struct world *mzx_world,
+ struct sprite *check_sprite, int x, int y, Uint32 *candidates)
+{
+  struct sprite_index *index = get_sprite_index(mzx_world);
+  struct sprite_cells cells;
+  int bucket;
+  int cx, cy;
+  int i;
+
+  if(!get_sprite_cells(&cells, x + check_sprite->col_x,
+   y + check_sprite->col_y, check_sprite->col_width,
+   check_sprite->col_height))
+  {
+    memset(candidates, 0xFF, SPRITE_MASK_WORDS * sizeof(Uint32));
+    return;
+  }
+
+  memcpy(candidates, index->unplaced, SPRITE_MASK_WORDS * sizeof(Uint32));
 
-  return !blank;
+  for(cy = cells.y1; cy <= cells.y2; cy++)
+  {
+    for(cx = cells.x1; cx <= cells.x2; cx++)
+    {
+      bucket = ((cy & SPRITE_GRID_MASK) << SPRITE_GRID_SHIFT) |
+       (cx & SPRITE_GRID_MASK);
+
+      for(i = 0; i < SPRITE_MASK_WORDS; i++)
+        candidates[i] |= index->buckets[bucket][i];
+    }
+  }
 }
 
-void plot_sprite(struct world *mzx_world, struct sprite *cur_sprite, int color,
+void plot_sprite(struct world *mzx_world, int spr_num, int color,
  int x, int y)
 {
+  struct sprite *cur_sprite = mzx_world->sprite_list[spr_num];
+
   if(((cur_sprite->width) && (cur_sprite->height)))
   {
     cur_sprite->x = x;
@@ -80,6 +314,8 @@ void plot_sprite(struct world *mzx_world, struct sprite *cur_sprite, int color,
       cur_sprite->flags |= SPRITE_INITIALIZED;
       mzx_world->active_sprites++;
     }
+
+    update_sprite_index(mzx_world, spr_num);
   }
 }
 
@@ -92,7 +328,6 @@ void draw_sprites(struct world *mzx_world)
   int bwidth, bheight;
   bool use_vlayer;
   struct sprite **sprite_list = mzx_world->sprite_list;
-  struct sprite *draw_order[MAX_SPRITES];
   struct sprite *cur_sprite;
   char ch, color, dcolor;
   int viewport_x = src_board->viewport_x;
@@ -105,36 +340,18 @@ void draw_sprites(struct world *mzx_world)
   char *src_chars;
   char *src_colors;
 
+  mzx_world->sprites_drawn = 0;
+  mzx_world->sprite_chars_drawn = 0;
+
   // see if y sort should be done
   if(mzx_world->sprite_y_order)
-  {
-    // Switched to stdlib qsort. Hooray!
-    // Fill it with the active sprites in the beginning
-    // and the inactive sprites in the end.
-    for(i = 0, i2 = 0, i3 = MAX_SPRITES - 1; i < MAX_SPRITES; i++)
-    {
-      if((sprite_list[i])->flags & SPRITE_INITIALIZED)
-      {
-        draw_order[i2] = sprite_list[i];
-        i2++;
-      }
-      else
-      {
-        draw_order[i3] = sprite_list[i];
-        i3--;
-      }
-    }
-
-    // Now sort it, using qsort.
-
-    qsort(draw_order, i2, sizeof(struct sprite *), compare_spr);
-  }
+    sort_y_order(sprite_list);
 
   // draw this on top of the SCREEN window.
   for(i = 0; i < MAX_SPRITES; i++)
   {
     if(mzx_world->sprite_y_order)
-      cur_sprite = draw_order[i];
+      cur_sprite = sprite_list[y_order[i]];
     else
       cur_sprite = sprite_list[i];
 
@@ -226,6 +443,12 @@ void draw_sprites(struct world *mzx_world)
       if((ref_y + draw_height) > bheight)
         draw_height = bheight - ref_y;
 
+      if((draw_width > 0) && (draw_height > 0))
+      {
+        mzx_world->sprites_drawn++;
+        mzx_world->sprite_chars_drawn += draw_width * draw_height;
+      }
+
       i4 = ((ref_y + offset_y) * bwidth) + ref_x + offset_x;
       i5 = (start_y * 80) + start_x;
 
@@ -431,6 +654,7 @@ int sprite_colliding_xy(struct world *mzx_world, struct sprite *check_sprite,
   int *collision_list = mzx_world->collision_list;
   int vlayer_width = mzx_world->vlayer_width;
   int board_collide = 0;
+  Uint32 candidates[SPRITE_MASK_WORDS];
 
   if(!(check_sprite->flags & SPRITE_INITIALIZED))
     return -1;
@@ -502,36 +726,38 @@ int sprite_colliding_xy(struct world *mzx_world, struct sprite *check_sprite,
   i3 = (check_y * board_width) + check_x;
   i4 = (ref_y * bwidth) + ref_x;
 
-  for(i = 0; i < col_height; i++)
+  for(i = 0; (i < col_height) && !board_collide; i++)
   {
     for(i2 = 0; i2 < col_width; i2++)
     {
-      // First, if ccheck is on, it won't care if the source is 32
-      int c;
-
-      if(use_vlayer)
-      {
-        c = vlayer_chars[i4];
-      }
-      else
+      // Only customblocks collide, so don't bother looking at the char
+      // of anything else
+      if(level_id[i3] == 5)
       {
-        c = get_id_char(src_board, i4);
-      }
+        // First, if ccheck is on, it won't care if the source is 32
+        int c;
 
-      if(!(check_sprite->flags & SPRITE_CHAR_CHECK) ||
-       (c != 32))
-      {
-        // if ccheck2 is on and the char is blank, don't trigger.
-        if(!(check_sprite->flags & SPRITE_CHAR_CHECK2) ||
-         (!is_blank(c)))
+        if(use_vlayer)
+        {
+          c = vlayer_chars[i4];
+        }
+        else
+        {
+          c = get_id_char(src_board, i4);
+        }
+
+        if(!(check_sprite->flags & SPRITE_CHAR_CHECK) ||
+         (c != 32))
         {
-          if(level_id[i3] == 5)
+          // if ccheck2 is on and the char is blank, don't trigger.
+          if(!(check_sprite->flags & SPRITE_CHAR_CHECK2) ||
+           (!is_blank(c)))
           {
             // Colliding against background
-            if(board_collide) break;
             collision_list[colliding] = -1;
             colliding++;
             board_collide = 1;
+            break;
           }
         }
       }
@@ -543,8 +769,20 @@ int sprite_colliding_xy(struct world *mzx_world, struct sprite *check_sprite,
     i4 += skip2;
   }
 
+  get_sprite_candidates(mzx_world, check_sprite, x, y, candidates);
+
   for(i = 0; i < MAX_SPRITES; i++)
   {
+    // Skip a whole word of the candidate mask at a time if it's empty
+    if(!candidates[i >> 5])
+    {
+      i |= 31;
+      continue;
+    }
+
+    if(!(candidates[i >> 5] & (1U << (i & 31))))
+      continue;
+
     cur_sprite = sprite_list[i];
     if((cur_sprite == check_sprite) ||
      !(cur_sprite->flags & SPRITE_INITIALIZED))
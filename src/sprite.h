@@ -52,12 +52,14 @@ enum
   SPRITE_VLAYER       = (1 << 6),
 };
 
-void plot_sprite(struct world *mzx_world, struct sprite *cur_sprite, int color,
+void plot_sprite(struct world *mzx_world, int spr_num, int color,
  int x, int y);
 void draw_sprites(struct world *mzx_world);
 int sprite_at_xy(struct sprite *cur_sprite, int x, int y);
 int sprite_colliding_xy(struct world *mzx_world, struct sprite *check_sprite,
  int x, int y);
+void update_sprite_index(struct world *mzx_world, int spr_num);
+void invalidate_sprite_index(struct world *mzx_world);
 
 __M_END_DECLS
 
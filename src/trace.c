@@ -0,0 +1,270 @@
+/* MegaZeux
+ *
+ * Copyright (C) 2026 MegaZeux contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+#include "trace.h"
+#include "util.h"
+
+#define TRACE_MAX_DEPTH 16
+#define TRACE_AUDIO_QUEUE_SIZE 256
+
+// Loads and stores of the audio queue's positions, which are shared with
+// the mixer's thread without a lock (as in audio.c)
+
+#if defined(__GNUC__)
+#define load_acquire(ptr)       __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define store_release(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#else
+#define load_acquire(ptr)       (*(volatile Uint32 *)(ptr))
+#define store_release(ptr, val) (*(volatile Uint32 *)(ptr) = (val))
+#endif
+
+enum trace_thread
+{
+  TRACE_MAIN = 1,
+  TRACE_AUDIO
+};
+
+struct trace_event
+{
+  const char *name;
+  Uint64 start;
+  Uint32 duration;
+  Uint32 frame;
+  enum trace_thread thread;
+};
+
+struct trace_scope
+{
+  const char *name;
+  Uint64 start;
+};
+
+bool tracing;
+
+static char trace_file[MAX_PATH];
+static Uint64 trace_start_time;
+
+// Only the main thread writes here, so the oldest events are simply
+// overwritten once it's full
+static struct trace_event *events;
+static int max_events;
+static int num_events;
+static int next_event;
+
+static struct trace_scope scope_stack[TRACE_MAX_DEPTH];
+static int scope_depth;
+static Uint32 frame;
+
+// Events from the mixer wait here until the main thread picks them up at
+// the end of a frame. If it falls behind, new ones are dropped.
+static struct trace_event audio_queue[TRACE_AUDIO_QUEUE_SIZE];
+static Uint32 audio_head;
+static Uint32 audio_tail;
+static Uint32 audio_dropped;
+
+static void add_event(const char *name, Uint64 start, Uint64 end,
+ enum trace_thread thread)
+{
+  struct trace_event *event = events + next_event;
+
+  event->name = name;
+  event->start = start;
+  event->duration = (Uint32)(end - start);
+  event->frame = frame;
+  event->thread = thread;
+
+  next_event++;
+  if(next_event == max_events)
+    next_event = 0;
+
+  if(num_events < max_events)
+    num_events++;
+}
+
+static void take_audio_events(void)
+{
+  Uint32 head = load_acquire(&audio_head);
+  struct trace_event *event;
+
+  while(audio_tail != head)
+  {
+    event = audio_queue + (audio_tail % TRACE_AUDIO_QUEUE_SIZE);
+    add_event(event->name, event->start, event->start + event->duration,
+     TRACE_AUDIO);
+    audio_tail++;
+  }
+
+  store_release(&audio_tail, audio_tail);
+}
+
+// Traces should be started before the audio is, as the mixer's queue
+// is reset here. A relative file name is kept relative to the current
+// directory, wherever worlds move to later.
+
+void trace_start(const char *file_name, int max)
+{
+  if((file_name[0] == '/') || (file_name[0] == '\\') ||
+   strchr(file_name, ':') || !getcwd(trace_file, MAX_PATH))
+  {
+    snprintf(trace_file, MAX_PATH, "%s", file_name);
+  }
+  else
+  {
+    size_t len = strlen(trace_file);
+    snprintf(trace_file + len, MAX_PATH - len, "%s%s",
+     DIR_SEPARATOR, file_name);
+  }
+
+  max_events = MAX(max, 1024);
+  events = cmalloc(max_events * sizeof(struct trace_event));
+  num_events = 0;
+  next_event = 0;
+  scope_depth = 0;
+  frame = 0;
+  audio_head = 0;
+  audio_tail = 0;
+  audio_dropped = 0;
+
+  trace_start_time = get_ticks_us();
+  tracing = true;
+}
+
+void trace_stop(void)
+{
+  tracing = false;
+  free(events);
+  events = NULL;
+}
+
+void __trace_begin(const char *name)
+{
+  // Anything nested deeper than this isn't recorded
+  if(scope_depth < TRACE_MAX_DEPTH)
+  {
+    scope_stack[scope_depth].name = name;
+    scope_stack[scope_depth].start = get_ticks_us();
+  }
+
+  scope_depth++;
+}
+
+void __trace_end(void)
+{
+  if(scope_depth == 0)
+    return;
+
+  scope_depth--;
+
+  if(scope_depth < TRACE_MAX_DEPTH)
+  {
+    add_event(scope_stack[scope_depth].name, scope_stack[scope_depth].start,
+     get_ticks_us(), TRACE_MAIN);
+  }
+
+  if(scope_depth == 0)
+  {
+    take_audio_events();
+    frame++;
+  }
+}
+
+void __trace_audio(const char *name, Uint64 start)
+{
+  Uint32 tail = load_acquire(&audio_tail);
+  struct trace_event *event;
+
+  if(audio_head - tail >= TRACE_AUDIO_QUEUE_SIZE)
+  {
+    audio_dropped++;
+    return;
+  }
+
+  event = audio_queue + (audio_head % TRACE_AUDIO_QUEUE_SIZE);
+  event->name = name;
+  event->start = start;
+  event->duration = (Uint32)(get_ticks_us() - start);
+
+  store_release(&audio_head, audio_head + 1);
+}
+
+static void write_thread_name(FILE *fp, enum trace_thread thread,
+ const char *name)
+{
+  fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+   "\"args\":{\"name\":\"%s\"}}", thread, name);
+}
+
+// Timestamps are in microseconds from the start of the trace. Events are
+// written in the order they ended, which the viewers don't mind.
+
+bool trace_save(void)
+{
+  struct trace_event *event;
+  Uint32 dropped;
+  int first;
+  int i;
+  FILE *fp;
+
+  if(!events)
+    return false;
+
+  fp = fopen_unsafe(trace_file, "wb");
+  if(!fp)
+  {
+    warn("Failed to open '%s' for the trace\n", trace_file);
+    return false;
+  }
+
+  take_audio_events();
+
+  // The oldest event is the next to be overwritten
+  first = (num_events == max_events) ? next_event : 0;
+
+  fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  write_thread_name(fp, TRACE_MAIN, "main");
+  fprintf(fp, ",\n");
+  write_thread_name(fp, TRACE_AUDIO, "audio");
+
+  for(i = 0; i < num_events; i++)
+  {
+    event = events + ((first + i) % max_events);
+
+    fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+     "\"ts\":%.0f,\"dur\":%u,\"args\":{\"frame\":%u}}", event->name,
+     event->thread, (double)(event->start - trace_start_time),
+     event->duration, event->frame);
+  }
+
+  fprintf(fp, "\n]}\n");
+  fclose(fp);
+
+  dropped = load_acquire(&audio_dropped);
+  if(dropped)
+    warn("%u audio events were dropped from the trace\n", dropped);
+
+  return true;
+}
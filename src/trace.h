@@ -0,0 +1,74 @@
+/* MegaZeux
+ *
+ * Copyright (C) 2026 MegaZeux contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// Traces record how long the named parts of each frame took, keeping the
+// most recent events in a ring buffer. They're saved in the Chrome trace
+// event format, which chrome://tracing and Perfetto can show as a timeline.
+//
+// Scopes on the main thread nest, and each outermost scope is one frame.
+// Scope names must be string constants, as only the pointers are kept.
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include "compat.h"
+
+__M_BEGIN_DECLS
+
+#include "platform.h"
+
+CORE_LIBSPEC extern bool tracing;
+
+CORE_LIBSPEC void trace_start(const char *file_name, int max_events);
+CORE_LIBSPEC void trace_stop(void);
+CORE_LIBSPEC bool trace_save(void);
+
+void __trace_begin(const char *name);
+void __trace_end(void);
+void __trace_audio(const char *name, Uint64 start);
+
+static inline void trace_begin(const char *name)
+{
+  if(tracing)
+    __trace_begin(name);
+}
+
+static inline void trace_end(void)
+{
+  if(tracing)
+    __trace_end();
+}
+
+// The audio mixer's thread can't use scopes; it takes the time it started
+// with trace_time and records the whole event when it's done.
+
+static inline Uint64 trace_time(void)
+{
+  return tracing ? get_ticks_us() : 0;
+}
+
+static inline void trace_audio(const char *name, Uint64 start)
+{
+  if(tracing && start)
+    __trace_audio(name, start);
+}
+
+__M_END_DECLS
+
+#endif // __TRACE_H
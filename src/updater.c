@@ -45,6 +45,7 @@
 #endif
 
 #define MAX_RETRIES   3
+#define MAX_PIPELINED 4
 
 #define OUTBOUND_PORT 80
 #define LINE_BUF_LEN  256
@@ -389,8 +390,8 @@ err_out:
 static void __check_for_updates(struct config_info *conf)
 {
   char **list_entries, buffer[LINE_BUF_LEN], *url_base, *value;
-  struct manifest_entry *removed, *replaced, *added, *e;
-  int i = 0, entries = 0, buf_len, result;
+  struct manifest_entry *removed, *replaced, *added, *e, *next_e;
+  int i = 0, entries = 0, buf_len, result, pending;
   char update_branch[LINE_BUF_LEN];
   const char *version = VERSION;
   int list_entry_width = 0;
@@ -682,36 +683,69 @@ static void __check_for_updates(struct config_info *conf)
     else
       replaced = added;
 
+    // The server may have closed the connection after the manifest
+    if(!host_keep_alive(h))
+    {
+      if(!reissue_connection(conf, &h, update_host))
+        goto err_free_delete_list;
+    }
+
     cancel_update = false;
     host_set_callbacks(h, NULL, recv_cb, cancel_cb);
 
+    /* Requests for the next few files are sent before the current one has
+     * been received (HTTP pipelining), so the server isn't left waiting for
+     * another round trip between each file. `e' is the file being received
+     * and `next_e' the next one to request.
+     */
     i = 1;
-    for(e = replaced; e; e = e->next, i++)
+    retries = 0;
+    pending = 0;
+    e = replaced;
+    next_e = replaced;
+    while(e)
     {
-      for(retries = 0; retries < MAX_RETRIES; retries++)
-      {
-        char name[72];
-        bool m_ret;
+      char name[72];
+      bool m_ret = false;
 
-        if(!check_create_basedir(e->name))
+      while(next_e && pending < MAX_PIPELINED)
+      {
+        if(!check_create_basedir(next_e->name))
           goto err_free_delete_list;
 
-        final_size = (long)e->size;
+        if(!manifest_entry_request(h, url_base, next_e))
+          break;
 
-        m_hide();
-        snprintf(name, 72, "%s (%ldb) [%u/%u]", e->name, final_size, i, entries);
-        meter(name, 0, final_size);
-        update_screen();
+        next_e = next_e->next;
+        pending++;
+      }
 
-        m_ret = manifest_entry_download_replace(h, url_base, e, delete_hook);
+      final_size = (long)e->size;
 
-        clear_screen(32, 7);
-        m_show();
-        update_screen();
+      m_hide();
+      snprintf(name, 72, "%s (%ldb) [%u/%u]", e->name, final_size, i, entries);
+      meter(name, 0, final_size);
+      update_screen();
 
-        if(m_ret)
-          break;
+      if(pending)
+        m_ret = manifest_entry_receive_replace(h, e, delete_hook);
 
+      clear_screen(32, 7);
+      m_show();
+      update_screen();
+
+      if(m_ret)
+      {
+        e = e->next;
+        pending--;
+        retries = 0;
+        i++;
+
+        if(!e || host_keep_alive(h))
+          continue;
+      }
+      else
+      {
         if(cancel_update)
         {
           error("Download was cancelled; update aborted.", 1, 8, 0);
@@ -719,19 +753,26 @@ static void __check_for_updates(struct config_info *conf)
           goto err_free_delete_list;
         }
 
-        if(!reissue_connection(conf, &h, update_host))
+        retries++;
+        if(retries == MAX_RETRIES)
+        {
+          snprintf(widget_buf, WIDGET_BUF_LEN,
+           "Failed to download \"%s\" (after %d attempts).", e->name, retries);
+          widget_buf[WIDGET_BUF_LEN - 1] = 0;
+          error(widget_buf, 1, 8, 0);
           goto err_free_delete_list;
-        host_set_callbacks(h, NULL, recv_cb, cancel_cb);
+        }
       }
 
-      if(retries == MAX_RETRIES)
-      {
-        snprintf(widget_buf, WIDGET_BUF_LEN,
-         "Failed to download \"%s\" (after %d attempts).", e->name, retries);
-        widget_buf[WIDGET_BUF_LEN - 1] = 0;
-        error(widget_buf, 1, 8, 0);
+      /* Any requests still outstanding were lost with the old connection,
+       * so they're sent again on the new one.
+       */
+      if(!reissue_connection(conf, &h, update_host))
         goto err_free_delete_list;
-      }
+      host_set_callbacks(h, NULL, recv_cb, cancel_cb);
+
+      next_e = e;
+      pending = 0;
     }
 
     if(delete_list)
@@ -247,23 +247,82 @@ long ftell_and_rewind(FILE *f)
   return size;
 }
 
+#ifdef X86_TARGETS
+
+#include <cpuid.h>
+
+bool cpu_has_avx2(void)
+{
+  static int has_avx2 = -1;
+  unsigned int eax, ebx, ecx, edx;
+
+  if(has_avx2 >= 0)
+    return has_avx2;
+
+  has_avx2 = 0;
+  if(__get_cpuid_max(0, NULL) < 7)
+    return false;
+
+  // AVX, and the OS saves the AVX registers (XCR0 bits 1 and 2)
+  __cpuid(1, eax, ebx, ecx, edx);
+  if(!(ecx & (1 << 27)) || !(ecx & (1 << 28)))
+    return false;
+
+  __asm__("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+  if((eax & 6) != 6)
+    return false;
+
+  // AVX2
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  has_avx2 = (ebx & (1 << 5)) != 0;
+  return has_avx2;
+}
+
+#endif // X86_TARGETS
+
+static unsigned long long random_seed = 0;
+
 // Random function, returns an integer [0-range)
 
 unsigned int Random(unsigned long long range)
 {
-  static unsigned long long seed = 0;
   unsigned long long value;
 
   // If the seed is 0, initialise it with time and clock
-  if(seed == 0)
-    seed = time(NULL) + clock();
+  if(random_seed == 0)
+    random_seed = time(NULL) + clock();
 
-  seed = seed * 1664525 + 1013904223;
+  random_seed = random_seed * 1664525 + 1013904223;
 
-  value = (seed & 0xFFFFFFFF) * range / 0xFFFFFFFF;
+  value = (random_seed & 0xFFFFFFFF) * range / 0xFFFFFFFF;
   return (unsigned int)value;
 }
 
+// Make Random give the same numbers every time; 0 goes back to using
+// the time and clock
+
+void set_random_seed(unsigned long long seed)
+{
+  random_seed = seed;
+}
+
+// FNV-1a hash of a name, ignoring case, for tables of names that are
+// compared with strcasecmp() (counters, strings and robot labels)
+
+unsigned int hash_name_nocase(const char *name)
+{
+  unsigned int hash = 2166136261u;
+
+  while(*name)
+  {
+    hash ^= (unsigned int)tolower((int)(unsigned char)*name);
+    hash *= 16777619u;
+    name++;
+  }
+
+  return hash;
+}
+
 __utils_maybe_static ssize_t __get_path(const char *file_name, char *dest,
  unsigned int buf_len)
 {
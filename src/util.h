@@ -83,6 +83,8 @@ CORE_LIBSPEC char *mzx_res_get_by_id(enum resource_id id);
 
 CORE_LIBSPEC long ftell_and_rewind(FILE *f);
 unsigned int Random(unsigned long long range);
+void set_random_seed(unsigned long long seed);
+unsigned int hash_name_nocase(const char *name);
 
 CORE_LIBSPEC ssize_t get_path(const char *file_name, char *dest, unsigned int buf_len);
 #ifdef CONFIG_UTILS
@@ -97,6 +99,15 @@ CORE_LIBSPEC int create_path_if_not_exists(const char *filename);
 
 CORE_LIBSPEC int change_dir_name(char *path_name, const char *dest, int buf_size);
 
+// Functions for newer x86 extensions can be built with a target attribute
+// and used if the CPU has them, so builds for older CPUs still work
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+ (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ >= 5)))
+#define X86_TARGETS
+CORE_LIBSPEC bool cpu_has_avx2(void);
+#endif
+
 typedef void (*fn_ptr)(void);
 
 struct dso_syms_map
@@ -48,6 +48,7 @@
 #include "game.h"
 #include "audio.h"
 #include "extmem.h"
+#include "memfile.h"
 #include "util.h"
 #include "validation.h"
 
@@ -364,6 +365,161 @@ int world_magic(const char magic_string[3])
   return 0;
 }
 
+__editor_maybe_static void set_update_done(struct world *mzx_world);
+
+// With lazy_board_loading on, load_world only reads the names and file
+// locations of the boards, and each board is read in the first time it's
+// needed. Boards that haven't been played on are dropped again, least
+// recently used first, while the loaded boards take up more than
+// lazy_board_memory.
+
+static void read_board(struct world *mzx_world, struct board *cur_board)
+{
+  load_lazy_board(cur_board, mzx_world->board_file,
+   mzx_world->board_file_savegame, mzx_world->board_file_version);
+
+  if(cur_board->robot_list)
+    cur_board->robot_list[0] = &mzx_world->global_robot;
+
+  optimize_null_objects(cur_board);
+  store_board_to_extram(cur_board);
+
+  cur_board->clean = true;
+  set_update_done(mzx_world);
+}
+
+static size_t board_memory(struct board *cur_board)
+{
+  size_t size = cur_board->board_width * cur_board->board_height;
+  struct robot *cur_robot;
+  int i;
+
+  size *= cur_board->overlay_mode ? 8 : 6;
+
+  for(i = 1; i <= cur_board->num_robots; i++)
+  {
+    cur_robot = cur_board->robot_list[i];
+    if(cur_robot)
+    {
+      size += sizeof(struct robot) + cur_robot->stack_size * sizeof(int);
+#ifdef CONFIG_DEBYTECODE
+      size += cur_robot->program_source_length;
+#endif
+      size += cur_robot->program_bytecode_length;
+    }
+  }
+
+  return size;
+}
+
+static void evict_clean_boards(struct world *mzx_world, struct board *keep)
+{
+  size_t limit = (size_t)mzx_world->conf.lazy_board_memory * 1024;
+  size_t total = 0;
+  struct board *cur_board;
+  struct board *oldest;
+  int i;
+
+  // Nothing can be read back in once the world file is closed
+  if(!mzx_world->board_file)
+    return;
+
+  for(i = 0; i < mzx_world->num_boards; i++)
+  {
+    cur_board = mzx_world->board_list[i];
+    if(cur_board && cur_board->loaded)
+      total += board_memory(cur_board);
+  }
+
+  while(total > limit)
+  {
+    oldest = NULL;
+
+    for(i = 0; i < mzx_world->num_boards; i++)
+    {
+      cur_board = mzx_world->board_list[i];
+      if(cur_board && cur_board->loaded && cur_board->clean &&
+       (cur_board != mzx_world->current_board) && (cur_board != keep) &&
+       (!oldest || (cur_board->last_used < oldest->last_used)))
+        oldest = cur_board;
+    }
+
+    if(!oldest)
+      break;
+
+    total -= board_memory(oldest);
+    retrieve_board_from_extram(oldest);
+    unload_board(oldest);
+  }
+}
+
+// Get a board that's about to be used, reading it in first if necessary.
+// Only playing on a board changes it (see update), so this leaves it clean.
+struct board *get_board(struct world *mzx_world, int board_id)
+{
+  struct board *cur_board = mzx_world->board_list[board_id];
+
+  if(cur_board)
+  {
+    cur_board->last_used = ++mzx_world->board_use_count;
+
+    if(!cur_board->loaded)
+    {
+      read_board(mzx_world, cur_board);
+      evict_clean_boards(mzx_world, cur_board);
+    }
+  }
+
+  return cur_board;
+}
+
+// Read in every board that hasn't been yet and let go of the world file.
+void load_all_boards(struct world *mzx_world)
+{
+  struct board *cur_board;
+  int i;
+
+  if(!mzx_world->board_file)
+    return;
+
+  for(i = 0; i < mzx_world->num_boards; i++)
+  {
+    cur_board = mzx_world->board_list[i];
+    if(cur_board && !cur_board->loaded)
+      read_board(mzx_world, cur_board);
+  }
+
+  fclose(mzx_world->board_file);
+  mzx_world->board_file = NULL;
+}
+
+static bool same_file(const char *file_a, const char *file_b)
+{
+#ifdef __WIN32__
+  // Windows doesn't fill in st_ino, so compare the full paths instead
+  char full_a[MAX_PATH];
+  char full_b[MAX_PATH];
+
+  if(!_fullpath(full_a, file_a, MAX_PATH) ||
+   !_fullpath(full_b, file_b, MAX_PATH))
+    return false;
+
+  return !strcasecmp(full_a, full_b);
+#else
+  struct stat stat_a, stat_b;
+
+  if(stat(file_a, &stat_a) || stat(file_b, &stat_b))
+    return false;
+
+  // Some filesystems don't have inodes and leave them all 0. All that's
+  // left to go on there is the names.
+  if(!stat_a.st_ino || !stat_b.st_ino)
+    return !strcasecmp(file_a, file_b);
+
+  return (stat_a.st_dev == stat_b.st_dev) && (stat_a.st_ino == stat_b.st_ino);
+#endif
+}
+
 int save_world(struct world *mzx_world, const char *file, int savegame)
 {
   int i, num_boards;
@@ -374,6 +530,7 @@ int save_world(struct world *mzx_world, const char *file, int savegame)
   unsigned char *charset_mem;
   unsigned char r, g, b;
   struct board *cur_board;
+  struct memfile mf;
   FILE *fp;
 
   int meter_target = 2 + mzx_world->num_boards, meter_curr = 0;
@@ -402,6 +559,10 @@ int save_world(struct world *mzx_world, const char *file, int savegame)
   }
 #endif
 
+  // The world file can't be read from once it's been overwritten
+  if(mzx_world->board_file && same_file(mzx_world->board_file_name, file))
+    load_all_boards(mzx_world);
+
   fp = fopen_unsafe(file, "wb");
   if(!fp)
   {
@@ -409,48 +570,51 @@ int save_world(struct world *mzx_world, const char *file, int savegame)
     return -1;
   }
 
+  // The world is put together in memory and written out at the end
+  mfopen_write(&mf, 0);
+
   meter_initial_draw(meter_curr, meter_target, "Saving...");
 
   if(savegame)
   {
     // Write this MZX's version string
-    fputs("MZS", fp);
-    fputc((WORLD_VERSION >> 8) & 0xff, fp);
-    fputc(WORLD_VERSION & 0xff, fp);
+    mfwrite("MZS", 3, 1, &mf);
+    mfputc((WORLD_VERSION >> 8) & 0xff, &mf);
+    mfputc(WORLD_VERSION & 0xff, &mf);
 
     // Write the version of the loaded world for this SAV
-    fputw(mzx_world->version, fp);
+    mfputw(mzx_world->version, &mf);
 
-    fputc(mzx_world->current_board_id, fp);
+    mfputc(mzx_world->current_board_id, &mf);
   }
   else
   {
-    fwrite(mzx_world->name, BOARD_NAME_SIZE, 1, fp);
+    mfwrite(mzx_world->name, BOARD_NAME_SIZE, 1, &mf);
 
     // No protection
-    fputc(0, fp);
+    mfputc(0, &mf);
 
     // Write this MZX's version string
-    fputc('M', fp);
-    fputc((WORLD_VERSION >> 8) & 0xff, fp);
-    fputc(WORLD_VERSION & 0xff, fp);
+    mfputc('M', &mf);
+    mfputc((WORLD_VERSION >> 8) & 0xff, &mf);
+    mfputc(WORLD_VERSION & 0xff, &mf);
   }
 
   // Save charset
   charset_mem = cmalloc(3584);
   ec_mem_save_set(charset_mem);
-  fwrite(charset_mem, 3584, 1, fp);
+  mfwrite(charset_mem, 3584, 1, &mf);
   free(charset_mem);
 
   // Save idchars array.
-  fwrite(id_chars, 323, 1, fp);
-  fputc(missile_color, fp);
-  fwrite(bullet_color, 3, 1, fp);
-  fwrite(id_dmg, 128, 1, fp);
+  mfwrite(id_chars, 323, 1, &mf);
+  mfputc(missile_color, &mf);
+  mfwrite(bullet_color, 3, 1, &mf);
+  mfwrite(id_dmg, 128, 1, &mf);
 
   // Save status counters.
-  fwrite((char *)mzx_world->status_counters_shown, COUNTER_NAME_SIZE,
-   NUM_STATUS_COUNTERS, fp);
+  mfwrite((char *)mzx_world->status_counters_shown, COUNTER_NAME_SIZE,
+   NUM_STATUS_COUNTERS, &mf);
 
   /* Older MZX sources refer to SAVE_INDIVIDUAL, but it has always been
    * defined. Exo eventually removed the conditional code in 2.80.
@@ -459,67 +623,67 @@ int save_world(struct world *mzx_world, const char *file, int savegame)
 
   if(savegame)
   {
-    fwrite(mzx_world->keys, NUM_KEYS, 1, fp);
-    fputc(mzx_world->blind_dur, fp);
-    fputc(mzx_world->firewalker_dur, fp);
-    fputc(mzx_world->freeze_time_dur, fp);
-    fputc(mzx_world->slow_time_dur, fp);
-    fputc(mzx_world->wind_dur, fp);
+    mfwrite(mzx_world->keys, NUM_KEYS, 1, &mf);
+    mfputc(mzx_world->blind_dur, &mf);
+    mfputc(mzx_world->firewalker_dur, &mf);
+    mfputc(mzx_world->freeze_time_dur, &mf);
+    mfputc(mzx_world->slow_time_dur, &mf);
+    mfputc(mzx_world->wind_dur, &mf);
 
     for(i = 0; i < 8; i++)
     {
-      fputw(mzx_world->pl_saved_x[i], fp);
+      mfputw(mzx_world->pl_saved_x[i], &mf);
     }
 
     for(i = 0; i < 8; i++)
     {
-      fputw(mzx_world->pl_saved_y[i], fp);
+      mfputw(mzx_world->pl_saved_y[i], &mf);
     }
 
-    fwrite(mzx_world->pl_saved_board, 8, 1, fp);
-    fputc(mzx_world->saved_pl_color, fp);
-    fputc(mzx_world->under_player_id, fp);
-    fputc(mzx_world->under_player_color, fp);
-    fputc(mzx_world->under_player_param, fp);
-    fputc(mzx_world->mesg_edges, fp);
-    fputc(mzx_world->scroll_base_color, fp);
-    fputc(mzx_world->scroll_corner_color, fp);
-    fputc(mzx_world->scroll_pointer_color, fp);
-    fputc(mzx_world->scroll_title_color, fp);
-    fputc(mzx_world->scroll_arrow_color, fp);
+    mfwrite(mzx_world->pl_saved_board, 8, 1, &mf);
+    mfputc(mzx_world->saved_pl_color, &mf);
+    mfputc(mzx_world->under_player_id, &mf);
+    mfputc(mzx_world->under_player_color, &mf);
+    mfputc(mzx_world->under_player_param, &mf);
+    mfputc(mzx_world->mesg_edges, &mf);
+    mfputc(mzx_world->scroll_base_color, &mf);
+    mfputc(mzx_world->scroll_corner_color, &mf);
+    mfputc(mzx_world->scroll_pointer_color, &mf);
+    mfputc(mzx_world->scroll_title_color, &mf);
+    mfputc(mzx_world->scroll_arrow_color, &mf);
 
     {
       size_t len = strlen(mzx_world->real_mod_playing);
-      fputw((int)len, fp);
+      mfputw((int)len, &mf);
       if(len)
-        fwrite(mzx_world->real_mod_playing, len, 1, fp);
+        mfwrite(mzx_world->real_mod_playing, len, 1, &mf);
     }
   }
 
-  fputc(mzx_world->edge_color, fp);
-  fputc(mzx_world->first_board, fp);
-  fputc(mzx_world->endgame_board, fp);
-  fputc(mzx_world->death_board, fp);
-  fputw(mzx_world->endgame_x, fp);
-  fputw(mzx_world->endgame_y, fp);
-  fputc(mzx_world->game_over_sfx, fp);
-  fputw(mzx_world->death_x, fp);
-  fputw(mzx_world->death_y, fp);
-  fputw(mzx_world->starting_lives, fp);
-  fputw(mzx_world->lives_limit, fp);
-  fputw(mzx_world->starting_health, fp);
-  fputw(mzx_world->health_limit, fp);
-  fputc(mzx_world->enemy_hurt_enemy, fp);
-  fputc(mzx_world->clear_on_exit, fp);
-  fputc(mzx_world->only_from_swap, fp);
+  mfputc(mzx_world->edge_color, &mf);
+  mfputc(mzx_world->first_board, &mf);
+  mfputc(mzx_world->endgame_board, &mf);
+  mfputc(mzx_world->death_board, &mf);
+  mfputw(mzx_world->endgame_x, &mf);
+  mfputw(mzx_world->endgame_y, &mf);
+  mfputc(mzx_world->game_over_sfx, &mf);
+  mfputw(mzx_world->death_x, &mf);
+  mfputw(mzx_world->death_y, &mf);
+  mfputw(mzx_world->starting_lives, &mf);
+  mfputw(mzx_world->lives_limit, &mf);
+  mfputw(mzx_world->starting_health, &mf);
+  mfputw(mzx_world->health_limit, &mf);
+  mfputc(mzx_world->enemy_hurt_enemy, &mf);
+  mfputc(mzx_world->clear_on_exit, &mf);
+  mfputc(mzx_world->only_from_swap, &mf);
 
   // Palette...
   for(i = 0; i < 16; i++)
   {
     get_rgb(i, &r, &g, &b);
-    fputc(r, fp);
-    fputc(g, fp);
-    fputc(b, fp);
+    mfputc(r, &mf);
+    mfputc(g, &mf);
+    mfputc(b, &mf);
   }
 
   if(savegame)
@@ -528,111 +692,113 @@ int save_world(struct world *mzx_world, const char *file, int savegame)
 
     for(i = 0; i < 16; i++)
     {
-      fputc(get_color_intensity(i), fp);
+      mfputc(get_color_intensity(i), &mf);
     }
-    fputc(get_fade_status(), fp);
+    mfputc(get_fade_status(), &mf);
 
-    fputw(mzx_world->player_restart_x, fp);
-    fputw(mzx_world->player_restart_y, fp);
-    fputc(mzx_world->under_player_id, fp);
-    fputc(mzx_world->under_player_color, fp);
-    fputc(mzx_world->under_player_param, fp);
+    mfputw(mzx_world->player_restart_x, &mf);
+    mfputw(mzx_world->player_restart_y, &mf);
+    mfputc(mzx_world->under_player_id, &mf);
+    mfputc(mzx_world->under_player_color, &mf);
+    mfputc(mzx_world->under_player_param, &mf);
 
     // Write counters
-    fputd(mzx_world->num_counters, fp);
+    sort_counter_list(mzx_world);
+    mfputd(mzx_world->num_counters, &mf);
     for(i = 0; i < mzx_world->num_counters; i++)
     {
-      save_counter(fp, mzx_world->counter_list[i]);
+      save_counter(&mf, mzx_world->counter_list[i]);
     }
 
     // Write strings
-    fputd(mzx_world->num_strings, fp);
+    sort_string_list(mzx_world);
+    mfputd(mzx_world->num_strings, &mf);
 
     for(i = 0; i < mzx_world->num_strings; i++)
     {
-      save_string(fp, mzx_world->string_list[i]);
+      save_string(&mf, mzx_world->string_list[i]);
     }
 
     // Sprite data
     for(i = 0; i < MAX_SPRITES; i++)
     {
-      fputw((mzx_world->sprite_list[i])->x, fp);
-      fputw((mzx_world->sprite_list[i])->y, fp);
-      fputw((mzx_world->sprite_list[i])->ref_x, fp);
-      fputw((mzx_world->sprite_list[i])->ref_y, fp);
-      fputc((mzx_world->sprite_list[i])->color, fp);
-      fputc((mzx_world->sprite_list[i])->flags, fp);
-      fputc((mzx_world->sprite_list[i])->width, fp);
-      fputc((mzx_world->sprite_list[i])->height, fp);
-      fputc((mzx_world->sprite_list[i])->col_x, fp);
-      fputc((mzx_world->sprite_list[i])->col_y, fp);
-      fputc((mzx_world->sprite_list[i])->col_width, fp);
-      fputc((mzx_world->sprite_list[i])->col_height, fp);
+      mfputw((mzx_world->sprite_list[i])->x, &mf);
+      mfputw((mzx_world->sprite_list[i])->y, &mf);
+      mfputw((mzx_world->sprite_list[i])->ref_x, &mf);
+      mfputw((mzx_world->sprite_list[i])->ref_y, &mf);
+      mfputc((mzx_world->sprite_list[i])->color, &mf);
+      mfputc((mzx_world->sprite_list[i])->flags, &mf);
+      mfputc((mzx_world->sprite_list[i])->width, &mf);
+      mfputc((mzx_world->sprite_list[i])->height, &mf);
+      mfputc((mzx_world->sprite_list[i])->col_x, &mf);
+      mfputc((mzx_world->sprite_list[i])->col_y, &mf);
+      mfputc((mzx_world->sprite_list[i])->col_width, &mf);
+      mfputc((mzx_world->sprite_list[i])->col_height, &mf);
     }
     // total sprites
-    fputc(mzx_world->active_sprites, fp);
+    mfputc(mzx_world->active_sprites, &mf);
     // y order flag
-    fputc(mzx_world->sprite_y_order, fp);
+    mfputc(mzx_world->sprite_y_order, &mf);
     // collision info
-    fputw(mzx_world->collision_count, fp);
+    mfputw(mzx_world->collision_count, &mf);
 
     for(i = 0; i < MAX_SPRITES; i++)
     {
-      fputw(mzx_world->collision_list[i], fp);
+      mfputw(mzx_world->collision_list[i], &mf);
     }
 
     // Multiplier
-    fputw(mzx_world->multiplier, fp);
+    mfputw(mzx_world->multiplier, &mf);
     // Divider
-    fputw(mzx_world->divider, fp);
+    mfputw(mzx_world->divider, &mf);
     // Circle divisions
-    fputw(mzx_world->c_divisions, fp);
+    mfputw(mzx_world->c_divisions, &mf);
     // String FREAD and FWRITE Delimiters
-    fputw(mzx_world->fread_delimiter, fp);
-    fputw(mzx_world->fwrite_delimiter, fp);
+    mfputw(mzx_world->fread_delimiter, &mf);
+    mfputw(mzx_world->fwrite_delimiter, &mf);
     // Builtin shooting/message status
-    fputc(mzx_world->bi_shoot_status, fp);
-    fputc(mzx_world->bi_mesg_status, fp);
+    mfputc(mzx_world->bi_shoot_status, &mf);
+    mfputc(mzx_world->bi_mesg_status, &mf);
 
     // Write input file name and if open, position
     {
       size_t len = strlen(mzx_world->input_file_name);
-      fputw((int)len, fp);
+      mfputw((int)len, &mf);
       if(len)
-        fwrite(mzx_world->input_file_name, len, 1, fp);
+        mfwrite(mzx_world->input_file_name, len, 1, &mf);
     }
 
     if(!mzx_world->input_is_dir && mzx_world->input_file)
     {
-      fputd(ftell(mzx_world->input_file), fp);
+      mfputd(ftell(mzx_world->input_file), &mf);
     }
     else if(mzx_world->input_is_dir)
     {
-      fputd(dir_tell(&mzx_world->input_directory), fp);
+      mfputd(dir_tell(&mzx_world->input_directory), &mf);
     }
     else
     {
-      fputd(0, fp);
+      mfputd(0, &mf);
     }
 
     // Write output file name and if open, position
     {
       size_t len = strlen(mzx_world->output_file_name);
-      fputw((int)len, fp);
+      mfputw((int)len, &mf);
       if(len)
-        fwrite(mzx_world->output_file_name, len, 1, fp);
+        mfwrite(mzx_world->output_file_name, len, 1, &mf);
     }
 
     if(mzx_world->output_file)
     {
-      fputd(ftell(mzx_world->output_file), fp);
+      mfputd(ftell(mzx_world->output_file), &mf);
     }
     else
     {
-      fputd(0, fp);
+      mfputd(0, &mf);
     }
 
-    fputw(get_screen_mode(), fp);
+    mfputw(get_screen_mode(), &mf);
 
     if(get_screen_mode() > 1)
     {
@@ -640,27 +806,27 @@ int save_world(struct world *mzx_world, const char *file, int savegame)
       for(i = 0; i < 256; i++)
       {
         get_rgb(i, &r, &g, &b);
-        fputc(r, fp);
-        fputc(g, fp);
-        fputc(b, fp);
+        mfputc(r, &mf);
+        mfputc(g, &mf);
+        mfputc(b, &mf);
       }
     }
 
-    fputd(mzx_world->commands, fp);
+    mfputd(mzx_world->commands, &mf);
 
     vlayer_size = mzx_world->vlayer_size;
-    fputd(vlayer_size, fp);
-    fputw(mzx_world->vlayer_width, fp);
-    fputw(mzx_world->vlayer_height, fp);
+    mfputd(vlayer_size, &mf);
+    mfputw(mzx_world->vlayer_width, &mf);
+    mfputw(mzx_world->vlayer_height, &mf);
 
-    fwrite(mzx_world->vlayer_chars, 1, vlayer_size, fp);
-    fwrite(mzx_world->vlayer_colors, 1, vlayer_size, fp);
+    mfwrite(mzx_world->vlayer_chars, 1, vlayer_size, &mf);
+    mfwrite(mzx_world->vlayer_colors, 1, vlayer_size, &mf);
   }
 
   // Put position of global robot later
-  gl_rob_save_position = ftell(fp);
+  gl_rob_save_position = mftell(&mf);
   // Put some 0's
-  fputd(0, fp);
+  mfputd(0, &mf);
 
   // Put custom fx?
   if(mzx_world->custom_sfx_on == 1)
@@ -668,32 +834,32 @@ int save_world(struct world *mzx_world, const char *file, int savegame)
     int offset = 0;
     size_t sfx_len;
     int length_slot_pos, next_pos, total_len;
-    fputc(0, fp);
-    length_slot_pos = ftell(fp);
-    fputw(0, fp);
+    mfputc(0, &mf);
+    length_slot_pos = mftell(&mf);
+    mfputw(0, &mf);
     for(i = 0; i < NUM_SFX; i++, offset += 69)
     {
       sfx_len = strlen(mzx_world->custom_sfx + offset);
-      fputc((int)sfx_len, fp);
-      fwrite(mzx_world->custom_sfx + offset, sfx_len, 1, fp);
+      mfputc((int)sfx_len, &mf);
+      mfwrite(mzx_world->custom_sfx + offset, sfx_len, 1, &mf);
     }
     // Get size of the block
-    next_pos = ftell(fp);
+    next_pos = mftell(&mf);
     total_len = (next_pos - length_slot_pos) - 2;
-    fseek(fp, length_slot_pos, SEEK_SET);
-    fputw(total_len, fp);
-    fseek(fp, next_pos, SEEK_SET);
+    mfseek(&mf, length_slot_pos, SEEK_SET);
+    mfputw(total_len, &mf);
+    mfseek(&mf, next_pos, SEEK_SET);
   }
 
   meter_update_screen(&meter_curr, meter_target);
 
   num_boards = mzx_world->num_boards;
-  fputc(num_boards, fp);
+  mfputc(num_boards, &mf);
 
   // Put the names
   for(i = 0; i < num_boards; i++)
   {
-    fwrite((mzx_world->board_list[i])->board_name, 25, 1, fp);
+    mfwrite((mzx_world->board_list[i])->board_name, 25, 1, &mf);
   }
 
   /* Due to some bugs in the NDS's libfat library, seeking backwards
@@ -702,49 +868,58 @@ int save_world(struct world *mzx_world, const char *file, int savegame)
    * we can rewrite the size/offset list with less seeking later.
    */
   size_offset_list = cmalloc(8 * num_boards);
-  board_offsets_position = ftell(fp);
-  fseek(fp, 8 * num_boards, SEEK_CUR);
+  board_offsets_position = mftell(&mf);
+  mfseek(&mf, 8 * num_boards, SEEK_CUR);
 
   for(i = 0; i < num_boards; i++)
   {
     cur_board = mzx_world->board_list[i];
 
+    if(!cur_board->loaded)
+      read_board(mzx_world, cur_board);
+
     // Before messing with the board, make sure the board is
     // rid of any gaps in the object lists...
     optimize_null_objects(cur_board);
 
     // First save the offset of where the board will be placed
-    board_begin_position = ftell(fp);
+    board_begin_position = mftell(&mf);
     // Now save the board and get the size
-    board_size = save_board(cur_board, fp, savegame, WORLD_VERSION);
+    board_size = save_board(cur_board, &mf, savegame, WORLD_VERSION);
     // board_end_position, unused
-    ftell(fp);
+    mftell(&mf);
     // Record size/offset information.
     size_offset_list[2 * i] = board_size;
     size_offset_list[2 * i + 1] = board_begin_position;
 
+    if(cur_board->clean)
+      evict_clean_boards(mzx_world, NULL);
+
     meter_update_screen(&meter_curr, meter_target);
   }
 
   // Save for global robot position
-  gl_rob_position = ftell(fp);
-  save_robot(&mzx_world->global_robot, fp, savegame, WORLD_VERSION);
+  gl_rob_position = mftell(&mf);
+  save_robot(&mzx_world->global_robot, &mf, savegame, WORLD_VERSION);
 
   meter_update_screen(&meter_curr, meter_target);
 
   // Go back to where the global robot position should be saved
-  fseek(fp, gl_rob_save_position, SEEK_SET);
-  fputd(gl_rob_position, fp);
+  mfseek(&mf, gl_rob_save_position, SEEK_SET);
+  mfputd(gl_rob_position, &mf);
 
   // Go back to offsets/size list
-  fseek(fp, board_offsets_position, SEEK_SET);
+  mfseek(&mf, board_offsets_position, SEEK_SET);
   for(i = 0; i < num_boards; i++)
   {
-    fputd(size_offset_list[2 * i  ], fp);
-    fputd(size_offset_list[2 * i + 1], fp);
+    mfputd(size_offset_list[2 * i  ], &mf);
+    mfputd(size_offset_list[2 * i + 1], &mf);
   }
   free(size_offset_list);
 
+  mfsave(&mf, fp);
+  mfclose(&mf);
+
   meter_restore_screen();
 
 #ifdef CONFIG_DEBYTECODE
@@ -908,6 +1083,7 @@ __editor_maybe_static void optimize_null_boards(struct world *mzx_world)
             level_param[offset] = NO_BOARD;
         }
       }
+      mark_board_changed(cur_board);
 
       // Fix exits
       for(i3 = 0; i3 < 4; i3++)
@@ -1055,10 +1231,12 @@ static void load_world(struct world *mzx_world, FILE *fp, const char *file,
 {
   int i;
   int num_boards;
-  int gl_rob, last_pos;
+  int gl_rob, last_pos, board_pos;
   unsigned char *charset_mem;
   unsigned char r, g, b;
   struct board *cur_board;
+  struct memfile mf;
+  bool lazy;
   char *config_file_name;
   size_t file_name_len = strlen(file) - 4;
   struct stat file_info;
@@ -1067,10 +1245,12 @@ static void load_world(struct world *mzx_world, FILE *fp, const char *file,
 
   int meter_target = 2, meter_curr = 0;
 
+  mfopen_file(&mf, fp);
+
   if(savegame)
   {
-    mzx_world->version = fgetw(fp);
-    mzx_world->current_board_id = fgetc(fp);
+    mzx_world->version = mfgetw(&mf);
+    mzx_world->current_board_id = mfgetc(&mf);
   }
   else
   {
@@ -1108,84 +1288,84 @@ static void load_world(struct world *mzx_world, FILE *fp, const char *file,
   free(file_path);
 
   charset_mem = cmalloc(3584);
-  fread(charset_mem, 3584, 1, fp);
+  mfread(charset_mem, 3584, 1, &mf);
   ec_mem_load_set(charset_mem);
   free(charset_mem);
 
   // Idchars array...
-  fread(id_chars, 323, 1, fp);
-  missile_color = fgetc(fp);
-  fread(bullet_color, 3, 1, fp);
-  fread(id_dmg, 128, 1, fp);
+  mfread(id_chars, 323, 1, &mf);
+  missile_color = mfgetc(&mf);
+  mfread(bullet_color, 3, 1, &mf);
+  mfread(id_dmg, 128, 1, &mf);
 
   // Status counters...
-  fread((char *)mzx_world->status_counters_shown, COUNTER_NAME_SIZE,
-   NUM_STATUS_COUNTERS, fp);
+  mfread((char *)mzx_world->status_counters_shown, COUNTER_NAME_SIZE,
+   NUM_STATUS_COUNTERS, &mf);
 
   if(savegame)
   {
-    fread(mzx_world->keys, NUM_KEYS, 1, fp);
-    mzx_world->blind_dur = fgetc(fp);
-    mzx_world->firewalker_dur = fgetc(fp);
-    mzx_world->freeze_time_dur = fgetc(fp);
-    mzx_world->slow_time_dur = fgetc(fp);
-    mzx_world->wind_dur = fgetc(fp);
+    mfread(mzx_world->keys, NUM_KEYS, 1, &mf);
+    mzx_world->blind_dur = mfgetc(&mf);
+    mzx_world->firewalker_dur = mfgetc(&mf);
+    mzx_world->freeze_time_dur = mfgetc(&mf);
+    mzx_world->slow_time_dur = mfgetc(&mf);
+    mzx_world->wind_dur = mfgetc(&mf);
 
     for(i = 0; i < 8; i++)
     {
-      mzx_world->pl_saved_x[i] = fgetw(fp);
+      mzx_world->pl_saved_x[i] = mfgetw(&mf);
     }
 
     for(i = 0; i < 8; i++)
     {
-      mzx_world->pl_saved_y[i] = fgetw(fp);
+      mzx_world->pl_saved_y[i] = mfgetw(&mf);
     }
 
-    fread(mzx_world->pl_saved_board, 8, 1, fp);
-    mzx_world->saved_pl_color = fgetc(fp);
-    mzx_world->under_player_id = fgetc(fp);
-    mzx_world->under_player_color = fgetc(fp);
-    mzx_world->under_player_param = fgetc(fp);
-    mzx_world->mesg_edges = fgetc(fp);
-    mzx_world->scroll_base_color = fgetc(fp);
-    mzx_world->scroll_corner_color = fgetc(fp);
-    mzx_world->scroll_pointer_color = fgetc(fp);
-    mzx_world->scroll_title_color = fgetc(fp);
-    mzx_world->scroll_arrow_color = fgetc(fp);
+    mfread(mzx_world->pl_saved_board, 8, 1, &mf);
+    mzx_world->saved_pl_color = mfgetc(&mf);
+    mzx_world->under_player_id = mfgetc(&mf);
+    mzx_world->under_player_color = mfgetc(&mf);
+    mzx_world->under_player_param = mfgetc(&mf);
+    mzx_world->mesg_edges = mfgetc(&mf);
+    mzx_world->scroll_base_color = mfgetc(&mf);
+    mzx_world->scroll_corner_color = mfgetc(&mf);
+    mzx_world->scroll_pointer_color = mfgetc(&mf);
+    mzx_world->scroll_title_color = mfgetc(&mf);
+    mzx_world->scroll_arrow_color = mfgetc(&mf);
 
     {
-      size_t len = fgetw(fp);
+      size_t len = mfgetw(&mf);
       if(len >= MAX_PATH)
         len = MAX_PATH - 1;
 
-      fread(mzx_world->real_mod_playing, len, 1, fp);
+      mfread(mzx_world->real_mod_playing, len, 1, &mf);
       mzx_world->real_mod_playing[len] = 0;
     }
   }
 
-  mzx_world->edge_color = fgetc(fp);
-  mzx_world->first_board = fgetc(fp);
-  mzx_world->endgame_board = fgetc(fp);
-  mzx_world->death_board = fgetc(fp);
-  mzx_world->endgame_x = fgetw(fp);
-  mzx_world->endgame_y = fgetw(fp);
-  mzx_world->game_over_sfx = fgetc(fp);
-  mzx_world->death_x = fgetw(fp);
-  mzx_world->death_y = fgetw(fp);
-  mzx_world->starting_lives = fgetw(fp);
-  mzx_world->lives_limit = fgetw(fp);
-  mzx_world->starting_health = fgetw(fp);
-  mzx_world->health_limit = fgetw(fp);
-  mzx_world->enemy_hurt_enemy = fgetc(fp);
-  mzx_world->clear_on_exit = fgetc(fp);
-  mzx_world->only_from_swap = fgetc(fp);
+  mzx_world->edge_color = mfgetc(&mf);
+  mzx_world->first_board = mfgetc(&mf);
+  mzx_world->endgame_board = mfgetc(&mf);
+  mzx_world->death_board = mfgetc(&mf);
+  mzx_world->endgame_x = mfgetw(&mf);
+  mzx_world->endgame_y = mfgetw(&mf);
+  mzx_world->game_over_sfx = mfgetc(&mf);
+  mzx_world->death_x = mfgetw(&mf);
+  mzx_world->death_y = mfgetw(&mf);
+  mzx_world->starting_lives = mfgetw(&mf);
+  mzx_world->lives_limit = mfgetw(&mf);
+  mzx_world->starting_health = mfgetw(&mf);
+  mzx_world->health_limit = mfgetw(&mf);
+  mzx_world->enemy_hurt_enemy = mfgetc(&mf);
+  mzx_world->clear_on_exit = mfgetc(&mf);
+  mzx_world->only_from_swap = mfgetc(&mf);
 
   // Palette...
   for(i = 0; i < 16; i++)
   {
-    r = fgetc(fp);
-    g = fgetc(fp);
-    b = fgetc(fp);
+    r = mfgetc(&mf);
+    g = mfgetc(&mf);
+    b = mfgetc(&mf);
 
     set_rgb(i, r, g, b);
   }
@@ -1198,42 +1378,46 @@ static void load_world(struct world *mzx_world, FILE *fp, const char *file,
 
     for(i = 0; i < 16; i++)
     {
-      set_color_intensity(i, fgetc(fp));
+      set_color_intensity(i, mfgetc(&mf));
     }
 
-    *faded = fgetc(fp);
+    *faded = mfgetc(&mf);
 
-    mzx_world->player_restart_x = fgetw(fp);
-    mzx_world->player_restart_y = fgetw(fp);
-    mzx_world->under_player_id = fgetc(fp);
-    mzx_world->under_player_color = fgetc(fp);
-    mzx_world->under_player_param = fgetc(fp);
+    mzx_world->player_restart_x = mfgetw(&mf);
+    mzx_world->player_restart_y = mfgetw(&mf);
+    mzx_world->under_player_id = mfgetc(&mf);
+    mzx_world->under_player_color = mfgetc(&mf);
+    mzx_world->under_player_param = mfgetc(&mf);
 
     // Read counters
-    num_counters = fgetd(fp);
+    num_counters = mfgetd(&mf);
     mzx_world->num_counters = num_counters;
     mzx_world->num_counters_allocated = num_counters;
     mzx_world->counter_list = ccalloc(num_counters, sizeof(struct counter *));
 
     for(i = 0; i < num_counters; i++)
     {
-      mzx_world->counter_list[i] = load_counter(fp);
+      mzx_world->counter_list[i] = load_counter(&mf);
     }
 
+    rehash_counter_list(mzx_world);
+
     // Setup gateway functions
     initialize_gateway_functions(mzx_world);
 
     // Read strings
-    num_strings = fgetd(fp);
+    num_strings = mfgetd(&mf);
     mzx_world->num_strings = num_strings;
     mzx_world->num_strings_allocated = num_strings;
     mzx_world->string_list = ccalloc(num_strings, sizeof(struct string *));
 
     for(i = 0; i < num_strings; i++)
     {
-      mzx_world->string_list[i] = load_string(fp);
+      mzx_world->string_list[i] = load_string(&mf);
     }
 
+    rehash_string_list(mzx_world);
+
     // Allocate space for sprites and clist
     mzx_world->num_sprites = MAX_SPRITES;
     mzx_world->sprite_list = ccalloc(MAX_SPRITES, sizeof(struct sprite *));
@@ -1249,51 +1433,51 @@ static void load_world(struct world *mzx_world, FILE *fp, const char *file,
     // Sprite data
     for(i = 0; i < MAX_SPRITES; i++)
     {
-      (mzx_world->sprite_list[i])->x = fgetw(fp);
-      (mzx_world->sprite_list[i])->y = fgetw(fp);
-      (mzx_world->sprite_list[i])->ref_x = fgetw(fp);
-      (mzx_world->sprite_list[i])->ref_y = fgetw(fp);
-      (mzx_world->sprite_list[i])->color = fgetc(fp);
-      (mzx_world->sprite_list[i])->flags = fgetc(fp);
-      (mzx_world->sprite_list[i])->width = fgetc(fp);
-      (mzx_world->sprite_list[i])->height = fgetc(fp);
-      (mzx_world->sprite_list[i])->col_x = fgetc(fp);
-      (mzx_world->sprite_list[i])->col_y = fgetc(fp);
-      (mzx_world->sprite_list[i])->col_width = fgetc(fp);
-      (mzx_world->sprite_list[i])->col_height = fgetc(fp);
+      (mzx_world->sprite_list[i])->x = mfgetw(&mf);
+      (mzx_world->sprite_list[i])->y = mfgetw(&mf);
+      (mzx_world->sprite_list[i])->ref_x = mfgetw(&mf);
+      (mzx_world->sprite_list[i])->ref_y = mfgetw(&mf);
+      (mzx_world->sprite_list[i])->color = mfgetc(&mf);
+      (mzx_world->sprite_list[i])->flags = mfgetc(&mf);
+      (mzx_world->sprite_list[i])->width = mfgetc(&mf);
+      (mzx_world->sprite_list[i])->height = mfgetc(&mf);
+      (mzx_world->sprite_list[i])->col_x = mfgetc(&mf);
+      (mzx_world->sprite_list[i])->col_y = mfgetc(&mf);
+      (mzx_world->sprite_list[i])->col_width = mfgetc(&mf);
+      (mzx_world->sprite_list[i])->col_height = mfgetc(&mf);
     }
 
     // total sprites
-    mzx_world->active_sprites = fgetc(fp);
+    mzx_world->active_sprites = mfgetc(&mf);
     // y order flag
-    mzx_world->sprite_y_order = fgetc(fp);
+    mzx_world->sprite_y_order = mfgetc(&mf);
     // collision info
-    mzx_world->collision_count = fgetw(fp);
+    mzx_world->collision_count = mfgetw(&mf);
 
     for(i = 0; i < MAX_SPRITES; i++)
     {
-      mzx_world->collision_list[i] = fgetw(fp);
+      mzx_world->collision_list[i] = mfgetw(&mf);
     }
 
     // Multiplier
-    mzx_world->multiplier = fgetw(fp);
+    mzx_world->multiplier = mfgetw(&mf);
     // Divider
-    mzx_world->divider = fgetw(fp);
+    mzx_world->divider = mfgetw(&mf);
     // Circle divisions
-    mzx_world->c_divisions = fgetw(fp);
+    mzx_world->c_divisions = mfgetw(&mf);
     // String FREAD and FWRITE Delimiters
-    mzx_world->fread_delimiter = fgetw(fp);
-    mzx_world->fwrite_delimiter = fgetw(fp);
+    mzx_world->fread_delimiter = mfgetw(&mf);
+    mzx_world->fwrite_delimiter = mfgetw(&mf);
     // Builtin shooting/message status
-    mzx_world->bi_shoot_status = fgetc(fp);
-    mzx_world->bi_mesg_status = fgetc(fp);
+    mzx_world->bi_shoot_status = mfgetc(&mf);
+    mzx_world->bi_mesg_status = mfgetc(&mf);
 
     {
-      size_t len = fgetw(fp);
+      size_t len = mfgetw(&mf);
       if(len >= MAX_PATH)
         len = MAX_PATH - 1;
 
-      fread(mzx_world->input_file_name, len, 1, fp);
+      mfread(mzx_world->input_file_name, len, 1, &mf);
       mzx_world->input_file_name[len] = 0;
     }
 
@@ -1309,35 +1493,35 @@ static void load_world(struct world *mzx_world, FILE *fp, const char *file,
       {
         if(dir_open(&mzx_world->input_directory, translated_path))
         {
-          dir_seek(&mzx_world->input_directory, fgetd(fp));
+          dir_seek(&mzx_world->input_directory, mfgetd(&mf));
           mzx_world->input_is_dir = true;
         }
         else
-          fseek(fp, 4, SEEK_CUR);
+          mfseek(&mf, 4, SEEK_CUR);
       }
       else if(err == -FSAFE_SUCCESS)
       {
         mzx_world->input_file = fopen_unsafe(translated_path, "rb");
         if(mzx_world->input_file)
-          fseek(mzx_world->input_file, fgetd(fp), SEEK_SET);
+          fseek(mzx_world->input_file, mfgetd(&mf), SEEK_SET);
         else
-          fseek(fp, 4, SEEK_CUR);
+          mfseek(&mf, 4, SEEK_CUR);
       }
 
       free(translated_path);
     }
     else
     {
-      fseek(fp, 4, SEEK_CUR);
+      mfseek(&mf, 4, SEEK_CUR);
     }
 
     // Load ouput file name, open
     {
-      size_t len = fgetw(fp);
+      size_t len = mfgetw(&mf);
       if(len >= MAX_PATH)
         len = MAX_PATH - 1;
 
-      fread(mzx_world->output_file_name, len, 1, fp);
+      mfread(mzx_world->output_file_name, len, 1, &mf);
       mzx_world->output_file_name[len] = 0;
     }
 
@@ -1348,19 +1532,19 @@ static void load_world(struct world *mzx_world, FILE *fp, const char *file,
 
       if(mzx_world->output_file)
       {
-        fseek(mzx_world->output_file, fgetd(fp), SEEK_SET);
+        fseek(mzx_world->output_file, mfgetd(&mf), SEEK_SET);
       }
       else
       {
-        fseek(fp, 4, SEEK_CUR);
+        mfseek(&mf, 4, SEEK_CUR);
       }
     }
     else
     {
-      fseek(fp, 4, SEEK_CUR);
+      mfseek(&mf, 4, SEEK_CUR);
     }
 
-    screen_mode = fgetw(fp);
+    screen_mode = mfgetw(&mf);
 
     // If it's at SMZX mode 2, set default palette as loaded
     // so the .sav one doesn't get overwritten
@@ -1375,34 +1559,34 @@ static void load_world(struct world *mzx_world, FILE *fp, const char *file,
     {
       for(i = 0; i < 256; i++)
       {
-        r = fgetc(fp);
-        g = fgetc(fp);
-        b = fgetc(fp);
+        r = mfgetc(&mf);
+        g = mfgetc(&mf);
+        b = mfgetc(&mf);
 
         set_rgb(i, r, g, b);
       }
     }
 
-    mzx_world->commands = fgetd(fp);
+    mzx_world->commands = mfgetd(&mf);
 
-    vlayer_size = fgetd(fp);
-    mzx_world->vlayer_width = fgetw(fp);
-    mzx_world->vlayer_height = fgetw(fp);
+    vlayer_size = mfgetd(&mf);
+    mzx_world->vlayer_width = mfgetw(&mf);
+    mzx_world->vlayer_height = mfgetw(&mf);
     mzx_world->vlayer_size = vlayer_size;
 
     mzx_world->vlayer_chars = cmalloc(vlayer_size);
     mzx_world->vlayer_colors = cmalloc(vlayer_size);
 
-    fread(mzx_world->vlayer_chars, 1, vlayer_size, fp);
-    fread(mzx_world->vlayer_colors, 1, vlayer_size, fp);
+    mfread(mzx_world->vlayer_chars, 1, vlayer_size, &mf);
+    mfread(mzx_world->vlayer_colors, 1, vlayer_size, &mf);
   }
 
   update_palette();
 
   // Get position of global robot...
-  gl_rob = fgetd(fp);
+  gl_rob = mfgetd(&mf);
   // Get number of boards
-  num_boards = fgetc(fp);
+  num_boards = mfgetc(&mf);
 
   if(num_boards == 0)
   {
@@ -1410,19 +1594,19 @@ static void load_world(struct world *mzx_world, FILE *fp, const char *file,
     char *sfx_offset = mzx_world->custom_sfx;
     // Sfx
     mzx_world->custom_sfx_on = 1;
-    fseek(fp, 2, SEEK_CUR);     // Skip word size
+    mfseek(&mf, 2, SEEK_CUR);     // Skip word size
 
     //Read sfx
     for(i = 0; i < NUM_SFX; i++, sfx_offset += 69)
     {
-      sfx_size = fgetc(fp);
-      fread(sfx_offset, sfx_size, 1, fp);
+      sfx_size = mfgetc(&mf);
+      mfread(sfx_offset, sfx_size, 1, &mf);
 #ifdef CONFIG_DEBYTECODE
       if(version < 0x025A)
         convert_sfx_strs(sfx_offset);
 #endif
     }
-    num_boards = fgetc(fp);
+    num_boards = mfgetc(&mf);
   }
   else
   {
@@ -1438,29 +1622,58 @@ static void load_world(struct world *mzx_world, FILE *fp, const char *file,
 
   // Skip the names for now
   // Gonna wanna come back to here
-  last_pos = ftell(fp);
-  fseek(fp, num_boards * BOARD_NAME_SIZE, SEEK_CUR);
+  last_pos = mftell(&mf);
+  mfseek(&mf, num_boards * BOARD_NAME_SIZE, SEEK_CUR);
+
+  // Deleted boards would have to be taken out of every board's entrances
+  // and exits, so worlds with them are loaded all at once.
+  lazy = mzx_world->conf.lazy_board_loading;
+
+  for(i = 0, board_pos = mftell(&mf); lazy && (i < num_boards); i++)
+  {
+    if(!mfgetd(&mf))
+      lazy = false;
+
+    mfseek(&mf, 4, SEEK_CUR);
+  }
+
+  mfseek(&mf, board_pos, SEEK_SET);
 
   for(i = 0; i < num_boards; i++)
   {
-    mzx_world->board_list[i] = load_board_allocate(fp, savegame, version);
-    store_board_to_extram(mzx_world->board_list[i]);
+    if(lazy)
+    {
+      cur_board = ccalloc(1, sizeof(struct board));
+      cur_board->file_size = mfgetd(&mf);
+      cur_board->file_offset = mfgetd(&mf);
+      mzx_world->board_list[i] = cur_board;
+    }
+    else
+    {
+      mzx_world->board_list[i] = load_board_allocate(&mf, savegame, version);
+      store_board_to_extram(mzx_world->board_list[i]);
+    }
+
     meter_update_screen(&meter_curr, meter_target);
   }
 
   // Read global robot
-  fseek(fp, gl_rob, SEEK_SET); //don't worry if this fails
-  load_robot(&mzx_world->global_robot, fp, savegame, version);
+  mfseek(&mf, gl_rob, SEEK_SET); //don't worry if this fails
+  load_robot(&mzx_world->global_robot, &mf, savegame, version);
 
   // Go back to where the names are
-  fseek(fp, last_pos, SEEK_SET);
+  mfseek(&mf, last_pos, SEEK_SET);
   for(i = 0; i < num_boards; i++)
   {
     cur_board = mzx_world->board_list[i];
     // Look at the name, width, and height of the just loaded board
     if(cur_board)
     {
-      fread(cur_board->board_name, BOARD_NAME_SIZE, 1, fp);
+      mfread(cur_board->board_name, BOARD_NAME_SIZE, 1, &mf);
+
+      // Boards left in the file get the rest when they're read in
+      if(!cur_board->loaded)
+        continue;
 
       // Also patch a pointer to the global robot
       if(cur_board->robot_list)
@@ -1473,17 +1686,29 @@ static void load_world(struct world *mzx_world, FILE *fp, const char *file,
     }
     else
     {
-      fseek(fp, BOARD_NAME_SIZE, SEEK_CUR);
+      mfseek(&mf, BOARD_NAME_SIZE, SEEK_CUR);
     }
   }
 
   meter_update_screen(&meter_curr, meter_target);
 
+  mfclose(&mf);
+
+  if(lazy)
+  {
+    mzx_world->board_file = fp;
+    strncpy(mzx_world->board_file_name, file, MAX_PATH - 1);
+    mzx_world->board_file_name[MAX_PATH - 1] = 0;
+    mzx_world->board_file_savegame = savegame;
+    mzx_world->board_file_version = version;
+    mzx_world->board_use_count = 0;
+  }
+
   // This pointer is now invalid. Clear it before we try to
   // send it back to extra RAM.
   mzx_world->current_board = NULL;
   set_current_board_ext(mzx_world,
-   mzx_world->board_list[mzx_world->current_board_id]);
+   get_board(mzx_world, mzx_world->current_board_id));
 
   mzx_world->active = 1;
 
@@ -1498,7 +1723,8 @@ static void load_world(struct world *mzx_world, FILE *fp, const char *file,
 
   meter_restore_screen();
 
-  fclose(fp);
+  if(!lazy)
+    fclose(fp);
 }
 
 // After clearing the above, use this to get default values. Use
@@ -1681,7 +1907,7 @@ bool reload_swap(struct world *mzx_world, const char *file, int *faded)
 
   mzx_world->current_board_id = mzx_world->first_board;
   set_current_board_ext(mzx_world,
-   mzx_world->board_list[mzx_world->current_board_id]);
+   get_board(mzx_world, mzx_world->current_board_id));
 
   return true;
 }
@@ -1699,12 +1925,18 @@ void clear_world(struct world *mzx_world)
 
   for(i = 0; i < num_boards; i++)
   {
-    if(mzx_world->current_board_id != i)
+    if((mzx_world->current_board_id != i) && board_list[i]->loaded)
       retrieve_board_from_extram(board_list[i]);
     clear_board(board_list[i]);
   }
   free(board_list);
 
+  if(mzx_world->board_file)
+  {
+    fclose(mzx_world->board_file);
+    mzx_world->board_file = NULL;
+  }
+
   clear_robot_contents(&mzx_world->global_robot);
 
   if(!mzx_world->input_is_dir && mzx_world->input_file)
@@ -1752,16 +1984,25 @@ void clear_global_data(struct world *mzx_world)
   free(counter_list);
   mzx_world->counter_list = NULL;
 
+  free(mzx_world->counter_hash);
+  mzx_world->counter_hash = NULL;
+  mzx_world->counter_hash_size = 0;
+
   mzx_world->num_counters = 0;
   mzx_world->num_counters_allocated = 0;
 
   for(i = 0; i < num_strings; i++)
   {
+    free(string_list[i]->value);
     free(string_list[i]);
   }
 
   free(string_list);
   mzx_world->string_list = NULL;
+
+  free(mzx_world->string_hash);
+  mzx_world->string_hash = NULL;
+  mzx_world->string_hash_size = 0;
   mzx_world->num_strings = 0;
   mzx_world->num_strings_allocated = 0;
 
@@ -1778,6 +2019,8 @@ void clear_global_data(struct world *mzx_world)
   mzx_world->collision_list = NULL;
   mzx_world->collision_count = 0;
 
+  invalidate_sprite_index(mzx_world);
+
   mzx_world->active_sprites = 0;
   mzx_world->sprite_y_order = 0;
 
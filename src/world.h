@@ -122,6 +122,8 @@ CORE_LIBSPEC int save_world(struct world *mzx_world, const char *file,
 CORE_LIBSPEC bool reload_world(struct world *mzx_world, const char *file,
  int *faded);
 CORE_LIBSPEC void clear_world(struct world *mzx_world);
+CORE_LIBSPEC struct board *get_board(struct world *mzx_world, int board_id);
+CORE_LIBSPEC void load_all_boards(struct world *mzx_world);
 CORE_LIBSPEC void clear_global_data(struct world *mzx_world);
 CORE_LIBSPEC void default_scroll_values(struct world *mzx_world);
 
@@ -94,9 +94,13 @@ struct world
   int num_counters;
   int num_counters_allocated;
   struct counter **counter_list;
+  unsigned int counter_hash_size;
+  struct counter **counter_hash;
   int num_strings;
   int num_strings_allocated;
   struct string **string_list;
+  unsigned int string_hash_size;
+  struct string **string_hash;
   int num_sprites;
   int num_sprites_allocated;
   int sprite_num;
@@ -105,6 +109,10 @@ struct world
   int sprite_y_order;
   int collision_count;
   int *collision_list;
+  struct sprite_index *sprite_index;
+  // Cost of the last draw_sprites, for benchmark runs
+  int sprites_drawn;
+  int sprite_chars_drawn;
   int multiplier;
   int divider;
   int c_divisions;
@@ -131,6 +139,13 @@ struct world
   struct board *current_board;
   int current_board_id;
 
+  // The file boards that haven't been loaded yet are read from
+  FILE *board_file;
+  char board_file_name[MAX_PATH];
+  int board_file_savegame;
+  int board_file_version;
+  unsigned int board_use_count;
+
   struct robot global_robot;
 
   int custom_sfx_on;
@@ -201,6 +216,7 @@ struct world
   // An array for game2.cpp
   char *update_done;
   int update_done_size;
+  struct board *update_done_board;
 };
 
 __M_END_DECLS